@@ -14,9 +14,13 @@
 #ifndef DIAGNOSTIC_AGGREGATOR__AGGREGATOR_HPP_
 #define DIAGNOSTIC_AGGREGATOR__AGGREGATOR_HPP_
 
+#include <atomic>
+#include <chrono>
+#include <list>
 #include <map>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <memory>
 #include <mutex>
@@ -26,10 +30,16 @@
 #include "diagnostic_msgs/msg/key_value.hpp"
 #include "bondcpp/bond.hpp"
 #include "diagnostic_aggregator/analyzer.hpp"
+#include "diagnostic_aggregator/aggregator_stats.hpp"
 #include "diagnostic_aggregator/analyzer_group.hpp"
+#include "diagnostic_aggregator/diagnostic_journal.hpp"
+#include "diagnostic_aggregator/ingest_limiter.hpp"
 #include "diagnostic_aggregator/other_analyzer.hpp"
+#include "diagnostic_aggregator/status_history.hpp"
 #include "diagnostic_aggregator/status_item.hpp"
 #include "diagnostic_msgs/srv/add_diagnostics.hpp"
+#include "std_srvs/srv/trigger.hpp"
+#include "diagnostic_aggregator/srv/query_history.hpp"
 
 #define ROS_ERROR printf
 #define ROS_FATAL printf
@@ -65,6 +75,8 @@ Output:
 \verbatim
 base_path: My Robot
 pub_rate: 1.0
+publish_on_escalation: true
+min_event_interval: 0.1
 other_as_errors: false
 analyzers:
   sensors:
@@ -80,22 +92,86 @@ analyzers:
  * Any other parameters in the namespace can by used to specify the analyzer. If
  * any analyzer is not properly specified, or returns false on initialization,
  * the aggregator will report the error and publish it in the aggregated output.
+ *
+ * The full aggregated output is published at pub_rate. If publish_on_escalation
+ * is set, any item whose level rises is published right away instead of waiting
+ * for the next period: the top level state, and the subtrees of the analyzers
+ * that handle the item. Only those analyzers are reported, so the top level
+ * state of an event publish is the highest of their levels and of the last
+ * full publish; lower levels show at the next full publish. These event
+ * publishes are at least min_event_interval seconds apart. Escalations within
+ * that interval are merged into the next event publish.
+ *
+ * The analyzers can be reloaded without a restart: update the analyzer
+ * parameters of the diagnostic_aggregator node, e.g. with ros2 param set, then
+ * call the /diagnostics_agg/reload service. This needs get_parameter_node() to
+ * be spun along with get_node().
+ *
+ * The last history_size level, message and value transitions of each item are
+ * kept, within history_memory megabytes for all items. The
+ * /diagnostics_agg/query_history service returns them for an item, or for all
+ * items under an analyzer path, over a time range. The history of an item that
+ * no analyzer holds anymore is eventually dropped.
+ *
+ * If journal_path is set, level and message transitions are also appended to
+ * rotating segment files in that directory, which survive a crash. They are
+ * read back with the journal_reader tool.
+ *
+ * Unless self_diagnostics is false, the aggregator adds its own status,
+ * "Base Path/Aggregator", to the full output: statuses received and their rate,
+ * statuses only handled by "Other", the match cache size, and latencies of the
+ * ingest critical section and of publishData(). It doesn't count towards the
+ * top level state. If stats_service is true, the same values are returned by
+ * the /diagnostics_agg/stats service. With self_diagnostics false, none of
+ * these values are gathered, and the service returns zeros.
+ *
+ * Memory stays bounded when status names are unbounded (sequence numbers,
+ * PIDs): at most match_cache_size names (default 10000, 0 for no limit) keep
+ * their analyzer matches cached, and their last level to detect escalations. A
+ * name seen again after being forgotten counts as new. "Other" holds at most
+ * max_other_items items (default 1000, 0 for no limit), evicting the least
+ * recently updated.
+ *
+ * Incoming statuses are counted per source, by status name prefix or by
+ * publisher (ingest_source_key), and each source can be limited to
+ * ingest_rate_limit statuses per second before analysis, so a flooding node
+ * can't starve the others. The noisiest sources are reported as
+ * "Base Path/Aggregator/Sources" with the self-diagnostics.
+ *
+ * Unless dedup_statuses is false, a status with the same level, message,
+ * hardware ID and values as the last one of its item isn't analyzed again, it
+ * only refreshes the update time of that item, and is passed to
+ * Analyzer::refresh(). Analyzers that no longer hold the item, because it went
+ * stale, was evicted, or they were added since, analyze it again. Analyzers
+ * must read update times from the items they hold for this to work. Such a
+ * repeated status never counts as an escalation.
  */
 class Aggregator
 {
 public:
   /*!
    *\brief Constructor initializes with main prefix (ex: '/Robot')
+   *
+   *\param parameters : Set on the aggregator's nodes before any other
+   * parameter is read, overriding the command line ones. Lets the aggregator
+   * be configured when it's created in-process.
    */
-  Aggregator();
+  explicit Aggregator(
+    const std::vector<rclcpp::Parameter> & parameters = std::vector<rclcpp::Parameter>());
 
   ~Aggregator();
 
   /*!
-   *\brief Processes, publishes data. Should be called at pub_rate.
+   *\brief Processes, publishes data. Called at pub_rate by the publish timer.
    */
   void publishData();
 
+  /*!
+   *\brief Publishes the subtrees of items that escalated since the last
+   * publish, if at least min_event_interval has passed since the last one.
+   */
+  void publishEvent();
+
   /*!
    *\brief True if the NodeHandle reports OK
    */
@@ -105,12 +181,39 @@ public:
    *\brief Publish rate defaults to 1Hz, but can be set with ~pub_rate param
    */
   double getPubRate() const {return pub_rate_;}
+  /*!
+   *\brief Node to spin. It is safe to spin it with a multi-threaded executor.
+   */
   rclcpp::Node::SharedPtr get_node() {return nh;}
+  /*!
+   *\brief Node holding the aggregator and analyzer parameters. Spin it to serve
+   * parameter changes, it may be added to the same executor as get_node().
+   */
+  rclcpp::Node::SharedPtr get_parameter_node() {return nh_an;}
 
 private:
+  friend class AggregatorTestAccess;
+
+  /*!
+   *\brief Callback for incoming "/diagnostics". Benchmarks call it directly
+   * through AggregatorTestAccess.
+   */
+  void diagCallback(
+    const diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr & diag_msg,
+    const rmw_message_info_t & info);
+
   rclcpp::Node::SharedPtr n_;
   rclcpp::Node::SharedPtr nh;
+  /*!
+   *\brief Parameter node for the aggregator and its analyzers, read directly
+   */
   rclcpp::Node::SharedPtr nh_an;
+  /*!
+   *\brief Loads the analyzer parameters of nodes calling add_diagnostics. Its
+   * parameter clients spin it themselves, so it must not be added to an
+   * executor.
+   */
+  rclcpp::Node::SharedPtr nh_client_;
 
   rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr agg_pub_;
   rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticStatus>::SharedPtr
@@ -118,15 +221,80 @@ private:
   rclcpp::Subscription<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr
     diag_sub_;
   rclcpp::Service<diagnostic_msgs::srv::AddDiagnostics>::SharedPtr add_srv_;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr reload_srv_;
+  rclcpp::Service<diagnostic_aggregator::srv::QueryHistory>::SharedPtr history_srv_;
+  rclcpp::Service<std_srvs::srv::Trigger>::SharedPtr stats_srv_;
+  rclcpp::TimerBase::SharedPtr publish_timer_;
+  rclcpp::TimerBase::SharedPtr event_timer_;
+
+  rclcpp::callback_group::CallbackGroup::SharedPtr ingest_group_;
+  rclcpp::callback_group::CallbackGroup::SharedPtr publish_group_;
+  rclcpp::callback_group::CallbackGroup::SharedPtr service_group_;
 
+  /*!
+   *\brief Guards the analyzers, bonds_, and the escalation state. Held for
+   * analysis and report() only, never while building or publishing messages.
+   */
   std::mutex mutex_;
   double pub_rate_;
 
+  bool publish_on_escalation_;
+  double min_event_interval_;
+  std::chrono::steady_clock::time_point last_event_pub_;
+
+  bool self_diagnostics_;
+  AggregatorStats stats_;
+
+  std::unique_ptr<IngestLimiter> ingest_limiter_;
+  int64_t report_sources_;    /**< Noisiest sources in the self-diagnostics */
+
+  bool dedup_statuses_;
+
   /*!
-   *\brief Callback for incoming "/diagnostics"
+   *\brief Last item of each name, to only refresh it when an identical status
+   * arrives. Only used from diagCallback, which is serialized by ingest_group_
    */
-  void diagCallback(
-    const diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr & diag_msg);
+  std::unordered_map<std::string, std::shared_ptr<StatusItem>> last_items_;
+  size_t last_items_limit_;   /**< Size of last_items_ that triggers a sweep */
+
+  /*!
+   *\brief Last level of an item, to detect escalations
+   */
+  struct LastLevel
+  {
+    uint8_t level;
+    std::list<std::string>::iterator lru;
+  };
+
+  /*!
+   *\brief Last levels of at most match_cache_size_ recently seen items
+   */
+  std::unordered_map<std::string, LastLevel> last_levels_;
+  std::list<std::string> last_levels_lru_;  /**< Least recently seen first */
+
+  /*!
+   *\brief Highest and lowest levels of the last full publish, which event
+   * publishes don't report again. -1 and 255 before the first one.
+   */
+  std::atomic<int> full_level_;
+  std::atomic<int> full_min_level_;
+
+  /*!
+   *\brief Records the level of an item, and returns true if it rose. Called
+   * under mutex_.
+   */
+  bool updateLevel(const std::string & name, uint8_t level);
+
+  /*!
+   *\brief Analyzer paths with escalated items not yet published
+   */
+  std::set<std::string> event_paths_;
+
+  /*!
+   *\brief Publishes the top level state, and the aggregated output. If paths
+   * is given, only statuses under those paths are in the aggregated output.
+   */
+  void publish(const std::set<std::string> * paths);
 
   /*!
    *\brief Service request callback for addition of diagnostics.
@@ -141,10 +309,53 @@ private:
     const std::shared_ptr<rmw_request_id_t> request_header,
     const std::shared_ptr<diagnostic_msgs::srv::AddDiagnostics::Request> req,
     std::shared_ptr<diagnostic_msgs::srv::AddDiagnostics::Response> res);
-  AnalyzerGroup * analyzer_group_;
+  /*!
+   *\brief Replaced as a whole by reloadAnalyzers(). Always swapped under
+   * mutex_, so holders of a copy can keep using the old group.
+   */
+  std::shared_ptr<AnalyzerGroup> analyzer_group_;
+
+  /*!
+   *\brief Analyzers added through bonds. Carried over to reloaded groups.
+   */
+  std::vector<std::shared_ptr<Analyzer>> added_analyzers_;
+
+  /*!
+   *\brief Service callback for /diagnostics_agg/reload
+   *
+   * Builds a new AnalyzerGroup from the current analyzer parameters, then
+   * swaps it in. Analyzers whose parameters didn't change are carried over with
+   * their items, so a reload doesn't cause stale or missing reports for them.
+   * The lock is only held to swap the groups.
+   */
+  bool reloadAnalyzers(std::string & message);
+
+  /*!
+   *\brief Service callback for /diagnostics_agg/query_history
+   *
+   * Selects the items by name or analyzer path under mutex_, then reads their
+   * history without it.
+   */
+  void queryHistory(
+    const diagnostic_aggregator::srv::QueryHistory::Request & req,
+    diagnostic_aggregator::srv::QueryHistory::Response & res);
+
+  /*!
+   *\brief Transitions of every incoming item. Has its own lock, so it's recorded
+   * before mutex_ is taken.
+   */
+  std::unique_ptr<StatusHistory> history_;
+
+  /*!
+   *\brief Level and message transitions on disk, NULL unless journal_path is
+   * set. Only used from diagCallback, which is serialized by ingest_group_
+   */
+  std::unique_ptr<DiagnosticJournal> journal_;
 
   OtherAnalyzer * other_analyzer_;
 
+  size_t match_cache_size_;   /**< Most names in the match cache of each group */
+
   std::vector<std::shared_ptr<bond::Bond>>
   bonds_;     /**< \brief Contains all bonds for additional diagnostics. */
 
@@ -171,6 +382,9 @@ private:
   std::string
     base_path_;   /**< \brief Prepended to all status names of aggregator. */
 
+  /*!
+   *\brief Only used from diagCallback, which is serialized by ingest_group_
+   */
   std::set<std::string> ros_warnings_;
 
   /*
@@ -0,0 +1,116 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__AGGREGATOR_STATS_HPP_
+#define DIAGNOSTIC_AGGREGATOR__AGGREGATOR_STATS_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "diagnostic_msgs/msg/key_value.hpp"
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Lock-free histogram of durations, in power of two buckets
+ *
+ * Bucket i counts durations in [2^i, 2^(i+1)) nanoseconds. Percentiles are
+ *reported as the upper bound of their bucket, so they are at most 2x high.
+ */
+class LatencyHistogram
+{
+public:
+  static const int kBuckets = 40;
+
+  LatencyHistogram();
+
+  void record(std::chrono::steady_clock::duration duration);
+
+  uint64_t getCount() const {return count_.load(std::memory_order_relaxed);}
+
+  /*!
+   *\brief Mean in microseconds
+   */
+  double getMean() const;
+
+  /*!
+   *\brief Upper bound of percentile p (0-1), in microseconds
+   */
+  double getPercentile(double p) const;
+
+  /*!
+   *\brief Longest duration in microseconds
+   */
+  double getMax() const;
+
+private:
+  std::atomic<uint64_t> buckets_[kBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+/*!
+ *\brief Counters and latencies of the Aggregator's own work
+ *
+ * Updated from the ingest and publish threads without locks. Counters are
+ *totals since start. Rates are computed between two calls of report(), which
+ *only the publish path calls. toString() shows the last rate, so querying it
+ *doesn't change the window.
+ */
+class AggregatorStats
+{
+public:
+  AggregatorStats();
+
+  LatencyHistogram ingest_lock;   /**< Time diagCallback holds the mutex */
+  LatencyHistogram publish;       /**< Time of publishData() */
+
+  std::atomic<uint64_t> statuses;       /**< Statuses received */
+  std::atomic<uint64_t> other;          /**< Statuses only analyzed by "Other" */
+  std::atomic<uint64_t> duplicates;     /**< Statuses that only refreshed their item */
+  std::atomic<uint64_t> match_cache;    /**< Names in the match cache */
+  std::atomic<uint64_t> match_cache_evictions;  /**< Names evicted from the match cache */
+  std::atomic<uint64_t> other_items;    /**< Items held by "Other" */
+  std::atomic<uint64_t> other_evictions;  /**< Items evicted by "Other" */
+
+  /*!
+   *\brief Status named name with all statistics as values. Always OK.
+   */
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> report(const std::string & name);
+
+  /*!
+   *\brief The values of report(), one "key: value" per line
+   */
+  std::string toString();
+
+private:
+  /*!
+   *\brief Gets all values. Starts a new rate window if update_rate is true.
+   */
+  void getValues(std::vector<diagnostic_msgs::msg::KeyValue> & values, bool update_rate);
+
+  std::mutex rate_mutex_;
+  std::chrono::steady_clock::time_point last_report_;
+  uint64_t last_statuses_;
+  double rate_;
+};
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__AGGREGATOR_STATS_HPP_
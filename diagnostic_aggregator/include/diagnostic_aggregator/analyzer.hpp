@@ -121,6 +121,16 @@ public:
    */
   virtual bool analyze(const std::shared_ptr<StatusItem> item) = 0;
 
+  /*!
+   *\brief Called instead of analyze() when a status is identical to the last
+   *one of its name
+   *
+   * The item is the one last analyzed under that name, with a refreshed update
+   * time. An analyzer that still holds it has nothing to do, others must analyze
+   * it again, which is the default. Returns what analyze() would.
+   */
+  virtual bool refresh(const std::shared_ptr<StatusItem> item) {return analyze(item);}
+
   /*!
    *\brief Analysis function, output processed data.
    *
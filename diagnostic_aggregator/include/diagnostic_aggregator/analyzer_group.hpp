@@ -16,6 +16,7 @@
 
 #include <algorithm>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <memory>
@@ -23,6 +24,7 @@
 #include "diagnostic_msgs/msg/key_value.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "diagnostic_aggregator/analyzer.hpp"
+#include "diagnostic_aggregator/match_cache.hpp"
 #include "diagnostic_aggregator/status_item.hpp"
 #include "pluginlib/class_list_macros.hpp"
 #include "pluginlib/class_loader.hpp"
@@ -107,6 +109,19 @@ public:
   virtual bool init(
     const std::string base_path, const char *,
     const rclcpp::Node::SharedPtr & n, const char *);
+
+  /*!
+   *\brief Initializes as a new configuration of a running group
+   *
+   * Sub-analyzers whose parameters are identical to those they had in previous
+   *are shared with previous rather than created again, so they keep their
+   *state. previous can keep analyzing while this runs, since only its
+   *configuration is read.
+   */
+  bool init(
+    const std::string base_path, const char * nsp,
+    const rclcpp::Node::SharedPtr & n, const char * rnsp,
+    const AnalyzerGroup * previous);
   // virtual bool init(const std::string base_path, const
   // rclcpp::Node::SharedPtr &n); //change to remove dependecy of copy
   // constructor
@@ -131,11 +146,39 @@ public:
    */
   void resetMatches();
 
+  /*!
+   *\brief Bounds the match cache of this group and its sub-groups. 0 for no
+   *limit, which is the default.
+   */
+  void setMatchCacheSize(size_t size);
+
+  /*!
+   *\brief Number of names whose matches are cached
+   */
+  size_t getMatchCacheSize() const {return matched_.size();}
+
+  /*!
+   *\brief Names evicted from the match cache
+   */
+  uint64_t getMatchCacheEvictions() const {return matched_.getEvictions();}
+
+  /*!
+   *\brief Adds the paths of the sub-analyzers that matched an item to paths
+   *
+   * Only valid after match() has been called for that name.
+   */
+  void getMatchedPaths(const std::string & name, std::set<std::string> & paths);
+
   /*!
    *\brief Analyze returns true if any sub-analyzers will analyze an item
    */
   virtual bool analyze(const std::shared_ptr<StatusItem> item);
 
+  /*!
+   *\brief Refreshes the item in the sub-analyzers that match it
+   */
+  virtual bool refresh(const std::shared_ptr<StatusItem> item);
+
   /*!
    *\brief The processed output is the combined output of the sub-analyzers, and
    *the top level status
@@ -143,6 +186,16 @@ public:
   virtual std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
   report();
 
+  /*!
+   *\brief The output of only the sub-analyzers whose path is in paths, without
+   *the top level status
+   *
+   * Used with the paths from getMatchedPaths() to report the subtrees of some
+   *items without running every sub-analyzer.
+   */
+  std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
+  reportPaths(const std::set<std::string> & paths);
+
   virtual std::string getPath() const {return path_;}
 
   virtual std::string getName() const {return nice_name_;}
@@ -151,9 +204,24 @@ private:
   std::string path_, nice_name_;
 
   /*!
-   *\brief Loads Analyzer plugins in "analyzers" namespace
+   *\brief Loads Analyzer plugins in "analyzers" namespace. Shared with the
+   *groups that reuse analyzers it created.
    */
-  pluginlib::ClassLoader<Analyzer> analyzer_loader_;
+  std::shared_ptr<pluginlib::ClassLoader<Analyzer>> analyzer_loader_;
+
+  /*!
+   *\brief Parameters an analyzer was created from
+   */
+  struct AnalyzerConfig
+  {
+    std::string config;
+    std::shared_ptr<Analyzer> analyzer;
+  };
+
+  /*!
+   *\brief Analyzers loaded from parameters, by their "type" parameter name
+   */
+  std::map<std::string, AnalyzerConfig> configs_;
 
   /*!
    *\brief These items store errors, if any, for analyzers that failed to
@@ -164,9 +232,16 @@ private:
   std::vector<std::shared_ptr<Analyzer>> analyzers_;
 
   /*
-   *\brief The map of names to matchings is stored internally.
+   *\brief Which sub-analyzers match each name, by index in analyzers_
    */
-  std::map<const std::string, std::vector<bool>> matched_;
+  MatchCache matched_;
+
+  /*!
+   *\brief Passes the item to the sub-analyzers that match it, with refresh()
+   *or analyze()
+   */
+  bool dispatch(const std::shared_ptr<StatusItem> & item, bool refresh);
+
   rclcpp::Node::SharedPtr analyzers_nh;
   rclcpp::Node::SharedPtr analyzers_nh1;
 };
@@ -0,0 +1,78 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__ANALYZER_PARAMS_HPP_
+#define DIAGNOSTIC_AGGREGATOR__ANALYZER_PARAMS_HPP_
+
+#include <map>
+#include <memory>
+#include <string>
+#include "rclcpp/rclcpp.hpp"
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Analyzer parameters, full parameter name to value string
+ */
+typedef std::map<std::string, std::string> AnalyzerParamMap;
+typedef std::shared_ptr<const AnalyzerParamMap> AnalyzerParamMapConstPtr;
+
+/*!
+ *\brief Loads every "analyzers_params" parameter of node nsp
+ *
+ * If nsp names the node n itself, its parameters are read directly without any
+ *service call. Otherwise they are fetched from the parameter service of nsp
+ *with one list and one get request, instead of one get per parameter.
+ *
+ * If an enclosing AnalyzerParamsScope already holds the parameters of nsp,
+ *those are shared and nothing is fetched or copied. This lets an AnalyzerGroup load the
+ *configuration once and share it with all of its sub-analyzers.
+ *
+ *\param n : Node used to reach the parameters
+ *\param nsp : Name of the node holding the parameters
+ *\param params : Filled with all parameters under "analyzers_params"
+ *\return False if the parameter service couldn't be reached
+ */
+bool loadAnalyzerParams(
+  const rclcpp::Node::SharedPtr & n, const std::string & nsp,
+  AnalyzerParamMapConstPtr & params);
+
+/*!
+ *\brief Makes loaded parameters available to nested loadAnalyzerParams() calls
+ *
+ * Scopes are per thread, and nest.
+ */
+class AnalyzerParamsScope
+{
+public:
+  AnalyzerParamsScope(const std::string & nsp, const AnalyzerParamMapConstPtr & params);
+
+  ~AnalyzerParamsScope();
+
+  /*!
+   *\brief Innermost scope on this thread holding the parameters of nsp, or NULL
+   */
+  static AnalyzerParamMapConstPtr find(const std::string & nsp);
+
+private:
+  AnalyzerParamsScope(const AnalyzerParamsScope &) = delete;
+  AnalyzerParamsScope & operator=(const AnalyzerParamsScope &) = delete;
+
+  std::string nsp_;
+  AnalyzerParamMapConstPtr params_;
+  AnalyzerParamsScope * prev_;
+};
+
+}  // namespace diagnostic_aggregator
+#endif  // DIAGNOSTIC_AGGREGATOR__ANALYZER_PARAMS_HPP_
@@ -0,0 +1,189 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__COLUMNAR_EXPORTER_HPP_
+#define DIAGNOSTIC_AGGREGATOR__COLUMNAR_EXPORTER_HPP_
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "diagnostic_aggregator/status_item.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Writes diagnostic statuses to one set of column files per item
+ *
+ * Every status name gets a directory in the output directory, holding one file
+ *per column and a "columns.txt" manifest:
+ *
+ *\verbatim
+ * name <status name>
+ * rows <N>
+ * stamp int64 stamp.bin
+ * level uint8 level.bin
+ * message dict message.bin message.dict
+ * hardware_id dict hardware_id.bin hardware_id.dict
+ * value <key> float64 value_0.bin
+ * value <key> float64 value_1.bin text value_1_text.bin value_1_text.dict
+ *\endverbatim
+ *
+ * The fields of a line are separated by tabs. In the status name and the
+ *keys, backslash, tab and newline are escaped as in C string literals.
+ *
+ * Stamps are nanoseconds. Values are parsed as numbers. Values that aren't
+ *numbers are NaN in the float64 column, and are also kept in a text column,
+ *which only exists for keys that had such a value. Missing values are NaN.
+ *
+ * Text columns are dictionary encoded: the column holds uint32 codes, and the
+ *".dict" file holds the distinct strings in code order, each as a uint32
+ *length and its bytes. In value text columns, code 0 means the value was a
+ *number or missing, and string i of the dictionary has code i + 1.
+ *
+ * All files are in host byte order. Rows are buffered in memory up to a fixed
+ *total and then appended to the files, so memory doesn't grow with the number
+ *of rows. Only the dictionaries grow, with the number of distinct strings.
+ */
+class ColumnarExporter
+{
+public:
+  /*!
+   *\param directory : Created if it doesn't exist
+   *\param skip : Keep every skip-th status of each item, like sparse_csv.py
+   */
+  ColumnarExporter(const std::string & directory, unsigned int skip = 1);
+
+  ~ColumnarExporter();
+
+  /*!
+   *\brief Creates the output directory
+   */
+  bool open(std::string & error);
+
+  /*!
+   *\brief Adds a row to the columns of the status name
+   */
+  void add(const diagnostic_msgs::msg::DiagnosticStatus & status, const rclcpp::Time & stamp);
+
+  /*!
+   *\brief Writes the remaining rows, the dictionaries and the manifests
+   *
+   *\return False if any file couldn't be written
+   */
+  bool finish(std::string & error);
+
+  /*!
+   *\brief Rows written for all items
+   */
+  uint64_t getRows() const {return rows_;}
+
+private:
+  /*!
+   *\brief Column file, appended in chunks and closed in between, so there's no
+   *limit on open files
+   */
+  class ColumnFile
+  {
+public:
+    ColumnFile(ColumnarExporter & exporter, const std::string & path);
+
+    void append(const void * data, size_t size);
+
+    template<typename T>
+    void append(const T & value) {append(&value, sizeof(T));}
+
+    /*!
+     *\brief Appends count copies of value
+     */
+    template<typename T>
+    void fill(const T & value, uint64_t count)
+    {
+      for (uint64_t i = 0; i < count; ++i) {
+        append(value);
+      }
+    }
+
+    void flush();
+
+    const std::string & getPath() const {return path_;}
+
+private:
+    ColumnarExporter & exporter_;
+    std::string path_;
+    std::vector<char> buffer_;
+    bool created_;
+  };
+
+  /*!
+   *\brief Column of dictionary codes
+   */
+  struct StringColumn
+  {
+    StringColumn(ColumnarExporter & exporter, const std::string & path)
+    : codes(exporter, path + ".bin"), dict_path(path + ".dict") {}
+
+    uint32_t code(const std::string & value);
+
+    ColumnFile codes;
+    std::string dict_path;
+    std::unordered_map<std::string, uint32_t> dictionary;
+  };
+
+  struct ValueColumn
+  {
+    std::string key;
+    std::string name;
+    std::unique_ptr<ColumnFile> numbers;
+    std::unique_ptr<StringColumn> text;
+    uint64_t row;   /**< Last row written to */
+  };
+
+  struct Item
+  {
+    std::string directory;
+    std::unique_ptr<StatusItem> status;
+    uint64_t seen;
+    uint64_t rows;
+    std::unique_ptr<ColumnFile> stamps;
+    std::unique_ptr<ColumnFile> levels;
+    std::unique_ptr<StringColumn> messages;
+    std::unique_ptr<StringColumn> hw_ids;
+    std::vector<std::unique_ptr<ValueColumn>> values;
+    std::unordered_map<std::string, size_t> value_ids;
+  };
+
+  Item & getItem(const diagnostic_msgs::msg::DiagnosticStatus & status);
+  void addRow(Item & item, const rclcpp::Time & stamp);
+  bool writeDictionary(const StringColumn & column);
+  bool writeManifest(const Item & item);
+  void buffered(size_t size);
+
+  std::string directory_;
+  unsigned int skip_;
+  uint64_t rows_;
+  bool failed_;
+
+  std::unordered_map<std::string, std::unique_ptr<Item>> items_;
+  std::unordered_map<std::string, unsigned int> directory_names_;
+
+  std::vector<ColumnFile *> columns_;
+  size_t buffered_;
+};
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__COLUMNAR_EXPORTER_HPP_
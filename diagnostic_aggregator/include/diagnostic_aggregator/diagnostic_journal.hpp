@@ -0,0 +1,191 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__DIAGNOSTIC_JOURNAL_HPP_
+#define DIAGNOSTIC_AGGREGATOR__DIAGNOSTIC_JOURNAL_HPP_
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Start of every journal segment file
+ *
+ * Offsets in a segment are from the start of the file. Stamps are ROS time in
+ *nanoseconds.
+ */
+struct JournalSegmentHeader
+{
+  char magic[8];          /**< "DIAGJRN1" */
+  uint32_t size;          /**< Mapped size of the segment */
+  uint32_t end;           /**< End of the last complete record */
+  int64_t first_stamp;
+  int64_t last_stamp;
+  uint32_t index;         /**< Offset of the index, 0 until the segment is closed */
+  uint32_t item_count;    /**< Entries in the index */
+};
+
+/*!
+ *\brief Header of a record, followed by "length" bytes of text
+ *
+ * A name record gives the status name of an item ID within its segment, and
+ *precedes the first transition of that item. A transition record holds the
+ *new level and message of an item. Transitions of an item are chained
+ *backwards through "prev".
+ */
+struct JournalRecord
+{
+  uint32_t size;          /**< Whole record, 8 byte aligned. 0 past the last record */
+  uint16_t item;
+  uint8_t type;
+  uint8_t level;
+  int64_t stamp;
+  uint32_t prev;          /**< Previous transition of the item, 0 if none */
+  uint32_t length;
+};
+
+/*!
+ *\brief Index of a closed segment, one entry per item ID
+ */
+struct JournalIndexEntry
+{
+  uint32_t name;          /**< Offset of the name record */
+  uint32_t last;          /**< Offset of the last transition */
+};
+
+enum JournalRecordType
+{
+  Record_Name = 0,
+  Record_Transition = 1
+};
+
+/*!
+ *\brief Appends level and message transitions of items to rotating segment files
+ *
+ * Each segment is a file of "segment_size" bytes, mapped in memory. A record is
+ *written fully before its size is set, so a crash leaves a segment whose
+ *records are all readable. When a segment is full its index of item ID to
+ *name and last transition is appended, the file is truncated to its used size,
+ *and a new segment is started. Only the newest "max_segments" segments are
+ *kept.
+ *
+ * Items without a transition in a whole segment are forgotten when it's
+ *closed. Their next status is recorded again even if it didn't change.
+ *
+ * Messages longer than 1024 bytes are truncated. record() is not thread safe.
+ */
+class DiagnosticJournal
+{
+public:
+  DiagnosticJournal(
+    const std::string & directory, size_t segment_size, size_t max_segments);
+
+  /*!
+   *\brief Closes the current segment
+   */
+  ~DiagnosticJournal();
+
+  /*!
+   *\brief Creates the directory if needed and starts a segment after any
+   *existing ones
+   */
+  bool open(std::string & error);
+
+  /*!
+   *\brief Appends a transition if the level or message of the item changed
+   */
+  void record(
+    const diagnostic_msgs::msg::DiagnosticStatus & status,
+    const rclcpp::Time & stamp);
+
+private:
+  struct Item
+  {
+    uint8_t level;
+    size_t message_hash;
+    uint64_t segment;    /**< Segment where id is valid */
+    uint16_t id;
+  };
+
+  bool openSegment();
+  void closeSegment();
+  uint32_t append(
+    uint8_t type, uint16_t item, uint8_t level, int64_t stamp, uint32_t prev,
+    const char * text, uint32_t length);
+
+  std::string directory_;
+  size_t segment_size_;
+  size_t max_segments_;
+
+  uint64_t segment_;     /**< Sequence number of the current segment */
+  int fd_;
+  char * data_;
+  std::vector<JournalIndexEntry> index_;
+  std::deque<std::string> segments_;   /**< Files, oldest first */
+  std::unordered_map<std::string, Item> items_;
+};
+
+/*!
+ *\brief Reads transitions back from the segments of a DiagnosticJournal
+ *
+ * Segments outside the time range are skipped from their header. When reading
+ *a single item from a closed segment, only that item's records are visited,
+ *through the index. Otherwise records are scanned by their headers, and only
+ *the text of those in range is read.
+ */
+class JournalReader
+{
+public:
+  struct Entry
+  {
+    int64_t stamp;
+    uint8_t level;
+    std::string name;
+    std::string message;
+  };
+
+  explicit JournalReader(const std::string & directory);
+
+  /*!
+   *\brief Appends the transitions within [start, end] to entries
+   *
+   *\param item : Only read this status name, all items if empty
+   *\return False if the directory can't be read
+   */
+  bool read(
+    int64_t start, int64_t end, const std::string & item,
+    std::vector<Entry> & entries, std::string & error) const;
+
+private:
+  void readSegment(
+    const char * data, size_t size, int64_t start, int64_t end,
+    const std::string & item, std::vector<Entry> & entries) const;
+
+  std::string directory_;
+};
+
+/*!
+ *\brief Journal segment files in directory, oldest first
+ */
+bool listJournalSegments(
+  const std::string & directory, std::vector<std::string> & segments);
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__DIAGNOSTIC_JOURNAL_HPP_
@@ -16,14 +16,16 @@
 
 #include <map>
 #include <memory>
-#include <regex>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include "pluginlib/class_list_macros.hpp"
 #include "diagnostic_aggregator/analyzer.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "diagnostic_aggregator/generic_analyzer_base.hpp"
+#include "diagnostic_aggregator/pattern_matcher.hpp"
+#include "diagnostic_aggregator/regex_set.hpp"
 #include "diagnostic_aggregator/status_item.hpp"
 #include "diagnostic_msgs/msg/diagnostic_status.hpp"
 #include "diagnostic_msgs/msg/key_value.hpp"
@@ -107,6 +109,11 @@ inline bool getParamVals(
  * The above parameters can be given as a single string ("tilt_hokuyo_node") or
  *a list of strings (['Battery', 'Smart Battery']).
  *
+ * The regexes of an analyzer are compiled into one DFA (see RegexSet), which
+ *supports the ECMAScript syntax except backreferences, lookarounds and word
+ *boundaries. init() fails on those, and on regexes that would need more than
+ *10000 DFA states.
+ *
  * In some cases, it's possible to clean up the processed diagnostic status
  *names.
  * - \b remove_prefix If these prefix is found in a status name, it will be
@@ -213,20 +220,36 @@ public:
   virtual std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
   report();
 
+  /*!
+   *\brief Updates state with new StatusItem, and marks expected items present
+   */
+  virtual bool analyze(const std::shared_ptr<StatusItem> item);
+
   /*!
    *\brief Returns true if item matches any of the given criteria
    *
    */
   virtual bool match(const std::string name);
 
+protected:
+  /*!
+   *\brief Output name with the chaff removed
+   */
+  virtual std::string getStatusName(const std::string & name) const;
+
+  virtual void itemRemoved(const std::string & name);
+
 private:
   std::vector<std::string> chaff_; /**< Removed from the start of node names. */
   std::vector<std::string> expected_;
+  std::vector<std::string> expected_status_names_;  /**< getStatusName() of expected_ */
+  std::unordered_map<std::string, size_t> expected_index_;
+  std::vector<bool> expected_present_;  /**< Expected items held, by index */
   std::vector<std::string> startswith_;
   std::vector<std::string> contains_;
   std::vector<std::string> name_;
-  std::vector<std::regex>
-  regex_;     /**< Regular expressions to check against diagnostics names. */
+  RegexSet regex_;  /**< Regular expressions to check against diagnostics names. */
+  PatternMatcher matcher_;  /**< expected_, name_, startswith_ and contains_ */
   rclcpp::Node::SharedPtr gen_nh;
 };
 
@@ -47,6 +47,9 @@ namespace diagnostic_aggregator
  *
  * The GenericAnalyzerBase holds the state of the analyzer, and tracks if items
  *are stale, and if the user has the correct number of items.
+ *
+ * The name an item is reported under is built by getStatusName() when the
+ *item is first seen, and kept until the item is removed.
  */
 class GenericAnalyzerBase : public Analyzer
 {
@@ -83,6 +86,12 @@ public:
     path_ = path;
     discard_stale_ = discard_stale;
 
+    // Items added before the path was known
+    std::map<std::string, Entry>::iterator it = items_.begin();
+    for (; it != items_.end(); ++it) {
+      it->second.status_name = getStatusName(it->first);
+    }
+
     if (discard_stale_ && timeout <= 0) {
       ROS_WARN("Cannot discard stale items if no timeout specified. No items "
         "will be discarded");
@@ -110,11 +119,24 @@ public:
       return false;
     }
 
-    items_[item->getName()] = item;
+    addItem(item->getName(), item);
 
     return has_initialized_;
   }
 
+  /*!
+   *\brief Analyzes the item again only if it isn't the one held, which was
+   *discarded as stale or replaced
+   */
+  virtual bool refresh(const std::shared_ptr<StatusItem> item)
+  {
+    std::map<std::string, Entry>::const_iterator it = items_.find(item->getName());
+    if (it != items_.end() && it->second.item == item) {
+      return true;
+    }
+    return analyze(item);
+  }
+
   /*!
    *\brief Reports current state, returns vector of formatted status messages
    *
@@ -147,16 +169,19 @@ public:
 
     bool all_stale = true;
 
-    std::map<std::string, std::shared_ptr<StatusItem>>::iterator it =
-      items_.begin();
+    rclcpp::Time update_time_now1_;
+    if (timeout_ > 0) {
+      rclcpp::Clock ros_clock(RCL_ROS_TIME);
+      update_time_now1_ = ros_clock.now();
+    }
+
+    std::map<std::string, Entry>::iterator it = items_.begin();
     while (it != items_.end()) {
-      std::string name = it->first;
-      std::shared_ptr<StatusItem> item = it->second;
+      const std::string & name = it->first;
+      const std::shared_ptr<StatusItem> & item = it->second.item;
 
       bool stale = false;
       if (timeout_ > 0) {
-        rclcpp::Clock ros_clock(RCL_ROS_TIME);
-        rclcpp::Time update_time_now1_ = ros_clock.now();
         stale =
           (((update_time_now1_ - item->getLastUpdateTime()).nanoseconds()) *
           1e-9) > timeout_;
@@ -164,6 +189,7 @@ public:
 
       // Erase item if its stale and we're discarding items
       if (discard_stale_ && stale) {
+        itemRemoved(name);
         items_.erase(it++);
         continue;
       }
@@ -182,7 +208,7 @@ public:
       // boost::shared_ptr<diagnostic_msgs::DiagnosticStatus> stat =
       // item->toStatusMsg(path_, stale);
 
-      processed.push_back(item->toStatusMsg(path_, stale));
+      processed.push_back(item->toNamedStatusMsg(it->second.status_name, stale));
 
       if (stale) {
         header_status->level = 3;
@@ -252,16 +278,59 @@ protected:
   /*!
    *\brief Subclasses can add items to analyze
    */
-  void addItem(std::string name, std::shared_ptr<StatusItem> item)
+  void addItem(const std::string & name, std::shared_ptr<StatusItem> item)
+  {
+    std::map<std::string, Entry>::iterator it = items_.find(name);
+    if (it == items_.end()) {
+      it = items_.insert(std::make_pair(name, Entry())).first;
+      it->second.status_name = getStatusName(name);
+    }
+    it->second.item = item;
+  }
+
+  /*!
+   *\brief Subclasses can drop items, which are then no longer reported
+   */
+  void removeItem(const std::string & name)
+  {
+    if (items_.erase(name) > 0) {
+      itemRemoved(name);
+    }
+  }
+
+  /*!
+   *\brief Full name an item is reported under, "path/output name"
+   *
+   * Called once per item, when it is added or when the path is set.
+   */
+  virtual std::string getStatusName(const std::string & name) const
   {
-    items_[name] = item;
+    if (path_ == "/") {
+      return "/" + getOutputName(name);
+    }
+    return path_ + "/" + getOutputName(name);
   }
 
+  /*!
+   *\brief Called when an item is discarded as stale or removed
+   */
+  virtual void itemRemoved(const std::string & name) {(void)name;}
+
+  bool hasItem(const std::string & name) const {return items_.count(name) > 0;}
+
+  size_t getItemCount() const {return items_.size();}
+
 private:
+  struct Entry
+  {
+    std::shared_ptr<StatusItem> item;
+    std::string status_name;  /**< getStatusName() of the item */
+  };
+
   /*!
    *\brief Stores items by name. State of analyzer
    */
-  std::map<std::string, std::shared_ptr<StatusItem>> items_;
+  std::map<std::string, Entry> items_;
 
   bool discard_stale_, has_initialized_, has_warned_;
 };
@@ -0,0 +1,137 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__INGEST_LIMITER_HPP_
+#define DIAGNOSTIC_AGGREGATOR__INGEST_LIMITER_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Counts incoming statuses per source, and limits the rate of each source
+ *
+ * A source is either the prefix of the status name before the first ':', which
+ *is the node name for diagnostic_updater statuses, or the publisher of the
+ *message. Statuses whose name has no ':' share a single source, so unprefixed
+ *names can't each get a bucket of their own.
+ *
+ * Each source has a token bucket of burst statuses, refilled at rate statuses
+ *per second. Statuses over it are dropped before analysis. When downsampling,
+ *a status over the limit is still admitted if its level differs from the last
+ *admitted level of its item, so a flooding source still reports its
+ *escalations.
+ *
+ * Thread safe. filter() is called from the ingest thread, report() from the
+ *publish thread.
+ */
+class IngestLimiter
+{
+public:
+  enum Key
+  {
+    Key_Name,
+    Key_Publisher
+  };
+
+  enum Action
+  {
+    Action_Drop,
+    Action_Downsample
+  };
+
+  /*!
+   *\param key : How the source of a status is determined
+   *\param rate : Statuses per second admitted from each source. 0 for no limit.
+   *\param burst : Statuses a source can send at once above rate
+   *\param action : What happens to statuses over the limit
+   *\param max_sources : Most sources tracked. The least recently seen one is
+   *forgotten beyond it.
+   */
+  IngestLimiter(Key key, double rate, double burst, Action action, size_t max_sources);
+
+  /*!
+   *\brief Counts the statuses of msg and decides which are analyzed
+   *
+   *\param publisher : Source of all statuses of msg with Key_Publisher
+   *\param admitted : Set to whether each status of msg is analyzed
+   *\return Statuses dropped
+   */
+  size_t filter(
+    const diagnostic_msgs::msg::DiagnosticArray & msg, const std::string & publisher,
+    std::vector<bool> & admitted);
+
+  /*!
+   *\brief Status named name with the top noisiest sources since the last report
+   *
+   * WARN if a source was limited since the last report, OK otherwise.
+   */
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> report(
+    const std::string & name, size_t top);
+
+  Key getKey() const {return key_;}
+
+  /*!
+   *\brief Statuses dropped since construction
+   */
+  uint64_t getDropped() const {return dropped_.load(std::memory_order_relaxed);}
+
+  /*!
+   *\brief Source of a status named name with Key_Name. Empty if the name has
+   *no ':'.
+   */
+  static std::string getSourceName(const std::string & name);
+
+private:
+  struct Source
+  {
+    double tokens;
+    std::chrono::steady_clock::time_point last_seen;
+    uint64_t received, dropped;
+    uint64_t reported_received, reported_dropped;
+    /*!
+     *\brief Last admitted level of each item, only when downsampling
+     */
+    std::unordered_map<std::string, uint8_t> levels;
+    std::list<std::string>::iterator lru;
+  };
+
+  Source & getSource(const std::string & key, std::chrono::steady_clock::time_point now);
+
+  bool admit(Source & source, const diagnostic_msgs::msg::DiagnosticStatus & status);
+
+  Key key_;
+  double rate_, burst_;
+  Action action_;
+  size_t max_sources_;
+
+  std::mutex mutex_;
+  std::unordered_map<std::string, Source> sources_;
+  std::list<std::string> lru_;   /**< Keys of sources_, least recently seen first */
+  std::chrono::steady_clock::time_point last_report_;
+  std::atomic<uint64_t> dropped_;
+};
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__INGEST_LIMITER_HPP_
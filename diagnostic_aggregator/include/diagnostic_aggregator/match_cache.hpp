@@ -0,0 +1,100 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__MATCH_CACHE_HPP_
+#define DIAGNOSTIC_AGGREGATOR__MATCH_CACHE_HPP_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Bounded cache of which analyzers match a status name
+ *
+ * When full, an entry is evicted with the CLOCK algorithm: the hand sweeps the
+ *entries, clearing their referenced bit, and evicts the first one that wasn't
+ *referenced since the last sweep. Names that keep being reported stay cached,
+ *while names seen once (sequence numbers, PIDs) are evicted first.
+ *
+ * An evicted name is simply matched again the next time it is seen.
+ */
+class MatchCache
+{
+public:
+  /*!
+   *\param capacity : Most names held. 0 for no limit.
+   */
+  explicit MatchCache(size_t capacity = 0);
+
+  /*!
+   *\brief Matches of name, or NULL if not cached
+   *
+   * The pointer is valid until the next insert() or clear().
+   */
+  const std::vector<bool> * find(const std::string & name);
+
+  /*!
+   *\brief Like find(), but doesn't count as a use of name
+   *
+   * For lookups that follow a find() or insert() of the same status, so a name
+   *seen once isn't kept as if it was seen twice.
+   */
+  const std::vector<bool> * peek(const std::string & name) const;
+
+  /*!
+   *\brief Caches the matches of name, evicting another name if full
+   */
+  const std::vector<bool> & insert(const std::string & name, const std::vector<bool> & matches);
+
+  void clear();
+
+  /*!
+   *\brief Changes the capacity, evicting names if it shrinks
+   */
+  void setCapacity(size_t capacity);
+
+  size_t size() const {return entries_.size();}
+
+  size_t getCapacity() const {return capacity_;}
+
+  /*!
+   *\brief Names evicted since construction
+   */
+  uint64_t getEvictions() const {return evictions_;}
+
+private:
+  struct Entry
+  {
+    std::string name;
+    std::vector<bool> matches;
+    bool referenced;
+  };
+
+  /*!
+   *\brief Index of the entry to replace
+   */
+  size_t evict();
+
+  std::vector<Entry> entries_;
+  std::unordered_map<std::string, size_t> index_;
+  size_t capacity_;
+  size_t hand_;
+  uint64_t evictions_;
+};
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__MATCH_CACHE_HPP_
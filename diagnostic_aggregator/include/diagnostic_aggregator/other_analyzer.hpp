@@ -13,9 +13,12 @@
 // limitations under the License.
 #ifndef DIAGNOSTIC_AGGREGATOR__OTHER_ANALYZER_HPP_
 #define DIAGNOSTIC_AGGREGATOR__OTHER_ANALYZER_HPP_
+#include <algorithm>
+#include <list>
 #include <memory>
 #include <vector>
 #include <string>
+#include <unordered_map>
 #include "diagnostic_aggregator/generic_analyzer_base.hpp"
 #include "rclcpp/rclcpp.hpp"
 // TODO(tfoote replace these terrible macros)
@@ -37,6 +40,10 @@ namespace diagnostic_aggregator
  *
  * Stale items will be discarded after 5 seconds of no updates.
  *
+ * At most setMaxItems() items are held. When a new item arrives at the limit,
+ *the least recently updated one is evicted, and an "Overflow" status reports
+ *the evictions.
+ *
  * OtherAnalyzer is designed to be used internally by the Aggregator only.
  *
  */
@@ -49,7 +56,8 @@ public:
   /* explicit OtherAnalyzer(bool other_as_errors = false)
    : other_as_errors_(other_as_errors)
    { }*/
-  OtherAnalyzer() {}
+  OtherAnalyzer()
+  : max_items_(0), evictions_(0), reported_evictions_(0) {}
 
   ~OtherAnalyzer() {}
 
@@ -85,6 +93,45 @@ public:
    */
   bool match(std::string name) {return true;}
 
+  /*!
+   *\brief Most items held, 0 for no limit
+   */
+  void setMaxItems(size_t max_items) {max_items_ = max_items;}
+
+  /*!
+   *\brief Items evicted to stay within the limit
+   */
+  uint64_t getEvictions() const {return evictions_;}
+
+  size_t getItemCount() const {return GenericAnalyzerBase::getItemCount();}
+
+  /*!
+   *\brief Updates the item, evicting the least recently updated one if it's
+   *new and the limit is reached
+   */
+  bool analyze(const std::shared_ptr<StatusItem> item)
+  {
+    std::unordered_map<std::string, std::list<std::string>::iterator>::iterator it =
+      lru_index_.find(item->getName());
+    if (it != lru_index_.end()) {
+      lru_.splice(lru_.end(), lru_, it->second);
+    } else {
+      if (max_items_ > 0 && lru_.size() >= max_items_) {
+        removeItem(lru_.front());
+        lru_index_.erase(lru_.front());
+        lru_.pop_front();
+        ++evictions_;
+      }
+      lru_index_[item->getName()] = lru_.insert(lru_.end(), item->getName());
+    }
+    return GenericAnalyzerBase::analyze(item);
+  }
+
+  /*!
+   *\brief Repeated statuses count as updates, so steady items aren't evicted
+   */
+  bool refresh(const std::shared_ptr<StatusItem> item) {return analyze(item);}
+
   /*
    *\brief Reports diagnostics, but doesn't report anything if it doesn't have
    *data
@@ -96,6 +143,17 @@ public:
     std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
     processed = GenericAnalyzerBase::report();
 
+    // Forget items the base discarded as stale
+    std::list<std::string>::iterator name = lru_.begin();
+    while (name != lru_.end()) {
+      if (hasItem(*name)) {
+        ++name;
+      } else {
+        lru_index_.erase(*name);
+        name = lru_.erase(name);
+      }
+    }
+
     // We don't report anything if there's no "Other" items
     if (processed.size() == 1) {
       processed.clear();
@@ -113,11 +171,44 @@ public:
       }
     }
 
+    if (evictions_ > 0 && !processed.empty()) {
+      std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> overflow(
+        new diagnostic_msgs::msg::DiagnosticStatus());
+      overflow->name = path_ + "/Overflow";
+      if (evictions_ > reported_evictions_) {
+        overflow->level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+        overflow->message = "Items evicted, more than " + std::to_string(max_items_) +
+          " unanalyzed names";
+      } else {
+        overflow->level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+        overflow->message = "No recent evictions";
+      }
+      diagnostic_msgs::msg::KeyValue kv;
+      kv.key = "Evicted Items";
+      kv.value = std::to_string(evictions_);
+      overflow->values.push_back(kv);
+      kv.key = "Max Items";
+      kv.value = std::to_string(max_items_);
+      overflow->values.push_back(kv);
+      processed[0]->level = std::max(processed[0]->level, overflow->level);
+      processed.push_back(overflow);
+      reported_evictions_ = evictions_;
+    }
+
     return processed;
   }
 
 private:
   bool other_as_errors_;
+
+  size_t max_items_;
+  uint64_t evictions_, reported_evictions_;
+
+  /*!
+   *\brief Item names, least recently updated first
+   */
+  std::list<std::string> lru_;
+  std::unordered_map<std::string, std::list<std::string>::iterator> lru_index_;
 };
 
 }  // namespace diagnostic_aggregator
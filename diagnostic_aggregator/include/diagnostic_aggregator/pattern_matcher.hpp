@@ -0,0 +1,118 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__PATTERN_MATCHER_HPP_
+#define DIAGNOSTIC_AGGREGATOR__PATTERN_MATCHER_HPP_
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Matches a name against many exact names, prefixes and substrings at once
+ *
+ * Exact names are looked up in a hash set, and prefixes by their first two
+ *bytes. Substrings are found with a Teddy style filter: patterns are sorted
+ *into 8 buckets, and for every position of the name, nibble tables give the
+ *buckets of the patterns whose first two bytes could start there. With SSSE3
+ *or AVX2, 16 or 32 positions are filtered per instruction with pshufb. At
+ *candidate positions, the sorted patterns of the candidate buckets are
+ *narrowed byte by byte with binary searches, so wide lists cost
+ *O(length * log(patterns)) per candidate.
+ *
+ * The instruction set is selected at runtime, with a scalar fallback that uses
+ *the same tables.
+ */
+class PatternMatcher
+{
+public:
+  enum Implementation
+  {
+    Impl_Scalar,
+    Impl_SSSE3,
+    Impl_AVX2
+  };
+
+  PatternMatcher();
+
+  void addExact(const std::string & name);
+  void addPrefix(const std::string & prefix);
+  void addContains(const std::string & substring);
+
+  /*!
+   *\brief Builds the tables. Must be called after the last add, before match().
+   */
+  void build();
+
+  /*!
+   *\brief True if name equals, starts with or contains one of the patterns
+   */
+  bool match(const std::string & name) const;
+
+  bool empty() const;
+
+  /*!
+   *\brief Best implementation supported by this CPU
+   */
+  static Implementation getBestImplementation();
+
+  /*!
+   *\brief Forces an implementation, for benchmarks. Ignored if unsupported.
+   */
+  void setImplementation(Implementation impl);
+
+  Implementation getImplementation() const {return impl_;}
+
+private:
+  bool matchPrefix(const std::string & name) const;
+  bool matchContains(const char * text, size_t size) const;
+  bool verify(const char * text, size_t size, size_t pos, uint8_t buckets) const;
+
+  /*!
+   * The kernels scan the positions from start to size. text must be readable
+   *up to readable, and text[size] must be 0.
+   */
+  bool containsScalar(const char * text, size_t size, size_t start) const;
+  bool containsSSSE3(const char * text, size_t size, size_t readable) const;
+  bool containsAVX2(const char * text, size_t size, size_t readable) const;
+
+  Implementation impl_;
+
+  std::unordered_set<std::string> exact_;
+
+  std::vector<std::string> prefixes_;
+  bool short_prefixes_[256];   /**< Prefixes of one byte */
+  std::unordered_map<uint16_t, std::vector<uint32_t>> prefix_index_;
+  bool empty_prefix_;
+
+  std::vector<std::string> contains_;
+  uint32_t bucket_bounds_[9];   /**< Bucket b is contains_[bounds[b], bounds[b + 1]) */
+  bool empty_contains_;
+
+  /*!
+   *\brief Bucket bits of the low and high nibble of the first and second byte
+   */
+  alignas(16) uint8_t lo0_[16];
+  alignas(16) uint8_t hi0_[16];
+  alignas(16) uint8_t lo1_[16];
+  alignas(16) uint8_t hi1_[16];
+};
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__PATTERN_MATCHER_HPP_
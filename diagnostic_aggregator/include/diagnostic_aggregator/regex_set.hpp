@@ -0,0 +1,85 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__REGEX_SET_HPP_
+#define DIAGNOSTIC_AGGREGATOR__REGEX_SET_HPP_
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Several regular expressions compiled into one DFA
+ *
+ * match() tells whether a name fully matches any of the patterns, like
+ *std::regex_match with any of them, in time linear in the length of the name
+ *and independent of the number of patterns. It doesn't allocate.
+ *
+ * The syntax is the subset of ECMAScript that a DFA can match: literals and
+ *escapes, '.', classes with ranges, negation, \\d \\w \\s and [:name:], groups,
+ *non-capturing groups, '|', '*', '+', '?' and {m,n} (lazy or not, which
+ *doesn't change whether a name matches), '^' at the start and '$' at the end.
+ *Backreferences, lookarounds, word boundaries and groups nested more than 256
+ *deep are rejected by add().
+ *
+ * The DFA is built completely by compile(). Patterns that would need more than
+ *max_states states, like ".*a.{30}", are rejected there.
+ */
+class RegexSet
+{
+public:
+  explicit RegexSet(size_t max_states = 10000);
+  ~RegexSet();
+
+  /*!
+   *\brief Parses pattern and adds it to the set
+   *
+   *\param error : Why pattern is unsupported, if false is returned
+   */
+  bool add(const std::string & pattern, std::string & error);
+
+  /*!
+   *\brief Builds the DFA of all added patterns
+   *
+   *\param error : Why the DFA could not be built, if false is returned
+   */
+  bool compile(std::string & error);
+
+  /*!
+   *\brief True if name fully matches one of the patterns
+   */
+  bool match(const std::string & name) const;
+
+  bool empty() const {return patterns_.empty();}
+
+  size_t getStateCount() const {return accepting_.size();}
+
+  struct Node;
+
+private:
+  size_t max_states_;
+  std::vector<std::shared_ptr<Node>> patterns_;
+
+  uint8_t classes_[256];    /**< Bytes no pattern tells apart share a class */
+  uint32_t num_classes_;
+  std::vector<uint32_t> transitions_;   /**< State * num_classes_ + class */
+  std::vector<uint8_t> accepting_;
+};
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__REGEX_SET_HPP_
@@ -0,0 +1,177 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__RULE_ANALYZER_HPP_
+#define DIAGNOSTIC_AGGREGATOR__RULE_ANALYZER_HPP_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "pluginlib/class_list_macros.hpp"
+#include "diagnostic_aggregator/analyzer.hpp"
+#include "diagnostic_aggregator/rule_expression.hpp"
+#include "diagnostic_aggregator/status_item.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "diagnostic_msgs/msg/key_value.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+// TODO(tfoote replace these terrible macros)
+#define ROS_ERROR printf
+#define ROS_FATAL printf
+#define ROS_WARN printf
+#define ROS_INFO printf
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief RuleAnalyzer raises a status when an expression over other statuses
+ *holds
+ *
+ * Each rule is a boolean expression over the levels and values of incoming
+ *status items (see RuleExpression for the syntax). Rules are compiled once in
+ *init(), and a rule is only re-evaluated when one of the statuses it references
+ *is updated, or when one of them goes stale.
+ *
+ *\verbatim
+ * motor_rules:
+ *   type: diagnostic_aggregator/RuleAnalyzer
+ *   path: Motor Rules
+ *   timeout: 5.0
+ *   rules:
+ *     overheat:
+ *       expr: "value('Motor', 'temp') > 70 && value('Motor', 'duty') > 0.9"
+ *       for: 5.0
+ *       level: error
+ *       message: Motor overheating under load
+ *     driver:
+ *       expr: "level('Motor Driver') >= WARN"
+ *\endverbatim
+ *
+ * Parameters of each rule:
+ * - \b expr The condition. Required.
+ * - \b for Seconds the condition must hold before the rule fires. Default 0.
+ * - \b level Level reported while the rule fires: warn, error, or 0-2.
+ *Default error.
+ * - \b message Message reported while the rule fires. Defaults to the
+ *expression.
+ *
+ * Referenced statuses that haven't updated within "timeout" seconds are treated
+ *as missing, so their fields are NaN. Default 5.0, values <= 0 disable this.
+ *
+ * The RuleAnalyzer reports one status per rule under "Base Path/My Path", and
+ *a header status with the highest level of its rules. It only looks at the
+ *items it matches, so analyze() returns false and those items are still
+ *reported by other analyzers.
+ */
+class RuleAnalyzer : public Analyzer
+{
+public:
+  /*!
+   *\brief Default constructor loaded by pluginlib
+   */
+  RuleAnalyzer();
+
+  virtual ~RuleAnalyzer();
+
+  /*!
+   *\brief Loads and compiles the rules from the analyzer namespace
+   *
+   *\return False if there are no rules, or if any rule fails to compile
+   */
+  bool init(
+    const std::string base_path, const char * nsp,
+    const rclcpp::Node::SharedPtr & n, const char * rnsp);
+
+  /*!
+   *\brief True if any rule references this status name
+   */
+  bool match(const std::string name);
+
+  /*!
+   *\brief Updates the referenced fields and re-evaluates dependent rules
+   *
+   *\return Always false, rules don't report the items themselves
+   */
+  bool analyze(const std::shared_ptr<StatusItem> item);
+
+  /*!
+   *\brief Analyzes the item again if its source went stale since
+   */
+  bool refresh(const std::shared_ptr<StatusItem> item);
+
+  virtual std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
+  report();
+
+  std::string getPath() const {return path_;}
+
+  std::string getName() const {return nice_name_;}
+
+private:
+  /*!
+   *\brief A compiled rule and its evaluation state
+   */
+  struct Rule
+  {
+    std::string name;
+    std::string text;
+    std::string message;
+    RuleExpression expr;
+    uint8_t level;
+    double hold;
+    bool condition;
+    rclcpp::Time since;
+  };
+
+  /*!
+   *\brief A field of a status item that some rule reads
+   */
+  struct Field
+  {
+    std::string key;  /**< Empty for the level of the item */
+    uint32_t slot;
+  };
+
+  /*!
+   *\brief Everything the rules read from one status name
+   */
+  struct Source
+  {
+    std::vector<Field> fields;
+    std::vector<uint32_t> rules;  /**< Indices of dependent rules */
+    /*!
+     *\brief Last analyzed item. Duplicate statuses refresh its update time
+     * without being analyzed again.
+     */
+    std::shared_ptr<StatusItem> item;
+    bool present;
+  };
+
+  uint32_t resolveSlot(const std::string & name, const std::string & key);
+
+  void evaluate(Rule & rule, const rclcpp::Time & now);
+
+  std::string path_, nice_name_;
+  double timeout_;
+
+  std::vector<Rule> rules_;
+  std::vector<double> slots_;
+  std::vector<std::string> slot_names_;  /**< Status name of each slot */
+  std::map<std::string, Source> sources_;
+  std::map<std::pair<std::string, std::string>, uint32_t> slot_ids_;
+};
+
+}  // namespace diagnostic_aggregator
+#endif  // DIAGNOSTIC_AGGREGATOR__RULE_ANALYZER_HPP_
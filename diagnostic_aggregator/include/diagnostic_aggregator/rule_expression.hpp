@@ -0,0 +1,136 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__RULE_EXPRESSION_HPP_
+#define DIAGNOSTIC_AGGREGATOR__RULE_EXPRESSION_HPP_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Compiled boolean/arithmetic expression over diagnostic status fields
+ *
+ * A RuleExpression is compiled once from its text into a flat stack-machine
+ * bytecode. Each status field referenced by the expression is resolved to a
+ * "slot", an index into a table of doubles owned by the caller. Evaluating the
+ * expression is then a single pass over the bytecode with no allocation and
+ * no string work.
+ *
+ * Grammar:
+ *\verbatim
+ * expr    := or
+ * or      := and (('||' | 'or') and)*
+ * and     := compare (('&&' | 'and') compare)*
+ * compare := sum (('<' | '<=' | '>' | '>=' | '==' | '!=') sum)?
+ * sum     := product (('+' | '-') product)*
+ * product := unary (('*' | '/') unary)*
+ * unary   := ('!' | 'not' | '-') unary | primary
+ * primary := NUMBER | 'true' | 'false' | 'OK' | 'WARN' | 'ERROR' | 'STALE'
+ *          | 'level' '(' STRING ')'
+ *          | 'value' '(' STRING ',' STRING ')'
+ *          | '(' expr ')'
+ *\endverbatim
+ *
+ * level('name') is the level of the status with that name. value('name',
+ * 'key') is the value for "key" of that status, converted to a number. Fields
+ * that are missing or not numeric are NaN, so any comparison against them is
+ * false.
+ *
+ * Parentheses and unary operators may nest at most 256 deep; deeper
+ * expressions fail to compile.
+ */
+class RuleExpression
+{
+public:
+  /*!
+   *\brief Resolves (status name, key) to a slot. An empty key means "level".
+   */
+  typedef std::function<uint32_t(const std::string &, const std::string &)>
+    SlotResolver;
+
+  RuleExpression();
+
+  ~RuleExpression();
+
+  /*!
+   *\brief Compiles expression text into bytecode
+   *
+   *\param text : Expression source
+   *\param resolve : Called once per distinct field referenced by the expression
+   *\param error : Set to a description of the problem if compilation fails
+   *\return True if compilation succeeded
+   */
+  bool compile(
+    const std::string & text, const SlotResolver & resolve,
+    std::string & error);
+
+  /*!
+   *\brief Evaluates the compiled expression against a slot table
+   *
+   *\return Value of the expression. Non-zero, non-NaN values are "true".
+   */
+  double evaluate(const std::vector<double> & slots) const;
+
+  /*!
+   *\brief Evaluates the expression as a condition
+   */
+  bool test(const std::vector<double> & slots) const
+  {
+    double result = evaluate(slots);
+    return result == result && result != 0.0;
+  }
+
+  /*!
+   *\brief Distinct slots referenced by the expression
+   */
+  const std::vector<uint32_t> & getSlots() const {return slots_;}
+
+  /*!
+   *\brief Number of bytecode instructions
+   */
+  size_t size() const {return code_.size();}
+
+private:
+  enum OpCode : uint8_t
+  {
+    Op_Const, Op_Slot, Op_Neg, Op_Not, Op_Add, Op_Sub, Op_Mul, Op_Div,
+    Op_Lt, Op_Le, Op_Gt, Op_Ge, Op_Eq, Op_Ne, Op_And, Op_Or
+  };
+
+  struct Instruction
+  {
+    OpCode op;
+    uint32_t slot;
+    double value;
+  };
+
+  class Parser;
+
+  std::vector<Instruction> code_;
+  std::vector<uint32_t> slots_;
+  size_t max_depth_;
+
+  /*!
+   *\brief Scratch evaluation stack, sized to max_depth_ at compile time
+   */
+  mutable std::vector<double> stack_;
+};
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__RULE_EXPRESSION_HPP_
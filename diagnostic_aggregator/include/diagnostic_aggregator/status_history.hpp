@@ -0,0 +1,158 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#ifndef DIAGNOSTIC_AGGREGATOR__STATUS_HISTORY_HPP_
+#define DIAGNOSTIC_AGGREGATOR__STATUS_HISTORY_HPP_
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "builtin_interfaces/msg/time.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "diagnostic_msgs/msg/key_value.hpp"
+#include "rclcpp/rclcpp.hpp"
+
+namespace diagnostic_aggregator
+{
+
+/*!
+ *\brief Bounded history of the level, message and value transitions of items
+ *
+ * Each item name has a ring of at most "max_per_item" transitions. A status is
+ *only recorded when its level, message or one of its values differs from the
+ *last recorded one, so an item that repeats the same status costs nothing but
+ *the comparison.
+ *
+ * The rings are stored by column: timestamps, levels, message hashes, messages
+ *and changed values each have their own array. Range queries binary search the
+ *timestamps without touching the other columns. Messages are only stored when
+ *they differ from the previous transition of the item, and values only when
+ *they changed.
+ *
+ * All items together use at most "memory_budget" bytes (estimated), counting
+ *their rings, names and last values. When over budget, the oldest transitions
+ *of all items are evicted first. The latest transition of an item is only
+ *evicted with the whole item, once nothing older is left. Items that are gone
+ *can be dropped with forget().
+ *
+ * record() and query() are thread safe.
+ */
+class StatusHistory
+{
+public:
+  /*!
+   *\param max_per_item : Transitions kept per item. 0 disables the history.
+   *\param memory_budget : Bytes for all items together
+   */
+  StatusHistory(size_t max_per_item, size_t memory_budget);
+
+  ~StatusHistory();
+
+  /*!
+   *\brief Records status if it differs from the last recorded status of its name
+   */
+  void record(
+    const diagnostic_msgs::msg::DiagnosticStatus & status,
+    const rclcpp::Time & stamp);
+
+  /*!
+   *\brief Drops the whole history of the named item
+   */
+  void forget(const std::string & name);
+
+  /*!
+   *\brief Names of all items with a history
+   */
+  void getNames(std::vector<std::string> & names) const;
+
+  /*!
+   *\brief Appends the transitions of the named items within [start, end]
+   *
+   * Each status has the level and message after the transition, and the values
+   *that changed with it. The first transition of an item holds all its values,
+   *unless it was evicted since.
+   */
+  void query(
+    const std::vector<std::string> & names, const rclcpp::Time & start,
+    const rclcpp::Time & end, std::vector<builtin_interfaces::msg::Time> & stamps,
+    std::vector<diagnostic_msgs::msg::DiagnosticStatus> & statuses) const;
+
+  /*!
+   *\brief Estimated bytes used by all histories
+   */
+  size_t getMemoryUsage() const;
+
+  bool enabled() const {return max_per_item_ > 0;}
+
+private:
+  /*!
+   *\brief Ring of transitions of one item, one array per column
+   *
+   * Entries are indexed from the oldest one. The arrays grow up to max_per_item_
+   *and are then reused.
+   */
+  struct Track
+  {
+    std::string name;
+    std::vector<int64_t> stamps;
+    std::vector<uint64_t> seqs;  /**< Order of the entries among all items */
+    std::vector<uint8_t> levels;
+    std::vector<size_t> message_hashes;
+    std::vector<std::string> messages;  /**< Only set if hash differs from previous entry */
+    std::vector<std::vector<diagnostic_msgs::msg::KeyValue>> values;
+    std::vector<size_t> bytes;
+    size_t head;   /**< Slot of the oldest entry */
+    size_t count;
+
+    std::string hw_id;
+    std::vector<diagnostic_msgs::msg::KeyValue> last_values;
+    size_t fixed_bytes;   /**< Name, hardware ID, last values and bookkeeping */
+
+    size_t slot(size_t i) const {return (head + i) % stamps.size();}
+  };
+
+  /*!
+   *\brief An entry in the eviction queue. Stale once its track is dropped or
+   * the entry was evicted by max_per_item.
+   */
+  struct Queued
+  {
+    std::weak_ptr<Track> track;
+    uint64_t seq;
+  };
+
+  void evictOldest(Track & track);
+  void dropTrack(const std::string & name);
+
+  size_t max_per_item_;
+  size_t memory_budget_;
+  size_t memory_usage_;
+  uint64_t next_seq_;
+  size_t entries_;   /**< Entries in all tracks */
+
+  std::unordered_map<std::string, std::shared_ptr<Track>> tracks_;
+  /*!
+   *\brief Entries of all tracks, oldest first. Compacted when more than half
+   * are stale.
+   */
+  std::deque<Queued> evict_queue_;
+
+  mutable std::mutex mutex_;
+};
+
+}  // namespace diagnostic_aggregator
+
+#endif  // DIAGNOSTIC_AGGREGATOR__STATUS_HISTORY_HPP_
@@ -188,6 +188,24 @@ public:
    */
   bool update(const diagnostic_msgs::msg::DiagnosticStatus * status);
 
+  /*!
+   *\brief Hash of the level, message, hardware ID and values of status
+   *
+   * Equal for statuses that only differ by name, so two statuses of the same
+   *item with equal hashes are almost certainly identical.
+   */
+  static uint64_t hashStatus(const diagnostic_msgs::msg::DiagnosticStatus & status);
+
+  /*!
+   *\brief hashStatus() of the last update, 0 if constructed from a name
+   */
+  uint64_t getHash() const {return hash_;}
+
+  /*!
+   *\brief Updates the time only, for a status identical to the last one
+   */
+  void refresh(const rclcpp::Time & stamp) {update_time_ = stamp;}
+
   /*!
    *\brief Prepends "path/" to name, makes item stale if "stale" true.
    *
@@ -202,6 +220,14 @@ public:
   std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>
   toStatusMsg(const std::string & path, const bool stale = false) const;
 
+  /*!
+   *\brief Like toStatusMsg(), with the full name of the status given
+   *
+   * For callers that keep the name of the item, so it isn't built again.
+   */
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>
+  toNamedStatusMsg(const std::string & status_name, const bool stale = false) const;
+
   /*
    *\brief Returns level of DiagnosticStatus message
    */
@@ -227,6 +253,11 @@ public:
    */
   /*const ros::Time getLastUpdateTime() const { return update_time_; }*/
   const rclcpp::Time getLastUpdateTime() const {return update_time_;}
+  /*!
+   *\brief Returns the KeyValues of the last update
+   */
+  const std::vector<diagnostic_msgs::msg::KeyValue> & getValues() const {return values_;}
+
   /*!
    *\brief Returns true if item has key in values KeyValues
    *
@@ -261,6 +292,7 @@ public:
 
 private:
   rclcpp::Time update_time_;
+  uint64_t hash_;
 
   DiagnosticLevel level_;
   std::string output_name_; /**< name_ w/o "/" */
@@ -12,6 +12,9 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <chrono>
+#include <set>
 #include <string>
 #include <vector>
 #include <memory>
@@ -23,17 +26,51 @@
 //  using namespace std;
 //  using namespace diagnostic_aggregator;
 
-diagnostic_aggregator::Aggregator::Aggregator()
-: pub_rate_(1.0), analyzer_group_(NULL), other_analyzer_(NULL),
-  base_path_("")
+namespace
 {
+
+/*
+ *\brief Hex string of a publisher GID
+ */
+std::string formatGid(const rmw_gid_t & gid)
+{
+  static const char digits[] = "0123456789abcdef";
+  std::string out;
+  out.reserve(2 * RMW_GID_STORAGE_SIZE);
+  for (size_t i = 0; i < RMW_GID_STORAGE_SIZE; ++i) {
+    out += digits[gid.data[i] >> 4];
+    out += digits[gid.data[i] & 0xf];
+  }
+  return out;
+}
+
+}  // namespace
+
+diagnostic_aggregator::Aggregator::Aggregator(const std::vector<rclcpp::Parameter> & parameters)
+: pub_rate_(1.0), publish_on_escalation_(false), min_event_interval_(0.1),
+  self_diagnostics_(true), report_sources_(5),
+  dedup_statuses_(true), last_items_limit_(1024),
+  full_level_(-1), full_min_level_(255), other_analyzer_(NULL), base_path_("")
+{
+  match_cache_size_ = 10000;
   auto context =
     rclcpp::contexts::default_context::get_global_default_context();
   const std::vector<std::string> arguments = {};
-  const std::vector<rclcpp::Parameter> initial_values = {
-    rclcpp::Parameter("base_path", "/"),
-    rclcpp::Parameter("pub_rate", pub_rate_),
-  };
+  std::vector<rclcpp::Parameter> initial_values;
+  for (const rclcpp::Parameter & defaults : {
+      rclcpp::Parameter("base_path", "/"),
+      rclcpp::Parameter("pub_rate", pub_rate_),
+    })
+  {
+    bool overridden = false;
+    for (const rclcpp::Parameter & parameter : parameters) {
+      overridden = overridden || parameter.get_name() == defaults.get_name();
+    }
+    if (!overridden) {
+      initial_values.push_back(defaults);
+    }
+  }
+  initial_values.insert(initial_values.end(), parameters.begin(), parameters.end());
   const bool use_global_arguments = true;
   const bool use_intra_process = true;
 
@@ -51,30 +88,96 @@ diagnostic_aggregator::Aggregator::Aggregator()
   nh = std::make_shared<rclcpp::Node>("analyzers", "/", options);
   nh_an = std::make_shared<rclcpp::Node>(
     "diagnostic_aggregator", "/", options);
-  //  Listing parameter using syncronous paramter serrvice
-  auto parameters_client = std::make_shared<rclcpp::SyncParametersClient>(nh);
-  using namespace std::chrono_literals;
-  while (!parameters_client->wait_for_service(1s)) {
-    if (!rclcpp::ok()) {
-      RCLCPP_ERROR(nh->get_logger(),
-        "Interrupted while waiting for the service. Exiting.");
-    }
-    RCLCPP_INFO(nh->get_logger(), "service not available, waiting again...");
+  nh_client_ = std::make_shared<rclcpp::Node>(
+    "diagnostic_aggregator_client", "/", rclcpp::NodeOptions()
+    .use_intra_process_comms(use_intra_process)
+    .use_global_arguments(use_global_arguments)
+    .context(context)
+    .arguments(arguments));
+  std::stringstream ss, ss1;
+
+  nh_an->get_parameter_or("pub_rate", pub_rate_, pub_rate_);
+  nh_an->get_parameter_or("publish_on_escalation", publish_on_escalation_,
+    publish_on_escalation_);
+  nh_an->get_parameter_or("min_event_interval", min_event_interval_,
+    min_event_interval_);
+  nh_an->get_parameter_or("self_diagnostics", self_diagnostics_, self_diagnostics_);
+  nh_an->get_parameter_or("dedup_statuses", dedup_statuses_, dedup_statuses_);
+  bool stats_service = false;
+  nh_an->get_parameter_or("stats_service", stats_service, stats_service);
+  if (pub_rate_ <= 0) {
+    ROS_WARN("Invalid pub_rate %f, using 1.0\n", pub_rate_);
+    pub_rate_ = 1.0;
   }
 
-  RCLCPP_INFO(nh->get_logger(), "service is  available Now ");
-  std::stringstream ss, ss1;
+  int64_t history_size = 100;
+  double history_memory = 16.0;
+  nh_an->get_parameter_or("history_size", history_size, history_size);
+  nh_an->get_parameter_or("history_memory", history_memory, history_memory);
+  int64_t match_cache_size = 10000;
+  int64_t max_other_items = 1000;
+  nh_an->get_parameter_or("match_cache_size", match_cache_size, match_cache_size);
+  nh_an->get_parameter_or("max_other_items", max_other_items, max_other_items);
+  match_cache_size_ = std::max<int64_t>(match_cache_size, 0);
 
-  analyzer_group_ = new AnalyzerGroup();
+  std::string source_key = "name";
+  double rate_limit = 0.0;
+  double burst = -1.0;
+  std::string limit_action = "drop";
+  int64_t max_sources = 1000;
+  nh_an->get_parameter_or("ingest_source_key", source_key, source_key);
+  nh_an->get_parameter_or("ingest_rate_limit", rate_limit, rate_limit);
+  nh_an->get_parameter_or("ingest_burst", burst, burst);
+  nh_an->get_parameter_or("ingest_limit_action", limit_action, limit_action);
+  nh_an->get_parameter_or("ingest_max_sources", max_sources, max_sources);
+  nh_an->get_parameter_or("ingest_report_sources", report_sources_, report_sources_);
+  if (source_key != "name" && source_key != "publisher") {
+    ROS_WARN("Invalid ingest_source_key %s, using name\n", source_key.c_str());
+    source_key = "name";
+  }
+  if (limit_action != "drop" && limit_action != "downsample") {
+    ROS_WARN("Invalid ingest_limit_action %s, using drop\n", limit_action.c_str());
+    limit_action = "drop";
+  }
+  ingest_limiter_.reset(new IngestLimiter(
+      source_key == "publisher" ? IngestLimiter::Key_Publisher : IngestLimiter::Key_Name,
+      rate_limit, burst < 0 ? rate_limit : burst,
+      limit_action == "downsample" ? IngestLimiter::Action_Downsample : IngestLimiter::Action_Drop,
+      std::max<int64_t>(max_sources, 1)));
+
+  history_.reset(new StatusHistory(std::max<int64_t>(history_size, 0),
+    static_cast<size_t>(std::max(history_memory, 0.0) * 1024 * 1024)));
+
+  std::string journal_path;
+  double journal_segment_size = 8.0;
+  int64_t journal_segments = 8;
+  nh_an->get_parameter_or("journal_path", journal_path, journal_path);
+  nh_an->get_parameter_or("journal_segment_size", journal_segment_size,
+    journal_segment_size);
+  nh_an->get_parameter_or("journal_segments", journal_segments, journal_segments);
+  if (!journal_path.empty()) {
+    journal_.reset(new DiagnosticJournal(journal_path,
+      static_cast<size_t>(std::max(journal_segment_size, 0.0) * 1024 * 1024),
+      std::max<int64_t>(journal_segments, 1)));
+    std::string error;
+    if (!journal_->open(error)) {
+      ROS_ERROR("%s, journal disabled\n", error.c_str());
+      journal_.reset();
+    }
+  }
+
+  analyzer_group_ = std::make_shared<AnalyzerGroup>();
   //  Analyzer initialisation: parameter passed is base path, name of node which create analyzer
   //  node share pointer
   if (!analyzer_group_->init(base_path_, nh_an->get_name(), nh_an, NULL)) {
     // if (!analyzer_group_->init(base_path_,"analyzers",nh,"gen_analyzers"))
     ROS_ERROR("Analyzer group for diagnostic aggregator failed to initialize!");
   }
+  analyzer_group_->setMatchCacheSize(match_cache_size_);
   // Last analyzer handles remaining data
   other_analyzer_ = new OtherAnalyzer();
   other_analyzer_->init(base_path_);  //  This always returns true
+  other_analyzer_->setMaxItems(std::max<int64_t>(max_other_items, 0));
   //  Callback for service adding analyzer
   auto handle_add_agreegator =
     [this](
@@ -95,6 +198,14 @@ diagnostic_aggregator::Aggregator::Aggregator()
       }
       std::shared_ptr<Analyzer> group = std::make_shared<AnalyzerGroup>();
 
+      // The group is fully initialized before its bond exists, so bondFormed
+      // can't add it half-built
+      if (!group->init(base_path_, req->load_namespace.c_str(), nh_client_, NULL)) {
+        res->message = "Failed to initialise AnalyzerGroup.";
+        res->success = false;
+        return true;
+      }
+
       { // lock here ensures that bonds from the same namespace aren't added
         // twice. Without it, possibility of two simultaneous calls adding two
         // objects.
@@ -119,33 +230,88 @@ diagnostic_aggregator::Aggregator::Aggregator()
         bonds_.push_back(req_bond);  // bond formed, keep track of it
       }
 
-      rclcpp::Node::SharedPtr nh_temp;
-      if (group->init(base_path_, req->load_namespace.c_str(), nh_an, NULL)) {
-        // if (group->init(base_path_,
-        // req->load_namespace.c_str(),nh_temp,req->load_namespace.c_str()))
-        res->message =
-          "Successfully initialised AnalyzerGroup. Waiting for bond to form.";
-        res->success = true;
-        return true;
-      } else {
-        res->message = "Failed to initialise AnalyzerGroup.";
-        res->success = false;
-        return true;
-      }
+      res->message =
+        "Successfully initialised AnalyzerGroup. Waiting for bond to form.";
+      res->success = true;
+      return true;
     };
 
-  std::function<void(diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr)>
+  // Ingest, publishing and the add_diagnostics service each get their own
+  // callback group, so a multi-threaded executor can run them concurrently.
+  // Callbacks within a group never run concurrently with each other.
+  ingest_group_ = nh->create_callback_group(
+    rclcpp::callback_group::CallbackGroupType::MutuallyExclusive);
+  publish_group_ = nh->create_callback_group(
+    rclcpp::callback_group::CallbackGroupType::MutuallyExclusive);
+  service_group_ = nh->create_callback_group(
+    rclcpp::callback_group::CallbackGroupType::MutuallyExclusive);
+
+  std::function<void(diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr,
+    const rmw_message_info_t &)>
   cb_std_function =
-    std::bind(&Aggregator::diagCallback, this, std::placeholders::_1);
+    std::bind(&Aggregator::diagCallback, this, std::placeholders::_1, std::placeholders::_2);
   add_srv_ = nh->create_service<diagnostic_msgs::srv::AddDiagnostics>(
-    "/diagnostics_agg/add_diagnostics", handle_add_agreegator);
+    "/diagnostics_agg/add_diagnostics", handle_add_agreegator,
+    rmw_qos_profile_services_default, service_group_);
+  auto handle_reload =
+    [this](
+    const std::shared_ptr<rmw_request_id_t> request_header,
+    const std::shared_ptr<std_srvs::srv::Trigger::Request> req,
+    std::shared_ptr<std_srvs::srv::Trigger::Response> res)
+    {
+      (void)request_header;
+      (void)req;
+      res->success = reloadAnalyzers(res->message);
+    };
+  reload_srv_ = nh->create_service<std_srvs::srv::Trigger>(
+    "/diagnostics_agg/reload", handle_reload,
+    rmw_qos_profile_services_default, service_group_);
+  auto handle_query_history =
+    [this](
+    const std::shared_ptr<rmw_request_id_t> request_header,
+    const std::shared_ptr<diagnostic_aggregator::srv::QueryHistory::Request> req,
+    std::shared_ptr<diagnostic_aggregator::srv::QueryHistory::Response> res)
+    {
+      (void)request_header;
+      queryHistory(*req, *res);
+    };
+  history_srv_ = nh->create_service<diagnostic_aggregator::srv::QueryHistory>(
+    "/diagnostics_agg/query_history", handle_query_history,
+    rmw_qos_profile_services_default, service_group_);
+  if (stats_service) {
+    auto handle_stats =
+      [this](
+      const std::shared_ptr<rmw_request_id_t> request_header,
+      const std::shared_ptr<std_srvs::srv::Trigger::Request> req,
+      std::shared_ptr<std_srvs::srv::Trigger::Response> res)
+      {
+        (void)request_header;
+        (void)req;
+        res->success = true;
+        res->message = stats_.toString();
+      };
+    stats_srv_ = nh->create_service<std_srvs::srv::Trigger>(
+      "/diagnostics_agg/stats", handle_stats,
+      rmw_qos_profile_services_default, service_group_);
+  }
   diag_sub_ = nh->create_subscription<diagnostic_msgs::msg::DiagnosticArray>(
-    "/diagnostics", cb_std_function, rmw_qos_profile_default);
+    "/diagnostics", cb_std_function, rmw_qos_profile_default, ingest_group_);
   agg_pub_ = nh->create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
     "/diagnostics_agg");
   toplevel_state_pub_ =
     nh->create_publisher<diagnostic_msgs::msg::DiagnosticStatus>(
     "/diagnostics_toplevel_state");
+
+  publish_timer_ = nh->create_wall_timer(
+    std::chrono::duration<double>(1.0 / pub_rate_),
+    std::bind(&Aggregator::publishData, this), publish_group_);
+  if (publish_on_escalation_) {
+    // Flushes escalations that arrived within min_event_interval of the last
+    // event publish
+    event_timer_ = nh->create_wall_timer(
+      std::chrono::duration<double>(min_event_interval_),
+      std::bind(&Aggregator::publishEvent, this), publish_group_);
+  }
 }
 
 void diagnostic_aggregator::Aggregator::checkTimestamp(
@@ -172,37 +338,162 @@ void diagnostic_aggregator::Aggregator::checkTimestamp(
 }
 
 void diagnostic_aggregator::Aggregator::diagCallback(
-  const diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr & diag_msg)
+  const diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr & diag_msg,
+  const rmw_message_info_t & info)
 {
   checkTimestamp(diag_msg);
+  // Statistics are only gathered for the self-diagnostics, so that they cost
+  // nothing when those are off
+  if (self_diagnostics_) {
+    stats_.statuses.fetch_add(diag_msg->status.size(), std::memory_order_relaxed);
+  }
+
+  // Floods are dropped here, before they cost any analysis or lock time
+  std::vector<bool> admitted;
+  std::string publisher;
+  if (ingest_limiter_->getKey() == IngestLimiter::Key_Publisher) {
+    publisher = formatGid(info.publisher_gid);
+  }
+  ingest_limiter_->filter(*diag_msg, publisher, admitted);
+  uint64_t other = 0;
   bool analyzed = false;
+  bool matched = false;
+  bool escalated = false;
+
+  // Items are built before taking the lock, to keep the critical section short.
+  // A status identical to the last one of its item only refreshes that item.
+  std::vector<std::shared_ptr<StatusItem>> items;
+  std::vector<std::shared_ptr<StatusItem>> duplicates;
+  items.reserve(diag_msg->status.size());
+  for (unsigned int j = 0; j < diag_msg->status.size(); ++j) {
+    if (!admitted[j]) {
+      continue;
+    }
+    const diagnostic_msgs::msg::DiagnosticStatus & status = diag_msg->status[j];
+    if (dedup_statuses_) {
+      std::unordered_map<std::string, std::shared_ptr<StatusItem>>::iterator last =
+        last_items_.find(status.name);
+      if (last != last_items_.end() && last->second->getHash() == StatusItem::hashStatus(status)) {
+        duplicates.push_back(last->second);
+        continue;
+      }
+    }
+    items.push_back(std::make_shared<StatusItem>(&status));
+    history_->record(status, items.back()->getLastUpdateTime());
+    if (journal_) {
+      journal_->record(status, items.back()->getLastUpdateTime());
+    }
+    if (dedup_statuses_) {
+      last_items_[status.name] = items.back();
+    }
+  }
+  if (self_diagnostics_) {
+    stats_.duplicates.fetch_add(duplicates.size(), std::memory_order_relaxed);
+  }
+
   { // lock the whole loop to ensure nothing in the analyzer group changes
     // during it.
     // std::mutex::scoped_lock lock(mutex_);
     std::unique_lock<std::mutex> lock(mutex_);
-    for (unsigned int j = 0; j < diag_msg->status.size(); ++j) {
+    std::chrono::steady_clock::time_point locked;
+    if (self_diagnostics_) {
+      locked = std::chrono::steady_clock::now();
+    }
+    // Duplicates follow the new items. Each analyzer that still holds a
+    // duplicate only sees its time refreshed, the others analyze it again.
+    size_t fresh = items.size();
+    if (!duplicates.empty()) {
+      rclcpp::Clock ros_clock(RCL_ROS_TIME);
+      rclcpp::Time now = ros_clock.now();
+      for (unsigned int j = 0; j < duplicates.size(); ++j) {
+        duplicates[j]->refresh(now);
+      }
+      items.insert(items.end(), duplicates.begin(), duplicates.end());
+    }
+    for (unsigned int j = 0; j < items.size(); ++j) {
       analyzed = false;
-      std::shared_ptr<StatusItem> item(new StatusItem(&diag_msg->status[j]));
+      const std::shared_ptr<StatusItem> & item = items[j];
+      bool repeated = j >= fresh;
 
-      if (analyzer_group_->match(item->getName())) {
-        analyzed = analyzer_group_->analyze(item);
-
-      } else {
-        std::cout << "No match found for " << item->getName() << std::endl;
+      matched = analyzer_group_->match(item->getName());
+      if (matched) {
+        analyzed = repeated ? analyzer_group_->refresh(item) : analyzer_group_->analyze(item);
       }
       if (!analyzed) {
-        other_analyzer_->analyze(item);
+        if (repeated) {
+          other_analyzer_->refresh(item);
+        } else {
+          other_analyzer_->analyze(item);
+        }
+        ++other;
+      }
+
+      if (publish_on_escalation_ && !repeated &&
+        updateLevel(item->getName(), item->getLevel()))
+      {
+        escalated = true;
+        if (matched) {
+          analyzer_group_->getMatchedPaths(item->getName(), event_paths_);
+        }
+        if (!analyzed) {
+          event_paths_.insert(other_analyzer_->getPath());
+        }
+      }
+    }
+    if (self_diagnostics_) {
+      stats_.ingest_lock.record(std::chrono::steady_clock::now() - locked);
+    }
+  }
+  if (self_diagnostics_) {
+    stats_.other.fetch_add(other, std::memory_order_relaxed);
+  }
+
+  // Forget items that no analyzer holds anymore, and their history, once the
+  // table has doubled
+  if (last_items_.size() > last_items_limit_) {
+    items.clear();
+    duplicates.clear();
+    std::unordered_map<std::string, std::shared_ptr<StatusItem>>::iterator it =
+      last_items_.begin();
+    while (it != last_items_.end()) {
+      if (it->second.use_count() == 1) {
+        history_->forget(it->first);
+        it = last_items_.erase(it);
+      } else {
+        ++it;
       }
     }
+    last_items_limit_ = std::max<size_t>(2 * last_items_.size(), 1024);
+  }
+
+  if (escalated) {
+    publishEvent();
   }
 }
 
-diagnostic_aggregator::Aggregator::~Aggregator()
+bool diagnostic_aggregator::Aggregator::updateLevel(const std::string & name, uint8_t level)
 {
-  if (analyzer_group_) {
-    delete analyzer_group_;
+  std::unordered_map<std::string, LastLevel>::iterator it = last_levels_.find(name);
+  if (it != last_levels_.end()) {
+    last_levels_lru_.splice(last_levels_lru_.end(), last_levels_lru_, it->second.lru);
+    bool rose = level > it->second.level;
+    it->second.level = level;
+    return rose;
+  }
+
+  // New names start from OK
+  if (match_cache_size_ > 0 && last_levels_.size() >= match_cache_size_) {
+    last_levels_.erase(last_levels_lru_.front());
+    last_levels_lru_.pop_front();
   }
+  LastLevel & last = last_levels_[name];
+  last.level = level;
+  last.lru = last_levels_lru_.insert(last_levels_lru_.end(), name);
+  return level > 0;
+}
 
+diagnostic_aggregator::Aggregator::~Aggregator()
+{
   if (other_analyzer_) {
     delete other_analyzer_;
   }
@@ -226,6 +517,11 @@ void diagnostic_aggregator::Aggregator::bondBroken(
   if (!analyzer_group_->removeAnalyzer(analyzer)) {
     ROS_WARN("Broken bond tried to remove an analyzer which didn't exist.");
   }
+  std::vector<std::shared_ptr<Analyzer>>::iterator added =
+    std::find(added_analyzers_.begin(), added_analyzers_.end(), analyzer);
+  if (added != added_analyzers_.end()) {
+    added_analyzers_.erase(added);
+  }
 
   analyzer_group_->resetMatches();
 }
@@ -236,48 +532,198 @@ void diagnostic_aggregator::Aggregator::bondFormed(std::shared_ptr<Analyzer> gro
   // boost::mutex::scoped_lock lock(mutex_);
   std::unique_lock<std::mutex> lock(mutex_);
   analyzer_group_->addAnalyzer(group);
+  analyzer_group_->setMatchCacheSize(match_cache_size_);
   analyzer_group_->resetMatches();
+  added_analyzers_.push_back(group);
+}
+
+bool diagnostic_aggregator::Aggregator::reloadAnalyzers(std::string & message)
+{
+  std::shared_ptr<AnalyzerGroup> group;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    group = analyzer_group_;
+  }
+
+  // The new group is built without the lock. Only the configuration of the
+  // current group is read here, so diagCallback and publishing continue on it.
+  std::shared_ptr<AnalyzerGroup> new_group = std::make_shared<AnalyzerGroup>();
+  if (!new_group->init(base_path_, nh_an->get_name(), nh_an, NULL, group.get())) {
+    message = "Failed to initialize the new analyzers. Keeping the current ones.";
+    return false;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (unsigned int i = 0; i < added_analyzers_.size(); ++i) {
+      new_group->addAnalyzer(added_analyzers_[i]);
+    }
+    new_group->setMatchCacheSize(match_cache_size_);
+    analyzer_group_.swap(new_group);
+    // Escalation paths refer to the old analyzers
+    event_paths_.clear();
+  }
+
+  // new_group now holds the last reference to the old group, if any. It is
+  // released here, outside the lock.
+  message = "Reloaded analyzers";
+  return true;
+}
+
+void diagnostic_aggregator::Aggregator::queryHistory(
+  const diagnostic_aggregator::srv::QueryHistory::Request & req,
+  diagnostic_aggregator::srv::QueryHistory::Response & res)
+{
+  if (!history_->enabled()) {
+    res.success = false;
+    res.message = "History is disabled, history_size is 0";
+    return;
+  }
+
+  rclcpp::Time start(req.start, RCL_ROS_TIME);
+  rclcpp::Time end(req.end, RCL_ROS_TIME);
+  if (end.nanoseconds() == 0) {
+    rclcpp::Clock ros_clock(RCL_ROS_TIME);
+    end = ros_clock.now();
+  }
+
+  std::vector<std::string> names;
+  history_->getNames(names);
+
+  // Items named req.name, and items handled by analyzers at or below it
+  std::string prefix = req.name == "/" ? req.name : req.name + "/";
+  std::vector<std::string> selected;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::set<std::string> paths;
+    for (unsigned int i = 0; i < names.size(); ++i) {
+      if (names[i] == req.name) {
+        selected.push_back(names[i]);
+        continue;
+      }
+      paths.clear();
+      if (analyzer_group_->match(names[i])) {
+        analyzer_group_->getMatchedPaths(names[i], paths);
+      } else {
+        paths.insert(other_analyzer_->getPath());
+      }
+      for (const std::string & path : paths) {
+        if (path == req.name || path.compare(0, prefix.size(), prefix) == 0) {
+          selected.push_back(names[i]);
+          break;
+        }
+      }
+    }
+  }
+
+  history_->query(selected, start, end, res.stamps, res.statuses);
+  res.success = true;
+  res.message = std::to_string(res.statuses.size()) + " transitions of " +
+    std::to_string(selected.size()) + " items";
 }
 
 void diagnostic_aggregator::Aggregator::publishData()
+{
+  {
+    // The full output covers any pending escalations
+    std::unique_lock<std::mutex> lock(mutex_);
+    event_paths_.clear();
+  }
+  if (!self_diagnostics_) {
+    publish(NULL);
+    return;
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  publish(NULL);
+  stats_.publish.record(std::chrono::steady_clock::now() - start);
+}
+
+void diagnostic_aggregator::Aggregator::publishEvent()
+{
+  std::set<std::string> paths;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (event_paths_.empty()) {
+      return;
+    }
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (now - last_event_pub_ < std::chrono::duration<double>(min_event_interval_)) {
+      return;  // event_timer_ will retry
+    }
+    last_event_pub_ = now;
+    paths.swap(event_paths_);
+  }
+  publish(&paths);
+}
+
+void diagnostic_aggregator::Aggregator::publish(const std::set<std::string> * paths)
 {
   // diagnostic_msgs::msg::DiagnosticArray diag_array;
 
   diagnostic_msgs::msg::DiagnosticStatus diag_toplevel_state;
   diag_toplevel_state.name = "toplevel_state";
-  diag_toplevel_state.level = -1;
+  // level is unsigned, so the highest level is found in an int
+  int max_level = -1;
   int min_level = 255;
 
   std::shared_ptr<diagnostic_msgs::msg::DiagnosticArray> diag_array =
     std::make_shared<diagnostic_msgs::msg::DiagnosticArray>();
 
+  // Only the analyzers' state is guarded. Building and publishing the message
+  // happens outside the lock so ingest can continue on another thread.
   std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>> processed;
+  std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
+  processed_other;
   {
     std::unique_lock<std::mutex> lock(mutex_);
-    processed = analyzer_group_->report();
+    if (paths) {
+      // Only the analyzers that handle escalated items
+      processed = analyzer_group_->reportPaths(*paths);
+      if (paths->count(other_analyzer_->getPath())) {
+        processed_other = other_analyzer_->report();
+      }
+    } else {
+      processed = analyzer_group_->report();
+      processed_other = other_analyzer_->report();
+    }
+    if (self_diagnostics_) {
+      stats_.match_cache.store(analyzer_group_->getMatchCacheSize(), std::memory_order_relaxed);
+      stats_.match_cache_evictions.store(analyzer_group_->getMatchCacheEvictions(),
+        std::memory_order_relaxed);
+      stats_.other_items.store(other_analyzer_->getItemCount(), std::memory_order_relaxed);
+      stats_.other_evictions.store(other_analyzer_->getEvictions(), std::memory_order_relaxed);
+    }
   }
   for (unsigned int i = 0; i < processed.size(); ++i) {
     diag_array->status.push_back(*processed[i]);
 
-    if (processed[i]->level > diag_toplevel_state.level) {
-      diag_toplevel_state.level = processed[i]->level;
-    }
-    if (processed[i]->level < min_level) {
-      min_level = processed[i]->level;
-    }
+    max_level = std::max<int>(max_level, processed[i]->level);
+    min_level = std::min<int>(min_level, processed[i]->level);
   }
 
-  std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
-  processed_other = other_analyzer_->report();
   for (unsigned int i = 0; i < processed_other.size(); ++i) {
     diag_array->status.push_back(*processed_other[i]);
 
-    if (processed_other[i]->level > diag_toplevel_state.level) {
-      diag_toplevel_state.level = processed_other[i]->level;
-    }
-    if (processed_other[i]->level < min_level) {
-      min_level = processed_other[i]->level;
-    }
+    max_level = std::max<int>(max_level, processed_other[i]->level);
+    min_level = std::min<int>(min_level, processed_other[i]->level);
+  }
+
+  // Analyzers not reported by an event publish count with their levels of the
+  // last full publish
+  if (paths) {
+    max_level = std::max(max_level, full_level_.load());
+    min_level = std::min(min_level, full_min_level_.load());
+  } else {
+    full_level_.store(max_level);
+    full_min_level_.store(min_level);
+  }
+
+  // Not part of the top level state
+  if (self_diagnostics_ && !paths) {
+    std::string name = base_path_ == "/" ? "/Aggregator" : base_path_ + "/Aggregator";
+    diag_array->status.push_back(*stats_.report(name));
+    diag_array->status.push_back(*ingest_limiter_->report(name + "/Sources",
+      std::max<int64_t>(report_sources_, 0)));
   }
 
   /*  diag_array.header.stamp = ros::Time::now();*/
@@ -288,9 +734,10 @@ void diagnostic_aggregator::Aggregator::publishData()
   diag_array->header.stamp.nanosec = ros_now.nanosec;
   agg_pub_->publish(diag_array);
   // Top level is error if we have stale items, unless all stale
-  if (diag_toplevel_state.level > 2 && min_level <= 2) {
-    diag_toplevel_state.level = 2;
+  if (max_level > 2 && min_level <= 2) {
+    max_level = 2;
   }
+  diag_toplevel_state.level = max_level;
 
   toplevel_state_pub_->publish(diag_toplevel_state);
 }
@@ -21,12 +21,13 @@ int main(int argc, char ** argv)
   try {
     diagnostic_aggregator::Aggregator agg;
 
-    rclcpp::Rate pub_rate(agg.getPubRate());
-    while (agg.ok()) {
-      rclcpp::spin_some(agg.get_node());
-      agg.publishData();
-      pub_rate.sleep();
-    }
+    // Publishing is driven by the aggregator's timers. Ingest, publishing and
+    // services are in separate callback groups, so they run on separate
+    // threads. The parameter node serves parameter changes for reloads.
+    rclcpp::executors::MultiThreadedExecutor executor;
+    executor.add_node(agg.get_node());
+    executor.add_node(agg.get_parameter_node());
+    executor.spin();
   } catch (std::exception & e) {
     std::cout << "Vaibhav diagnostic_aggregator exception hit  " << std::endl;
   }
@@ -0,0 +1,164 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <memory>
+#include "diagnostic_aggregator/aggregator_stats.hpp"
+
+namespace
+{
+
+void addValue(
+  std::vector<diagnostic_msgs::msg::KeyValue> & values, const std::string & key,
+  const std::string & value)
+{
+  diagnostic_msgs::msg::KeyValue kv;
+  kv.key = key;
+  kv.value = value;
+  values.push_back(kv);
+}
+
+std::string formatDouble(double value)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.1f", value);
+  return buf;
+}
+
+void addLatency(
+  std::vector<diagnostic_msgs::msg::KeyValue> & values, const std::string & name,
+  const diagnostic_aggregator::LatencyHistogram & histogram)
+{
+  addValue(values, name + " Count", std::to_string(histogram.getCount()));
+  addValue(values, name + " Mean (us)", formatDouble(histogram.getMean()));
+  addValue(values, name + " p99 (us)", formatDouble(histogram.getPercentile(0.99)));
+  addValue(values, name + " Max (us)", formatDouble(histogram.getMax()));
+}
+
+}  // namespace
+
+diagnostic_aggregator::LatencyHistogram::LatencyHistogram()
+: count_(0), sum_(0), max_(0)
+{
+  for (int i = 0; i < kBuckets; ++i) {
+    buckets_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void diagnostic_aggregator::LatencyHistogram::record(
+  std::chrono::steady_clock::duration duration)
+{
+  int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+  uint64_t value = ns > 0 ? ns : 0;
+
+  int bucket = 0;
+  while (bucket < kBuckets - 1 && (value >> (bucket + 1)) != 0) {
+    ++bucket;
+  }
+  buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (value > max && !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {
+  }
+}
+
+double diagnostic_aggregator::LatencyHistogram::getMean() const
+{
+  uint64_t count = getCount();
+  return count ? sum_.load(std::memory_order_relaxed) * 1e-3 / count : 0.0;
+}
+
+double diagnostic_aggregator::LatencyHistogram::getPercentile(double p) const
+{
+  uint64_t count = getCount();
+  if (count == 0) {
+    return 0.0;
+  }
+  uint64_t target = static_cast<uint64_t>(p * count);
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += buckets_[i].load(std::memory_order_relaxed);
+    if (seen > target) {
+      return (uint64_t(1) << (i + 1)) * 1e-3;
+    }
+  }
+  return getMax();
+}
+
+double diagnostic_aggregator::LatencyHistogram::getMax() const
+{
+  return max_.load(std::memory_order_relaxed) * 1e-3;
+}
+
+diagnostic_aggregator::AggregatorStats::AggregatorStats()
+: statuses(0), other(0), duplicates(0), match_cache(0), match_cache_evictions(0), other_items(0),
+  other_evictions(0),
+  last_report_(std::chrono::steady_clock::now()), last_statuses_(0), rate_(0.0) {}
+
+void diagnostic_aggregator::AggregatorStats::getValues(
+  std::vector<diagnostic_msgs::msg::KeyValue> & values, bool update_rate)
+{
+  double rate;
+  {
+    std::unique_lock<std::mutex> lock(rate_mutex_);
+    if (update_rate) {
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      double elapsed = std::chrono::duration<double>(now - last_report_).count();
+      uint64_t total = statuses.load(std::memory_order_relaxed);
+      if (elapsed > 0) {
+        rate_ = (total - last_statuses_) / elapsed;
+      }
+      last_report_ = now;
+      last_statuses_ = total;
+    }
+    rate = rate_;
+  }
+
+  addValue(values, "Statuses Received", std::to_string(statuses.load()));
+  addValue(values, "Statuses/s", formatDouble(rate));
+  addValue(values, "Other Statuses", std::to_string(other.load()));
+  addValue(values, "Duplicate Statuses", std::to_string(duplicates.load()));
+  addValue(values, "Match Cache Size", std::to_string(match_cache.load()));
+  addValue(values, "Match Cache Evictions", std::to_string(match_cache_evictions.load()));
+  addValue(values, "Other Items", std::to_string(other_items.load()));
+  addValue(values, "Other Evictions", std::to_string(other_evictions.load()));
+  addLatency(values, "Ingest Lock", ingest_lock);
+  addLatency(values, "Publish", publish);
+}
+
+std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>
+diagnostic_aggregator::AggregatorStats::report(const std::string & name)
+{
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> status =
+    std::make_shared<diagnostic_msgs::msg::DiagnosticStatus>();
+  status->name = name;
+  status->level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+  status->message = "OK";
+  getValues(status->values, true);
+  return status;
+}
+
+std::string diagnostic_aggregator::AggregatorStats::toString()
+{
+  std::vector<diagnostic_msgs::msg::KeyValue> values;
+  getValues(values, false);
+  std::string out;
+  for (unsigned int i = 0; i < values.size(); ++i) {
+    out += values[i].key + ": " + values[i].value + "\n";
+  }
+  return out;
+}
@@ -15,6 +15,7 @@
 #include <iostream>
 #include <iterator>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 #include <memory>
@@ -22,19 +23,34 @@
 #include "rclcpp/node.hpp"
 #include "rclcpp/rclcpp.hpp"
 #include "diagnostic_aggregator/analyzer_group.hpp"
+#include "diagnostic_aggregator/analyzer_params.hpp"
 
 PLUGINLIB_EXPORT_CLASS(diagnostic_aggregator::AnalyzerGroup,
   diagnostic_aggregator::Analyzer)
 
 diagnostic_aggregator::AnalyzerGroup::AnalyzerGroup()
 : path_(""), nice_name_(""),
-  analyzer_loader_("diagnostic_aggregator",
-    "diagnostic_aggregator::Analyzer") {}
+  analyzer_loader_(std::make_shared<pluginlib::ClassLoader<Analyzer>>(
+      "diagnostic_aggregator", "diagnostic_aggregator::Analyzer")) {}
 
 bool diagnostic_aggregator::AnalyzerGroup::init(
   const std::string base_path, const char * nsp,
   const rclcpp::Node::SharedPtr & nh, const char * rnsp)
 {
+  return init(base_path, nsp, nh, rnsp, NULL);
+}
+
+bool diagnostic_aggregator::AnalyzerGroup::init(
+  const std::string base_path, const char * nsp,
+  const rclcpp::Node::SharedPtr & nh, const char * rnsp,
+  const AnalyzerGroup * previous)
+{
+  // Analyzers carried over from previous were created by its loader, which
+  // must outlive them
+  if (previous) {
+    analyzer_loader_ = previous->analyzer_loader_;
+  }
+
   auto context =
     rclcpp::contexts::default_context::get_global_default_context();
   const std::vector<std::string> arguments = {};
@@ -58,21 +74,14 @@ bool diagnostic_aggregator::AnalyzerGroup::init(
   std::string anz_name;
   std::string an_name = nsp;
   analyzers_nh = nh;
-  // Paramter clinet for parameter service
-  rclcpp::SyncParametersClient::SharedPtr parameters_client_analyzer =
-    std::make_shared<rclcpp::SyncParametersClient>(analyzers_nh, nsp);
-  using namespace std::chrono_literals;
-  while (!parameters_client_analyzer->wait_for_service(1s)) {
-    if (!rclcpp::ok()) {
-      RCLCPP_ERROR(analyzers_nh->get_logger(),
-        "Interrupted while waiting for the service. Exiting.");
-      return 0;
-    }
-    RCLCPP_INFO(analyzers_nh->get_logger(),
-      "service not available, waiting again...");
+  // All analyzer parameters are loaded once here, and shared with the
+  // sub-analyzers through params_scope below
+  AnalyzerParamMapConstPtr all_params;
+  if (!loadAnalyzerParams(analyzers_nh, nsp, all_params)) {
+    return false;
   }
+  AnalyzerParamsScope params_scope(nsp, all_params);
 
-  RCLCPP_INFO(analyzers_nh->get_logger(), "service is  available Now ");
   std::stringstream ss;
   std::stringstream ss1;
 
@@ -88,18 +97,17 @@ bool diagnostic_aggregator::AnalyzerGroup::init(
     params_anz = "analyzers_params";
   }
 
-  auto parameters_and_prefixes =
-    parameters_client_analyzer->list_parameters({params_anz}, 10);
   //  Lising parameter for analyzer from yaml file
+  std::string params_prefix = params_anz + ".";
   ss << "\nParameter names:";
-  for (auto & name : parameters_and_prefixes.names) {
-    //  ss << "\n " << name;
-    for (auto & parameter : parameters_client_analyzer->get_parameters({name})) {
-      ss1 << "\nParameter name: " << parameter.get_name();
-      ss1 << "\nParameter value (" << parameter.get_type_name() <<
-        "): " << parameter.value_to_string();
-      anl_param[parameter.get_name()] = parameter.value_to_string();
-    }
+  for (AnalyzerParamMap::const_iterator it =
+    all_params->lower_bound(params_prefix);
+    it != all_params->end() &&
+    it->first.compare(0, params_prefix.size(), params_prefix) == 0; ++it)
+  {
+    ss1 << "\nParameter name: " << it->first;
+    ss1 << "\nParameter value: " << it->second;
+    anl_param[it->first] = it->second;
   }
 
   RCLCPP_INFO(analyzers_nh->get_logger(), ss1.str().c_str());
@@ -111,6 +119,7 @@ bool diagnostic_aggregator::AnalyzerGroup::init(
     std::string ns = anl_it->second;
     std::shared_ptr<Analyzer> analyzer;
     std::string an_type = anl_it->second;
+    std::string config;
     if (std::string::npos != analyzer_name.find("type")) {
       std::string params_anz_ = params_anz + ".";
       std::string p_name = analyzer_name;
@@ -121,13 +130,35 @@ bool diagnostic_aggregator::AnalyzerGroup::init(
       if (std::string::npos != p_name.find("analyzers_params")) {
         continue;
       }
+
+      // Everything under this analyzer's namespace, to detect config changes
+      std::string an_prefix = analyzer_name.substr(0, analyzer_name.rfind(".") + 1);
+      for (AnalyzerParamMap::const_iterator it = all_params->lower_bound(an_prefix);
+        it != all_params->end() &&
+        it->first.compare(0, an_prefix.size(), an_prefix) == 0; ++it)
+      {
+        config += it->first + "=" + it->second + "\n";
+      }
+
+      // Unchanged analyzers are carried over from the previous group with
+      // their state, instead of being created again
+      if (previous) {
+        std::map<std::string, AnalyzerConfig>::const_iterator prev_it =
+          previous->configs_.find(analyzer_name);
+        if (prev_it != previous->configs_.end() && prev_it->second.config == config) {
+          analyzers_.push_back(prev_it->second.analyzer);
+          configs_[analyzer_name] = prev_it->second;
+          continue;
+        }
+      }
+
       try {
         // Look for non-fully qualified class name for Analyzer type
-        if (!analyzer_loader_.isClassAvailable(an_type)) {
+        if (!analyzer_loader_->isClassAvailable(an_type)) {
           bool have_class = false;
-          std::vector<std::string> classes = analyzer_loader_.getDeclaredClasses();
+          std::vector<std::string> classes = analyzer_loader_->getDeclaredClasses();
           for (unsigned int i = 0; i < classes.size(); ++i) {
-            if (an_type == analyzer_loader_.getName(classes[i])) {
+            if (an_type == analyzer_loader_->getName(classes[i])) {
               // if we've found a match... we'll get the fully qualified name
               // and break out of the loop
               ROS_WARN("Analyzer specification should now include the package "
@@ -146,7 +177,7 @@ bool diagnostic_aggregator::AnalyzerGroup::init(
             continue;
           }
         }
-        analyzer = analyzer_loader_.createSharedInstance(an_type);
+        analyzer = analyzer_loader_->createSharedInstance(an_type);
       } catch (pluginlib::LibraryLoadException & e) {
         ROS_ERROR("Failed to load analyzer %s, type %s. Caught exception. %s",
           ns.c_str(), an_type.c_str(), e.what());
@@ -177,6 +208,9 @@ bool diagnostic_aggregator::AnalyzerGroup::init(
       continue;
     }
     analyzers_.push_back(analyzer);
+    AnalyzerConfig & analyzer_config = configs_[analyzer_name];
+    analyzer_config.config = config;
+    analyzer_config.analyzer = analyzer;
   }
   if (analyzers_.size() == 0) {
     init_ok = false;
@@ -210,36 +244,81 @@ bool diagnostic_aggregator::AnalyzerGroup::match(const std::string name)
     return false;
   }
 
-  bool match_name = false;
-  if (matched_.count(name)) {
-    std::vector<bool> & mtch_vec = matched_[name];
-    for (unsigned int i = 0; i < mtch_vec.size(); ++i) {
-      if (mtch_vec[i]) {
-        return true;
-      }
+  const std::vector<bool> * mtch_vec = matched_.find(name);
+  if (!mtch_vec) {
+    std::vector<bool> matches(analyzers_.size());
+    for (unsigned int i = 0; i < analyzers_.size(); ++i) {
+      matches[i] = analyzers_[i]->match(name);
     }
-    return false;
+    mtch_vec = &matched_.insert(name, matches);
   }
 
-  matched_[name].resize(analyzers_.size());
-  for (unsigned int i = 0; i < analyzers_.size(); ++i) {
-    bool mtch = analyzers_[i]->match(name);
-    match_name = mtch || match_name;
-    matched_[name].at(i) = mtch;
+  for (unsigned int i = 0; i < mtch_vec->size(); ++i) {
+    if ((*mtch_vec)[i]) {
+      return true;
+    }
   }
-
-  return match_name;
+  return false;
 }
 
 void diagnostic_aggregator::AnalyzerGroup::resetMatches() {matched_.clear();}
 
+void diagnostic_aggregator::AnalyzerGroup::setMatchCacheSize(size_t size)
+{
+  matched_.setCapacity(size);
+  for (unsigned int i = 0; i < analyzers_.size(); ++i) {
+    AnalyzerGroup * group = dynamic_cast<AnalyzerGroup *>(analyzers_[i].get());
+    if (group) {
+      group->setMatchCacheSize(size);
+    }
+  }
+}
+
+void diagnostic_aggregator::AnalyzerGroup::getMatchedPaths(
+  const std::string & name, std::set<std::string> & paths)
+{
+  const std::vector<bool> * mtch_vec = matched_.peek(name);
+  if (!mtch_vec) {
+    return;
+  }
+  for (unsigned int i = 0; i < mtch_vec->size(); ++i) {
+    if ((*mtch_vec)[i]) {
+      paths.insert(analyzers_[i]->getPath());
+    }
+  }
+}
+
 bool diagnostic_aggregator::AnalyzerGroup::analyze(const std::shared_ptr<StatusItem> item)
 {
+  return dispatch(item, false);
+}
+
+bool diagnostic_aggregator::AnalyzerGroup::refresh(const std::shared_ptr<StatusItem> item)
+{
+  return dispatch(item, true);
+}
+
+bool diagnostic_aggregator::AnalyzerGroup::dispatch(
+  const std::shared_ptr<StatusItem> & item, bool refresh)
+{
+  // match() normally ran just before, and already counted this use of the
+  // name. It may have been evicted since.
+  const std::vector<bool> * mtch_vec = matched_.peek(item->getName());
+  if (!mtch_vec) {
+    if (!match(item->getName())) {
+      return false;
+    }
+    mtch_vec = matched_.peek(item->getName());
+  }
+
   bool analyzed = false;
-  std::vector<bool> & mtch_vec = matched_[item->getName()];
-  for (unsigned int i = 0; i < mtch_vec.size(); ++i) {
-    if (mtch_vec[i]) {
-      analyzed = analyzers_[i]->analyze(item) || analyzed;
+  for (unsigned int i = 0; i < mtch_vec->size(); ++i) {
+    if ((*mtch_vec)[i]) {
+      if (refresh) {
+        analyzed = analyzers_[i]->refresh(item) || analyzed;
+      } else {
+        analyzed = analyzers_[i]->analyze(item) || analyzed;
+      }
     }
   }
 
@@ -318,3 +397,18 @@ diagnostic_aggregator::AnalyzerGroup::report()
 
   return output;
 }
+
+std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
+diagnostic_aggregator::AnalyzerGroup::reportPaths(const std::set<std::string> & paths)
+{
+  std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>> output;
+  for (unsigned int j = 0; j < analyzers_.size(); ++j) {
+    if (!paths.count(analyzers_[j]->getPath())) {
+      continue;
+    }
+    std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>> processed =
+      analyzers_[j]->report();
+    output.insert(output.end(), processed.begin(), processed.end());
+  }
+  return output;
+}
@@ -0,0 +1,106 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "rcl_interfaces/srv/list_parameters.hpp"
+#include "diagnostic_aggregator/analyzer_params.hpp"
+
+namespace
+{
+
+// Per thread, because a scope lives on the stack of the AnalyzerGroup::init()
+// that opened it. An analyzer initialized on another thread sees no scope and
+// loads its parameters itself, which costs a fetch but gives the same values,
+// and it can't see the scope of another thread after that scope is destroyed.
+thread_local diagnostic_aggregator::AnalyzerParamsScope * current_scope = NULL;
+
+const char * const params_prefix = "analyzers_params";
+
+/*
+ *\brief True if nsp names node n, with or without its namespace
+ */
+bool isOwnNode(const rclcpp::Node::SharedPtr & n, const std::string & nsp)
+{
+  std::string name = nsp;
+  if (name.size() > 1 && name[0] == '/' && name.find('/', 1) == std::string::npos) {
+    name = name.substr(1);
+  }
+  return name == n->get_name() || nsp == n->get_fully_qualified_name();
+}
+
+}  // namespace
+
+bool diagnostic_aggregator::loadAnalyzerParams(
+  const rclcpp::Node::SharedPtr & n, const std::string & nsp,
+  AnalyzerParamMapConstPtr & params)
+{
+  params = AnalyzerParamsScope::find(nsp);
+  if (params) {
+    return true;
+  }
+
+  std::vector<rclcpp::Parameter> values;
+  if (isOwnNode(n, nsp)) {
+    auto list = n->list_parameters({params_prefix},
+        rcl_interfaces::srv::ListParameters::Request::DEPTH_RECURSIVE);
+    values = n->get_parameters(list.names);
+  } else {
+    auto parameters_client =
+      std::make_shared<rclcpp::SyncParametersClient>(n, nsp);
+    using namespace std::chrono_literals;
+    while (!parameters_client->wait_for_service(1s)) {
+      if (!rclcpp::ok()) {
+        RCLCPP_ERROR(n->get_logger(),
+          "Interrupted while waiting for the service. Exiting.");
+        return false;
+      }
+      RCLCPP_INFO(n->get_logger(), "service not available, waiting again...");
+    }
+    auto list = parameters_client->list_parameters({params_prefix},
+        rcl_interfaces::srv::ListParameters::Request::DEPTH_RECURSIVE);
+    values = parameters_client->get_parameters(list.names);
+  }
+
+  std::shared_ptr<AnalyzerParamMap> loaded = std::make_shared<AnalyzerParamMap>();
+  for (auto & parameter : values) {
+    (*loaded)[parameter.get_name()] = parameter.value_to_string();
+  }
+  params = loaded;
+  return true;
+}
+
+diagnostic_aggregator::AnalyzerParamsScope::AnalyzerParamsScope(
+  const std::string & nsp, const AnalyzerParamMapConstPtr & params)
+: nsp_(nsp), params_(params), prev_(current_scope)
+{
+  current_scope = this;
+}
+
+diagnostic_aggregator::AnalyzerParamsScope::~AnalyzerParamsScope()
+{
+  current_scope = prev_;
+}
+
+diagnostic_aggregator::AnalyzerParamMapConstPtr
+diagnostic_aggregator::AnalyzerParamsScope::find(const std::string & nsp)
+{
+  for (AnalyzerParamsScope * scope = current_scope; scope; scope = scope->prev_) {
+    if (scope->nsp_ == nsp) {
+      return scope->params_;
+    }
+  }
+  return AnalyzerParamMapConstPtr();
+}
@@ -0,0 +1,339 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <sys/stat.h>
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include <memory>
+#include "diagnostic_aggregator/columnar_exporter.hpp"
+
+namespace
+{
+
+/*
+ *\brief Rows buffered for all columns before they are appended to the files
+ */
+const size_t kBufferLimit = 32 * 1024 * 1024;
+
+bool parseNumber(const std::string & value, double & number)
+{
+  const char * start = value.c_str();
+  char * end = NULL;
+  number = strtod(start, &end);
+  if (end == start) {
+    return false;
+  }
+  while (isspace(static_cast<unsigned char>(*end))) {
+    ++end;
+  }
+  return *end == '\0';
+}
+
+/*
+ *\brief Name or key made safe for a tab separated manifest field
+ */
+std::string manifestField(const std::string & text)
+{
+  std::string out;
+  for (unsigned int i = 0; i < text.size(); ++i) {
+    switch (text[i]) {
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      default:
+        out += text[i];
+    }
+  }
+  return out;
+}
+
+/*
+ *\brief Status name made safe for a directory name
+ */
+std::string directoryName(const std::string & name)
+{
+  std::string out;
+  for (unsigned int i = 0; i < name.size(); ++i) {
+    char c = name[i];
+    out += isalnum(static_cast<unsigned char>(c)) || c == '-' || c == '.' ? c : '_';
+  }
+  if (out.empty() || out[0] == '.') {
+    out = "_" + out;
+  }
+  return out;
+}
+
+}  // namespace
+
+diagnostic_aggregator::ColumnarExporter::ColumnFile::ColumnFile(
+  ColumnarExporter & exporter, const std::string & path)
+: exporter_(exporter), path_(path), created_(false)
+{
+  exporter_.columns_.push_back(this);
+}
+
+void diagnostic_aggregator::ColumnarExporter::ColumnFile::append(
+  const void * data, size_t size)
+{
+  const char * bytes = static_cast<const char *>(data);
+  buffer_.insert(buffer_.end(), bytes, bytes + size);
+  exporter_.buffered(size);
+}
+
+void diagnostic_aggregator::ColumnarExporter::ColumnFile::flush()
+{
+  if (buffer_.empty() && created_) {
+    return;
+  }
+  FILE * file = fopen(path_.c_str(), created_ ? "ab" : "wb");
+  if (!file || fwrite(buffer_.data(), 1, buffer_.size(), file) != buffer_.size()) {
+    exporter_.failed_ = true;
+  }
+  if (file) {
+    fclose(file);
+  }
+  created_ = true;
+  exporter_.buffered_ -= buffer_.size();
+  std::vector<char>().swap(buffer_);
+}
+
+uint32_t diagnostic_aggregator::ColumnarExporter::StringColumn::code(const std::string & value)
+{
+  std::unordered_map<std::string, uint32_t>::iterator it = dictionary.find(value);
+  if (it != dictionary.end()) {
+    return it->second;
+  }
+  uint32_t c = dictionary.size();
+  dictionary[value] = c;
+  return c;
+}
+
+diagnostic_aggregator::ColumnarExporter::ColumnarExporter(
+  const std::string & directory, unsigned int skip)
+: directory_(directory), skip_(skip > 0 ? skip : 1), rows_(0), failed_(false),
+  buffered_(0) {}
+
+diagnostic_aggregator::ColumnarExporter::~ColumnarExporter() {}
+
+bool diagnostic_aggregator::ColumnarExporter::open(std::string & error)
+{
+  if (mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST) {
+    error = "Can't create " + directory_ + ": " + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+void diagnostic_aggregator::ColumnarExporter::buffered(size_t size)
+{
+  buffered_ += size;
+  if (buffered_ < kBufferLimit) {
+    return;
+  }
+  for (unsigned int i = 0; i < columns_.size(); ++i) {
+    columns_[i]->flush();
+  }
+}
+
+diagnostic_aggregator::ColumnarExporter::Item &
+diagnostic_aggregator::ColumnarExporter::getItem(
+  const diagnostic_msgs::msg::DiagnosticStatus & status)
+{
+  std::unordered_map<std::string, std::unique_ptr<Item>>::iterator it =
+    items_.find(status.name);
+  if (it != items_.end()) {
+    it->second->status->update(&status);
+    return *it->second;
+  }
+
+  std::unique_ptr<Item> item(new Item());
+  std::string name = directoryName(status.name);
+  unsigned int & uses = directory_names_[name];
+  if (uses++ > 0) {
+    name += "_" + std::to_string(uses);
+  }
+  item->directory = directory_ + "/" + name;
+  if (mkdir(item->directory.c_str(), 0755) != 0 && errno != EEXIST) {
+    failed_ = true;
+  }
+
+  item->status.reset(new StatusItem(&status));
+  item->seen = 0;
+  item->rows = 0;
+  item->stamps.reset(new ColumnFile(*this, item->directory + "/stamp.bin"));
+  item->levels.reset(new ColumnFile(*this, item->directory + "/level.bin"));
+  item->messages.reset(new StringColumn(*this, item->directory + "/message"));
+  item->hw_ids.reset(new StringColumn(*this, item->directory + "/hardware_id"));
+
+  Item & ref = *item;
+  items_[status.name] = std::move(item);
+  return ref;
+}
+
+void diagnostic_aggregator::ColumnarExporter::add(
+  const diagnostic_msgs::msg::DiagnosticStatus & status, const rclcpp::Time & stamp)
+{
+  Item & item = getItem(status);
+  if (item.seen++ % skip_ == 0) {
+    addRow(item, stamp);
+  }
+}
+
+void diagnostic_aggregator::ColumnarExporter::addRow(Item & item, const rclcpp::Time & stamp)
+{
+  const double nan = std::numeric_limits<double>::quiet_NaN();
+  const StatusItem & status = *item.status;
+  uint64_t row = item.rows;
+
+  item.stamps->append(static_cast<int64_t>(stamp.nanoseconds()));
+  item.levels->append(static_cast<uint8_t>(status.getLevel()));
+  item.messages->codes.append(item.messages->code(status.getMessage()));
+  item.hw_ids->codes.append(item.hw_ids->code(status.getHwId()));
+
+  const std::vector<diagnostic_msgs::msg::KeyValue> & values = status.getValues();
+  for (unsigned int i = 0; i < values.size(); ++i) {
+    std::unordered_map<std::string, size_t>::iterator id = item.value_ids.find(values[i].key);
+    if (id == item.value_ids.end()) {
+      // New key, missing in all earlier rows
+      std::unique_ptr<ValueColumn> column(new ValueColumn());
+      column->key = values[i].key;
+      column->name = "value_" + std::to_string(item.values.size());
+      column->numbers.reset(new ColumnFile(*this, item.directory + "/" + column->name + ".bin"));
+      column->numbers->fill(nan, row);
+      column->row = row;
+      id = item.value_ids.insert(std::make_pair(values[i].key, item.values.size())).first;
+      item.values.push_back(std::move(column));
+    }
+    ValueColumn & column = *item.values[id->second];
+    if (column.row > row) {
+      continue;  // Repeated key, first one wins
+    }
+
+    double number;
+    if (parseNumber(values[i].value, number)) {
+      column.numbers->append(number);
+      if (column.text) {
+        column.text->codes.append(static_cast<uint32_t>(0));
+      }
+    } else {
+      column.numbers->append(nan);
+      if (!column.text) {
+        column.text.reset(new StringColumn(*this, item.directory + "/" + column.name + "_text"));
+        column.text->codes.fill(static_cast<uint32_t>(0), row);
+      }
+      column.text->codes.append(column.text->code(values[i].value) + 1);
+    }
+    column.row = row + 1;
+  }
+
+  // Keys missing from this status
+  for (unsigned int i = 0; i < item.values.size(); ++i) {
+    ValueColumn & column = *item.values[i];
+    if (column.row > row) {
+      continue;
+    }
+    column.numbers->append(nan);
+    if (column.text) {
+      column.text->codes.append(static_cast<uint32_t>(0));
+    }
+    column.row = row + 1;
+  }
+
+  ++item.rows;
+  ++rows_;
+}
+
+bool diagnostic_aggregator::ColumnarExporter::writeDictionary(const StringColumn & column)
+{
+  std::vector<const std::string *> strings(column.dictionary.size());
+  for (const auto & entry : column.dictionary) {
+    strings[entry.second] = &entry.first;
+  }
+
+  FILE * file = fopen(column.dict_path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+  bool ok = true;
+  for (unsigned int i = 0; i < strings.size(); ++i) {
+    uint32_t length = strings[i]->size();
+    ok = ok && fwrite(&length, sizeof(length), 1, file) == 1;
+    ok = ok && fwrite(strings[i]->data(), 1, length, file) == length;
+  }
+  fclose(file);
+  return ok;
+}
+
+bool diagnostic_aggregator::ColumnarExporter::writeManifest(const Item & item)
+{
+  FILE * file = fopen((item.directory + "/columns.txt").c_str(), "w");
+  if (!file) {
+    return false;
+  }
+  fprintf(file, "name\t%s\n", manifestField(item.status->getName()).c_str());
+  fprintf(file, "rows\t%llu\n", static_cast<unsigned long long>(item.rows));
+  fprintf(file, "stamp\tint64\tstamp.bin\n");
+  fprintf(file, "level\tuint8\tlevel.bin\n");
+  fprintf(file, "message\tdict\tmessage.bin\tmessage.dict\n");
+  fprintf(file, "hardware_id\tdict\thardware_id.bin\thardware_id.dict\n");
+  for (unsigned int i = 0; i < item.values.size(); ++i) {
+    const ValueColumn & column = *item.values[i];
+    fprintf(file, "value\t%s\tfloat64\t%s.bin", manifestField(column.key).c_str(),
+      column.name.c_str());
+    if (column.text) {
+      fprintf(file, "\ttext\t%s_text.bin\t%s_text.dict", column.name.c_str(),
+        column.name.c_str());
+    }
+    fprintf(file, "\n");
+  }
+  return fclose(file) == 0;
+}
+
+bool diagnostic_aggregator::ColumnarExporter::finish(std::string & error)
+{
+  for (unsigned int i = 0; i < columns_.size(); ++i) {
+    columns_[i]->flush();
+  }
+
+  for (const auto & entry : items_) {
+    const Item & item = *entry.second;
+    bool ok = writeDictionary(*item.messages) && writeDictionary(*item.hw_ids);
+    for (unsigned int i = 0; i < item.values.size(); ++i) {
+      if (item.values[i]->text) {
+        ok = ok && writeDictionary(*item.values[i]->text);
+      }
+    }
+    if (!ok || !writeManifest(item)) {
+      failed_ = true;
+    }
+  }
+
+  if (failed_) {
+    error = "Failed to write some files in " + directory_;
+    return false;
+  }
+  return true;
+}
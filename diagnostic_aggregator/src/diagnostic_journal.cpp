@@ -0,0 +1,441 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/diagnostic_journal.hpp"
+
+#define ROS_ERROR printf
+
+namespace
+{
+
+const char kMagic[8] = {'D', 'I', 'A', 'G', 'J', 'R', 'N', '1'};
+const char kSuffix[] = ".diagjournal";
+const uint32_t kMaxMessage = 1024;
+
+uint32_t align8(uint32_t n)
+{
+  return (n + 7) & ~7u;
+}
+
+std::string segmentName(const std::string & directory, uint64_t segment)
+{
+  char name[32];
+  snprintf(name, sizeof(name), "%010llu", static_cast<unsigned long long>(segment));
+  return directory + "/" + name + kSuffix;
+}
+
+/*
+ *\brief Sequence number of a segment file, or false if it isn't one
+ */
+bool segmentNumber(const std::string & file, uint64_t & segment)
+{
+  size_t suffix = sizeof(kSuffix) - 1;
+  if (file.size() <= suffix || file.compare(file.size() - suffix, suffix, kSuffix) != 0) {
+    return false;
+  }
+  std::string digits = file.substr(0, file.size() - suffix);
+  if (digits.find_first_not_of("0123456789") != std::string::npos) {
+    return false;
+  }
+  segment = strtoull(digits.c_str(), NULL, 10);
+  return true;
+}
+
+/*
+ *\brief Record at offset, or NULL if it isn't a complete record of the segment
+ */
+const diagnostic_aggregator::JournalRecord * recordAt(
+  const char * data, size_t end, uint32_t offset)
+{
+  if (offset < sizeof(diagnostic_aggregator::JournalSegmentHeader) ||
+    offset + sizeof(diagnostic_aggregator::JournalRecord) > end)
+  {
+    return NULL;
+  }
+  const diagnostic_aggregator::JournalRecord * record =
+    reinterpret_cast<const diagnostic_aggregator::JournalRecord *>(data + offset);
+  if (record->size < sizeof(diagnostic_aggregator::JournalRecord) ||
+    offset + record->size > end ||
+    sizeof(diagnostic_aggregator::JournalRecord) + record->length > record->size)
+  {
+    return NULL;
+  }
+  return record;
+}
+
+std::string recordText(const diagnostic_aggregator::JournalRecord * record)
+{
+  return std::string(reinterpret_cast<const char *>(record + 1), record->length);
+}
+
+}  // namespace
+
+bool diagnostic_aggregator::listJournalSegments(
+  const std::string & directory, std::vector<std::string> & segments)
+{
+  DIR * dir = opendir(directory.c_str());
+  if (!dir) {
+    return false;
+  }
+  std::vector<std::pair<uint64_t, std::string>> found;
+  struct dirent * entry;
+  while ((entry = readdir(dir)) != NULL) {
+    uint64_t segment;
+    if (segmentNumber(entry->d_name, segment)) {
+      found.push_back(std::make_pair(segment, directory + "/" + entry->d_name));
+    }
+  }
+  closedir(dir);
+
+  std::sort(found.begin(), found.end());
+  for (unsigned int i = 0; i < found.size(); ++i) {
+    segments.push_back(found[i].second);
+  }
+  return true;
+}
+
+diagnostic_aggregator::DiagnosticJournal::DiagnosticJournal(
+  const std::string & directory, size_t segment_size, size_t max_segments)
+: directory_(directory), segment_size_(segment_size),
+  max_segments_(std::max<size_t>(max_segments, 1)), segment_(0), fd_(-1), data_(NULL)
+{
+  // Offsets are 32 bits
+  segment_size_ = std::min<size_t>(segment_size_, 0x7fffffff);
+  segment_size_ = std::max<size_t>(segment_size_, 64 * 1024);
+}
+
+diagnostic_aggregator::DiagnosticJournal::~DiagnosticJournal()
+{
+  closeSegment();
+}
+
+bool diagnostic_aggregator::DiagnosticJournal::open(std::string & error)
+{
+  if (mkdir(directory_.c_str(), 0755) != 0 && errno != EEXIST) {
+    error = "Can't create journal directory " + directory_ + ": " + strerror(errno);
+    return false;
+  }
+
+  std::vector<std::string> existing;
+  if (!listJournalSegments(directory_, existing)) {
+    error = "Can't read journal directory " + directory_ + ": " + strerror(errno);
+    return false;
+  }
+  for (unsigned int i = 0; i < existing.size(); ++i) {
+    segments_.push_back(existing[i]);
+  }
+  if (!existing.empty()) {
+    std::string last = existing.back().substr(existing.back().rfind('/') + 1);
+    segmentNumber(last, segment_);
+    ++segment_;
+  }
+
+  if (!openSegment()) {
+    error = "Can't create journal segment in " + directory_ + ": " + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool diagnostic_aggregator::DiagnosticJournal::openSegment()
+{
+  std::string path = segmentName(directory_, segment_);
+  fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+  if (ftruncate(fd_, segment_size_) != 0) {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  void * data = mmap(NULL, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    ::close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  data_ = static_cast<char *>(data);
+
+  JournalSegmentHeader * header = reinterpret_cast<JournalSegmentHeader *>(data_);
+  memcpy(header->magic, kMagic, sizeof(kMagic));
+  header->size = segment_size_;
+  header->end = sizeof(JournalSegmentHeader);
+  header->first_stamp = 0;
+  header->last_stamp = 0;
+  header->index = 0;
+  header->item_count = 0;
+  index_.clear();
+
+  segments_.push_back(path);
+  while (segments_.size() > max_segments_) {
+    unlink(segments_.front().c_str());
+    segments_.pop_front();
+  }
+  return true;
+}
+
+void diagnostic_aggregator::DiagnosticJournal::closeSegment()
+{
+  if (!data_) {
+    return;
+  }
+
+  JournalSegmentHeader * header = reinterpret_cast<JournalSegmentHeader *>(data_);
+  uint32_t index = header->end;
+  memcpy(data_ + index, index_.data(), index_.size() * sizeof(JournalIndexEntry));
+  header->item_count = index_.size();
+  std::atomic_thread_fence(std::memory_order_release);
+  header->index = index;
+  uint32_t used = index + index_.size() * sizeof(JournalIndexEntry);
+
+  msync(data_, segment_size_, MS_ASYNC);
+  munmap(data_, segment_size_);
+  data_ = NULL;
+  if (ftruncate(fd_, used) != 0) {
+    ROS_ERROR("Failed to truncate journal segment %s\n", segments_.back().c_str());
+  }
+  ::close(fd_);
+  fd_ = -1;
+
+  // Items without a transition in the closed segment are forgotten, so
+  // items_ holds at most the items of two segments
+  std::unordered_map<std::string, Item>::iterator it = items_.begin();
+  while (it != items_.end()) {
+    if (it->second.segment != segment_) {
+      it = items_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  ++segment_;
+}
+
+uint32_t diagnostic_aggregator::DiagnosticJournal::append(
+  uint8_t type, uint16_t item, uint8_t level, int64_t stamp, uint32_t prev,
+  const char * text, uint32_t length)
+{
+  JournalSegmentHeader * header = reinterpret_cast<JournalSegmentHeader *>(data_);
+  uint32_t offset = header->end;
+  uint32_t size = align8(sizeof(JournalRecord) + length);
+
+  JournalRecord * record = reinterpret_cast<JournalRecord *>(data_ + offset);
+  record->item = item;
+  record->type = type;
+  record->level = level;
+  record->stamp = stamp;
+  record->prev = prev;
+  record->length = length;
+  memcpy(record + 1, text, length);
+
+  // The size is set last, so a reader never sees a partial record
+  std::atomic_thread_fence(std::memory_order_release);
+  record->size = size;
+
+  header->end = offset + size;
+  if (header->first_stamp == 0) {
+    header->first_stamp = stamp;
+  }
+  header->last_stamp = stamp;
+  return offset;
+}
+
+void diagnostic_aggregator::DiagnosticJournal::record(
+  const diagnostic_msgs::msg::DiagnosticStatus & status,
+  const rclcpp::Time & stamp)
+{
+  if (!data_) {
+    return;
+  }
+
+  size_t message_hash = std::hash<std::string>()(status.message);
+  std::unordered_map<std::string, Item>::iterator it = items_.find(status.name);
+  if (it != items_.end() && it->second.level == status.level &&
+    it->second.message_hash == message_hash)
+  {
+    return;
+  }
+
+  uint32_t name_length = std::min<size_t>(status.name.size(), kMaxMessage);
+  uint32_t message_length = std::min<size_t>(status.message.size(), kMaxMessage);
+
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    bool defined = it != items_.end() && it->second.segment == segment_;
+    uint32_t needed = align8(sizeof(JournalRecord) + message_length) +
+      sizeof(JournalIndexEntry) * index_.size();
+    if (!defined) {
+      needed += align8(sizeof(JournalRecord) + name_length) + sizeof(JournalIndexEntry);
+    }
+
+    JournalSegmentHeader * header = reinterpret_cast<JournalSegmentHeader *>(data_);
+    if (header->end + needed > segment_size_ || (!defined && index_.size() > 0xffff)) {
+      if (attempt > 0) {
+        return;
+      }
+      closeSegment();
+      if (!openSegment()) {
+        ROS_ERROR("Failed to start journal segment in %s, journal disabled\n",
+          directory_.c_str());
+        return;
+      }
+      // closeSegment() forgets items
+      it = items_.find(status.name);
+      continue;
+    }
+
+    if (it == items_.end()) {
+      it = items_.insert(std::make_pair(status.name, Item())).first;
+    }
+    Item & item = it->second;
+    if (!defined) {
+      item.segment = segment_;
+      item.id = index_.size();
+      JournalIndexEntry entry;
+      entry.name = append(Record_Name, item.id, 0, stamp.nanoseconds(), 0,
+          status.name.data(), name_length);
+      entry.last = 0;
+      index_.push_back(entry);
+    }
+
+    JournalIndexEntry & entry = index_[item.id];
+    entry.last = append(Record_Transition, item.id, status.level, stamp.nanoseconds(),
+        entry.last, status.message.data(), message_length);
+
+    // Only a written transition is compared against
+    item.level = status.level;
+    item.message_hash = message_hash;
+    return;
+  }
+}
+
+diagnostic_aggregator::JournalReader::JournalReader(const std::string & directory)
+: directory_(directory) {}
+
+bool diagnostic_aggregator::JournalReader::read(
+  int64_t start, int64_t end, const std::string & item,
+  std::vector<Entry> & entries, std::string & error) const
+{
+  std::vector<std::string> segments;
+  if (!listJournalSegments(directory_, segments)) {
+    error = "Can't read journal directory " + directory_ + ": " + strerror(errno);
+    return false;
+  }
+
+  for (unsigned int i = 0; i < segments.size(); ++i) {
+    int fd = ::open(segments[i].c_str(), O_RDONLY);
+    if (fd < 0) {
+      continue;  // Rotated away since listing
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(JournalSegmentHeader)) {
+      ::close(fd);
+      continue;
+    }
+    void * data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      continue;
+    }
+    readSegment(static_cast<const char *>(data), st.st_size, start, end, item, entries);
+    munmap(data, st.st_size);
+  }
+  return true;
+}
+
+void diagnostic_aggregator::JournalReader::readSegment(
+  const char * data, size_t size, int64_t start, int64_t end,
+  const std::string & item, std::vector<Entry> & entries) const
+{
+  const JournalSegmentHeader * header = reinterpret_cast<const JournalSegmentHeader *>(data);
+  if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 || header->first_stamp == 0 ||
+    header->last_stamp < start || header->first_stamp > end)
+  {
+    return;
+  }
+  size_t records_end = std::min<size_t>(header->end, size);
+
+  // Closed segment and a single item: follow its chain from the index
+  size_t index_end = header->index + header->item_count * sizeof(JournalIndexEntry);
+  if (!item.empty() && header->index != 0 && index_end <= size) {
+    const JournalIndexEntry * index =
+      reinterpret_cast<const JournalIndexEntry *>(data + header->index);
+    for (uint32_t id = 0; id < header->item_count; ++id) {
+      const JournalRecord * name = recordAt(data, records_end, index[id].name);
+      if (!name || name->length != item.size() ||
+        memcmp(name + 1, item.data(), item.size()) != 0)
+      {
+        continue;
+      }
+      size_t first = entries.size();
+      const JournalRecord * record = recordAt(data, records_end, index[id].last);
+      while (record && record->stamp >= start) {
+        if (record->stamp <= end) {
+          Entry entry;
+          entry.stamp = record->stamp;
+          entry.level = record->level;
+          entry.name = item;
+          entry.message = recordText(record);
+          entries.push_back(entry);
+        }
+        record = record->prev ? recordAt(data, records_end, record->prev) : NULL;
+      }
+      std::reverse(entries.begin() + first, entries.end());
+      return;
+    }
+    return;
+  }
+
+  // Scan the record headers. Crashed segments have no index, and end at the
+  // last complete record.
+  std::vector<std::string> names;
+  uint32_t offset = sizeof(JournalSegmentHeader);
+  const JournalRecord * record;
+  while ((record = recordAt(data, records_end, offset)) != NULL) {
+    offset += record->size;
+    if (record->type == Record_Name) {
+      if (record->item >= names.size()) {
+        names.resize(record->item + 1);
+      }
+      names[record->item] = recordText(record);
+      continue;
+    }
+    if (record->stamp < start || record->stamp > end || record->item >= names.size()) {
+      continue;
+    }
+    const std::string & name = names[record->item];
+    if (!item.empty() && name != item) {
+      continue;
+    }
+    Entry entry;
+    entry.stamp = record->stamp;
+    entry.level = record->level;
+    entry.name = name;
+    entry.message = recordText(record);
+    entries.push_back(entry);
+  }
+}
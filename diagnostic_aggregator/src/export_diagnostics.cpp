@@ -0,0 +1,120 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**< \author Exports the diagnostics of a bag to per-item column files */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include "diagnostic_aggregator/columnar_exporter.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "rmw/rmw.h"
+#include "rosbag2/sequential_reader.hpp"
+#include "rosidl_typesupport_cpp/message_type_support.hpp"
+
+void usage()
+{
+  fprintf(stderr,
+    "Usage: export_diagnostics BAG OUTPUT_DIR [-s SKIP] [-t TOPIC]\n"
+    "  SKIP : Keep every SKIP-th status of each item. Default 1\n"
+    "  TOPIC : Diagnostics topic. Default /diagnostics\n");
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc < 3) {
+    usage();
+    return 1;
+  }
+
+  std::string bag = argv[1];
+  std::string output = argv[2];
+  unsigned int skip = 1;
+  std::string topic = "/diagnostics";
+  for (int i = 3; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (strcmp(argv[i], "-s") == 0) {
+      skip = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-t") == 0) {
+      topic = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  diagnostic_aggregator::ColumnarExporter exporter(output, skip);
+  std::string error;
+  if (!exporter.open(error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  rosbag2::StorageOptions storage_options;
+  storage_options.uri = bag;
+  storage_options.storage_id = "sqlite3";
+  rosbag2::ConverterOptions converter_options;
+  converter_options.input_serialization_format = "cdr";
+  converter_options.output_serialization_format = "cdr";
+
+  rosbag2::SequentialReader reader;
+  try {
+    reader.open(storage_options, converter_options);
+  } catch (const std::exception & e) {
+    fprintf(stderr, "Failed to open %s: %s\n", bag.c_str(), e.what());
+    return 1;
+  }
+
+  const rosidl_message_type_support_t * type_support =
+    rosidl_typesupport_cpp::get_message_type_support_handle<
+    diagnostic_msgs::msg::DiagnosticArray>();
+
+  // One message at a time, so memory doesn't depend on the size of the bag
+  diagnostic_msgs::msg::DiagnosticArray msg;
+  uint64_t messages = 0;
+  while (reader.has_next()) {
+    std::shared_ptr<rosbag2::SerializedBagMessage> bag_message = reader.read_next();
+    if (bag_message->topic_name != topic) {
+      continue;
+    }
+    if (rmw_deserialize(bag_message->serialized_data.get(), type_support, &msg) != RMW_RET_OK) {
+      fprintf(stderr, "Failed to deserialize a message, skipping it\n");
+      continue;
+    }
+
+    // Bag time if the publisher didn't stamp the array
+    rclcpp::Time stamp(msg.header.stamp, RCL_ROS_TIME);
+    if (stamp.nanoseconds() == 0) {
+      stamp = rclcpp::Time(bag_message->time_stamp, RCL_ROS_TIME);
+    }
+    for (unsigned int i = 0; i < msg.status.size(); ++i) {
+      exporter.add(msg.status[i], stamp);
+    }
+    ++messages;
+  }
+
+  if (!exporter.finish(error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+  printf("Exported %llu rows from %llu messages to %s\n",
+    static_cast<unsigned long long>(exporter.getRows()),
+    static_cast<unsigned long long>(messages), output.c_str());
+  return 0;
+}
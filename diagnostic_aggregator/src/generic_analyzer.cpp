@@ -15,6 +15,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include "diagnostic_aggregator/analyzer_params.hpp"
 #include "diagnostic_aggregator/generic_analyzer.hpp"
 
 PLUGINLIB_EXPORT_CLASS(diagnostic_aggregator::GenericAnalyzer,
@@ -40,36 +41,12 @@ bool diagnostic_aggregator::GenericAnalyzer::init(
 
   gen_nh = n;
   std::string nice_name;
-  auto parameters_client =
-    std::make_shared<rclcpp::SyncParametersClient>(gen_nh, nsp);
-  using namespace std::chrono_literals;
-  while (!parameters_client->wait_for_service(1s)) {
-    if (!rclcpp::ok()) {
-      RCLCPP_ERROR(gen_nh->get_logger(),
-        "Interrupted while waiting for the service. Exiting.");
-      return 0;
-    }
-    RCLCPP_INFO(gen_nh->get_logger(),
-      "service not available, waiting again...");
-  }
-  std::stringstream ss;
-  std::stringstream ss1;
-  std::map<std::string, std::string> anl_param;
-
-  auto parameters_and_prefixes =
-    parameters_client->list_parameters({gen_an_name}, 10);
-
-  ss << "\nParameter names:";
-  for (auto & name : parameters_and_prefixes.names) {
-    //  ss << "\n " << name;
-    for (auto & parameter : parameters_client->get_parameters({name})) {
-      ss1 << "\nParameter name: " << parameter.get_name();
-      ss1 << "\nParameter value (" << parameter.get_type_name() <<
-        "): " << parameter.value_to_string();
-      anl_param[parameter.get_name()] = parameter.value_to_string();
-    }
+  AnalyzerParamMapConstPtr params;
+  if (!loadAnalyzerParams(gen_nh, nsp, params)) {
+    return false;
   }
-  std::map<std::string, std::string>::iterator anl_it;
+  const AnalyzerParamMap & anl_param = *params;
+  AnalyzerParamMap::const_iterator anl_it;
   anl_it = anl_param.find(gen_an_name + ".path");
   if (anl_it != anl_param.end()) {
     nice_name = anl_it->second;
@@ -120,7 +97,9 @@ bool diagnostic_aggregator::GenericAnalyzer::init(
     for (unsigned int i = 0; i < expected_.size(); ++i) {
       std::shared_ptr<StatusItem> item(new StatusItem(expected_[i]));
       addItem(expected_[i], item);
+      expected_index_[expected_[i]] = i;
     }
+    expected_present_.assign(expected_.size(), true);
   }
 
   anl_it = anl_param.find(gen_an_name + ".regex");
@@ -129,20 +108,23 @@ bool diagnostic_aggregator::GenericAnalyzer::init(
     std::vector<std::string> regex_strs;
     getParamVals(regexes, regex_strs);
 
+    std::string error;
     for (unsigned int i = 0; i < regex_strs.size(); ++i) {
-      try {
-        std::regex re(regex_strs[i]);
-        regex_.push_back(re);
-      } catch (std::regex_error & e) {
-        ROS_ERROR("Attempted to make regex from %s. Caught exception, ignoring "
-          "value. Exception: %s",
-          regex_strs[i].c_str(), e.what());
+      if (!regex_.add(regex_strs[i], error)) {
+        ROS_ERROR("GenericAnalyzer %s: regex %s is unsupported: %s\n",
+          nice_name.c_str(), regex_strs[i].c_str(), error.c_str());
+        return false;
       }
     }
+    if (!regex_.empty() && !regex_.compile(error)) {
+      ROS_ERROR("GenericAnalyzer %s: regexes can't be compiled: %s\n",
+        nice_name.c_str(), error.c_str());
+      return false;
+    }
   }
 
   if (startswith_.size() == 0 && name_.size() == 0 && contains_.size() == 0 &&
-    expected_.size() == 0 && regex_.size() == 0)
+    expected_.size() == 0 && regex_.empty())
   {
     ROS_ERROR("GenericAnalyzer was not initialized with any way of checking "
       "diagnostics. Name: %s, namespace:",
@@ -150,6 +132,20 @@ bool diagnostic_aggregator::GenericAnalyzer::init(
     return false;
   }
 
+  for (unsigned int i = 0; i < expected_.size(); ++i) {
+    matcher_.addExact(expected_[i]);
+  }
+  for (unsigned int i = 0; i < name_.size(); ++i) {
+    matcher_.addExact(name_[i]);
+  }
+  for (unsigned int i = 0; i < startswith_.size(); ++i) {
+    matcher_.addPrefix(startswith_[i]);
+  }
+  for (unsigned int i = 0; i < contains_.size(); ++i) {
+    matcher_.addContains(contains_[i]);
+  }
+  matcher_.build();
+
   // convert chaff_ to output name format. Fixes #17
   for (size_t i = 0; i < chaff_.size(); i++) {
     chaff_[i] = getOutputName(chaff_[i]);
@@ -191,46 +187,59 @@ bool diagnostic_aggregator::GenericAnalyzer::init(
   if (my_path.find("/") != 0) {
     my_path = "/" + my_path;
   }
-  return GenericAnalyzerBase::init_v(my_path, nice_name, timeout,
-           num_items_expected, discard_stale);
+  if (!GenericAnalyzerBase::init_v(my_path, nice_name, timeout,
+    num_items_expected, discard_stale))
+  {
+    return false;
+  }
+
+  expected_status_names_.clear();
+  for (unsigned int i = 0; i < expected_.size(); ++i) {
+    expected_status_names_.push_back(getStatusName(expected_[i]));
+  }
+  return true;
 }
 
 diagnostic_aggregator::GenericAnalyzer::~GenericAnalyzer() {}
 
-bool diagnostic_aggregator::GenericAnalyzer::match(const std::string name)
+bool diagnostic_aggregator::GenericAnalyzer::analyze(const std::shared_ptr<StatusItem> item)
 {
-  std::cmatch what;
-  for (unsigned int i = 0; i < regex_.size(); ++i) {
-    if (std::regex_match(name.c_str(), what, regex_[i])) {
-      return true;
+  if (!expected_index_.empty()) {
+    std::unordered_map<std::string, size_t>::const_iterator it =
+      expected_index_.find(item->getName());
+    if (it != expected_index_.end()) {
+      expected_present_[it->second] = true;
     }
   }
+  return GenericAnalyzerBase::analyze(item);
+}
 
-  for (unsigned int i = 0; i < expected_.size(); ++i) {
-    if (name == expected_[i]) {
-      return true;
-    }
-  }
+std::string diagnostic_aggregator::GenericAnalyzer::getStatusName(const std::string & name) const
+{
+  std::string status_name = GenericAnalyzerBase::getStatusName(name);
 
-  for (unsigned int i = 0; i < name_.size(); ++i) {
-    if (name == name_[i]) {
-      return true;
-    }
+  // Remove all leading name chaff
+  for (unsigned int i = 0; i < chaff_.size(); ++i) {
+    status_name = removeLeadingNameChaff(status_name, chaff_[i]);
   }
+  return status_name;
+}
 
-  for (unsigned int i = 0; i < startswith_.size(); ++i) {
-    if (name.find(startswith_[i]) == 0) {
-      return true;
-    }
+void diagnostic_aggregator::GenericAnalyzer::itemRemoved(const std::string & name)
+{
+  std::unordered_map<std::string, size_t>::const_iterator it = expected_index_.find(name);
+  if (it != expected_index_.end()) {
+    expected_present_[it->second] = false;
   }
+}
 
-  for (unsigned int i = 0; i < contains_.size(); ++i) {
-    if (name.find(contains_[i]) != std::string::npos) {
-      return true;
-    }
+bool diagnostic_aggregator::GenericAnalyzer::match(const std::string name)
+{
+  if (regex_.match(name)) {
+    return true;
   }
 
-  return false;
+  return matcher_.match(name);
 }
 
 std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
@@ -240,33 +249,15 @@ diagnostic_aggregator::GenericAnalyzer::report()
     GenericAnalyzerBase::report();
 
   // Check and make sure our expected names haven't been removed ...
-  std::vector<std::string> expected_names_missing;
-  bool has_name = false;
-
-  for (unsigned int i = 0; i < expected_.size(); ++i) {
-    has_name = false;
-    for (unsigned int j = 0; j < processed.size(); ++j) {
-      size_t last_slash = processed[j]->name.rfind("/");
-      std::string nice_name = processed[j]->name.substr(last_slash + 1);
-      if (nice_name == expected_[i] ||
-        nice_name == getOutputName(expected_[i]))
-      {
-        has_name = true;
-        break;
-      }
-
-      // Remove chaff, check names
-      for (unsigned int k = 0; k < chaff_.size(); ++k) {
-        if (nice_name == removeLeadingNameChaff(expected_[i], chaff_[k])) {
-          has_name = true;
-          break;
-        }
-      }
-    }
-    if (!has_name) {
-      expected_names_missing.push_back(expected_[i]);
+  std::vector<size_t> expected_missing;
+  for (size_t i = 0; i < expected_present_.size(); ++i) {
+    if (!expected_present_[i]) {
+      expected_missing.push_back(i);
     }
   }
+  if (expected_missing.empty() || processed.empty()) {
+    return processed;
+  }
 
   // Check that all processed items aren't stale
   bool all_stale = true;
@@ -276,37 +267,29 @@ diagnostic_aggregator::GenericAnalyzer::report()
     }
   }
 
-  // Add missing names to header ...
-  for (unsigned int i = 0; i < expected_names_missing.size(); ++i) {
-    std::shared_ptr<StatusItem> item(new StatusItem(expected_names_missing[i]));
-    processed.push_back(item->toStatusMsg(path_, true));
+  // If we're missing any items, set the header status to error or stale
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> header_status = processed[0];
+  if (!all_stale) {
+    header_status->level = 2;
+    header_status->message = "Error";
+  } else {
+    header_status->level = 3;
+    header_status->message = "All Stale";
   }
 
-  for (unsigned int j = 0; j < processed.size(); ++j) {
-    // Remove all leading name chaff
-    for (unsigned int i = 0; i < chaff_.size(); ++i) {
-      processed[j]->name =
-        removeLeadingNameChaff(processed[j]->name, chaff_[i]);
-    }
-
-    // If we're missing any items, set the header status to error or stale
-    if (expected_names_missing.size() > 0 && processed[j]->name == path_) {
-      if (!all_stale) {
-        processed[j]->level = 2;
-        processed[j]->message = "Error";
-      } else {
-        processed[j]->level = 3;
-        processed[j]->message = "All Stale";
-      }
-
-      // Add all missing items to header item
-      for (unsigned int k = 0; k < expected_names_missing.size(); ++k) {
-        diagnostic_msgs::msg::KeyValue kv;
-        kv.key = expected_names_missing[k];
-        kv.value = "Missing";
-        processed[j]->values.push_back(kv);
-      }
-    }
+  // Add missing names to header ...
+  for (size_t k = 0; k < expected_missing.size(); ++k) {
+    std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> missing(
+      new diagnostic_msgs::msg::DiagnosticStatus());
+    missing->name = expected_status_names_[expected_missing[k]];
+    missing->level = Level_Stale;
+    missing->message = "Missing";
+    processed.push_back(missing);
+
+    diagnostic_msgs::msg::KeyValue kv;
+    kv.key = expected_[expected_missing[k]];
+    kv.value = "Missing";
+    header_status->values.push_back(kv);
   }
 
   return processed;
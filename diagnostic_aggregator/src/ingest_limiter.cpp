@@ -0,0 +1,215 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <memory>
+#include "diagnostic_aggregator/ingest_limiter.hpp"
+
+namespace
+{
+
+// Item levels kept per source for downsampling. Beyond it they are forgotten,
+// and the next status of each item is admitted as a level change.
+const size_t kMaxLevels = 10000;
+
+}  // namespace
+
+diagnostic_aggregator::IngestLimiter::IngestLimiter(
+  Key key, double rate, double burst, Action action, size_t max_sources)
+: key_(key), rate_(std::max(rate, 0.0)), burst_(std::max(burst, 1.0)), action_(action),
+  max_sources_(std::max<size_t>(max_sources, 1)),
+  last_report_(std::chrono::steady_clock::now()), dropped_(0) {}
+
+std::string diagnostic_aggregator::IngestLimiter::getSourceName(const std::string & name)
+{
+  std::string::size_type colon = name.find(':');
+  if (colon == std::string::npos) {
+    return std::string();
+  }
+  return name.substr(0, colon);
+}
+
+diagnostic_aggregator::IngestLimiter::Source &
+diagnostic_aggregator::IngestLimiter::getSource(
+  const std::string & key, std::chrono::steady_clock::time_point now)
+{
+  std::unordered_map<std::string, Source>::iterator it = sources_.find(key);
+  if (it != sources_.end()) {
+    Source & source = it->second;
+    double elapsed = std::chrono::duration<double>(now - source.last_seen).count();
+    source.tokens = std::min(burst_, source.tokens + elapsed * rate_);
+    source.last_seen = now;
+    lru_.splice(lru_.end(), lru_, source.lru);
+    return source;
+  }
+
+  if (sources_.size() >= max_sources_) {
+    sources_.erase(lru_.front());
+    lru_.pop_front();
+  }
+
+  Source & source = sources_[key];
+  source.lru = lru_.insert(lru_.end(), key);
+  source.tokens = burst_;
+  source.last_seen = now;
+  source.received = 0;
+  source.dropped = 0;
+  source.reported_received = 0;
+  source.reported_dropped = 0;
+  return source;
+}
+
+bool diagnostic_aggregator::IngestLimiter::admit(
+  Source & source, const diagnostic_msgs::msg::DiagnosticStatus & status)
+{
+  ++source.received;
+  bool admitted = true;
+  if (rate_ > 0) {
+    if (source.tokens >= 1.0) {
+      source.tokens -= 1.0;
+    } else {
+      admitted = false;
+    }
+  }
+
+  if (action_ == Action_Downsample) {
+    if (source.levels.size() >= kMaxLevels) {
+      source.levels.clear();
+    }
+    std::pair<std::unordered_map<std::string, uint8_t>::iterator, bool> level =
+      source.levels.insert(std::make_pair(status.name, status.level));
+    if (!admitted && (level.second || level.first->second != status.level)) {
+      admitted = true;
+    }
+    if (admitted) {
+      level.first->second = status.level;
+    }
+  }
+
+  if (!admitted) {
+    ++source.dropped;
+  }
+  return admitted;
+}
+
+size_t diagnostic_aggregator::IngestLimiter::filter(
+  const diagnostic_msgs::msg::DiagnosticArray & msg, const std::string & publisher,
+  std::vector<bool> & admitted)
+{
+  admitted.assign(msg.status.size(), true);
+  size_t dropped = 0;
+  std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (key_ == Key_Publisher) {
+    Source & source = getSource(publisher, now);
+    for (size_t i = 0; i < msg.status.size(); ++i) {
+      if (!admit(source, msg.status[i])) {
+        admitted[i] = false;
+        ++dropped;
+      }
+    }
+  } else {
+    // Statuses of a message usually come from one node, so the last source is
+    // reused while the name prefix doesn't change
+    std::string last_key;
+    Source * source = NULL;
+    for (size_t i = 0; i < msg.status.size(); ++i) {
+      std::string key = getSourceName(msg.status[i].name);
+      if (!source || key != last_key) {
+        source = &getSource(key, now);
+        last_key.swap(key);
+      }
+      if (!admit(*source, msg.status[i])) {
+        admitted[i] = false;
+        ++dropped;
+      }
+    }
+  }
+  lock.unlock();
+
+  dropped_.fetch_add(dropped, std::memory_order_relaxed);
+  return dropped;
+}
+
+std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>
+diagnostic_aggregator::IngestLimiter::report(const std::string & name, size_t top)
+{
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> status =
+    std::make_shared<diagnostic_msgs::msg::DiagnosticStatus>();
+  status->name = name;
+
+  struct Rate
+  {
+    double rate;
+    uint64_t dropped;
+    std::string name;
+    bool operator<(const Rate & other) const {return rate > other.rate;}
+  };
+  std::vector<Rate> rates;
+  size_t limited = 0;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - last_report_).count();
+    last_report_ = now;
+
+    rates.reserve(sources_.size());
+    std::unordered_map<std::string, Source>::iterator it;
+    for (it = sources_.begin(); it != sources_.end(); ++it) {
+      Source & source = it->second;
+      Rate rate;
+      rate.rate = elapsed > 0 ? (source.received - source.reported_received) / elapsed : 0.0;
+      rate.dropped = source.dropped - source.reported_dropped;
+      rate.name = it->first;
+      if (rate.dropped > 0) {
+        ++limited;
+      }
+      rates.push_back(rate);
+      source.reported_received = source.received;
+      source.reported_dropped = source.dropped;
+    }
+  }
+
+  top = std::min(top, rates.size());
+  std::partial_sort(rates.begin(), rates.begin() + top, rates.end());
+
+  if (limited > 0) {
+    status->level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+    status->message = std::to_string(limited) + " sources limited";
+  } else {
+    status->level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+    status->message = "OK";
+  }
+
+  diagnostic_msgs::msg::KeyValue kv;
+  kv.key = "Sources";
+  kv.value = std::to_string(rates.size());
+  status->values.push_back(kv);
+  kv.key = "Dropped Statuses";
+  kv.value = std::to_string(getDropped());
+  status->values.push_back(kv);
+  for (size_t i = 0; i < top; ++i) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "%.1f/s, %llu dropped", rates[i].rate,
+      static_cast<unsigned long long>(rates[i].dropped));
+    kv.key = rates[i].name.empty() ? "(no prefix)" : rates[i].name;
+    kv.value = buf;
+    status->values.push_back(kv);
+  }
+  return status;
+}
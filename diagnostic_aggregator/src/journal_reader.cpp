@@ -0,0 +1,77 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**< \author Prints the transitions recorded by the aggregator journal */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/diagnostic_journal.hpp"
+
+void usage()
+{
+  fprintf(stderr,
+    "Usage: journal_reader DIRECTORY [-s START] [-e END] [-i ITEM]\n"
+    "  START, END : ROS time in seconds\n"
+    "  ITEM : Only print this status name\n");
+}
+
+int main(int argc, char ** argv)
+{
+  if (argc < 2) {
+    usage();
+    return 1;
+  }
+
+  std::string directory = argv[1];
+  int64_t start = std::numeric_limits<int64_t>::min();
+  int64_t end = std::numeric_limits<int64_t>::max();
+  std::string item;
+  for (int i = 2; i < argc; ++i) {
+    if (i + 1 >= argc) {
+      usage();
+      return 1;
+    }
+    if (strcmp(argv[i], "-s") == 0) {
+      start = static_cast<int64_t>(atof(argv[++i]) * 1e9);
+    } else if (strcmp(argv[i], "-e") == 0) {
+      end = static_cast<int64_t>(atof(argv[++i]) * 1e9);
+    } else if (strcmp(argv[i], "-i") == 0) {
+      item = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  diagnostic_aggregator::JournalReader reader(directory);
+  std::vector<diagnostic_aggregator::JournalReader::Entry> entries;
+  std::string error;
+  if (!reader.read(start, end, item, entries, error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 1;
+  }
+
+  const char * levels[] = {"OK", "WARN", "ERROR", "STALE"};
+  for (unsigned int i = 0; i < entries.size(); ++i) {
+    const diagnostic_aggregator::JournalReader::Entry & entry = entries[i];
+    printf("%.3f %-5s %s: %s\n", entry.stamp * 1e-9,
+      entry.level < 4 ? levels[entry.level] : "?", entry.name.c_str(),
+      entry.message.c_str());
+  }
+  return 0;
+}
@@ -0,0 +1,105 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/match_cache.hpp"
+
+diagnostic_aggregator::MatchCache::MatchCache(size_t capacity)
+: capacity_(capacity), hand_(0), evictions_(0) {}
+
+const std::vector<bool> * diagnostic_aggregator::MatchCache::find(const std::string & name)
+{
+  std::unordered_map<std::string, size_t>::const_iterator it = index_.find(name);
+  if (it == index_.end()) {
+    return NULL;
+  }
+  Entry & entry = entries_[it->second];
+  entry.referenced = true;
+  return &entry.matches;
+}
+
+const std::vector<bool> * diagnostic_aggregator::MatchCache::peek(const std::string & name) const
+{
+  std::unordered_map<std::string, size_t>::const_iterator it = index_.find(name);
+  if (it == index_.end()) {
+    return NULL;
+  }
+  return &entries_[it->second].matches;
+}
+
+size_t diagnostic_aggregator::MatchCache::evict()
+{
+  while (true) {
+    if (hand_ >= entries_.size()) {
+      hand_ = 0;
+    }
+    Entry & entry = entries_[hand_];
+    if (entry.referenced) {
+      entry.referenced = false;
+      ++hand_;
+      continue;
+    }
+    index_.erase(entry.name);
+    ++evictions_;
+    return hand_++;
+  }
+}
+
+const std::vector<bool> & diagnostic_aggregator::MatchCache::insert(
+  const std::string & name, const std::vector<bool> & matches)
+{
+  std::unordered_map<std::string, size_t>::iterator it = index_.find(name);
+  if (it != index_.end()) {
+    entries_[it->second].matches = matches;
+    return entries_[it->second].matches;
+  }
+
+  size_t slot;
+  if (capacity_ > 0 && entries_.size() >= capacity_) {
+    slot = evict();
+  } else {
+    slot = entries_.size();
+    entries_.push_back(Entry());
+  }
+
+  Entry & entry = entries_[slot];
+  entry.name = name;
+  entry.matches = matches;
+  // New entries must be used again before the next sweep to survive it
+  entry.referenced = false;
+  index_[name] = slot;
+  return entry.matches;
+}
+
+void diagnostic_aggregator::MatchCache::clear()
+{
+  entries_.clear();
+  index_.clear();
+  hand_ = 0;
+}
+
+void diagnostic_aggregator::MatchCache::setCapacity(size_t capacity)
+{
+  capacity_ = capacity;
+  if (capacity_ == 0 || entries_.size() <= capacity_) {
+    return;
+  }
+  evictions_ += entries_.size() - capacity_;
+  entries_.resize(capacity_);
+  index_.clear();
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    index_[entries_[i].name] = i;
+  }
+  hand_ = 0;
+}
@@ -0,0 +1,397 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/pattern_matcher.hpp"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define DIAGNOSTIC_AGGREGATOR_HAS_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Names shorter than this are copied to a zero padded buffer, so the vector
+// kernels cover every position without a scalar tail
+const size_t kPaddedSize = 256;
+const size_t kPadding = 33;
+
+const size_t kAVX2MinSize = 64;
+
+inline uint16_t firstTwo(const std::string & str)
+{
+  return static_cast<uint8_t>(str[0]) | (static_cast<uint8_t>(str[1]) << 8);
+}
+
+}  // namespace
+
+diagnostic_aggregator::PatternMatcher::PatternMatcher()
+: impl_(getBestImplementation()), empty_prefix_(false), empty_contains_(false)
+{
+  memset(short_prefixes_, 0, sizeof(short_prefixes_));
+  memset(lo0_, 0, sizeof(lo0_));
+  memset(hi0_, 0, sizeof(hi0_));
+  memset(lo1_, 0, sizeof(lo1_));
+  memset(hi1_, 0, sizeof(hi1_));
+}
+
+void diagnostic_aggregator::PatternMatcher::addExact(const std::string & name)
+{
+  exact_.insert(name);
+}
+
+void diagnostic_aggregator::PatternMatcher::addPrefix(const std::string & prefix)
+{
+  prefixes_.push_back(prefix);
+}
+
+void diagnostic_aggregator::PatternMatcher::addContains(const std::string & substring)
+{
+  contains_.push_back(substring);
+}
+
+void diagnostic_aggregator::PatternMatcher::build()
+{
+  prefix_index_.clear();
+  memset(short_prefixes_, 0, sizeof(short_prefixes_));
+  empty_prefix_ = false;
+  for (uint32_t i = 0; i < prefixes_.size(); ++i) {
+    const std::string & prefix = prefixes_[i];
+    if (prefix.empty()) {
+      empty_prefix_ = true;
+    } else if (prefix.size() == 1) {
+      short_prefixes_[static_cast<uint8_t>(prefix[0])] = true;
+    } else {
+      prefix_index_[firstTwo(prefix)].push_back(i);
+    }
+  }
+
+  // Sorted patterns share their first bytes with their neighbours, so
+  // contiguous ranges make buckets with few distinct fingerprints
+  std::sort(contains_.begin(), contains_.end());
+  contains_.erase(std::unique(contains_.begin(), contains_.end()), contains_.end());
+  empty_contains_ = !contains_.empty() && contains_[0].empty();
+  for (int b = 0; b <= 8; ++b) {
+    bucket_bounds_[b] = (b * contains_.size() + 7) / 8;
+  }
+  memset(lo0_, 0, sizeof(lo0_));
+  memset(hi0_, 0, sizeof(hi0_));
+  memset(lo1_, 0, sizeof(lo1_));
+  memset(hi1_, 0, sizeof(hi1_));
+  for (uint32_t i = 0; i < contains_.size(); ++i) {
+    const std::string & pattern = contains_[i];
+    if (pattern.empty()) {
+      continue;
+    }
+    uint32_t b = i * 8 / contains_.size();
+    uint8_t bit = 1 << b;
+
+    uint8_t c0 = pattern[0];
+    lo0_[c0 & 0xf] |= bit;
+    hi0_[c0 >> 4] |= bit;
+    if (pattern.size() == 1) {
+      // Any second byte
+      for (int n = 0; n < 16; ++n) {
+        lo1_[n] |= bit;
+        hi1_[n] |= bit;
+      }
+    } else {
+      uint8_t c1 = pattern[1];
+      lo1_[c1 & 0xf] |= bit;
+      hi1_[c1 >> 4] |= bit;
+    }
+  }
+}
+
+bool diagnostic_aggregator::PatternMatcher::empty() const
+{
+  return exact_.empty() && prefixes_.empty() && contains_.empty();
+}
+
+bool diagnostic_aggregator::PatternMatcher::match(const std::string & name) const
+{
+  if (!exact_.empty() && exact_.count(name)) {
+    return true;
+  }
+  if (!prefixes_.empty() && matchPrefix(name)) {
+    return true;
+  }
+  if (!contains_.empty()) {
+    return empty_contains_ || matchContains(name.c_str(), name.size());
+  }
+  return false;
+}
+
+bool diagnostic_aggregator::PatternMatcher::matchPrefix(const std::string & name) const
+{
+  if (empty_prefix_) {
+    return true;
+  }
+  if (name.empty()) {
+    return false;
+  }
+  if (short_prefixes_[static_cast<uint8_t>(name[0])]) {
+    return true;
+  }
+  if (name.size() < 2) {
+    return false;
+  }
+  std::unordered_map<uint16_t, std::vector<uint32_t>>::const_iterator it =
+    prefix_index_.find(firstTwo(name));
+  if (it == prefix_index_.end()) {
+    return false;
+  }
+  for (uint32_t i : it->second) {
+    const std::string & prefix = prefixes_[i];
+    if (prefix.size() <= name.size() &&
+      memcmp(name.data() + 2, prefix.data() + 2, prefix.size() - 2) == 0)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool diagnostic_aggregator::PatternMatcher::verify(
+  const char * text, size_t size, size_t pos, uint8_t buckets) const
+{
+  // Buckets are contiguous ranges of the sorted patterns. Searching from the
+  // first to the last candidate bucket at once is cheaper than bucket by
+  // bucket, as neighbouring buckets often share their first bytes.
+  typedef std::vector<std::string>::const_iterator Iterator;
+  Iterator lo = contains_.begin() + bucket_bounds_[__builtin_ctz(buckets)];
+  Iterator hi = contains_.begin() + bucket_bounds_[32 - __builtin_clz(buckets)];
+
+  // All patterns in [lo, hi) start with the d bytes at pos. As they are
+  // sorted, one that ends there comes first.
+  for (size_t d = 0; lo != hi; ++d) {
+    if (lo->size() == d) {
+      return true;
+    }
+    if (pos + d >= size) {
+      break;
+    }
+    uint8_t c = text[pos + d];
+    lo = std::lower_bound(lo, hi, c,
+        [d](const std::string & pattern, uint8_t c) {
+          return static_cast<uint8_t>(pattern[d]) < c;
+        });
+    hi = std::upper_bound(lo, hi, c,
+        [d](uint8_t c, const std::string & pattern) {
+          return c < static_cast<uint8_t>(pattern[d]);
+        });
+  }
+  return false;
+}
+
+bool diagnostic_aggregator::PatternMatcher::matchContains(const char * text, size_t size) const
+{
+  if (impl_ == Impl_Scalar) {
+    return containsScalar(text, size, 0);
+  }
+
+  const char * scan = text;
+  size_t readable = size + 1;   // Up to the terminating 0 of the string
+  char padded[kPaddedSize];
+  if (size + kPadding <= kPaddedSize) {
+    memcpy(padded, text, size);
+    memset(padded + size, 0, kPadding);
+    scan = padded;
+    readable = size + kPadding;
+  }
+  // Most names fit in a few 16 byte vectors. Below kAVX2MinSize, the cost of
+  // switching the upper halves of the AVX registers on and off outweighs
+  // filtering twice as many positions per instruction.
+  if (impl_ == Impl_AVX2 && size >= kAVX2MinSize) {
+    return containsAVX2(scan, size, readable);
+  }
+  return containsSSSE3(scan, size, readable);
+}
+
+bool diagnostic_aggregator::PatternMatcher::containsScalar(
+  const char * text, size_t size, size_t start) const
+{
+  for (size_t i = start; i < size; ++i) {
+    uint8_t c0 = text[i];
+    uint8_t buckets = lo0_[c0 & 0xf] & hi0_[c0 >> 4];
+    if (!buckets) {
+      continue;
+    }
+    uint8_t c1 = text[i + 1];
+    buckets &= lo1_[c1 & 0xf] & hi1_[c1 >> 4];
+    if (buckets && verify(text, size, i, buckets)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#ifdef DIAGNOSTIC_AGGREGATOR_HAS_X86_SIMD
+
+__attribute__((target("ssse3")))
+bool diagnostic_aggregator::PatternMatcher::containsSSSE3(
+  const char * text, size_t size, size_t readable) const
+{
+  const __m128i lo0 = _mm_load_si128(reinterpret_cast<const __m128i *>(lo0_));
+  const __m128i hi0 = _mm_load_si128(reinterpret_cast<const __m128i *>(hi0_));
+  const __m128i lo1 = _mm_load_si128(reinterpret_cast<const __m128i *>(lo1_));
+  const __m128i hi1 = _mm_load_si128(reinterpret_cast<const __m128i *>(hi1_));
+  const __m128i nibble = _mm_set1_epi8(0x0f);
+  const __m128i zero = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i < size && i + 17 <= readable; i += 16) {
+    __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i));
+    __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(text + i + 1));
+    __m128i first = _mm_and_si128(
+      _mm_shuffle_epi8(lo0, _mm_and_si128(a, nibble)),
+      _mm_shuffle_epi8(hi0, _mm_and_si128(_mm_srli_epi16(a, 4), nibble)));
+    __m128i second = _mm_and_si128(
+      _mm_shuffle_epi8(lo1, _mm_and_si128(b, nibble)),
+      _mm_shuffle_epi8(hi1, _mm_and_si128(_mm_srli_epi16(b, 4), nibble)));
+    __m128i buckets = _mm_and_si128(first, second);
+
+    uint32_t mask = ~_mm_movemask_epi8(_mm_cmpeq_epi8(buckets, zero)) & 0xffff;
+    if (size - i < 16) {
+      mask &= (1u << (size - i)) - 1;
+    }
+    if (mask) {
+      alignas(16) uint8_t bits[16];
+      _mm_store_si128(reinterpret_cast<__m128i *>(bits), buckets);
+      while (mask) {
+        int j = __builtin_ctz(mask);
+        mask &= mask - 1;
+        if (verify(text, size, i + j, bits[j])) {
+          return true;
+        }
+      }
+    }
+  }
+  return containsScalar(text, size, i);
+}
+
+__attribute__((target("avx2")))
+bool diagnostic_aggregator::PatternMatcher::containsAVX2(
+  const char * text, size_t size, size_t readable) const
+{
+  // pshufb works within 128 bit lanes, so both lanes get the tables
+  const __m256i lo0 = _mm256_broadcastsi128_si256(
+    _mm_load_si128(reinterpret_cast<const __m128i *>(lo0_)));
+  const __m256i hi0 = _mm256_broadcastsi128_si256(
+    _mm_load_si128(reinterpret_cast<const __m128i *>(hi0_)));
+  const __m256i lo1 = _mm256_broadcastsi128_si256(
+    _mm_load_si128(reinterpret_cast<const __m128i *>(lo1_)));
+  const __m256i hi1 = _mm256_broadcastsi128_si256(
+    _mm_load_si128(reinterpret_cast<const __m128i *>(hi1_)));
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+
+  // Candidates are verified after each chunk rather than in the vector loop,
+  // so the tables are reloaded after vzeroupper once per chunk
+  const size_t kBlocks = 8;
+  alignas(32) uint8_t bits[kBlocks * 32];
+  uint32_t masks[kBlocks];
+
+  size_t i = 0;
+  while (i < size && i + 33 <= readable) {
+    size_t chunk = i;
+    size_t blocks = 0;
+    uint32_t any = 0;
+    for (; blocks < kBlocks && i < size && i + 33 <= readable; ++blocks, i += 32) {
+      __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i));
+      __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(text + i + 1));
+      __m256i first = _mm256_and_si256(
+        _mm256_shuffle_epi8(lo0, _mm256_and_si256(a, nibble)),
+        _mm256_shuffle_epi8(hi0, _mm256_and_si256(_mm256_srli_epi16(a, 4), nibble)));
+      __m256i second = _mm256_and_si256(
+        _mm256_shuffle_epi8(lo1, _mm256_and_si256(b, nibble)),
+        _mm256_shuffle_epi8(hi1, _mm256_and_si256(_mm256_srli_epi16(b, 4), nibble)));
+      __m256i buckets = _mm256_and_si256(first, second);
+      _mm256_store_si256(reinterpret_cast<__m256i *>(bits + blocks * 32), buckets);
+
+      uint32_t mask = ~static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(buckets, zero)));
+      if (size - i < 32) {
+        mask &= (1u << (size - i)) - 1;
+      }
+      masks[blocks] = mask;
+      any |= mask;
+    }
+
+    if (!any) {
+      continue;
+    }
+    // verify() is compiled without AVX. Running it with the upper halves of
+    // the registers dirty is slow on most CPUs.
+    _mm256_zeroupper();
+    for (size_t block = 0; block < blocks; ++block) {
+      uint32_t mask = masks[block];
+      while (mask) {
+        int j = __builtin_ctz(mask);
+        mask &= mask - 1;
+        if (verify(text, size, chunk + block * 32 + j, bits[block * 32 + j])) {
+          return true;
+        }
+      }
+    }
+  }
+  // The SSSE3 kernel finishes the last 32 bytes, then the scalar one
+  _mm256_zeroupper();
+  return i < size && containsSSSE3(text + i, size - i, readable - i);
+}
+
+diagnostic_aggregator::PatternMatcher::Implementation
+diagnostic_aggregator::PatternMatcher::getBestImplementation()
+{
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return Impl_AVX2;
+  }
+  if (__builtin_cpu_supports("ssse3")) {
+    return Impl_SSSE3;
+  }
+  return Impl_Scalar;
+}
+
+#else
+
+bool diagnostic_aggregator::PatternMatcher::containsSSSE3(
+  const char * text, size_t size, size_t) const
+{
+  return containsScalar(text, size, 0);
+}
+
+bool diagnostic_aggregator::PatternMatcher::containsAVX2(
+  const char * text, size_t size, size_t) const
+{
+  return containsScalar(text, size, 0);
+}
+
+diagnostic_aggregator::PatternMatcher::Implementation
+diagnostic_aggregator::PatternMatcher::getBestImplementation()
+{
+  return Impl_Scalar;
+}
+
+#endif
+
+void diagnostic_aggregator::PatternMatcher::setImplementation(Implementation impl)
+{
+  if (impl <= getBestImplementation()) {
+    impl_ = impl;
+  }
+}
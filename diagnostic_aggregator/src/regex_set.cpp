@@ -0,0 +1,693 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "diagnostic_aggregator/regex_set.hpp"
+
+typedef std::bitset<256> ByteSet;
+
+struct diagnostic_aggregator::RegexSet::Node
+{
+  enum Type
+  {
+    Empty,
+    Set,
+    Concat,
+    Alt,
+    Repeat
+  };
+
+  explicit Node(Type type)
+  : type(type), min(0), max(0) {}
+
+  Type type;
+  ByteSet bytes;
+  std::vector<std::shared_ptr<Node>> children;
+  int min, max;     /**< Repeat bounds, max -1 for no bound */
+};
+
+namespace
+{
+
+typedef diagnostic_aggregator::RegexSet::Node Node;
+typedef std::shared_ptr<Node> NodePtr;
+
+const int kMaxRepeat = 1000;
+const size_t kMaxNfaStates = 100000;
+
+/*!
+ *\brief Deepest nesting of groups accepted. Bounds the recursion of the parser
+ *and of Nfa::build(), so that a pattern from the configuration can't overflow
+ *the stack.
+ */
+const size_t kMaxNesting = 256;
+
+struct ParseError
+{
+  explicit ParseError(const std::string & what)
+  : what(what) {}
+  std::string what;
+};
+
+NodePtr makeSet(const ByteSet & bytes)
+{
+  NodePtr node = std::make_shared<Node>(Node::Set);
+  node->bytes = bytes;
+  return node;
+}
+
+ByteSet byteRange(int lo, int hi)
+{
+  ByteSet bytes;
+  for (int c = lo; c <= hi; ++c) {
+    bytes.set(c);
+  }
+  return bytes;
+}
+
+ByteSet digits() {return byteRange('0', '9');}
+
+ByteSet wordChars()
+{
+  return byteRange('a', 'z') | byteRange('A', 'Z') | digits() | byteRange('_', '_');
+}
+
+ByteSet spaces()
+{
+  return byteRange(' ', ' ') | byteRange('\t', '\r');
+}
+
+/*!
+ *\brief Recursive descent parser of the supported ECMAScript subset
+ */
+class Parser
+{
+public:
+  explicit Parser(const std::string & pattern)
+  : pattern_(pattern), pos_(0), end_(pattern.size()), nesting_(0) {}
+
+  NodePtr parse()
+  {
+    // Names are matched whole, so anchors at the ends change nothing
+    if (end_ > 0 && pattern_[0] == '^') {
+      pos_ = 1;
+    }
+    if (end_ > pos_ && pattern_[end_ - 1] == '$') {
+      size_t backslashes = 0;
+      while (backslashes < end_ - 1 && pattern_[end_ - 2 - backslashes] == '\\') {
+        ++backslashes;
+      }
+      if (backslashes % 2 == 0) {
+        --end_;
+      }
+    }
+
+    NodePtr node = parseAlt();
+    if (pos_ < end_) {
+      fail("unmatched ')'");
+    }
+    return node;
+  }
+
+private:
+  void fail(const std::string & what) const
+  {
+    throw ParseError(what + " at position " + std::to_string(pos_));
+  }
+
+  bool more() const {return pos_ < end_;}
+
+  char peek() const {return pattern_[pos_];}
+
+  NodePtr parseAlt()
+  {
+    NodePtr first = parseConcat();
+    if (!more() || peek() != '|') {
+      return first;
+    }
+    NodePtr alt = std::make_shared<Node>(Node::Alt);
+    alt->children.push_back(first);
+    while (more() && peek() == '|') {
+      ++pos_;
+      alt->children.push_back(parseConcat());
+    }
+    return alt;
+  }
+
+  NodePtr parseConcat()
+  {
+    NodePtr concat = std::make_shared<Node>(Node::Concat);
+    while (more() && peek() != '|' && peek() != ')') {
+      concat->children.push_back(parseRepeat());
+    }
+    if (concat->children.empty()) {
+      return std::make_shared<Node>(Node::Empty);
+    }
+    if (concat->children.size() == 1) {
+      return concat->children[0];
+    }
+    return concat;
+  }
+
+  NodePtr parseRepeat()
+  {
+    NodePtr atom = parseAtom();
+    if (!more()) {
+      return atom;
+    }
+
+    int min, max;
+    char c = peek();
+    if (c == '*') {
+      min = 0;
+      max = -1;
+    } else if (c == '+') {
+      min = 1;
+      max = -1;
+    } else if (c == '?') {
+      min = 0;
+      max = 1;
+    } else if (c == '{') {
+      parseBounds(min, max);
+      --pos_;
+    } else {
+      return atom;
+    }
+    ++pos_;
+    // Lazy quantifiers match the same names
+    if (more() && peek() == '?') {
+      ++pos_;
+    }
+    if (more() && (peek() == '*' || peek() == '+' || peek() == '?' || peek() == '{')) {
+      fail("nothing to repeat");
+    }
+
+    NodePtr repeat = std::make_shared<Node>(Node::Repeat);
+    repeat->children.push_back(atom);
+    repeat->min = min;
+    repeat->max = max;
+    return repeat;
+  }
+
+  //  Parses {m}, {m,} or {m,n}, leaving pos_ after the '}'
+  void parseBounds(int & min, int & max)
+  {
+    ++pos_;
+    min = parseNumber();
+    max = min;
+    if (more() && peek() == ',') {
+      ++pos_;
+      max = more() && peek() == '}' ? -1 : parseNumber();
+    }
+    if (!more() || peek() != '}') {
+      fail("invalid repeat bounds");
+    }
+    ++pos_;
+    if (max != -1 && max < min) {
+      fail("repeat bounds out of order");
+    }
+  }
+
+  int parseNumber()
+  {
+    if (!more() || !isdigit(static_cast<unsigned char>(peek()))) {
+      fail("invalid repeat bounds");
+    }
+    int value = 0;
+    while (more() && isdigit(static_cast<unsigned char>(peek()))) {
+      value = value * 10 + (peek() - '0');
+      if (value > kMaxRepeat) {
+        fail("repeat count above " + std::to_string(kMaxRepeat));
+      }
+      ++pos_;
+    }
+    return value;
+  }
+
+  NodePtr parseAtom()
+  {
+    char c = pattern_[pos_++];
+    switch (c) {
+      case '(':
+        {
+          if (more() && peek() == '?') {
+            if (pos_ + 1 < end_ && pattern_[pos_ + 1] == ':') {
+              pos_ += 2;
+            } else {
+              fail("lookarounds are unsupported");
+            }
+          }
+          if (nesting_ >= kMaxNesting) {
+            fail("groups nested deeper than " + std::to_string(kMaxNesting) + " levels");
+          }
+          ++nesting_;
+          NodePtr group = parseAlt();
+          --nesting_;
+          if (!more() || peek() != ')') {
+            fail("missing ')'");
+          }
+          ++pos_;
+          return group;
+        }
+      case '[':
+        return makeSet(parseClass());
+      case '.':
+        return makeSet(~(byteRange('\n', '\n') | byteRange('\r', '\r')));
+      case '\\':
+        return makeSet(parseEscape(false));
+      case '*':
+      case '+':
+      case '?':
+      case '{':
+        --pos_;
+        fail("nothing to repeat");
+        break;
+      case '^':
+        --pos_;
+        fail("'^' is only supported at the start");
+        break;
+      case '$':
+        --pos_;
+        fail("'$' is only supported at the end");
+        break;
+      default:
+        break;
+    }
+    ByteSet bytes;
+    bytes.set(static_cast<unsigned char>(c));
+    return makeSet(bytes);
+  }
+
+  ByteSet parseEscape(bool in_class)
+  {
+    if (!more()) {
+      fail("trailing '\\'");
+    }
+    char c = pattern_[pos_++];
+    ByteSet bytes;
+    switch (c) {
+      case 'd': return digits();
+      case 'D': return ~digits();
+      case 'w': return wordChars();
+      case 'W': return ~wordChars();
+      case 's': return spaces();
+      case 'S': return ~spaces();
+      case 't': bytes.set('\t'); return bytes;
+      case 'n': bytes.set('\n'); return bytes;
+      case 'r': bytes.set('\r'); return bytes;
+      case 'f': bytes.set('\f'); return bytes;
+      case 'v': bytes.set('\v'); return bytes;
+      case '0':
+        if (more() && isdigit(static_cast<unsigned char>(peek()))) {
+          fail("octal escapes are unsupported");
+        }
+        bytes.set(0);
+        return bytes;
+      case 'x':
+        {
+          if (pos_ + 2 > end_ || !isxdigit(static_cast<unsigned char>(pattern_[pos_])) ||
+            !isxdigit(static_cast<unsigned char>(pattern_[pos_ + 1])))
+          {
+            fail("invalid \\x escape");
+          }
+          bytes.set(std::stoi(pattern_.substr(pos_, 2), nullptr, 16));
+          pos_ += 2;
+          return bytes;
+        }
+      case 'b':
+        if (in_class) {
+          bytes.set('\b');
+          return bytes;
+        }
+        --pos_;
+        fail("word boundaries are unsupported");
+        break;
+      default:
+        break;
+    }
+    if (isdigit(static_cast<unsigned char>(c))) {
+      --pos_;
+      fail("backreferences are unsupported");
+    }
+    if (isalnum(static_cast<unsigned char>(c))) {
+      --pos_;
+      fail(std::string("escape \\") + c + " is unsupported");
+    }
+    bytes.set(static_cast<unsigned char>(c));
+    return bytes;
+  }
+
+  ByteSet parseClass()
+  {
+    bool negate = false;
+    if (more() && peek() == '^') {
+      negate = true;
+      ++pos_;
+    }
+    ByteSet bytes;
+    while (true) {
+      if (!more()) {
+        fail("missing ']'");
+      }
+      if (peek() == ']') {
+        ++pos_;
+        break;
+      }
+      bool single = true;
+      ByteSet item = parseClassItem(single);
+      if (single && pos_ + 1 < end_ && peek() == '-' && pattern_[pos_ + 1] != ']') {
+        ++pos_;
+        bool single_hi = true;
+        ByteSet hi = parseClassItem(single_hi);
+        if (!single_hi) {
+          fail("invalid class range");
+        }
+        int lo_byte = 0, hi_byte = 0;
+        for (int b = 0; b < 256; ++b) {
+          if (item.test(b)) {
+            lo_byte = b;
+          }
+          if (hi.test(b)) {
+            hi_byte = b;
+          }
+        }
+        if (lo_byte > hi_byte) {
+          fail("class range out of order");
+        }
+        item = byteRange(lo_byte, hi_byte);
+      }
+      bytes |= item;
+    }
+    return negate ? ~bytes : bytes;
+  }
+
+  //  single is set to whether the item is one byte, which can start a range
+  ByteSet parseClassItem(bool & single)
+  {
+    if (pattern_.compare(pos_, 2, "[:") == 0) {
+      size_t close = pattern_.find(":]", pos_ + 2);
+      if (close == std::string::npos || close >= end_) {
+        fail("missing ':]'");
+      }
+      std::string name = pattern_.substr(pos_ + 2, close - pos_ - 2);
+      pos_ = close + 2;
+      single = false;
+      return namedClass(name);
+    }
+    ByteSet item;
+    if (peek() == '\\') {
+      ++pos_;
+      item = parseEscape(true);
+    } else {
+      item.set(static_cast<unsigned char>(pattern_[pos_++]));
+    }
+    single = item.count() == 1;
+    return item;
+  }
+
+  ByteSet namedClass(const std::string & name)
+  {
+    ByteSet upper = byteRange('A', 'Z');
+    ByteSet lower = byteRange('a', 'z');
+    if (name == "alpha") {return upper | lower;}
+    if (name == "digit") {return digits();}
+    if (name == "alnum") {return upper | lower | digits();}
+    if (name == "space") {return spaces();}
+    if (name == "upper") {return upper;}
+    if (name == "lower") {return lower;}
+    if (name == "xdigit") {return digits() | byteRange('a', 'f') | byteRange('A', 'F');}
+    if (name == "punct") {
+      return byteRange('!', '/') | byteRange(':', '@') | byteRange('[', '`') |
+             byteRange('{', '~');
+    }
+    if (name == "w") {return wordChars();}
+    fail("unknown class [:" + name + ":]");
+    return ByteSet();
+  }
+
+  const std::string & pattern_;
+  size_t pos_, end_;
+  size_t nesting_;  /**< Groups open at pos_ */
+};
+
+/*!
+ *\brief Thompson NFA of the patterns
+ */
+class Nfa
+{
+public:
+  enum Type
+  {
+    Byte,     /**< Consumes a byte of sets[set], then goes to out */
+    Split,    /**< Goes to out and out1 without consuming */
+    Accept
+  };
+
+  struct State
+  {
+    Type type;
+    uint32_t set;
+    int out, out1;
+  };
+
+  int add(Type type, int out = -1, int out1 = -1, uint32_t set = 0)
+  {
+    if (states.size() >= kMaxNfaStates) {
+      throw ParseError("patterns need more than " + std::to_string(kMaxNfaStates) +
+              " NFA states");
+    }
+    State state;
+    state.type = type;
+    state.set = set;
+    state.out = out;
+    state.out1 = out1;
+    states.push_back(state);
+    return states.size() - 1;
+  }
+
+  //  Adds the states of node, which continue to next. Returns the first one.
+  int build(const Node & node, int next)
+  {
+    switch (node.type) {
+      case Node::Empty:
+        return next;
+      case Node::Set:
+        sets.push_back(node.bytes);
+        return add(Byte, next, -1, sets.size() - 1);
+      case Node::Concat:
+        for (size_t i = node.children.size(); i-- > 0; ) {
+          next = build(*node.children[i], next);
+        }
+        return next;
+      case Node::Alt:
+        {
+          int start = build(*node.children.back(), next);
+          for (size_t i = node.children.size() - 1; i-- > 0; ) {
+            int branch = build(*node.children[i], next);
+            start = add(Split, branch, start);
+          }
+          return start;
+        }
+      case Node::Repeat:
+        {
+          const Node & child = *node.children[0];
+          int tail = next;
+          if (node.max == -1) {
+            int loop = add(Split, -1, next);
+            int body = build(child, loop);
+            states[loop].out = body;
+            tail = loop;
+          } else {
+            // x{0,2} is (x(x)?)?
+            for (int i = node.min; i < node.max; ++i) {
+              int body = build(child, tail);
+              tail = add(Split, body, next);
+            }
+          }
+          for (int i = 0; i < node.min; ++i) {
+            tail = build(child, tail);
+          }
+          return tail;
+        }
+    }
+    return next;
+  }
+
+  std::vector<State> states;
+  std::vector<ByteSet> sets;
+};
+
+/*!
+ *\brief Adds the states reachable from state without consuming to closure
+ */
+void addClosure(
+  const Nfa & nfa, int state, std::vector<uint32_t> & seen, uint32_t mark,
+  std::vector<int> & stack, std::vector<int> & closure)
+{
+  stack.push_back(state);
+  while (!stack.empty()) {
+    int s = stack.back();
+    stack.pop_back();
+    if (s < 0 || seen[s] == mark) {
+      continue;
+    }
+    seen[s] = mark;
+    const Nfa::State & nfa_state = nfa.states[s];
+    if (nfa_state.type == Nfa::Split) {
+      stack.push_back(nfa_state.out1);
+      stack.push_back(nfa_state.out);
+    } else {
+      closure.push_back(s);
+    }
+  }
+}
+
+}  // namespace
+
+diagnostic_aggregator::RegexSet::RegexSet(size_t max_states)
+: max_states_(max_states), num_classes_(1)
+{
+  memset(classes_, 0, sizeof(classes_));
+  // Only the dead state, so nothing matches until compile()
+  transitions_.assign(1, 0);
+  accepting_.assign(1, 0);
+}
+
+diagnostic_aggregator::RegexSet::~RegexSet() {}
+
+bool diagnostic_aggregator::RegexSet::add(const std::string & pattern, std::string & error)
+{
+  try {
+    Parser parser(pattern);
+    patterns_.push_back(parser.parse());
+  } catch (const ParseError & e) {
+    error = e.what;
+    return false;
+  }
+  return true;
+}
+
+bool diagnostic_aggregator::RegexSet::compile(std::string & error)
+{
+  Nfa nfa;
+  int start;
+  try {
+    int accept = nfa.add(Nfa::Accept);
+    start = -1;
+    for (size_t i = patterns_.size(); i-- > 0; ) {
+      int pattern = nfa.build(*patterns_[i], accept);
+      start = start == -1 ? pattern : nfa.add(Nfa::Split, pattern, start);
+    }
+  } catch (const ParseError & e) {
+    error = e.what;
+    return false;
+  }
+
+  // Bytes that belong to the same sets can't be told apart by any pattern
+  std::map<std::vector<bool>, uint8_t> signatures;
+  std::vector<uint8_t> representatives;
+  for (int b = 0; b < 256; ++b) {
+    std::vector<bool> signature(nfa.sets.size());
+    for (size_t i = 0; i < nfa.sets.size(); ++i) {
+      signature[i] = nfa.sets[i].test(b);
+    }
+    std::map<std::vector<bool>, uint8_t>::iterator it = signatures.find(signature);
+    if (it == signatures.end()) {
+      it = signatures.insert(std::make_pair(signature, representatives.size())).first;
+      representatives.push_back(b);
+    }
+    classes_[b] = it->second;
+  }
+  num_classes_ = representatives.size();
+
+  // Subset construction. State 0 is the dead state, the empty set.
+  // seen[s] == mark if s is already in the closure being computed
+  std::vector<uint32_t> seen(nfa.states.size(), 0);
+  uint32_t mark = 1;
+  std::vector<int> stack;
+  std::map<std::vector<int>, uint32_t> ids;
+  std::vector<std::vector<int>> sets;
+  sets.push_back(std::vector<int>());
+  ids[sets[0]] = 0;
+
+  std::vector<int> closure;
+  if (start != -1) {
+    addClosure(nfa, start, seen, mark, stack, closure);
+  }
+  std::sort(closure.begin(), closure.end());
+  if (!closure.empty()) {
+    ids[closure] = 1;
+    sets.push_back(closure);
+  }
+
+  std::vector<uint32_t> transitions;
+  std::vector<uint8_t> accepting;
+  for (size_t d = 0; d < sets.size(); ++d) {
+    bool accepts = false;
+    for (int s : sets[d]) {
+      accepts = accepts || nfa.states[s].type == Nfa::Accept;
+    }
+    accepting.push_back(accepts);
+
+    for (uint32_t c = 0; c < num_classes_; ++c) {
+      ++mark;
+      closure.clear();
+      for (int s : sets[d]) {
+        const Nfa::State & state = nfa.states[s];
+        if (state.type == Nfa::Byte && nfa.sets[state.set].test(representatives[c])) {
+          addClosure(nfa, state.out, seen, mark, stack, closure);
+        }
+      }
+      std::sort(closure.begin(), closure.end());
+
+      std::map<std::vector<int>, uint32_t>::iterator it = ids.find(closure);
+      if (it == ids.end()) {
+        if (sets.size() >= max_states_) {
+          error = "patterns need more than " + std::to_string(max_states_) + " DFA states";
+          return false;
+        }
+        it = ids.insert(std::make_pair(closure, sets.size())).first;
+        sets.push_back(closure);
+      }
+      transitions.push_back(it->second);
+    }
+  }
+
+  transitions_.swap(transitions);
+  accepting_.swap(accepting);
+  return true;
+}
+
+bool diagnostic_aggregator::RegexSet::match(const std::string & name) const
+{
+  if (accepting_.size() < 2) {
+    return false;
+  }
+  uint32_t state = 1;
+  const uint8_t * data = reinterpret_cast<const uint8_t *>(name.data());
+  for (size_t i = 0; i < name.size(); ++i) {
+    state = transitions_[state * num_classes_ + classes_[data[i]]];
+    if (state == 0) {
+      return false;
+    }
+  }
+  return accepting_[state];
+}
@@ -0,0 +1,310 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <memory>
+#include "diagnostic_aggregator/analyzer_params.hpp"
+#include "diagnostic_aggregator/rule_analyzer.hpp"
+
+PLUGINLIB_EXPORT_CLASS(diagnostic_aggregator::RuleAnalyzer,
+  diagnostic_aggregator::Analyzer)
+
+diagnostic_aggregator::RuleAnalyzer::RuleAnalyzer()
+: path_(""), nice_name_(""), timeout_(5.0) {}
+
+diagnostic_aggregator::RuleAnalyzer::~RuleAnalyzer() {}
+
+bool diagnostic_aggregator::RuleAnalyzer::init(
+  const std::string base_path, const char * nsp,
+  const rclcpp::Node::SharedPtr & n, const char * rnsp)
+{
+  std::string rule_an_name = rnsp;
+  rule_an_name.erase(rule_an_name.end() - 5, rule_an_name.end());
+
+  AnalyzerParamMapConstPtr params;
+  if (!loadAnalyzerParams(n, nsp, params)) {
+    return false;
+  }
+  const AnalyzerParamMap & anl_param = *params;
+
+  AnalyzerParamMap::const_iterator anl_it;
+  anl_it = anl_param.find(rule_an_name + ".path");
+  if (anl_it == anl_param.end()) {
+    ROS_ERROR("RuleAnalyzer %s was not given a path\n", rule_an_name.c_str());
+    return false;
+  }
+  nice_name_ = anl_it->second;
+
+  anl_it = anl_param.find(rule_an_name + ".timeout");
+  if (anl_it != anl_param.end()) {
+    timeout_ = stod(anl_it->second);
+  }
+
+  if (base_path == "/") {
+    path_ = nice_name_;
+  } else {
+    path_ = base_path + "/" + nice_name_;
+  }
+  if (path_.find("/") != 0) {
+    path_ = "/" + path_;
+  }
+
+  // Collect rule names from "<analyzer>.rules.<rule>.<field>"
+  std::string rules_prefix = rule_an_name + ".rules.";
+  std::set<std::string> rule_names;
+  for (anl_it = anl_param.begin(); anl_it != anl_param.end(); ++anl_it) {
+    if (anl_it->first.compare(0, rules_prefix.size(), rules_prefix) != 0) {
+      continue;
+    }
+    std::string rest = anl_it->first.substr(rules_prefix.size());
+    rule_names.insert(rest.substr(0, rest.find(".")));
+  }
+
+  RuleExpression::SlotResolver resolve = std::bind(
+    &RuleAnalyzer::resolveSlot, this, std::placeholders::_1,
+    std::placeholders::_2);
+
+  bool init_ok = true;
+  for (const std::string & rule_name : rule_names) {
+    std::string prefix = rules_prefix + rule_name + ".";
+    Rule rule;
+    rule.name = rule_name;
+    rule.level = diagnostic_msgs::msg::DiagnosticStatus::ERROR;
+    rule.hold = 0.0;
+    rule.condition = false;
+
+    anl_it = anl_param.find(prefix + "expr");
+    if (anl_it == anl_param.end()) {
+      ROS_ERROR("Rule %s of RuleAnalyzer %s has no expr\n", rule_name.c_str(),
+        nice_name_.c_str());
+      init_ok = false;
+      continue;
+    }
+    rule.text = anl_it->second;
+
+    anl_it = anl_param.find(prefix + "for");
+    if (anl_it != anl_param.end()) {
+      rule.hold = stod(anl_it->second);
+    }
+
+    anl_it = anl_param.find(prefix + "level");
+    if (anl_it != anl_param.end()) {
+      std::string level = anl_it->second;
+      std::transform(level.begin(), level.end(), level.begin(), ::tolower);
+      if (level == "warn" || level == "warning" || level == "1") {
+        rule.level = diagnostic_msgs::msg::DiagnosticStatus::WARN;
+      } else if (level == "ok" || level == "0") {
+        rule.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+      } else if (level != "error" && level != "2") {
+        ROS_WARN("Unknown level %s for rule %s, using error\n", level.c_str(),
+          rule_name.c_str());
+      }
+    }
+
+    anl_it = anl_param.find(prefix + "message");
+    rule.message = anl_it != anl_param.end() ? anl_it->second : rule.text;
+
+    std::string error;
+    if (!rule.expr.compile(rule.text, resolve, error)) {
+      ROS_ERROR("Failed to compile rule %s (%s): %s\n", rule_name.c_str(),
+        rule.text.c_str(), error.c_str());
+      init_ok = false;
+      continue;
+    }
+
+    rules_.push_back(rule);
+  }
+
+  // Build the status name -> dependent rules index
+  for (uint32_t i = 0; i < rules_.size(); ++i) {
+    std::set<std::string> names;
+    for (uint32_t slot : rules_[i].expr.getSlots()) {
+      names.insert(slot_names_[slot]);
+    }
+    for (const std::string & name : names) {
+      sources_[name].rules.push_back(i);
+    }
+  }
+
+  if (rules_.size() == 0) {
+    ROS_ERROR("RuleAnalyzer %s was not initialized with any rules\n",
+      nice_name_.c_str());
+    return false;
+  }
+
+  return init_ok;
+}
+
+uint32_t diagnostic_aggregator::RuleAnalyzer::resolveSlot(
+  const std::string & name, const std::string & key)
+{
+  std::pair<std::string, std::string> id(name, key);
+  std::map<std::pair<std::string, std::string>, uint32_t>::iterator it =
+    slot_ids_.find(id);
+  if (it != slot_ids_.end()) {
+    return it->second;
+  }
+
+  uint32_t slot = slots_.size();
+  slots_.push_back(std::numeric_limits<double>::quiet_NaN());
+  slot_names_.push_back(name);
+  slot_ids_[id] = slot;
+
+  Source & source = sources_[name];
+  source.present = false;
+  Field field;
+  field.key = key;
+  field.slot = slot;
+  source.fields.push_back(field);
+
+  return slot;
+}
+
+bool diagnostic_aggregator::RuleAnalyzer::match(const std::string name)
+{
+  return sources_.count(name) > 0;
+}
+
+void diagnostic_aggregator::RuleAnalyzer::evaluate(Rule & rule, const rclcpp::Time & now)
+{
+  bool condition = rule.expr.test(slots_);
+  if (condition && !rule.condition) {
+    rule.since = now;
+  }
+  rule.condition = condition;
+}
+
+bool diagnostic_aggregator::RuleAnalyzer::analyze(const std::shared_ptr<StatusItem> item)
+{
+  std::map<std::string, Source>::iterator it = sources_.find(item->getName());
+  if (it == sources_.end()) {
+    return false;
+  }
+
+  Source & source = it->second;
+  for (const Field & field : source.fields) {
+    if (field.key.empty()) {
+      slots_[field.slot] = item->getLevel();
+      continue;
+    }
+    double value = std::numeric_limits<double>::quiet_NaN();
+    if (item->hasKey(field.key)) {
+      std::string str = item->getValue(field.key);
+      char * end = NULL;
+      double parsed = strtod(str.c_str(), &end);
+      if (end != str.c_str() && *end == '\0') {
+        value = parsed;
+      }
+    }
+    slots_[field.slot] = value;
+  }
+  source.present = true;
+  source.item = item;
+
+  for (uint32_t rule : source.rules) {
+    evaluate(rules_[rule], item->getLastUpdateTime());
+  }
+
+  return false;
+}
+
+bool diagnostic_aggregator::RuleAnalyzer::refresh(const std::shared_ptr<StatusItem> item)
+{
+  std::map<std::string, Source>::const_iterator it = sources_.find(item->getName());
+  if (it != sources_.end() && it->second.item == item) {
+    return false;
+  }
+  return analyze(item);
+}
+
+std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>>
+diagnostic_aggregator::RuleAnalyzer::report()
+{
+  rclcpp::Clock ros_clock(RCL_ROS_TIME);
+  rclcpp::Time now = ros_clock.now();
+
+  // Stale sources no longer count as present
+  if (timeout_ > 0) {
+    for (auto & it : sources_) {
+      Source & source = it.second;
+      if (!source.present ||
+        (now - source.item->getLastUpdateTime()).nanoseconds() * 1e-9 <= timeout_)
+      {
+        continue;
+      }
+      source.present = false;
+      source.item.reset();
+      for (const Field & field : source.fields) {
+        slots_[field.slot] = std::numeric_limits<double>::quiet_NaN();
+      }
+      for (uint32_t rule : source.rules) {
+        evaluate(rules_[rule], now);
+      }
+    }
+  }
+
+  std::vector<std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>> processed;
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> header_status(
+    new diagnostic_msgs::msg::DiagnosticStatus());
+  header_status->name = path_;
+  header_status->level = 0;
+  processed.push_back(header_status);
+
+  for (const Rule & rule : rules_) {
+    std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> status(
+      new diagnostic_msgs::msg::DiagnosticStatus());
+    status->name = path_ + "/" + getOutputName(rule.name);
+    status->level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+    status->message = "OK";
+
+    double active = 0.0;
+    if (rule.condition) {
+      active = (now - rule.since).nanoseconds() * 1e-9;
+      if (active >= rule.hold) {
+        status->level = rule.level;
+        status->message = rule.message;
+      }
+    }
+
+    diagnostic_msgs::msg::KeyValue kv;
+    kv.key = "Expression";
+    kv.value = rule.text;
+    status->values.push_back(kv);
+    kv.key = "Condition";
+    kv.value = rule.condition ? "True" : "False";
+    status->values.push_back(kv);
+    if (rule.condition && rule.hold > 0) {
+      kv.key = "Active For (s)";
+      kv.value = std::to_string(active);
+      status->values.push_back(kv);
+    }
+
+    header_status->level = std::max(header_status->level, status->level);
+    kv.key = rule.name;
+    kv.value = status->message;
+    header_status->values.push_back(kv);
+
+    processed.push_back(status);
+  }
+
+  header_status->message = valToMsg(header_status->level);
+
+  return processed;
+}
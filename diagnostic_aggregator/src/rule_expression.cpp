@@ -0,0 +1,442 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/rule_expression.hpp"
+
+namespace
+{
+
+/*
+ *\brief Deepest nesting of parentheses and unary operators accepted. Bounds
+ *the recursion of the parser.
+ */
+const size_t max_nesting = 256;
+
+}  // namespace
+
+/*
+ *\brief Recursive descent parser that emits postfix bytecode
+ */
+class diagnostic_aggregator::RuleExpression::Parser
+{
+public:
+  Parser(
+    const std::string & text, const SlotResolver & resolve,
+    std::vector<Instruction> & code)
+  : text_(text), pos_(0), nesting_(0), resolve_(resolve), code_(code) {}
+
+  bool parse(std::string & error)
+  {
+    if (!parseOr()) {
+      error = error_;
+      return false;
+    }
+    skipSpace();
+    if (pos_ != text_.size()) {
+      error = "Unexpected '" + text_.substr(pos_) + "'";
+      return false;
+    }
+    return true;
+  }
+
+private:
+  const std::string & text_;
+  size_t pos_;
+  size_t nesting_;
+  const SlotResolver & resolve_;
+  std::vector<Instruction> & code_;
+  std::string error_;
+
+  bool fail(const std::string & msg)
+  {
+    if (error_.empty()) {
+      error_ = msg + " at offset " + std::to_string(pos_);
+    }
+    return false;
+  }
+
+  void emit(OpCode op, double value = 0.0, uint32_t slot = 0)
+  {
+    Instruction ins;
+    ins.op = op;
+    ins.slot = slot;
+    ins.value = value;
+    code_.push_back(ins);
+  }
+
+  void skipSpace()
+  {
+    while (pos_ < text_.size() && isspace(static_cast<unsigned char>(text_[pos_]))) {
+      ++pos_;
+    }
+  }
+
+  bool accept(const char * tok)
+  {
+    skipSpace();
+    size_t len = strlen(tok);
+    if (text_.compare(pos_, len, tok) != 0) {
+      return false;
+    }
+    // Keywords must not run into an identifier
+    if (isalpha(static_cast<unsigned char>(tok[0])) && pos_ + len < text_.size() &&
+      (isalnum(static_cast<unsigned char>(text_[pos_ + len])) || text_[pos_ + len] == '_'))
+    {
+      return false;
+    }
+    pos_ += len;
+    return true;
+  }
+
+  bool parseString(std::string & out)
+  {
+    skipSpace();
+    if (pos_ >= text_.size() || (text_[pos_] != '\'' && text_[pos_] != '"')) {
+      return fail("Expected quoted string");
+    }
+    char quote = text_[pos_++];
+    size_t end = text_.find(quote, pos_);
+    if (end == std::string::npos) {
+      return fail("Unterminated string");
+    }
+    out = text_.substr(pos_, end - pos_);
+    pos_ = end + 1;
+    return true;
+  }
+
+  bool parseOr()
+  {
+    if (!parseAnd()) {
+      return false;
+    }
+    while (accept("||") || accept("or")) {
+      if (!parseAnd()) {
+        return false;
+      }
+      emit(Op_Or);
+    }
+    return true;
+  }
+
+  bool parseAnd()
+  {
+    if (!parseCompare()) {
+      return false;
+    }
+    while (accept("&&") || accept("and")) {
+      if (!parseCompare()) {
+        return false;
+      }
+      emit(Op_And);
+    }
+    return true;
+  }
+
+  bool parseCompare()
+  {
+    if (!parseSum()) {
+      return false;
+    }
+    OpCode op;
+    // Two character operators must be tried first
+    if (accept("<=")) {
+      op = Op_Le;
+    } else if (accept(">=")) {
+      op = Op_Ge;
+    } else if (accept("==")) {
+      op = Op_Eq;
+    } else if (accept("!=")) {
+      op = Op_Ne;
+    } else if (accept("<")) {
+      op = Op_Lt;
+    } else if (accept(">")) {
+      op = Op_Gt;
+    } else {
+      return true;
+    }
+    if (!parseSum()) {
+      return false;
+    }
+    emit(op);
+    return true;
+  }
+
+  bool parseSum()
+  {
+    if (!parseProduct()) {
+      return false;
+    }
+    while (true) {
+      OpCode op;
+      if (accept("+")) {
+        op = Op_Add;
+      } else if (accept("-")) {
+        op = Op_Sub;
+      } else {
+        return true;
+      }
+      if (!parseProduct()) {
+        return false;
+      }
+      emit(op);
+    }
+  }
+
+  bool parseProduct()
+  {
+    if (!parseUnary()) {
+      return false;
+    }
+    while (true) {
+      OpCode op;
+      if (accept("*")) {
+        op = Op_Mul;
+      } else if (accept("/")) {
+        op = Op_Div;
+      } else {
+        return true;
+      }
+      if (!parseUnary()) {
+        return false;
+      }
+      emit(op);
+    }
+  }
+
+  /*
+   *\brief Every recursion of the parser goes through parseUnary(), so this
+   *is where nesting is limited
+   */
+  bool parseUnary()
+  {
+    if (nesting_ >= max_nesting) {
+      return fail("Expression nested deeper than " + std::to_string(max_nesting) + " levels");
+    }
+    ++nesting_;
+    bool ok = parseUnaryNested();
+    --nesting_;
+    return ok;
+  }
+
+  bool parseUnaryNested()
+  {
+    // "!=" is handled by parseCompare, so only a lone "!" is negation
+    skipSpace();
+    if ((pos_ + 1 >= text_.size() || text_[pos_ + 1] != '=') && accept("!")) {
+      if (!parseUnary()) {
+        return false;
+      }
+      emit(Op_Not);
+      return true;
+    }
+    if (accept("not")) {
+      if (!parseUnary()) {
+        return false;
+      }
+      emit(Op_Not);
+      return true;
+    }
+    if (accept("-")) {
+      if (!parseUnary()) {
+        return false;
+      }
+      emit(Op_Neg);
+      return true;
+    }
+    return parsePrimary();
+  }
+
+  bool parsePrimary()
+  {
+    skipSpace();
+    if (pos_ >= text_.size()) {
+      return fail("Unexpected end of expression");
+    }
+
+    if (accept("(")) {
+      if (!parseOr()) {
+        return false;
+      }
+      if (!accept(")")) {
+        return fail("Expected ')'");
+      }
+      return true;
+    }
+
+    if (isdigit(static_cast<unsigned char>(text_[pos_])) || text_[pos_] == '.') {
+      const char * start = text_.c_str() + pos_;
+      char * end = NULL;
+      double value = strtod(start, &end);
+      if (end == start) {
+        return fail("Invalid number");
+      }
+      pos_ += end - start;
+      emit(Op_Const, value);
+      return true;
+    }
+
+    if (accept("true")) {
+      emit(Op_Const, 1.0);
+      return true;
+    }
+    if (accept("false")) {
+      emit(Op_Const, 0.0);
+      return true;
+    }
+    if (accept("OK")) {
+      emit(Op_Const, 0.0);
+      return true;
+    }
+    if (accept("WARN")) {
+      emit(Op_Const, 1.0);
+      return true;
+    }
+    if (accept("ERROR")) {
+      emit(Op_Const, 2.0);
+      return true;
+    }
+    if (accept("STALE")) {
+      emit(Op_Const, 3.0);
+      return true;
+    }
+
+    if (accept("level")) {
+      std::string name;
+      if (!accept("(") || !parseString(name) || !accept(")")) {
+        return fail("Expected level('status name')");
+      }
+      emit(Op_Slot, 0.0, resolve_(name, ""));
+      return true;
+    }
+
+    if (accept("value")) {
+      std::string name, key;
+      if (!accept("(") || !parseString(name) || !accept(",") ||
+        !parseString(key) || !accept(")"))
+      {
+        return fail("Expected value('status name', 'key')");
+      }
+      if (key.empty()) {
+        return fail("Empty key in value()");
+      }
+      emit(Op_Slot, 0.0, resolve_(name, key));
+      return true;
+    }
+
+    return fail("Unexpected '" + text_.substr(pos_, 1) + "'");
+  }
+};
+
+diagnostic_aggregator::RuleExpression::RuleExpression()
+: max_depth_(0) {}
+
+diagnostic_aggregator::RuleExpression::~RuleExpression() {}
+
+bool diagnostic_aggregator::RuleExpression::compile(
+  const std::string & text, const SlotResolver & resolve, std::string & error)
+{
+  code_.clear();
+  slots_.clear();
+  max_depth_ = 0;
+
+  Parser parser(text, resolve, code_);
+  if (!parser.parse(error)) {
+    code_.clear();
+    return false;
+  }
+
+  // Stack depth needed by the program, and the distinct slots it reads
+  size_t depth = 0;
+  for (unsigned int i = 0; i < code_.size(); ++i) {
+    switch (code_[i].op) {
+      case Op_Slot:
+        if (std::find(slots_.begin(), slots_.end(), code_[i].slot) == slots_.end()) {
+          slots_.push_back(code_[i].slot);
+        }
+        ++depth;
+        break;
+      case Op_Const:
+        ++depth;
+        break;
+      case Op_Neg:
+      case Op_Not:
+        break;
+      default:
+        --depth;
+        break;
+    }
+    max_depth_ = std::max(max_depth_, depth);
+  }
+  stack_.resize(max_depth_);
+
+  return true;
+}
+
+double diagnostic_aggregator::RuleExpression::evaluate(
+  const std::vector<double> & slots) const
+{
+  if (code_.empty()) {
+    return std::numeric_limits<double>::quiet_NaN();
+  }
+
+  double * sp = stack_.data();
+  for (const Instruction & ins : code_) {
+    switch (ins.op) {
+      case Op_Const:
+        *sp++ = ins.value;
+        break;
+      case Op_Slot:
+        *sp++ = slots[ins.slot];
+        break;
+      case Op_Neg:
+        sp[-1] = -sp[-1];
+        break;
+      case Op_Not:
+        sp[-1] = (sp[-1] == sp[-1] && sp[-1] != 0.0) ? 0.0 : 1.0;
+        break;
+      default:
+        {
+          double b = *--sp;
+          double a = sp[-1];
+          double r = 0.0;
+          switch (ins.op) {
+            case Op_Add: r = a + b; break;
+            case Op_Sub: r = a - b; break;
+            case Op_Mul: r = a * b; break;
+            case Op_Div: r = a / b; break;
+            case Op_Lt: r = a < b; break;
+            case Op_Le: r = a <= b; break;
+            case Op_Gt: r = a > b; break;
+            case Op_Ge: r = a >= b; break;
+            case Op_Eq: r = a == b; break;
+            case Op_Ne: r = a == a && b == b && a != b; break;
+            case Op_And: r = (a == a && a != 0.0) && (b == b && b != 0.0); break;
+            case Op_Or: r = (a == a && a != 0.0) || (b == b && b != 0.0); break;
+            default: break;
+          }
+          sp[-1] = r;
+        }
+        break;
+    }
+  }
+
+  return stack_[0];
+}
@@ -0,0 +1,320 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+#include <memory>
+#include "diagnostic_aggregator/status_history.hpp"
+
+namespace
+{
+
+/*
+ *\brief Bytes of an entry besides its strings
+ */
+const size_t kEntryBytes = sizeof(int64_t) + sizeof(uint64_t) + sizeof(uint8_t) +
+  2 * sizeof(size_t) + sizeof(std::string) +
+  sizeof(std::vector<diagnostic_msgs::msg::KeyValue>) + 2 * sizeof(void *) + sizeof(uint64_t);
+
+/*
+ *\brief Bytes of a track besides its entries: the track, its hash map node
+ * and its strings
+ */
+const size_t kTrackBytes = 256;
+
+size_t valueBytes(const diagnostic_msgs::msg::KeyValue & kv)
+{
+  return sizeof(diagnostic_msgs::msg::KeyValue) + kv.key.size() + kv.value.size();
+}
+
+/*
+ *\brief Finds key in values, trying index hint first since values usually
+ *keep their order between updates
+ */
+const diagnostic_msgs::msg::KeyValue * findValue(
+  const std::vector<diagnostic_msgs::msg::KeyValue> & values,
+  const std::string & key, size_t hint)
+{
+  if (hint < values.size() && values[hint].key == key) {
+    return &values[hint];
+  }
+  for (unsigned int i = 0; i < values.size(); ++i) {
+    if (values[i].key == key) {
+      return &values[i];
+    }
+  }
+  return NULL;
+}
+
+}  // namespace
+
+diagnostic_aggregator::StatusHistory::StatusHistory(
+  size_t max_per_item, size_t memory_budget)
+: max_per_item_(max_per_item), memory_budget_(memory_budget), memory_usage_(0),
+  next_seq_(0), entries_(0) {}
+
+diagnostic_aggregator::StatusHistory::~StatusHistory() {}
+
+void diagnostic_aggregator::StatusHistory::record(
+  const diagnostic_msgs::msg::DiagnosticStatus & status,
+  const rclcpp::Time & stamp)
+{
+  if (!enabled()) {
+    return;
+  }
+
+  size_t message_hash = std::hash<std::string>()(status.message);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+
+  std::shared_ptr<Track> & tracked = tracks_[status.name];
+  if (!tracked) {
+    tracked = std::make_shared<Track>();
+    tracked->name = status.name;
+    tracked->head = 0;
+    tracked->count = 0;
+    tracked->fixed_bytes = 0;
+  }
+  std::shared_ptr<Track> keep = tracked;
+  Track & track = *keep;
+
+  // Values that differ from the last recorded ones
+  std::vector<diagnostic_msgs::msg::KeyValue> changed;
+  for (unsigned int i = 0; i < status.values.size(); ++i) {
+    const diagnostic_msgs::msg::KeyValue * last =
+      findValue(track.last_values, status.values[i].key, i);
+    if (!last || last->value != status.values[i].value) {
+      changed.push_back(status.values[i]);
+    }
+  }
+
+  bool new_message = true;
+  if (track.count > 0) {
+    size_t last = track.slot(track.count - 1);
+    new_message = track.message_hashes[last] != message_hash;
+    if (track.levels[last] == status.level && !new_message && changed.empty()) {
+      return;
+    }
+  }
+
+  size_t bytes = kEntryBytes + (new_message ? status.message.size() : 0);
+  for (unsigned int i = 0; i < changed.size(); ++i) {
+    bytes += valueBytes(changed[i]);
+  }
+
+  if (track.count == max_per_item_) {
+    evictOldest(track);
+  }
+
+  if (track.count == track.stamps.size()) {
+    // Grow the columns. Entries must start at slot 0 for push_back to append
+    // after the newest one.
+    if (track.head != 0) {
+      std::rotate(track.stamps.begin(), track.stamps.begin() + track.head, track.stamps.end());
+      std::rotate(track.seqs.begin(), track.seqs.begin() + track.head, track.seqs.end());
+      std::rotate(track.levels.begin(), track.levels.begin() + track.head, track.levels.end());
+      std::rotate(track.message_hashes.begin(), track.message_hashes.begin() + track.head,
+        track.message_hashes.end());
+      std::rotate(track.messages.begin(), track.messages.begin() + track.head,
+        track.messages.end());
+      std::rotate(track.values.begin(), track.values.begin() + track.head, track.values.end());
+      std::rotate(track.bytes.begin(), track.bytes.begin() + track.head, track.bytes.end());
+      track.head = 0;
+    }
+    track.stamps.push_back(0);
+    track.seqs.push_back(0);
+    track.levels.push_back(0);
+    track.message_hashes.push_back(0);
+    track.messages.push_back(std::string());
+    track.values.push_back(std::vector<diagnostic_msgs::msg::KeyValue>());
+    track.bytes.push_back(0);
+  }
+
+  size_t s = track.slot(track.count);
+  track.stamps[s] = stamp.nanoseconds();
+  track.seqs[s] = next_seq_;
+  track.levels[s] = status.level;
+  track.message_hashes[s] = message_hash;
+  if (new_message) {
+    track.messages[s] = status.message;
+  }
+  track.values[s].swap(changed);
+  track.bytes[s] = bytes;
+  ++track.count;
+  ++entries_;
+  memory_usage_ += bytes;
+  Queued queued;
+  queued.track = keep;
+  queued.seq = next_seq_++;
+  evict_queue_.push_back(queued);
+
+  track.hw_id = status.hardware_id;
+  track.last_values = status.values;
+  memory_usage_ -= track.fixed_bytes;
+  track.fixed_bytes = kTrackBytes + 2 * track.name.size() + track.hw_id.size();
+  for (unsigned int i = 0; i < track.last_values.size(); ++i) {
+    track.fixed_bytes += valueBytes(track.last_values[i]);
+  }
+  memory_usage_ += track.fixed_bytes;
+
+  // Evict the oldest entries of all tracks until under budget. An entry that
+  // is the only one of its track is also its latest, so the whole track goes.
+  while (memory_usage_ > memory_budget_ && !evict_queue_.empty()) {
+    std::shared_ptr<Track> victim = evict_queue_.front().track.lock();
+    uint64_t seq = evict_queue_.front().seq;
+    evict_queue_.pop_front();
+    if (!victim || victim->count == 0 || seq < victim->seqs[victim->head]) {
+      continue;  // Stale
+    }
+    if (victim->count > 1) {
+      evictOldest(*victim);
+    } else {
+      dropTrack(victim->name);
+    }
+  }
+
+  // Entries evicted by max_per_item and dropped tracks leave stale entries
+  if (evict_queue_.size() > 2 * entries_ + 1024) {
+    std::deque<Queued> live;
+    for (const Queued & entry : evict_queue_) {
+      std::shared_ptr<Track> owner = entry.track.lock();
+      if (owner && owner->count > 0 && entry.seq >= owner->seqs[owner->head]) {
+        live.push_back(entry);
+      }
+    }
+    evict_queue_.swap(live);
+  }
+}
+
+void diagnostic_aggregator::StatusHistory::evictOldest(Track & track)
+{
+  size_t s = track.head;
+  memory_usage_ -= track.bytes[s];
+
+  if (track.count > 1) {
+    // The next entry shares this message if it didn't store its own
+    size_t next = track.slot(1);
+    if (track.message_hashes[next] == track.message_hashes[s]) {
+      track.bytes[next] += track.messages[s].size();
+      memory_usage_ += track.messages[s].size();
+      track.messages[next].swap(track.messages[s]);
+    }
+  }
+
+  std::string().swap(track.messages[s]);
+  std::vector<diagnostic_msgs::msg::KeyValue>().swap(track.values[s]);
+  track.bytes[s] = 0;
+  track.head = (track.head + 1) % track.stamps.size();
+  --track.count;
+  --entries_;
+}
+
+void diagnostic_aggregator::StatusHistory::dropTrack(const std::string & name)
+{
+  std::unordered_map<std::string, std::shared_ptr<Track>>::iterator it = tracks_.find(name);
+  if (it == tracks_.end()) {
+    return;
+  }
+  Track & track = *it->second;
+  for (size_t i = 0; i < track.count; ++i) {
+    memory_usage_ -= track.bytes[track.slot(i)];
+  }
+  memory_usage_ -= track.fixed_bytes;
+  entries_ -= track.count;
+  tracks_.erase(it);
+}
+
+void diagnostic_aggregator::StatusHistory::forget(const std::string & name)
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  dropTrack(name);
+}
+
+void diagnostic_aggregator::StatusHistory::getNames(std::vector<std::string> & names) const
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  names.reserve(names.size() + tracks_.size());
+  for (const auto & track : tracks_) {
+    names.push_back(track.first);
+  }
+}
+
+void diagnostic_aggregator::StatusHistory::query(
+  const std::vector<std::string> & names, const rclcpp::Time & start,
+  const rclcpp::Time & end, std::vector<builtin_interfaces::msg::Time> & stamps,
+  std::vector<diagnostic_msgs::msg::DiagnosticStatus> & statuses) const
+{
+  int64_t start_ns = start.nanoseconds();
+  int64_t end_ns = end.nanoseconds();
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (unsigned int n = 0; n < names.size(); ++n) {
+    std::unordered_map<std::string, std::shared_ptr<Track>>::const_iterator it =
+      tracks_.find(names[n]);
+    if (it == tracks_.end()) {
+      continue;
+    }
+    const Track & track = *it->second;
+
+    // First entry at or after start. Only the timestamp column is read.
+    size_t lo = 0, hi = track.count;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (track.stamps[track.slot(mid)] < start_ns) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    if (lo == track.count || track.stamps[track.slot(lo)] > end_ns) {
+      continue;
+    }
+
+    // The message of the first entry may be stored with an earlier one. The
+    // oldest entry always has its message.
+    size_t m = lo;
+    while (m > 0 && track.message_hashes[track.slot(m - 1)] ==
+      track.message_hashes[track.slot(m)])
+    {
+      --m;
+    }
+    const std::string * message = &track.messages[track.slot(m)];
+
+    for (size_t i = lo; i < track.count; ++i) {
+      size_t s = track.slot(i);
+      if (track.stamps[s] > end_ns) {
+        break;
+      }
+      if (i > lo && track.message_hashes[s] != track.message_hashes[track.slot(i - 1)]) {
+        message = &track.messages[s];
+      }
+
+      diagnostic_msgs::msg::DiagnosticStatus status;
+      status.name = track.name;
+      status.hardware_id = track.hw_id;
+      status.level = track.levels[s];
+      status.message = *message;
+      status.values = track.values[s];
+      statuses.push_back(status);
+      stamps.push_back(rclcpp::Time(track.stamps[s], RCL_ROS_TIME));
+    }
+  }
+}
+
+size_t diagnostic_aggregator::StatusHistory::getMemoryUsage() const
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  return memory_usage_;
+}
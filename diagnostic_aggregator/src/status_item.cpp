@@ -19,6 +19,30 @@
 //  using namespace diagnostic_aggregator;
 //  using namespace std;
 
+namespace
+{
+
+// FNV-1a, fed string lengths too so that fields can't run into each other
+const uint64_t kFnvOffset = 14695981039346656037ULL;
+const uint64_t kFnvPrime = 1099511628211ULL;
+
+inline uint64_t hashBytes(uint64_t hash, const char * data, size_t size)
+{
+  for (size_t i = 0; i < size; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(data[i])) * kFnvPrime;
+  }
+  return hash;
+}
+
+inline uint64_t hashString(uint64_t hash, const std::string & str)
+{
+  uint32_t size = str.size();
+  hash = hashBytes(hash, reinterpret_cast<const char *>(&size), sizeof(size));
+  return hashBytes(hash, str.data(), str.size());
+}
+
+}  // namespace
+
 diagnostic_aggregator::StatusItem::StatusItem(const diagnostic_msgs::msg::DiagnosticStatus * status)
 {
   level_ = valToLevel(status->level);
@@ -26,6 +50,7 @@ diagnostic_aggregator::StatusItem::StatusItem(const diagnostic_msgs::msg::Diagno
   message_ = status->message;
   hw_id_ = status->hardware_id;
   values_ = status->values;
+  hash_ = hashStatus(*status);
 
   output_name_ = getOutputName(name_);
   rclcpp::Clock ros_clock(RCL_ROS_TIME);
@@ -40,6 +65,7 @@ diagnostic_aggregator::StatusItem::StatusItem(
   message_ = message;
   level_ = level;
   hw_id_ = "";
+  hash_ = 0;
 
   std::cout << "StatusItem name is =  " << name_ << std::endl;
   output_name_ = getOutputName(name_);
@@ -72,22 +98,42 @@ bool diagnostic_aggregator::StatusItem::update(
   message_ = status->message;
   hw_id_ = status->hardware_id;
   values_ = status->values;
+  hash_ = hashStatus(*status);
   rclcpp::Time update_time_ = ros_clock.now();
   return true;
 }
 
+uint64_t diagnostic_aggregator::StatusItem::hashStatus(
+  const diagnostic_msgs::msg::DiagnosticStatus & status)
+{
+  uint64_t hash = kFnvOffset;
+  hash = hashBytes(hash, reinterpret_cast<const char *>(&status.level), sizeof(status.level));
+  hash = hashString(hash, status.message);
+  hash = hashString(hash, status.hardware_id);
+  for (unsigned int i = 0; i < status.values.size(); ++i) {
+    hash = hashString(hash, status.values[i].key);
+    hash = hashString(hash, status.values[i].value);
+  }
+  return hash;
+}
+
 std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>
 diagnostic_aggregator::StatusItem::toStatusMsg(const std::string & path, bool stale) const
 {
-  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> status(
-    new diagnostic_msgs::msg::DiagnosticStatus());
-
   if (path == "/") {
-    status->name = "/" + output_name_;
-  } else {
-    status->name = path + "/" + output_name_;
+    return toNamedStatusMsg("/" + output_name_, stale);
   }
+  return toNamedStatusMsg(path + "/" + output_name_, stale);
+}
+
+std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus>
+diagnostic_aggregator::StatusItem::toNamedStatusMsg(
+  const std::string & status_name, bool stale) const
+{
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticStatus> status(
+    new diagnostic_msgs::msg::DiagnosticStatus());
 
+  status->name = status_name;
   status->level = level_;
   status->message = message_;
   status->hardware_id = hw_id_;
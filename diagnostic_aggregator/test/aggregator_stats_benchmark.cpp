@@ -0,0 +1,125 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//  Measures the overhead of AggregatorStats on the ingest path, by running it
+//  with self_diagnostics on and off
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/aggregator.hpp"
+
+const int kAnalyzers = 100;
+const int kStatusesPerMessage = 20;
+const int kMessages = 20000;
+
+namespace diagnostic_aggregator
+{
+
+//  Reaches the private ingest callback, to feed it without a subscription
+class AggregatorTestAccess
+{
+public:
+  static void diagCallback(
+    Aggregator & aggregator,
+    const diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr & message,
+    const rmw_message_info_t & info)
+  {
+    aggregator.diagCallback(message, info);
+  }
+};
+
+}  // namespace diagnostic_aggregator
+
+//  Parameters of an aggregator with num_analyzers GenericAnalyzers
+std::vector<rclcpp::Parameter> makeParameters(int num_analyzers, bool self_diagnostics)
+{
+  std::vector<rclcpp::Parameter> parameters;
+  parameters.push_back(rclcpp::Parameter("self_diagnostics", self_diagnostics));
+  for (int i = 0; i < num_analyzers; ++i) {
+    std::string prefix = "analyzers_params.analyzer" + std::to_string(i);
+    parameters.push_back(rclcpp::Parameter(prefix + ".type",
+      "diagnostic_aggregator/GenericAnalyzer"));
+    parameters.push_back(rclcpp::Parameter(prefix + ".path",
+      "Analyzer " + std::to_string(i)));
+    parameters.push_back(rclcpp::Parameter(prefix + ".startswith",
+      "item" + std::to_string(i) + ":"));
+    parameters.push_back(rclcpp::Parameter(prefix + ".timeout", 5.0));
+  }
+  return parameters;
+}
+
+//  kMessages messages of kStatusesPerMessage statuses. If changing, each
+//  status differs from the previous one of its name, so none is a duplicate.
+std::vector<diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr> makeMessages(bool changing)
+{
+  std::vector<diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr> messages;
+  for (int m = 0; m < kMessages; ++m) {
+    auto message = std::make_shared<diagnostic_msgs::msg::DiagnosticArray>();
+    message->header.stamp = rclcpp::Clock().now();
+    for (int j = 0; j < kStatusesPerMessage; ++j) {
+      int i = (m * kStatusesPerMessage + j) % (kAnalyzers * 5);
+      diagnostic_msgs::msg::DiagnosticStatus status;
+      status.name = "item" + std::to_string(i % kAnalyzers) + ": status " + std::to_string(i);
+      status.message = changing ? "OK " + std::to_string(m) : "OK";
+      message->status.push_back(status);
+    }
+    messages.push_back(message);
+  }
+  return messages;
+}
+
+//  Feeds messages to the aggregator's real ingest path. Returns seconds.
+double ingest(
+  diagnostic_aggregator::Aggregator & aggregator,
+  const std::vector<diagnostic_msgs::msg::DiagnosticArray::ConstSharedPtr> & messages)
+{
+  rmw_message_info_t info = rmw_message_info_t();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (const auto & message : messages) {
+    diagnostic_aggregator::AggregatorTestAccess::diagCallback(aggregator, message, info);
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+  {
+    // The same ingest with the statistics on and off. Rounds alternate so
+    // that both see the same machine load, and the fastest round of each is
+    // kept.
+    diagnostic_aggregator::Aggregator with_stats(makeParameters(kAnalyzers, true));
+    diagnostic_aggregator::Aggregator without_stats(makeParameters(kAnalyzers, false));
+
+    printf("%20s %16s %16s %12s\n", "statuses", "off (us/msg)", "on (us/msg)", "overhead");
+    for (bool changing : {true, false}) {
+      auto messages = makeMessages(changing);
+      ingest(with_stats, messages);  // Warm up
+      ingest(without_stats, messages);
+      double on = 1e9, off = 1e9;
+      for (int round = 0; round < 10; ++round) {
+        off = std::min(off, ingest(without_stats, messages));
+        on = std::min(on, ingest(with_stats, messages));
+      }
+      printf("%20s %16.3f %16.3f %10.2f %%\n", changing ? "changing" : "duplicates",
+        off * 1e6 / kMessages, on * 1e6 / kMessages, (on - off) * 100.0 / off);
+    }
+  }
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,82 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include "diagnostic_aggregator/aggregator_stats.hpp"
+
+using diagnostic_aggregator::AggregatorStats;
+using diagnostic_aggregator::LatencyHistogram;
+
+namespace
+{
+
+double getRate(const diagnostic_msgs::msg::DiagnosticStatus & status)
+{
+  for (const diagnostic_msgs::msg::KeyValue & kv : status.values) {
+    if (kv.key == "Statuses/s") {
+      return atof(kv.value.c_str());
+    }
+  }
+  ADD_FAILURE() << "No Statuses/s";
+  return 0.0;
+}
+
+}  // namespace
+
+TEST(LatencyHistogram, percentiles)
+{
+  LatencyHistogram histogram;
+  EXPECT_EQ(0.0, histogram.getPercentile(0.99));
+  for (int i = 0; i < 99; ++i) {
+    histogram.record(std::chrono::microseconds(1));
+  }
+  histogram.record(std::chrono::milliseconds(1));
+  EXPECT_EQ(100u, histogram.getCount());
+  EXPECT_NEAR(10.99, histogram.getMean(), 0.01);
+  EXPECT_EQ(1000.0, histogram.getMax());
+
+  // Upper bounds of power of two buckets, at most 2x high
+  EXPECT_GE(histogram.getPercentile(0.5), 1.0);
+  EXPECT_LE(histogram.getPercentile(0.5), 2.048);
+  EXPECT_GE(histogram.getPercentile(0.995), 1000.0);
+  EXPECT_LE(histogram.getPercentile(0.995), 2000.0);
+}
+
+TEST(AggregatorStats, rateWindowOnlyMovedByReport)
+{
+  AggregatorStats stats;
+  stats.report("stats");
+
+  // Stats service queries within the window don't shorten it
+  stats.statuses.fetch_add(100);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  stats.toString();
+  stats.statuses.fetch_add(100);
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  stats.toString();
+
+  double rate = getRate(*stats.report("stats"));
+  EXPECT_GT(rate, 500.0);
+  EXPECT_LT(rate, 1050.0);
+
+  // toString() shows the rate of the last window
+  std::string text = stats.toString();
+  EXPECT_NE(std::string::npos, text.find("Statuses Received: 200\n")) << text;
+  EXPECT_EQ(std::string::npos, text.find("Statuses/s: 0.0\n")) << text;
+}
@@ -0,0 +1,442 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/srv/add_diagnostics.hpp"
+#include "std_srvs/srv/trigger.hpp"
+#include "diagnostic_aggregator/aggregator.hpp"
+
+using diagnostic_msgs::msg::DiagnosticArray;
+using diagnostic_msgs::msg::DiagnosticStatus;
+
+namespace
+{
+
+DiagnosticStatus makeStatus(const std::string & name, uint8_t level)
+{
+  DiagnosticStatus status;
+  status.name = name;
+  status.level = level;
+  status.message = "level " + std::to_string(level);
+  return status;
+}
+
+/*
+ *\brief Parameters of a GenericAnalyzer matching names that start with prefix
+ */
+std::vector<rclcpp::Parameter> analyzer(
+  const std::string & name, const std::string & path, const std::string & prefix)
+{
+  std::string ns = "analyzers_params." + name;
+  return {
+    rclcpp::Parameter(ns + ".type", "diagnostic_aggregator/GenericAnalyzer"),
+    rclcpp::Parameter(ns + ".path", path),
+    rclcpp::Parameter(ns + ".startswith", prefix),
+  };
+}
+
+/*
+ *\brief Level of the status with that name in msg, -1 if there's none
+ */
+int findLevel(const DiagnosticArray & msg, const std::string & name)
+{
+  for (const DiagnosticStatus & status : msg.status) {
+    if (status.name == name) {
+      return status.level;
+    }
+  }
+  return -1;
+}
+
+/*
+ *\brief True if msg has a status at or below path
+ */
+bool hasPath(const DiagnosticArray & msg, const std::string & path)
+{
+  for (const DiagnosticStatus & status : msg.status) {
+    if (status.name.compare(0, path.size(), path) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+class AggregatorTest : public ::testing::Test
+{
+protected:
+  static void SetUpTestCase() {rclcpp::init(0, nullptr);}
+
+  static void TearDownTestCase() {rclcpp::shutdown();}
+
+  /*
+   *\brief Starts an aggregator with the given parameters. Its timers are too
+   *slow to publish during a test, publishData() is called instead.
+   */
+  void start(std::vector<rclcpp::Parameter> parameters)
+  {
+    parameters.push_back(rclcpp::Parameter("pub_rate", 0.001));
+    aggregator_.reset(new diagnostic_aggregator::Aggregator(parameters));
+
+    node_ = rclcpp::Node::make_shared("aggregator_test");
+    diag_pub_ = node_->create_publisher<DiagnosticArray>("/diagnostics");
+    agg_sub_ = node_->create_subscription<DiagnosticArray>("/diagnostics_agg",
+        [this](const DiagnosticArray::SharedPtr msg) {
+          std::unique_lock<std::mutex> lock(mutex_);
+          received_.push_back(*msg);
+        });
+    toplevel_sub_ = node_->create_subscription<DiagnosticStatus>(
+      "/diagnostics_toplevel_state",
+      [this](const DiagnosticStatus::SharedPtr msg) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        toplevel_.push_back(msg->level);
+      });
+
+    executor_.add_node(aggregator_->get_node());
+    executor_.add_node(aggregator_->get_parameter_node());
+    executor_.add_node(node_);
+    spinner_ = std::thread([this]() {executor_.spin();});
+  }
+
+  void TearDown()
+  {
+    executor_.cancel();
+    if (spinner_.joinable()) {
+      spinner_.join();
+    }
+  }
+
+  void publish(const std::vector<DiagnosticStatus> & statuses)
+  {
+    DiagnosticArray msg;
+    msg.header.stamp = rclcpp::Clock().now();
+    msg.status = statuses;
+    diag_pub_->publish(msg);
+  }
+
+  /*
+   *\brief Waits up to 5 s for done() to hold, publishing statuses every 100 ms
+   *if given, in case the first ones were sent before discovery
+   */
+  bool waitFor(
+    const std::function<bool()> & done,
+    const std::vector<DiagnosticStatus> & statuses = std::vector<DiagnosticStatus>())
+  {
+    for (int i = 0; i < 500; ++i) {
+      if (!statuses.empty() && i % 10 == 0) {
+        publish(statuses);
+      }
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (done()) {
+          return true;
+        }
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    return done();
+  }
+
+  /*
+   *\brief Calls publishData() and waits for its output
+   */
+  DiagnosticArray publishData()
+  {
+    size_t count;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      count = received_.size();
+    }
+    aggregator_->publishData();
+    EXPECT_TRUE(waitFor([this, count]() {return received_.size() > count;}));
+    std::unique_lock<std::mutex> lock(mutex_);
+    return received_.back();
+  }
+
+  /*
+   *\brief Publishes statuses, if any, and calls publishData() until its output
+   *satisfies done, at most 50 times
+   */
+  bool publishUntil(
+    const std::vector<DiagnosticStatus> & statuses,
+    const std::function<bool(const DiagnosticArray &)> & done, DiagnosticArray * output = NULL)
+  {
+    for (int i = 0; i < 50; ++i) {
+      if (!statuses.empty()) {
+        publish(statuses);
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      DiagnosticArray msg = publishData();
+      if (done(msg)) {
+        if (output) {
+          *output = msg;
+        }
+        return true;
+      }
+    }
+    return false;
+  }
+
+  std::unique_ptr<diagnostic_aggregator::Aggregator> aggregator_;
+  rclcpp::Node::SharedPtr node_;
+  rclcpp::Publisher<DiagnosticArray>::SharedPtr diag_pub_;
+  rclcpp::Subscription<DiagnosticArray>::SharedPtr agg_sub_;
+  rclcpp::Subscription<DiagnosticStatus>::SharedPtr toplevel_sub_;
+  rclcpp::executors::MultiThreadedExecutor executor_;
+  std::thread spinner_;
+
+  std::mutex mutex_;
+  std::vector<DiagnosticArray> received_;   /**< Guarded by mutex_ */
+  std::vector<int> toplevel_;               /**< Guarded by mutex_ */
+};
+
+TEST_F(AggregatorTest, escalationEvents)
+{
+  std::vector<rclcpp::Parameter> parameters = {
+    rclcpp::Parameter("publish_on_escalation", true),
+    rclcpp::Parameter("min_event_interval", 0.0),
+    rclcpp::Parameter("self_diagnostics", false),
+  };
+  for (const auto & p : analyzer("motors", "Motors", "motor")) {
+    parameters.push_back(p);
+  }
+  for (const auto & p : analyzer("sensors", "Sensors", "sensor")) {
+    parameters.push_back(p);
+  }
+  start(parameters);
+
+  // A new item that isn't OK escalates. Only its analyzer is published.
+  ASSERT_TRUE(waitFor([this]() {return !received_.empty();},
+    {makeStatus("motor1", 1), makeStatus("sensor1", 0)}));
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    EXPECT_EQ(1, findLevel(received_[0], "/Motors/motor1"));
+    EXPECT_EQ(1, findLevel(received_[0], "/Motors"));
+    EXPECT_FALSE(hasPath(received_[0], "/Sensors"));
+    EXPECT_EQ(1, toplevel_.back());
+  }
+
+  // The full output has everything
+  DiagnosticArray full = publishData();
+  EXPECT_EQ(1, findLevel(full, "/Motors/motor1"));
+  EXPECT_EQ(0, findLevel(full, "/Sensors/sensor1"));
+
+  // Same levels don't escalate, so the next output is the sensor event
+  size_t count;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    count = received_.size();
+  }
+  publish({makeStatus("motor1", 1)});
+  publish({makeStatus("sensor1", 2)});
+  ASSERT_TRUE(waitFor([this, count]() {return received_.size() > count;}));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  std::unique_lock<std::mutex> lock(mutex_);
+  ASSERT_EQ(count + 1, received_.size());
+  EXPECT_EQ(2, findLevel(received_.back(), "/Sensors/sensor1"));
+  EXPECT_FALSE(hasPath(received_.back(), "/Motors"));
+  EXPECT_EQ(2, toplevel_.back());
+}
+
+TEST_F(AggregatorTest, escalationLevelsBounded)
+{
+  // One analyzer per item, so events show which items escalated
+  std::vector<rclcpp::Parameter> parameters = {
+    rclcpp::Parameter("publish_on_escalation", true),
+    rclcpp::Parameter("min_event_interval", 0.0),
+    rclcpp::Parameter("self_diagnostics", false),
+    rclcpp::Parameter("match_cache_size", 4),
+    rclcpp::Parameter("dedup_statuses", false),
+  };
+  std::vector<DiagnosticStatus> statuses;
+  for (int i = 0; i < 6; ++i) {
+    std::string name = "item" + std::to_string(i);
+    for (const auto & p : analyzer(name, "Item " + std::to_string(i), name)) {
+      parameters.push_back(p);
+    }
+    statuses.push_back(makeStatus(name, 1));
+  }
+  start(parameters);
+
+  ASSERT_TRUE(waitFor([this]() {
+      return !received_.empty() && hasPath(received_.back(), "/Item 5");
+    }, statuses));
+  size_t count;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    count = received_.size();
+  }
+
+  // Only the 4 most recent levels are kept, item0's was forgotten
+  publish({makeStatus("item5", 1)});
+  publish({makeStatus("item0", 1)});
+  ASSERT_TRUE(waitFor([this, count]() {return received_.size() > count;}));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  std::unique_lock<std::mutex> lock(mutex_);
+  ASSERT_EQ(count + 1, received_.size());
+  EXPECT_TRUE(hasPath(received_.back(), "/Item 0"));
+  EXPECT_FALSE(hasPath(received_.back(), "/Item 5"));
+}
+
+TEST_F(AggregatorTest, addDiagnostics)
+{
+  start({rclcpp::Parameter("self_diagnostics", false)});
+
+  // The analyzers are loaded from the parameters of the requesting node
+  rclcpp::NodeOptions options;
+  options.initial_parameters(analyzer("extra", "Extra", "extra"));
+  rclcpp::Node::SharedPtr adder = rclcpp::Node::make_shared("adder", options);
+  executor_.add_node(adder);
+  auto client = adder->create_client<diagnostic_msgs::srv::AddDiagnostics>(
+    "/diagnostics_agg/add_diagnostics");
+  auto request = std::make_shared<diagnostic_msgs::srv::AddDiagnostics::Request>();
+  request->load_namespace = "/adder";
+  auto result = client->async_send_request(request);
+  ASSERT_EQ(std::future_status::ready, result.wait_for(std::chrono::seconds(5)));
+  ASSERT_TRUE(result.get()->success) << result.get()->message;
+
+  // Once the bond forms, the group handles its items
+  bool added = false;
+  for (int i = 0; i < 50 && !added; ++i) {
+    publish({makeStatus("extra1", 1)});
+    added = findLevel(publishData(), "/Extra/extra1") == 1;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  EXPECT_TRUE(added);
+
+  // A second request from the same namespace is refused
+  result = client->async_send_request(request);
+  ASSERT_EQ(std::future_status::ready, result.wait_for(std::chrono::seconds(5)));
+  EXPECT_FALSE(result.get()->success);
+}
+
+TEST_F(AggregatorTest, reloadChangedAnalyzer)
+{
+  std::vector<rclcpp::Parameter> parameters = analyzer("motors", "Motors", "motor");
+  parameters.push_back(rclcpp::Parameter("self_diagnostics", false));
+  start(parameters);
+
+  auto parameters_client =
+    std::make_shared<rclcpp::AsyncParametersClient>(node_, "diagnostic_aggregator");
+  ASSERT_TRUE(parameters_client->wait_for_service(std::chrono::seconds(5)));
+  auto reload = node_->create_client<std_srvs::srv::Trigger>("/diagnostics_agg/reload");
+  ASSERT_TRUE(reload->wait_for_service(std::chrono::seconds(5)));
+
+  // Each reload picks up the path set on the running aggregator
+  for (const std::string path : {"Drives", "Wheels"}) {
+    auto set = parameters_client->set_parameters(
+      {rclcpp::Parameter("analyzers_params.motors.path", path)});
+    ASSERT_EQ(std::future_status::ready, set.wait_for(std::chrono::seconds(5)));
+    ASSERT_TRUE(set.get()[0].successful);
+    auto result = reload->async_send_request(std::make_shared<std_srvs::srv::Trigger::Request>());
+    ASSERT_EQ(std::future_status::ready, result.wait_for(std::chrono::seconds(5)));
+    ASSERT_TRUE(result.get()->success) << result.get()->message;
+
+    DiagnosticArray output;
+    ASSERT_TRUE(publishUntil({makeStatus("motor1", 1)},
+      [&path](const DiagnosticArray & msg) {return findLevel(msg, "/" + path + "/motor1") == 1;},
+      &output)) << path;
+    EXPECT_FALSE(hasPath(output, "/Motors")) << path;
+  }
+}
+
+TEST_F(AggregatorTest, reloadKeepsUnchangedAnalyzers)
+{
+  std::vector<rclcpp::Parameter> parameters = analyzer("motors", "Motors", "motor");
+  std::vector<rclcpp::Parameter> sensors = analyzer("sensors", "Sensors", "sensor");
+  parameters.insert(parameters.end(), sensors.begin(), sensors.end());
+  parameters.push_back(rclcpp::Parameter("self_diagnostics", false));
+  start(parameters);
+
+  ASSERT_TRUE(publishUntil({makeStatus("sensor1", 1)},
+    [](const DiagnosticArray & msg) {return findLevel(msg, "/Sensors/sensor1") == 1;}));
+
+  auto parameters_client =
+    std::make_shared<rclcpp::AsyncParametersClient>(node_, "diagnostic_aggregator");
+  ASSERT_TRUE(parameters_client->wait_for_service(std::chrono::seconds(5)));
+  auto set = parameters_client->set_parameters(
+    {rclcpp::Parameter("analyzers_params.motors.path", "Drives")});
+  ASSERT_EQ(std::future_status::ready, set.wait_for(std::chrono::seconds(5)));
+  ASSERT_TRUE(set.get()[0].successful);
+  auto reload = node_->create_client<std_srvs::srv::Trigger>("/diagnostics_agg/reload");
+  ASSERT_TRUE(reload->wait_for_service(std::chrono::seconds(5)));
+  auto result = reload->async_send_request(std::make_shared<std_srvs::srv::Trigger::Request>());
+  ASSERT_EQ(std::future_status::ready, result.wait_for(std::chrono::seconds(5)));
+  ASSERT_TRUE(result.get()->success) << result.get()->message;
+
+  // The sensors analyzer was kept, with its item, without a new status
+  DiagnosticArray output = publishData();
+  EXPECT_EQ(1, findLevel(output, "/Sensors/sensor1"));
+  EXPECT_TRUE(hasPath(output, "/Drives"));
+  EXPECT_FALSE(hasPath(output, "/Motors"));
+}
+
+TEST_F(AggregatorTest, duplicatesKeepOtherItems)
+{
+  start({
+      rclcpp::Parameter("self_diagnostics", false),
+      rclcpp::Parameter("max_other_items", 2),
+    });
+
+  // "Other" is under the base path, "/"
+
+  ASSERT_TRUE(publishUntil({makeStatus("a", 0), makeStatus("b", 0)},
+    [](const DiagnosticArray & msg) {return hasPath(msg, "//Other/b");}));
+
+  // A repeated status counts as an update, so b is the least recently updated
+  // when c arrives
+  publish({makeStatus("a", 0)});
+  publish({makeStatus("c", 0)});
+  DiagnosticArray output;
+  ASSERT_TRUE(publishUntil({},
+    [](const DiagnosticArray & msg) {return hasPath(msg, "//Other/c");}, &output));
+  EXPECT_TRUE(hasPath(output, "//Other/a"));
+  EXPECT_FALSE(hasPath(output, "//Other/b"));
+}
+
+TEST_F(AggregatorTest, duplicatesResumeStaleRuleSources)
+{
+  // The generic analyzer still holds the item after the rule dropped it
+  std::vector<rclcpp::Parameter> parameters = analyzer("motors", "Motors", "motor");
+  parameters.push_back(rclcpp::Parameter("self_diagnostics", false));
+  parameters.push_back(rclcpp::Parameter(
+      "analyzers_params.rules.type", "diagnostic_aggregator/RuleAnalyzer"));
+  parameters.push_back(rclcpp::Parameter("analyzers_params.rules.path", "Rules"));
+  parameters.push_back(rclcpp::Parameter("analyzers_params.rules.timeout", 0.2));
+  parameters.push_back(rclcpp::Parameter(
+      "analyzers_params.rules.rules.hot.expr", "level('motor1') >= WARN"));
+  start(parameters);
+
+  std::vector<DiagnosticStatus> statuses = {makeStatus("motor1", 1)};
+  auto firing = [](const DiagnosticArray & msg) {return findLevel(msg, "/Rules/hot") == 2;};
+  ASSERT_TRUE(publishUntil(statuses, firing));
+
+  // Stale, so the rule no longer fires
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  EXPECT_EQ(0, findLevel(publishData(), "/Rules/hot"));
+
+  // The same status again reaches the rule
+  EXPECT_TRUE(publishUntil(statuses, firing));
+}
@@ -0,0 +1,72 @@
+// Copyright 2026 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//  Measures AnalyzerGroup::init() time as the number of analyzers grows
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <vector>
+#include "diagnostic_aggregator/analyzer_group.hpp"
+
+//  Builds a node holding the parameters of num_analyzers GenericAnalyzers
+rclcpp::Node::SharedPtr makeNode(int num_analyzers)
+{
+  std::vector<rclcpp::Parameter> initial_values;
+  for (int i = 0; i < num_analyzers; ++i) {
+    std::string prefix = "analyzers_params.analyzer" + std::to_string(i);
+    initial_values.push_back(rclcpp::Parameter(prefix + ".type",
+      "diagnostic_aggregator/GenericAnalyzer"));
+    initial_values.push_back(rclcpp::Parameter(prefix + ".path",
+      "Analyzer " + std::to_string(i)));
+    initial_values.push_back(rclcpp::Parameter(prefix + ".startswith",
+      "item" + std::to_string(i)));
+    initial_values.push_back(rclcpp::Parameter(prefix + ".timeout", 5.0));
+  }
+  auto options = rclcpp::NodeOptions()
+    .use_global_arguments(false)
+    .initial_parameters(initial_values);
+  return std::make_shared<rclcpp::Node>(
+    "analyzer_init_benchmark_" + std::to_string(num_analyzers), "/", options);
+}
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+
+  const int sizes[] = {1, 10, 100, 1000};
+  printf("%12s %12s %12s\n", "analyzers", "init (ms)", "per (us)");
+  for (int num_analyzers : sizes) {
+    rclcpp::Node::SharedPtr nh = makeNode(num_analyzers);
+    diagnostic_aggregator::AnalyzerGroup analyzer_group;
+
+    // The analyzers are initialized on this thread, inside init(), so they
+    // all share the parameters it loaded instead of fetching their own
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool ok = analyzer_group.init("/", nh->get_name(), nh, NULL);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (!ok) {
+      printf("AnalyzerGroup failed to initialize with %d analyzers\n", num_analyzers);
+      rclcpp::shutdown();
+      return 1;
+    }
+    printf("%12d %12.3f %12.3f\n", num_analyzers, elapsed.count() * 1e3,
+      elapsed.count() * 1e6 / num_analyzers);
+  }
+
+  rclcpp::shutdown();
+  return 0;
+}
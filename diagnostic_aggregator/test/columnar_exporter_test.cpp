@@ -0,0 +1,221 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+#include "diagnostic_aggregator/columnar_exporter.hpp"
+
+using diagnostic_aggregator::ColumnarExporter;
+using diagnostic_msgs::msg::DiagnosticStatus;
+
+namespace
+{
+
+DiagnosticStatus makeStatus(
+  const std::string & name, uint8_t level, const std::string & message,
+  const std::vector<std::pair<std::string, std::string>> & values =
+  std::vector<std::pair<std::string, std::string>>())
+{
+  DiagnosticStatus status;
+  status.name = name;
+  status.level = level;
+  status.message = message;
+  status.hardware_id = "hw";
+  for (const auto & value : values) {
+    diagnostic_msgs::msg::KeyValue kv;
+    kv.key = value.first;
+    kv.value = value.second;
+    status.values.push_back(kv);
+  }
+  return status;
+}
+
+rclcpp::Time at(int64_t seconds)
+{
+  return rclcpp::Time(seconds * 1000000000LL, RCL_ROS_TIME);
+}
+
+std::string readFile(const std::string & path)
+{
+  std::ifstream in(path, std::ios::binary);
+  return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+}
+
+template<typename T>
+std::vector<T> readColumn(const std::string & path)
+{
+  std::string data = readFile(path);
+  std::vector<T> column(data.size() / sizeof(T));
+  memcpy(column.data(), data.data(), column.size() * sizeof(T));
+  return column;
+}
+
+std::vector<std::string> readDictionary(const std::string & path)
+{
+  std::string data = readFile(path);
+  std::vector<std::string> strings;
+  size_t offset = 0;
+  while (offset + sizeof(uint32_t) <= data.size()) {
+    uint32_t length;
+    memcpy(&length, data.data() + offset, sizeof(length));
+    offset += sizeof(length);
+    strings.push_back(data.substr(offset, length));
+    offset += length;
+  }
+  return strings;
+}
+
+void removeTree(const std::string & path)
+{
+  DIR * dir = opendir(path.c_str());
+  if (!dir) {
+    unlink(path.c_str());
+    return;
+  }
+  struct dirent * entry;
+  while ((entry = readdir(dir)) != NULL) {
+    std::string name = entry->d_name;
+    if (name != "." && name != "..") {
+      removeTree(path + "/" + name);
+    }
+  }
+  closedir(dir);
+  rmdir(path.c_str());
+}
+
+}  // namespace
+
+class ColumnarExporterTest : public ::testing::Test
+{
+protected:
+  void SetUp()
+  {
+    char directory[] = "/tmp/columnar_exporter_test.XXXXXX";
+    ASSERT_TRUE(mkdtemp(directory) != NULL);
+    directory_ = directory;
+  }
+
+  void TearDown() {removeTree(directory_);}
+
+  std::string directory_;
+};
+
+TEST_F(ColumnarExporterTest, columns)
+{
+  ColumnarExporter exporter(directory_ + "/out");
+  std::string error;
+  ASSERT_TRUE(exporter.open(error)) << error;
+  exporter.add(makeStatus("motor/left", 0, "ok", {{"temp", "20.5"}}), at(1));
+  exporter.add(makeStatus("motor/left", 1, "hot", {{"temp", "80"}, {"mode", "auto"}}), at(2));
+  exporter.add(makeStatus("motor/left", 0, "ok", {{"mode", "3"}}), at(3));
+  exporter.add(makeStatus("motor/left", 0, "ok", {{"temp", "21"}, {"temp", "99"}}), at(4));
+  ASSERT_TRUE(exporter.finish(error)) << error;
+  EXPECT_EQ(4u, exporter.getRows());
+
+  std::string item = directory_ + "/out/motor_left";
+  EXPECT_EQ(
+    "name\tmotor/left\n"
+    "rows\t4\n"
+    "stamp\tint64\tstamp.bin\n"
+    "level\tuint8\tlevel.bin\n"
+    "message\tdict\tmessage.bin\tmessage.dict\n"
+    "hardware_id\tdict\thardware_id.bin\thardware_id.dict\n"
+    "value\ttemp\tfloat64\tvalue_0.bin\n"
+    "value\tmode\tfloat64\tvalue_1.bin\ttext\tvalue_1_text.bin\tvalue_1_text.dict\n",
+    readFile(item + "/columns.txt"));
+
+  EXPECT_EQ(std::vector<int64_t>({at(1).nanoseconds(), at(2).nanoseconds(),
+    at(3).nanoseconds(), at(4).nanoseconds()}), readColumn<int64_t>(item + "/stamp.bin"));
+  EXPECT_EQ(std::vector<uint8_t>({0, 1, 0, 0}), readColumn<uint8_t>(item + "/level.bin"));
+  EXPECT_EQ(std::vector<uint32_t>({0, 1, 0, 0}), readColumn<uint32_t>(item + "/message.bin"));
+  EXPECT_EQ(std::vector<std::string>({"ok", "hot"}), readDictionary(item + "/message.dict"));
+  EXPECT_EQ(std::vector<uint32_t>({0, 0, 0, 0}), readColumn<uint32_t>(item + "/hardware_id.bin"));
+  EXPECT_EQ(std::vector<std::string>({"hw"}), readDictionary(item + "/hardware_id.dict"));
+
+  // Missing values are NaN, and the first of repeated keys wins
+  std::vector<double> temp = readColumn<double>(item + "/value_0.bin");
+  ASSERT_EQ(4u, temp.size());
+  EXPECT_EQ(20.5, temp[0]);
+  EXPECT_EQ(80, temp[1]);
+  EXPECT_TRUE(std::isnan(temp[2]));
+  EXPECT_EQ(21, temp[3]);
+
+  // Text values are NaN numbers with a code in the text column, 0 for none
+  std::vector<double> mode = readColumn<double>(item + "/value_1.bin");
+  ASSERT_EQ(4u, mode.size());
+  EXPECT_TRUE(std::isnan(mode[0]));
+  EXPECT_TRUE(std::isnan(mode[1]));
+  EXPECT_EQ(3, mode[2]);
+  EXPECT_TRUE(std::isnan(mode[3]));
+  EXPECT_EQ(std::vector<uint32_t>({0, 1, 0, 0}),
+    readColumn<uint32_t>(item + "/value_1_text.bin"));
+  EXPECT_EQ(std::vector<std::string>({"auto"}), readDictionary(item + "/value_1_text.dict"));
+}
+
+TEST_F(ColumnarExporterTest, skipAndDirectoryNames)
+{
+  ColumnarExporter exporter(directory_, 3);
+  std::string error;
+  ASSERT_TRUE(exporter.open(error)) << error;
+  for (int i = 0; i < 7; ++i) {
+    exporter.add(makeStatus("a b", 0, std::to_string(i)), at(i));
+    exporter.add(makeStatus("a/b", 0, std::to_string(i)), at(i));
+  }
+  exporter.add(makeStatus(".hidden", 0, "x"), at(0));
+  ASSERT_TRUE(exporter.finish(error)) << error;
+
+  // Every third status of each item
+  EXPECT_EQ(7u, exporter.getRows());
+  EXPECT_EQ(std::vector<std::string>({"0", "3", "6"}),
+    readDictionary(directory_ + "/a_b/message.dict"));
+
+  // Names that map to the same directory get a suffix
+  EXPECT_EQ(0u, readFile(directory_ + "/a_b/columns.txt").find("name\ta b\n"));
+  EXPECT_EQ(0u, readFile(directory_ + "/a_b_2/columns.txt").find("name\ta/b\n"));
+  EXPECT_EQ(0u, readFile(directory_ + "/_.hidden/columns.txt").find("name\t.hidden\n"));
+}
+
+TEST_F(ColumnarExporterTest, manifestEscapes)
+{
+  ColumnarExporter exporter(directory_);
+  std::string error;
+  ASSERT_TRUE(exporter.open(error)) << error;
+  exporter.add(makeStatus("motor\tleft\\1", 0, "ok", {{"max temp", "1"}, {"a\nb", "2"}}),
+    at(0));
+  ASSERT_TRUE(exporter.finish(error)) << error;
+
+  // Spaces are kept, the separators are escaped
+  std::string manifest = readFile(directory_ + "/motor_left_1/columns.txt");
+  EXPECT_EQ(0u, manifest.find("name\tmotor\\tleft\\\\1\n"));
+  EXPECT_NE(std::string::npos, manifest.find("\nvalue\tmax temp\tfloat64\tvalue_0.bin\n"));
+  EXPECT_NE(std::string::npos, manifest.find("\nvalue\ta\\nb\tfloat64\tvalue_1.bin\n"));
+}
+
+TEST_F(ColumnarExporterTest, unwritableDirectory)
+{
+  ColumnarExporter exporter(directory_ + "/missing/out");
+  std::string error;
+  EXPECT_FALSE(exporter.open(error));
+  EXPECT_FALSE(error.empty());
+}
@@ -0,0 +1,247 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/diagnostic_journal.hpp"
+
+using diagnostic_aggregator::DiagnosticJournal;
+using diagnostic_aggregator::JournalReader;
+using diagnostic_msgs::msg::DiagnosticStatus;
+
+namespace
+{
+
+const size_t kSegmentSize = 64 * 1024;   // The smallest allowed
+const int64_t kAll[2] = {
+  std::numeric_limits<int64_t>::min(), std::numeric_limits<int64_t>::max()
+};
+
+DiagnosticStatus makeStatus(const std::string & name, uint8_t level, const std::string & message)
+{
+  DiagnosticStatus status;
+  status.name = name;
+  status.level = level;
+  status.message = message;
+  return status;
+}
+
+rclcpp::Time at(int64_t ms)
+{
+  return rclcpp::Time(ms * 1000000LL, RCL_ROS_TIME);
+}
+
+std::vector<JournalReader::Entry> readAll(
+  const std::string & directory, const std::string & item = std::string())
+{
+  std::vector<JournalReader::Entry> entries;
+  std::string error;
+  EXPECT_TRUE(JournalReader(directory).read(kAll[0], kAll[1], item, entries, error)) << error;
+  return entries;
+}
+
+}  // namespace
+
+class DiagnosticJournalTest : public ::testing::Test
+{
+protected:
+  void SetUp()
+  {
+    char directory[] = "/tmp/diagnostic_journal_test.XXXXXX";
+    ASSERT_TRUE(mkdtemp(directory) != NULL);
+    directory_ = directory;
+  }
+
+  void TearDown()
+  {
+    journal_.reset();
+    removeDirectory(directory_);
+    if (!copy_.empty()) {
+      removeDirectory(copy_);
+    }
+  }
+
+  void open(size_t max_segments)
+  {
+    journal_.reset(new DiagnosticJournal(directory_, kSegmentSize, max_segments));
+    std::string error;
+    ASSERT_TRUE(journal_->open(error)) << error;
+  }
+
+  static void removeDirectory(const std::string & directory)
+  {
+    std::vector<std::string> segments;
+    diagnostic_aggregator::listJournalSegments(directory, segments);
+    for (const std::string & segment : segments) {
+      unlink(segment.c_str());
+    }
+    rmdir(directory.c_str());
+  }
+
+  std::vector<std::string> segments() const
+  {
+    std::vector<std::string> found;
+    diagnostic_aggregator::listJournalSegments(directory_, found);
+    return found;
+  }
+
+  std::string directory_;
+  std::string copy_;
+  std::unique_ptr<DiagnosticJournal> journal_;
+};
+
+TEST_F(DiagnosticJournalTest, roundTrip)
+{
+  open(3);
+  journal_->record(makeStatus("motor", 0, "ok"), at(1));
+  journal_->record(makeStatus("motor", 0, "ok"), at(2));
+  journal_->record(makeStatus("sensor", 1, "noisy"), at(3));
+  journal_->record(makeStatus("motor", 2, "stalled"), at(4));
+  journal_->record(makeStatus("motor", 2, "stalled"), at(5));
+  journal_->record(makeStatus("motor", 0, "ok"), at(6));
+
+  // Read while the segment is open, then once it's closed and indexed
+  for (int closed = 0; closed < 2; ++closed) {
+    if (closed) {
+      journal_.reset();
+    }
+    std::vector<JournalReader::Entry> all = readAll(directory_);
+    ASSERT_EQ(4u, all.size()) << closed;
+    EXPECT_EQ("motor", all[0].name);
+    EXPECT_EQ("sensor", all[1].name);
+    EXPECT_EQ(1, all[1].level);
+    EXPECT_EQ("noisy", all[1].message);
+    EXPECT_EQ(at(4).nanoseconds(), all[2].stamp);
+
+    std::vector<JournalReader::Entry> motor = readAll(directory_, "motor");
+    ASSERT_EQ(3u, motor.size()) << closed;
+    EXPECT_EQ("ok", motor[0].message);
+    EXPECT_EQ("stalled", motor[1].message);
+    EXPECT_EQ(2, motor[1].level);
+    EXPECT_EQ("ok", motor[2].message);
+
+    // Time range
+    std::vector<JournalReader::Entry> range;
+    std::string error;
+    ASSERT_TRUE(JournalReader(directory_).read(at(2).nanoseconds(), at(4).nanoseconds(),
+      "motor", range, error));
+    ASSERT_EQ(1u, range.size());
+    EXPECT_EQ("stalled", range[0].message);
+  }
+}
+
+TEST_F(DiagnosticJournalTest, rotate)
+{
+  open(3);
+  journal_->record(makeStatus("steady", 0, "ok"), at(0));
+  std::string padding(200, 'x');
+  const int count = 2000;
+  for (int i = 1; i <= count; ++i) {
+    journal_->record(makeStatus("busy", i % 3, std::to_string(i) + padding), at(i));
+  }
+  EXPECT_EQ(3u, segments().size());
+
+  // Only the newest segments are left, in order, ending with the last record
+  std::vector<JournalReader::Entry> all = readAll(directory_);
+  ASSERT_FALSE(all.empty());
+  EXPECT_LT(all.size(), static_cast<size_t>(count));
+  for (size_t i = 1; i < all.size(); ++i) {
+    EXPECT_EQ(all[i - 1].stamp + 1000000, all[i].stamp);
+  }
+  EXPECT_EQ(std::to_string(count) + padding, all.back().message);
+  EXPECT_EQ(all.size(), readAll(directory_, "busy").size());
+
+  // "steady" was forgotten with its segment, so it's recorded again
+  EXPECT_TRUE(readAll(directory_, "steady").empty());
+  journal_->record(makeStatus("steady", 0, "ok"), at(count + 1));
+  std::vector<JournalReader::Entry> steady = readAll(directory_, "steady");
+  ASSERT_EQ(1u, steady.size());
+  EXPECT_EQ(at(count + 1).nanoseconds(), steady[0].stamp);
+
+  // A new journal continues after the existing segments
+  journal_.reset();
+  open(3);
+  journal_->record(makeStatus("busy", 0, "restarted"), at(count + 2));
+  journal_.reset();
+  EXPECT_EQ(3u, segments().size());
+  EXPECT_EQ("restarted", readAll(directory_).back().message);
+}
+
+TEST_F(DiagnosticJournalTest, rotateOnNewItem)
+{
+  // Items first seen when the segment is full start the next one
+  open(3);
+  std::string padding(200, 'x');
+  const int count = 1000;
+  for (int i = 0; i < count; ++i) {
+    journal_->record(makeStatus("busy", i % 3, std::to_string(i) + padding), at(2 * i));
+    journal_->record(makeStatus("item " + std::to_string(i), 1, padding), at(2 * i + 1));
+  }
+  EXPECT_EQ(3u, segments().size());
+
+  std::vector<JournalReader::Entry> all = readAll(directory_);
+  ASSERT_FALSE(all.empty());
+  for (size_t i = 1; i < all.size(); ++i) {
+    EXPECT_EQ(all[i - 1].stamp + 1000000, all[i].stamp);
+  }
+  std::vector<JournalReader::Entry> last = readAll(directory_, "item " + std::to_string(count - 1));
+  ASSERT_EQ(1u, last.size());
+  EXPECT_EQ(1, last[0].level);
+
+  // The last transition of each item is what later ones are compared to
+  journal_->record(makeStatus("item " + std::to_string(count - 1), 1, padding), at(2 * count));
+  journal_->record(makeStatus("busy", 0, "done"), at(2 * count + 1));
+  all = readAll(directory_);
+  EXPECT_EQ("done", all.back().message);
+  EXPECT_EQ(at(2 * count - 2).nanoseconds(), all[all.size() - 3].stamp);
+}
+
+TEST_F(DiagnosticJournalTest, truncatedLastRecord)
+{
+  open(3);
+  for (int i = 0; i < 10; ++i) {
+    journal_->record(makeStatus("motor", i % 2, "message " + std::to_string(i)), at(i));
+  }
+
+  // Copy the open segment, as a crash would leave it, and cut its last record
+  ASSERT_EQ(1u, segments().size());
+  std::ifstream in(segments()[0], std::ios::binary);
+  std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+  const diagnostic_aggregator::JournalSegmentHeader * header =
+    reinterpret_cast<const diagnostic_aggregator::JournalSegmentHeader *>(data.data());
+  ASSERT_GT(header->end, sizeof(*header));
+  data.resize(header->end - 4);
+
+  char copy[] = "/tmp/diagnostic_journal_copy.XXXXXX";
+  ASSERT_TRUE(mkdtemp(copy) != NULL);
+  copy_ = copy;
+  std::string path = segments()[0];
+  std::ofstream out(copy_ + path.substr(path.rfind('/')), std::ios::binary);
+  out.write(data.data(), data.size());
+  out.close();
+
+  std::vector<JournalReader::Entry> all = readAll(copy_);
+  ASSERT_EQ(9u, all.size());
+  EXPECT_EQ("message 8", all.back().message);
+  EXPECT_EQ(9u, readAll(copy_, "motor").size());
+}
@@ -0,0 +1,118 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**< \author Floods /diagnostics like a misbehaving node, next to a well behaved one */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rclcpp/rclcpp.hpp"
+#include "rcutils/cmdline_parser.h"
+
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+
+void print_usage()
+{
+  printf("Usage for flood_pub:\n");
+  printf("flood_pub [-n statuses] [-r rate] [-h]\n");
+  printf("options:\n");
+  printf("-h : Print this help function.\n");
+  printf("-n statuses : Statuses per flood message. Defaults to 1000.\n");
+  printf("-r rate : Flood messages per second. Defaults to 100.\n");
+}
+
+// Publishes "flood: item N" statuses at a high rate, and "quiet: heartbeat" at
+// 1 Hz from another node. With ingest_rate_limit set, the aggregator should
+// keep updating quiet and report flood as the noisiest, limited source.
+class FloodPublisher : public rclcpp::Node
+{
+public:
+  FloodPublisher(const std::string & name, const std::string & prefix, int statuses, double rate)
+  : Node(name), count_(0)
+  {
+    msg_ = std::make_shared<diagnostic_msgs::msg::DiagnosticArray>();
+    for (int i = 0; i < statuses; ++i) {
+      diagnostic_msgs::msg::DiagnosticStatus status;
+      status.name = prefix + ": item " + std::to_string(i);
+      status.level = diagnostic_msgs::msg::DiagnosticStatus::OK;
+      status.message = "OK";
+      msg_->status.push_back(status);
+    }
+
+    pub_ = this->create_publisher<diagnostic_msgs::msg::DiagnosticArray>("/diagnostics");
+
+    auto publish_message = [this]() -> void {
+        rclcpp::Clock clock(RCL_ROS_TIME);
+        msg_->header.stamp = clock.now();
+        // One item escalates now and then, which must get through when
+        // downsampling
+        ++count_;
+        msg_->status[0].level = (count_ / 500) % 2 ?
+          diagnostic_msgs::msg::DiagnosticStatus::WARN :
+          diagnostic_msgs::msg::DiagnosticStatus::OK;
+        pub_->publish(msg_);
+      };
+    timer_ = this->create_wall_timer(std::chrono::duration<double>(1.0 / rate),
+        publish_message);
+  }
+
+private:
+  uint64_t count_;
+  std::shared_ptr<diagnostic_msgs::msg::DiagnosticArray> msg_;
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr pub_;
+  rclcpp::TimerBase::SharedPtr timer_;
+};
+
+int main(int argc, char * argv[])
+{
+  setvbuf(stdout, NULL, _IONBF, BUFSIZ);
+
+  if (rcutils_cli_option_exist(argv, argv + argc, "-h")) {
+    print_usage();
+    return 0;
+  }
+
+  rclcpp::init(argc, argv);
+
+  int statuses = 1000;
+  double rate = 100.0;
+  char * cli_option = rcutils_cli_get_option(argv, argv + argc, "-n");
+  if (nullptr != cli_option) {
+    statuses = std::max(atoi(cli_option), 1);
+  }
+  cli_option = rcutils_cli_get_option(argv, argv + argc, "-r");
+  if (nullptr != cli_option) {
+    rate = atof(cli_option);
+  }
+  if (rate <= 0) {
+    rate = 100.0;
+  }
+
+  auto flood = std::make_shared<FloodPublisher>("flood_pub", "flood", statuses, rate);
+  auto quiet = std::make_shared<FloodPublisher>("quiet_pub", "quiet", 1, 1.0);
+
+  rclcpp::executors::SingleThreadedExecutor executor;
+  executor.add_node(flood);
+  executor.add_node(quiet);
+  executor.spin();
+
+  rclcpp::shutdown();
+  return 0;
+}
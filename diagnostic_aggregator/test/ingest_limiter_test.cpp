@@ -0,0 +1,129 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <set>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/ingest_limiter.hpp"
+
+using diagnostic_aggregator::IngestLimiter;
+
+namespace
+{
+
+// Low enough that no tokens are refilled during a test
+const double kRate = 1e-6;
+
+diagnostic_msgs::msg::DiagnosticArray makeMessage(
+  const std::vector<std::string> & names, uint8_t level = 0)
+{
+  diagnostic_msgs::msg::DiagnosticArray msg;
+  for (const std::string & name : names) {
+    diagnostic_msgs::msg::DiagnosticStatus status;
+    status.name = name;
+    status.level = level;
+    msg.status.push_back(status);
+  }
+  return msg;
+}
+
+size_t countAdmitted(IngestLimiter & limiter, const std::vector<std::string> & names,
+  uint8_t level = 0)
+{
+  std::vector<bool> admitted;
+  size_t dropped = limiter.filter(makeMessage(names, level), "publisher", admitted);
+  EXPECT_EQ(names.size(), admitted.size());
+  return names.size() - dropped;
+}
+
+std::set<std::string> reportedSources(IngestLimiter & limiter)
+{
+  std::set<std::string> sources;
+  auto status = limiter.report("Sources", 100);
+  for (size_t i = 2; i < status->values.size(); ++i) {
+    sources.insert(status->values[i].key);
+  }
+  return sources;
+}
+
+}  // namespace
+
+TEST(IngestLimiter, sourceName)
+{
+  EXPECT_EQ("node", IngestLimiter::getSourceName("node: Status"));
+  EXPECT_EQ("node", IngestLimiter::getSourceName("node: a: b"));
+  EXPECT_EQ("", IngestLimiter::getSourceName("no prefix"));
+}
+
+TEST(IngestLimiter, limitsEachSource)
+{
+  IngestLimiter limiter(IngestLimiter::Key_Name, kRate, 5, IngestLimiter::Action_Drop, 100);
+  std::vector<std::string> names;
+  for (int i = 0; i < 10; ++i) {
+    names.push_back("a: status " + std::to_string(i));
+    names.push_back("b: status " + std::to_string(i));
+  }
+  EXPECT_EQ(10u, countAdmitted(limiter, names));
+  EXPECT_EQ(10u, limiter.getDropped());
+
+  auto status = limiter.report("Sources", 10);
+  EXPECT_EQ(diagnostic_msgs::msg::DiagnosticStatus::WARN, status->level);
+  EXPECT_EQ("2 sources limited", status->message);
+}
+
+TEST(IngestLimiter, unprefixedNamesShareASource)
+{
+  IngestLimiter limiter(IngestLimiter::Key_Name, kRate, 5, IngestLimiter::Action_Drop, 100);
+  std::vector<std::string> names;
+  for (int i = 0; i < 20; ++i) {
+    names.push_back("status " + std::to_string(i));
+  }
+  EXPECT_EQ(5u, countAdmitted(limiter, names));
+  EXPECT_EQ(std::set<std::string>({"(no prefix)"}), reportedSources(limiter));
+}
+
+TEST(IngestLimiter, forgetsLeastRecentlySeenSource)
+{
+  IngestLimiter limiter(IngestLimiter::Key_Name, kRate, 2, IngestLimiter::Action_Drop, 2);
+  EXPECT_EQ(2u, countAdmitted(limiter, {"a: 1", "a: 2"}));
+  EXPECT_EQ(1u, countAdmitted(limiter, {"b: 1"}));
+  EXPECT_EQ(0u, countAdmitted(limiter, {"a: 3"}));
+
+  // b was seen least recently, so it's forgotten for c, and a keeps its
+  // empty bucket
+  EXPECT_EQ(1u, countAdmitted(limiter, {"c: 1"}));
+  EXPECT_EQ(std::set<std::string>({"a", "c"}), reportedSources(limiter));
+  EXPECT_EQ(0u, countAdmitted(limiter, {"a: 4"}));
+}
+
+TEST(IngestLimiter, downsampleAdmitsLevelChanges)
+{
+  IngestLimiter limiter(IngestLimiter::Key_Name, kRate, 1, IngestLimiter::Action_Downsample,
+    100);
+  EXPECT_EQ(1u, countAdmitted(limiter, {"a: x"}));
+  EXPECT_EQ(0u, countAdmitted(limiter, {"a: x"}));
+  EXPECT_EQ(1u, countAdmitted(limiter, {"a: x"}, 2));
+  EXPECT_EQ(0u, countAdmitted(limiter, {"a: x"}, 2));
+  // New items are admitted once
+  EXPECT_EQ(1u, countAdmitted(limiter, {"a: y"}));
+}
+
+TEST(IngestLimiter, noLimit)
+{
+  IngestLimiter limiter(IngestLimiter::Key_Publisher, 0, 1, IngestLimiter::Action_Drop, 100);
+  std::vector<std::string> names(1000, "a: x");
+  EXPECT_EQ(1000u, countAdmitted(limiter, names));
+  EXPECT_EQ(std::set<std::string>({"publisher"}), reportedSources(limiter));
+}
@@ -0,0 +1,188 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//  Compares PatternMatcher and RegexSet with the pattern by pattern loops
+//  GenericAnalyzer used
+
+#include <chrono>
+#include <cstdio>
+#include <regex>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/pattern_matcher.hpp"
+#include "diagnostic_aggregator/regex_set.hpp"
+
+const int kRounds = 20;
+
+struct Patterns
+{
+  std::vector<std::string> names, startswith, contains;
+};
+
+//  Like a wide YAML analyzer: a few names and prefixes, many substrings
+Patterns makePatterns(int num_contains)
+{
+  Patterns patterns;
+  for (int i = 0; i < 10; ++i) {
+    patterns.names.push_back("sensor_" + std::to_string(i) + ": Status");
+  }
+  for (int i = 0; i < 20; ++i) {
+    patterns.startswith.push_back("driver_" + std::to_string(i) + ":");
+  }
+  const char * words[] = {"Temperature", "Voltage", "Current", "Encoder", "Battery",
+    "Motor", "Joint", "Camera", "Lidar", "Network"};
+  for (int i = 0; i < num_contains; ++i) {
+    patterns.contains.push_back(std::string(words[i % 10]) + " " + std::to_string(i));
+  }
+  return patterns;
+}
+
+//  Half the names match a substring near their end, the others match nothing
+std::vector<std::string> makeNames(int num_contains)
+{
+  std::vector<std::string> names;
+  for (int i = 0; i < 1000; ++i) {
+    std::string name = "robot_node_" + std::to_string(i) + ": Hardware Monitor ";
+    if (i % 2) {
+      name += "Motor " + std::to_string((i * 7) % num_contains / 10 * 10 + 5);
+    } else {
+      name += "Fan Speed " + std::to_string(i);
+    }
+    names.push_back(name);
+  }
+  return names;
+}
+
+//  GenericAnalyzer::match() before PatternMatcher
+bool loopMatch(const Patterns & patterns, const std::string & name)
+{
+  for (unsigned int i = 0; i < patterns.names.size(); ++i) {
+    if (name == patterns.names[i]) {
+      return true;
+    }
+  }
+  for (unsigned int i = 0; i < patterns.startswith.size(); ++i) {
+    if (name.find(patterns.startswith[i]) == 0) {
+      return true;
+    }
+  }
+  for (unsigned int i = 0; i < patterns.contains.size(); ++i) {
+    if (name.find(patterns.contains[i]) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template<class Match>
+double run(const std::vector<std::string> & names, Match match, int & matched)
+{
+  matched = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int round = 0; round < kRounds; ++round) {
+    for (unsigned int i = 0; i < names.size(); ++i) {
+      matched += match(names[i]);
+    }
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return elapsed * 1e9 / (kRounds * names.size());
+}
+
+int main()
+{
+  using diagnostic_aggregator::PatternMatcher;
+  const char * impl_names[] = {"scalar", "ssse3", "avx2"};
+  const int sizes[] = {10, 100, 1000};
+
+  printf("%10s %10s %12s %10s\n", "contains", "matcher", "ns/match", "matched");
+  for (int num_contains : sizes) {
+    Patterns patterns = makePatterns(num_contains);
+    std::vector<std::string> names = makeNames(num_contains);
+
+    int expected;
+    double ns = run(names, [&](const std::string & name) {
+          return loopMatch(patterns, name);
+        }, expected);
+    printf("%10d %10s %12.1f %10d\n", num_contains, "loop", ns, expected);
+
+    for (int impl = PatternMatcher::Impl_Scalar; impl <= PatternMatcher::getBestImplementation();
+      ++impl)
+    {
+      PatternMatcher matcher;
+      for (const std::string & name : patterns.names) {
+        matcher.addExact(name);
+      }
+      for (const std::string & prefix : patterns.startswith) {
+        matcher.addPrefix(prefix);
+      }
+      for (const std::string & substring : patterns.contains) {
+        matcher.addContains(substring);
+      }
+      matcher.build();
+      matcher.setImplementation(static_cast<PatternMatcher::Implementation>(impl));
+
+      int matched;
+      ns = run(names, [&](const std::string & name) {
+            return matcher.match(name);
+          }, matched);
+      printf("%10d %10s %12.1f %10d%s\n", num_contains, impl_names[impl], ns, matched,
+        matched == expected ? "" : " MISMATCH");
+    }
+  }
+
+  //  The same rules as regexes, std::regex one at a time against RegexSet
+  printf("\n%10s %10s %12s %10s\n", "regexes", "matcher", "ns/match", "matched");
+  const int regex_sizes[] = {10, 100};
+  for (int num_regexes : regex_sizes) {
+    std::vector<std::string> names = makeNames(num_regexes);
+    std::vector<std::regex> regexes;
+    diagnostic_aggregator::RegexSet regex_set;
+    for (int i = 0; i < num_regexes; ++i) {
+      std::string pattern = ".*: .* Motor " + std::to_string(i) + "\\d?";
+      regexes.push_back(std::regex(pattern));
+      std::string error;
+      if (!regex_set.add(pattern, error)) {
+        printf("RegexSet rejected %s: %s\n", pattern.c_str(), error.c_str());
+        return 1;
+      }
+    }
+    std::string error;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (!regex_set.compile(error)) {
+      printf("RegexSet failed to compile: %s\n", error.c_str());
+      return 1;
+    }
+    double compile_ms =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1e3;
+
+    int expected;
+    double ns = run(names, [&](const std::string & name) {
+          for (const std::regex & regex : regexes) {
+            if (std::regex_match(name, regex)) {
+              return true;
+            }
+          }
+          return false;
+        }, expected);
+    printf("%10d %10s %12.1f %10d\n", num_regexes, "std", ns, expected);
+
+    int matched;
+    ns = run(names, [&](const std::string & name) {
+          return regex_set.match(name);
+        }, matched);
+    printf("%10d %10s %12.1f %10d%s (%zu states, compiled in %.1f ms)\n", num_regexes, "dfa", ns,
+      matched, matched == expected ? "" : " MISMATCH", regex_set.getStateCount(), compile_ms);
+  }
+  return 0;
+}
@@ -0,0 +1,123 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/analyzer_group.hpp"
+#include "diagnostic_aggregator/analyzer_params.hpp"
+#include "diagnostic_aggregator/match_cache.hpp"
+
+using diagnostic_aggregator::MatchCache;
+
+namespace
+{
+
+const std::vector<bool> kMatches = {true, false};
+
+std::shared_ptr<diagnostic_aggregator::StatusItem> makeItem(const std::string & name)
+{
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.name = name;
+  return std::make_shared<diagnostic_aggregator::StatusItem>(&status);
+}
+
+}  // namespace
+
+TEST(MatchCache, findAndInsert)
+{
+  MatchCache cache;
+  EXPECT_EQ(NULL, cache.find("a"));
+  EXPECT_EQ(kMatches, cache.insert("a", kMatches));
+  ASSERT_NE(nullptr, cache.find("a"));
+  EXPECT_EQ(kMatches, *cache.find("a"));
+  ASSERT_NE(nullptr, cache.peek("a"));
+  EXPECT_EQ(kMatches, *cache.peek("a"));
+  EXPECT_EQ(1u, cache.size());
+
+  cache.clear();
+  EXPECT_EQ(NULL, cache.peek("a"));
+  EXPECT_EQ(0u, cache.size());
+}
+
+TEST(MatchCache, evictsUnreferencedFirst)
+{
+  MatchCache cache(3);
+  cache.insert("steady1", kMatches);
+  cache.insert("steady2", kMatches);
+  cache.insert("once1", kMatches);
+  cache.find("steady1");
+  cache.find("steady2");
+
+  // Peeking isn't a use, so once1 is still the first unreferenced entry
+  cache.peek("once1");
+  cache.insert("once2", kMatches);
+  EXPECT_EQ(1u, cache.getEvictions());
+  EXPECT_EQ(NULL, cache.peek("once1"));
+  EXPECT_NE(nullptr, cache.peek("steady1"));
+  EXPECT_NE(nullptr, cache.peek("steady2"));
+  EXPECT_NE(nullptr, cache.peek("once2"));
+}
+
+TEST(MatchCache, shrink)
+{
+  MatchCache cache;
+  for (int i = 0; i < 10; ++i) {
+    cache.insert("name" + std::to_string(i), kMatches);
+  }
+  cache.setCapacity(4);
+  EXPECT_EQ(4u, cache.size());
+  EXPECT_EQ(6u, cache.getEvictions());
+  cache.insert("new", kMatches);
+  EXPECT_EQ(4u, cache.size());
+  EXPECT_NE(nullptr, cache.peek("new"));
+}
+
+TEST(MatchCache, groupKeepsSteadyNames)
+{
+  // One analyzer matching everything
+  auto params = std::make_shared<diagnostic_aggregator::AnalyzerParamMap>();
+  (*params)["analyzers_params.all.type"] = "diagnostic_aggregator/GenericAnalyzer";
+  (*params)["analyzers_params.all.path"] = "All";
+  (*params)["analyzers_params.all.contains"] = "e";
+  rclcpp::Node::SharedPtr node = rclcpp::Node::make_shared("test_node");
+  diagnostic_aggregator::AnalyzerGroup group;
+  {
+    diagnostic_aggregator::AnalyzerParamsScope scope("test_node", params);
+    ASSERT_TRUE(group.init("/", "test_node", node, NULL));
+  }
+  group.setMatchCacheSize(3);
+
+  // Each status is matched, then analyzed, like the aggregator does. Analyzing
+  // must not count as a second use, or every name looks steady.
+  auto receive = [&group](const std::string & name) {
+      ASSERT_TRUE(group.match(name));
+      ASSERT_TRUE(group.analyze(makeItem(name)));
+    };
+  receive("steady1");
+  receive("steady2");
+  receive("one-off1");
+  receive("steady1");
+  receive("steady2");
+
+  receive("one-off2");
+  EXPECT_EQ(1u, group.getMatchCacheEvictions());
+
+  // The steady names are still cached, so seeing them again evicts nothing
+  receive("steady1");
+  receive("steady2");
+  EXPECT_EQ(1u, group.getMatchCacheEvictions());
+  EXPECT_EQ(3u, group.getMatchCacheSize());
+}
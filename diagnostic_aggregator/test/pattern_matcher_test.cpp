@@ -0,0 +1,199 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/pattern_matcher.hpp"
+
+using diagnostic_aggregator::PatternMatcher;
+
+namespace
+{
+
+const PatternMatcher::Implementation kImplementations[] = {
+  PatternMatcher::Impl_Scalar, PatternMatcher::Impl_SSSE3, PatternMatcher::Impl_AVX2
+};
+
+/*
+ *\brief The patterns of a PatternMatcher, matched one by one
+ */
+struct NaiveMatcher
+{
+  std::vector<std::string> exact, prefixes, contains;
+
+  bool match(const std::string & name) const
+  {
+    for (const std::string & pattern : exact) {
+      if (name == pattern) {
+        return true;
+      }
+    }
+    for (const std::string & pattern : prefixes) {
+      if (name.compare(0, pattern.size(), pattern) == 0) {
+        return true;
+      }
+    }
+    for (const std::string & pattern : contains) {
+      if (name.find(pattern) != std::string::npos) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+/*
+ *\brief Random string of a small alphabet, so that patterns often match
+ */
+std::string randomString(std::mt19937 & rng, size_t size)
+{
+  static const char kAlphabet[] = "abc/ \xe9";
+  std::string str;
+  for (size_t i = 0; i < size; ++i) {
+    str += kAlphabet[rng() % (sizeof(kAlphabet) - 1)];
+  }
+  return str;
+}
+
+/*
+ *\brief Checks every implementation supported by this CPU against naive on
+ *random names of up to max_size bytes
+ */
+void expectSameMatches(PatternMatcher & matcher, const NaiveMatcher & naive, size_t max_size)
+{
+  std::mt19937 rng(42);
+  std::vector<std::string> names;
+  for (int i = 0; i < 2000; ++i) {
+    names.push_back(randomString(rng, rng() % (max_size + 1)));
+  }
+  // A pattern at the very end of names that fill whole blocks
+  for (const std::string & pattern : naive.contains) {
+    for (size_t size : {16, 31, 32, 33, 64}) {
+      if (pattern.size() <= size) {
+        names.push_back(std::string(size - pattern.size(), 'x') + pattern);
+      }
+    }
+  }
+
+  for (PatternMatcher::Implementation impl : kImplementations) {
+    matcher.setImplementation(impl);
+    if (matcher.getImplementation() != impl) {
+      continue;  // Unsupported by this CPU
+    }
+    for (const std::string & name : names) {
+      EXPECT_EQ(naive.match(name), matcher.match(name)) << "impl " << impl << ", \"" << name <<
+        "\"";
+    }
+  }
+}
+
+}  // namespace
+
+TEST(PatternMatcher, exactAndPrefix)
+{
+  PatternMatcher matcher;
+  NaiveMatcher naive;
+  naive.exact = {"abc", "a/b", ""};
+  naive.prefixes = {"c", "ba", "b/ a"};
+  for (const std::string & pattern : naive.exact) {
+    matcher.addExact(pattern);
+  }
+  for (const std::string & pattern : naive.prefixes) {
+    matcher.addPrefix(pattern);
+  }
+  matcher.build();
+
+  EXPECT_TRUE(matcher.match(""));
+  EXPECT_TRUE(matcher.match("cab"));
+  EXPECT_FALSE(matcher.match("abcd"));
+  expectSameMatches(matcher, naive, 8);
+}
+
+TEST(PatternMatcher, emptyPatterns)
+{
+  PatternMatcher prefix;
+  prefix.addPrefix("");
+  prefix.build();
+  EXPECT_TRUE(prefix.match(""));
+  EXPECT_TRUE(prefix.match("a"));
+
+  PatternMatcher contains;
+  contains.addContains("");
+  contains.build();
+  EXPECT_TRUE(contains.match(""));
+  EXPECT_TRUE(contains.match("a"));
+
+  PatternMatcher none;
+  none.build();
+  EXPECT_TRUE(none.empty());
+  EXPECT_FALSE(none.match("a"));
+}
+
+TEST(PatternMatcher, fewContains)
+{
+  PatternMatcher matcher;
+  NaiveMatcher naive;
+  naive.contains = {"a", "bc", "c/c", "\xe9 "};
+  for (const std::string & pattern : naive.contains) {
+    matcher.addContains(pattern);
+  }
+  matcher.build();
+  expectSameMatches(matcher, naive, 80);
+}
+
+TEST(PatternMatcher, manyContains)
+{
+  // More patterns than buckets, some longer than a 32 byte block, so that
+  // candidates are verified across blocks
+  std::mt19937 rng(7);
+  PatternMatcher matcher;
+  NaiveMatcher naive;
+  for (int i = 0; i < 200; ++i) {
+    naive.contains.push_back(randomString(rng, 4 + rng() % 6));
+  }
+  for (int i = 0; i < 10; ++i) {
+    naive.contains.push_back(randomString(rng, 33 + rng() % 20));
+  }
+  naive.contains.push_back(naive.contains.back());
+  for (const std::string & pattern : naive.contains) {
+    matcher.addContains(pattern);
+  }
+  matcher.build();
+  expectSameMatches(matcher, naive, 100);
+}
+
+TEST(PatternMatcher, everyKind)
+{
+  PatternMatcher matcher;
+  NaiveMatcher naive;
+  naive.exact = {"exact"};
+  naive.prefixes = {"/pre"};
+  naive.contains = {"mid", "dle"};
+  matcher.addExact("exact");
+  matcher.addPrefix("/pre");
+  matcher.addContains("mid");
+  matcher.addContains("dle");
+  matcher.build();
+
+  for (const std::string & name : {"exact", "exactly", "/prefix", "a/pre", "the middle",
+      "saddle", "none"})
+  {
+    for (PatternMatcher::Implementation impl : kImplementations) {
+      matcher.setImplementation(impl);
+      EXPECT_EQ(naive.match(name), matcher.match(name)) << name;
+    }
+  }
+}
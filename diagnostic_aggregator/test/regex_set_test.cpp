@@ -0,0 +1,134 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/regex_set.hpp"
+
+using diagnostic_aggregator::RegexSet;
+
+namespace
+{
+
+/*
+ *\brief Random names over the bytes the test patterns tell apart
+ */
+std::vector<std::string> randomNames()
+{
+  static const char kAlphabet[] = "ab/_ 0Z-.\t";
+  std::mt19937 rng(42);
+  std::vector<std::string> names = {""};
+  for (int i = 0; i < 3000; ++i) {
+    std::string name;
+    size_t size = rng() % 12;
+    for (size_t j = 0; j < size; ++j) {
+      name += kAlphabet[rng() % (sizeof(kAlphabet) - 1)];
+    }
+    names.push_back(name);
+  }
+  return names;
+}
+
+/*
+ *\brief Checks that a set of the patterns matches like std::regex_match with
+ *any of them
+ */
+void expectSameMatches(const std::vector<std::string> & patterns)
+{
+  RegexSet set;
+  std::vector<std::regex> regexes;
+  std::string error;
+  for (const std::string & pattern : patterns) {
+    ASSERT_TRUE(set.add(pattern, error)) << pattern << ": " << error;
+    regexes.push_back(std::regex(pattern));
+  }
+  ASSERT_TRUE(set.compile(error)) << error;
+
+  for (const std::string & name : randomNames()) {
+    bool expected = false;
+    for (const std::regex & regex : regexes) {
+      expected = expected || std::regex_match(name, regex);
+    }
+    EXPECT_EQ(expected, set.match(name)) << "\"" << name << "\"";
+  }
+}
+
+}  // namespace
+
+TEST(RegexSet, supportedSyntax)
+{
+  const char * patterns[] = {
+    "ab", "a.b", "a*b+", "(ab)?/", "(?:a|b){2,3}", "a{2}", "a{1,}b", "a*?b", "a+?",
+    "[ab]_[^ab]", "[a-z0]+", "\\d\\w\\s", "\\D\\W\\S", "[[:alpha:]]+", "[[:digit:][:space:]]",
+    "^a.*$", "\\.\\-\\/", "[\\d.]+", "(a|b|)c?", "[-a]", "[a-]Z",
+  };
+  for (const char * pattern : patterns) {
+    SCOPED_TRACE(pattern);
+    expectSameMatches({pattern});
+  }
+}
+
+TEST(RegexSet, severalPatterns)
+{
+  expectSameMatches({"a.*", ".*b", "(0|Z)+", "\\s"});
+}
+
+TEST(RegexSet, rejectedSyntax)
+{
+  const char * patterns[] = {
+    "(a)\\1", "a(?=b)", "a(?!b)", "\\ba", "a\\B", "(ab", "a)", "[ab", "*a", "a{2,1}",
+    "a^b", "a$b",
+  };
+  for (const char * pattern : patterns) {
+    RegexSet set;
+    std::string error;
+    EXPECT_FALSE(set.add(pattern, error)) << pattern;
+    EXPECT_FALSE(error.empty()) << pattern;
+  }
+}
+
+TEST(RegexSet, nestingLimit)
+{
+  RegexSet set;
+  std::string error;
+  EXPECT_TRUE(set.add(std::string(256, '(') + "a" + std::string(256, ')'), error)) << error;
+
+  EXPECT_FALSE(set.add(std::string(257, '(') + "a" + std::string(257, ')'), error));
+  EXPECT_NE(std::string::npos, error.find("nested deeper than 256")) << error;
+
+  // Deep enough to overflow the stack without the limit
+  EXPECT_FALSE(set.add(std::string(300000, '('), error));
+  EXPECT_FALSE(error.empty());
+}
+
+TEST(RegexSet, stateLimit)
+{
+  // A match must remember the last 31 bytes, more states than allowed
+  RegexSet set(1000);
+  std::string error;
+  ASSERT_TRUE(set.add(".*a.{30}", error)) << error;
+  EXPECT_FALSE(set.compile(error));
+  EXPECT_FALSE(error.empty());
+
+  // Within the limit
+  RegexSet small(1000);
+  ASSERT_TRUE(small.add(".*a.{5}", error)) << error;
+  ASSERT_TRUE(small.compile(error)) << error;
+  EXPECT_LE(small.getStateCount(), 1000u);
+  EXPECT_TRUE(small.match("xxa12345"));
+  EXPECT_FALSE(small.match("xxa1234"));
+}
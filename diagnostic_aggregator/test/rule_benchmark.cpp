@@ -0,0 +1,101 @@
+// Copyright 2018 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/**< \author Measures RuleAnalyzer evaluation time as the number of rules grows */
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/analyzer_params.hpp"
+#include "diagnostic_aggregator/rule_analyzer.hpp"
+
+const int kStatuses = 100;
+const int kRounds = 100;
+
+//  Parameters of a RuleAnalyzer with num_rules rules, each reading two of
+//  kStatuses statuses
+diagnostic_aggregator::AnalyzerParamMapConstPtr makeParams(int num_rules)
+{
+  auto params = std::make_shared<diagnostic_aggregator::AnalyzerParamMap>();
+  (*params)["analyzers_params.rules.type"] = "diagnostic_aggregator/RuleAnalyzer";
+  (*params)["analyzers_params.rules.path"] = "Rules";
+  for (int i = 0; i < num_rules; ++i) {
+    std::string a = "item" + std::to_string(i % kStatuses);
+    std::string b = "item" + std::to_string((i * 7 + 1) % kStatuses);
+    (*params)["analyzers_params.rules.rules.rule" + std::to_string(i) + ".expr"] =
+      "value('" + a + "', 'temp') > " + std::to_string(i % 90) + " && level('" + b +
+      "') >= WARN || value('" + b + "', 'load') * 2 > 1.5";
+  }
+  return params;
+}
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+  rclcpp::Node::SharedPtr nh = rclcpp::Node::make_shared("rule_benchmark");
+
+  std::vector<std::shared_ptr<diagnostic_aggregator::StatusItem>> items;
+  for (int i = 0; i < kStatuses; ++i) {
+    diagnostic_msgs::msg::DiagnosticStatus status;
+    status.name = "item" + std::to_string(i);
+    status.level = i % 3;
+    diagnostic_msgs::msg::KeyValue kv;
+    kv.key = "temp";
+    kv.value = std::to_string(i);
+    status.values.push_back(kv);
+    kv.key = "load";
+    kv.value = "0.5";
+    status.values.push_back(kv);
+    items.push_back(std::make_shared<diagnostic_aggregator::StatusItem>(&status));
+  }
+
+  const int sizes[] = {10, 100, 1000, 10000};
+  printf("%8s %14s %18s %14s\n", "rules", "compile (ms)", "analyze all (us)", "report (us)");
+  for (int num_rules : sizes) {
+    diagnostic_aggregator::RuleAnalyzer analyzer;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+      diagnostic_aggregator::AnalyzerParamsScope scope(nh->get_name(), makeParams(num_rules));
+      if (!analyzer.init("/", nh->get_name(), nh, "analyzers_params.rules.type")) {
+        printf("RuleAnalyzer failed to initialize with %d rules\n", num_rules);
+        rclcpp::shutdown();
+        return 1;
+      }
+    }
+    std::chrono::duration<double> compile = std::chrono::steady_clock::now() - start;
+
+    // Every status updated once, so every rule is evaluated twice
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+      for (const auto & item : items) {
+        analyzer.analyze(item);
+      }
+    }
+    std::chrono::duration<double> analyze = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int round = 0; round < kRounds; ++round) {
+      analyzer.report();
+    }
+    std::chrono::duration<double> report = std::chrono::steady_clock::now() - start;
+
+    printf("%8d %14.3f %18.3f %14.3f\n", num_rules, compile.count() * 1e3,
+      analyze.count() * 1e6 / kRounds, report.count() * 1e6 / kRounds);
+  }
+
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,330 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "diagnostic_aggregator/analyzer_params.hpp"
+#include "diagnostic_aggregator/rule_analyzer.hpp"
+#include "diagnostic_aggregator/rule_expression.hpp"
+
+using diagnostic_aggregator::RuleExpression;
+
+namespace
+{
+
+/*
+ *\brief Compiles expressions, giving one slot to each distinct field
+ */
+class Compiler
+{
+public:
+  bool compile(RuleExpression & expr, const std::string & text, std::string & error)
+  {
+    return expr.compile(text,
+             [this](const std::string & name, const std::string & key) {
+               std::pair<std::string, std::string> id(name, key);
+               if (!ids.count(id)) {
+                 ids[id] = slots.size();
+                 slots.push_back(std::numeric_limits<double>::quiet_NaN());
+               }
+               return ids[id];
+             }, error);
+  }
+
+  double evaluate(const std::string & text)
+  {
+    RuleExpression expr;
+    std::string error;
+    EXPECT_TRUE(compile(expr, text, error)) << text << ": " << error;
+    return expr.evaluate(slots);
+  }
+
+  bool test(const std::string & text)
+  {
+    RuleExpression expr;
+    std::string error;
+    EXPECT_TRUE(compile(expr, text, error)) << text << ": " << error;
+    return expr.test(slots);
+  }
+
+  std::string error(const std::string & text)
+  {
+    RuleExpression expr;
+    std::string error;
+    EXPECT_FALSE(compile(expr, text, error)) << text;
+    return error;
+  }
+
+  std::map<std::pair<std::string, std::string>, uint32_t> ids;
+  std::vector<double> slots;
+};
+
+diagnostic_msgs::msg::DiagnosticStatus makeStatus(
+  const std::string & name, uint8_t level,
+  const std::vector<std::pair<std::string, std::string>> & values = {})
+{
+  diagnostic_msgs::msg::DiagnosticStatus status;
+  status.name = name;
+  status.level = level;
+  for (const auto & value : values) {
+    diagnostic_msgs::msg::KeyValue kv;
+    kv.key = value.first;
+    kv.value = value.second;
+    status.values.push_back(kv);
+  }
+  return status;
+}
+
+/*
+ *\brief Level of the status reported for a rule
+ */
+uint8_t ruleLevel(diagnostic_aggregator::RuleAnalyzer & analyzer, const std::string & rule)
+{
+  for (const auto & status : analyzer.report()) {
+    if (status->name == analyzer.getPath() + "/" + rule) {
+      return status->level;
+    }
+  }
+  ADD_FAILURE() << "No status for rule " << rule;
+  return 255;
+}
+
+}  // namespace
+
+TEST(RuleExpression, precedence)
+{
+  Compiler c;
+  EXPECT_EQ(7.0, c.evaluate("1 + 2 * 3"));
+  EXPECT_EQ(7.0, c.evaluate("2 * 3 + 1"));
+  EXPECT_EQ(9.0, c.evaluate("(1 + 2) * 3"));
+  EXPECT_EQ(1.0, c.evaluate("8 - 4 - 3"));
+  EXPECT_EQ(1.0, c.evaluate("8 / 4 / 2"));
+  EXPECT_EQ(-6.0, c.evaluate("-2 * 3"));
+  EXPECT_EQ(2.0, c.evaluate("- -2"));
+  EXPECT_EQ(0.5, c.evaluate(".5"));
+
+  // Comparisons bind looser than arithmetic, "and" tighter than "or"
+  EXPECT_TRUE(c.test("1 + 1 == 2"));
+  EXPECT_TRUE(c.test("1 < 2 && 3 >= 3"));
+  EXPECT_TRUE(c.test("1 || 0 && 0"));
+  EXPECT_FALSE(c.test("(1 || 0) && 0"));
+  EXPECT_TRUE(c.test("true or false and false"));
+  EXPECT_TRUE(c.test("!0 && not false"));
+  EXPECT_TRUE(c.test("!1 == 0"));
+  EXPECT_TRUE(c.test("1 != 2"));
+  EXPECT_TRUE(c.test("ERROR > WARN && WARN > OK && STALE == 3"));
+}
+
+TEST(RuleExpression, fields)
+{
+  Compiler c;
+  RuleExpression expr;
+  std::string error;
+  ASSERT_TRUE(c.compile(expr,
+    "value('Motor', 'temp') > 70 && level('Motor') >= WARN && value('Motor', 'temp') < 90",
+    error)) << error;
+  // The same field twice uses a single slot
+  EXPECT_EQ(2u, expr.getSlots().size());
+
+  uint32_t temp = c.ids[std::make_pair(std::string("Motor"), std::string("temp"))];
+  uint32_t level = c.ids[std::make_pair(std::string("Motor"), std::string(""))];
+  c.slots[temp] = 80;
+  c.slots[level] = 1;
+  EXPECT_TRUE(expr.test(c.slots));
+  c.slots[temp] = 95;
+  EXPECT_FALSE(expr.test(c.slots));
+  c.slots[temp] = 80;
+  c.slots[level] = 0;
+  EXPECT_FALSE(expr.test(c.slots));
+}
+
+TEST(RuleExpression, nan)
+{
+  // Missing fields are NaN, and every comparison against NaN is false
+  Compiler c;
+  EXPECT_FALSE(c.test("level('missing') > 1"));
+  EXPECT_FALSE(c.test("level('missing') <= 1"));
+  EXPECT_FALSE(c.test("level('missing') == level('missing')"));
+  EXPECT_FALSE(c.test("level('missing') != 1"));
+  EXPECT_FALSE(c.test("level('missing')"));
+  EXPECT_FALSE(c.test("level('missing') || false"));
+  EXPECT_TRUE(c.test("!level('missing')"));
+  EXPECT_TRUE(c.test("!(level('missing') > 1)"));
+
+  RuleExpression empty;
+  EXPECT_NE(empty.evaluate(c.slots), empty.evaluate(c.slots));
+}
+
+TEST(RuleExpression, malformed)
+{
+  Compiler c;
+  EXPECT_NE(std::string::npos, c.error("").find("Unexpected end"));
+  EXPECT_NE(std::string::npos, c.error("1 +").find("Unexpected end"));
+  EXPECT_NE(std::string::npos, c.error("(1 + 2").find("Expected ')'"));
+  EXPECT_NE(std::string::npos, c.error("1 2").find("Unexpected '2'"));
+  EXPECT_NE(std::string::npos, c.error("level(Motor)").find("Expected quoted string"));
+  EXPECT_NE(std::string::npos, c.error("level('Motor)").find("Unterminated string"));
+  EXPECT_NE(std::string::npos, c.error("level('Motor'").find("level('status name')"));
+  EXPECT_NE(std::string::npos, c.error("value('Motor')").find("value('status name', 'key')"));
+  EXPECT_NE(std::string::npos, c.error("value('Motor', '')").find("Empty key"));
+  EXPECT_NE(std::string::npos, c.error("levels('Motor')").find("Unexpected 'l'"));
+  EXPECT_NE(std::string::npos, c.error("1 # 2").find("Unexpected '# 2'"));
+
+  // A failed compilation leaves nothing to evaluate
+  RuleExpression expr;
+  std::string error;
+  EXPECT_FALSE(c.compile(expr, "1 +", error));
+  EXPECT_EQ(0u, expr.size());
+}
+
+TEST(RuleExpression, nesting)
+{
+  Compiler c;
+  EXPECT_TRUE(c.test(std::string(200, '(') + "1" + std::string(200, ')')));
+  EXPECT_TRUE(c.test(std::string(200, '!') + "1"));
+
+  // Deeper nesting is rejected instead of overflowing the stack
+  EXPECT_NE(std::string::npos,
+    c.error(std::string(300, '(') + "1" + std::string(300, ')')).find("nested deeper"));
+  EXPECT_NE(std::string::npos, c.error(std::string(100000, '(') + "1").find("nested deeper"));
+  EXPECT_NE(std::string::npos, c.error(std::string(100000, '-') + "1").find("nested deeper"));
+
+  // Long flat expressions are not nesting
+  std::string sum = "0";
+  for (int i = 0; i < 1000; ++i) {
+    sum += " + 1";
+  }
+  EXPECT_EQ(1000.0, c.evaluate(sum));
+}
+
+class RuleAnalyzerTest : public ::testing::Test
+{
+protected:
+  bool init(const diagnostic_aggregator::AnalyzerParamMap & rules)
+  {
+    return init(analyzer, rules);
+  }
+
+  bool init(
+    diagnostic_aggregator::RuleAnalyzer & target,
+    const diagnostic_aggregator::AnalyzerParamMap & rules)
+  {
+    auto params = std::make_shared<diagnostic_aggregator::AnalyzerParamMap>(rules);
+    (*params)["analyzers_params.rules.type"] = "diagnostic_aggregator/RuleAnalyzer";
+    (*params)["analyzers_params.rules.path"] = "Rules";
+    diagnostic_aggregator::AnalyzerParamsScope scope("test_node", params);
+    return target.init("/", "test_node", node, "analyzers_params.rules.type");
+  }
+
+  void analyze(const diagnostic_msgs::msg::DiagnosticStatus & status)
+  {
+    EXPECT_TRUE(analyzer.match(status.name));
+    EXPECT_FALSE(analyzer.analyze(std::make_shared<diagnostic_aggregator::StatusItem>(&status)));
+  }
+
+  rclcpp::Node::SharedPtr node = rclcpp::Node::make_shared("test_node");
+  diagnostic_aggregator::RuleAnalyzer analyzer;
+};
+
+TEST_F(RuleAnalyzerTest, levels)
+{
+  ASSERT_TRUE(init({
+    {"analyzers_params.rules.rules.hot.expr", "value('Motor', 'temp') > 70"},
+    {"analyzers_params.rules.rules.hot.level", "warn"},
+    {"analyzers_params.rules.rules.driver.expr", "level('Driver') >= ERROR"},
+    {"analyzers_params.rules.rules.driver.message", "Driver failed"},
+  }));
+  EXPECT_FALSE(analyzer.match("Other"));
+
+  analyze(makeStatus("Motor", 0, {{"temp", "80"}}));
+  analyze(makeStatus("Driver", 0));
+  EXPECT_EQ(1, ruleLevel(analyzer, "hot"));
+  EXPECT_EQ(0, ruleLevel(analyzer, "driver"));
+
+  analyze(makeStatus("Motor", 0, {{"temp", "not a number"}}));
+  analyze(makeStatus("Driver", 2));
+  EXPECT_EQ(0, ruleLevel(analyzer, "hot"));
+  EXPECT_EQ(2, ruleLevel(analyzer, "driver"));
+
+  auto statuses = analyzer.report();
+  EXPECT_EQ("/Rules", statuses[0]->name);
+  EXPECT_EQ(2, statuses[0]->level);
+}
+
+TEST_F(RuleAnalyzerTest, hold)
+{
+  // "for" delays the rule until its condition has held that long
+  ASSERT_TRUE(init({
+    {"analyzers_params.rules.rules.hot.expr", "value('Motor', 'temp') > 70"},
+    {"analyzers_params.rules.rules.hot.for", "0.2"},
+  }));
+
+  analyze(makeStatus("Motor", 0, {{"temp", "80"}}));
+  EXPECT_EQ(0, ruleLevel(analyzer, "hot"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  analyze(makeStatus("Motor", 0, {{"temp", "85"}}));
+  EXPECT_EQ(0, ruleLevel(analyzer, "hot"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(150));
+  EXPECT_EQ(2, ruleLevel(analyzer, "hot"));
+
+  // Dropping below restarts the hold time
+  analyze(makeStatus("Motor", 0, {{"temp", "60"}}));
+  EXPECT_EQ(0, ruleLevel(analyzer, "hot"));
+  analyze(makeStatus("Motor", 0, {{"temp", "80"}}));
+  EXPECT_EQ(0, ruleLevel(analyzer, "hot"));
+}
+
+TEST_F(RuleAnalyzerTest, stale)
+{
+  // Fields of statuses that timed out are NaN
+  ASSERT_TRUE(init({
+    {"analyzers_params.rules.timeout", "0.2"},
+    {"analyzers_params.rules.rules.ok.expr", "level('Motor') == OK"},
+    {"analyzers_params.rules.rules.missing.expr", "!(level('Motor') >= OK)"},
+  }));
+
+  analyze(makeStatus("Motor", 0));
+  EXPECT_EQ(2, ruleLevel(analyzer, "ok"));
+  EXPECT_EQ(0, ruleLevel(analyzer, "missing"));
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  EXPECT_EQ(0, ruleLevel(analyzer, "ok"));
+  EXPECT_EQ(2, ruleLevel(analyzer, "missing"));
+
+  analyze(makeStatus("Motor", 0));
+  EXPECT_EQ(2, ruleLevel(analyzer, "ok"));
+  EXPECT_EQ(0, ruleLevel(analyzer, "missing"));
+}
+
+TEST_F(RuleAnalyzerTest, invalid)
+{
+  EXPECT_FALSE(init({
+    {"analyzers_params.rules.rules.bad.expr", "level('Motor') >"},
+    {"analyzers_params.rules.rules.good.expr", "level('Motor') > 0"},
+  }));
+
+  diagnostic_aggregator::RuleAnalyzer empty;
+  EXPECT_FALSE(init(empty, {}));
+
+  diagnostic_aggregator::RuleAnalyzer deep;
+  EXPECT_FALSE(init(deep, {
+    {"analyzers_params.rules.rules.deep.expr", std::string(1000, '(') + "1"},
+  }));
+}
@@ -0,0 +1,151 @@
+// Copyright 2015 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "diagnostic_aggregator/status_history.hpp"
+
+using diagnostic_aggregator::StatusHistory;
+using diagnostic_msgs::msg::DiagnosticStatus;
+
+namespace
+{
+
+DiagnosticStatus makeStatus(const std::string & name, uint8_t level, const std::string & message)
+{
+  DiagnosticStatus status;
+  status.name = name;
+  status.level = level;
+  status.message = message;
+  return status;
+}
+
+rclcpp::Time at(int64_t seconds)
+{
+  return rclcpp::Time(seconds * 1000000000LL, RCL_ROS_TIME);
+}
+
+/*
+ *\brief All transitions of name
+ */
+std::vector<DiagnosticStatus> history(const StatusHistory & h, const std::string & name)
+{
+  std::vector<builtin_interfaces::msg::Time> stamps;
+  std::vector<DiagnosticStatus> statuses;
+  h.query({name}, at(0), at(1000000), stamps, statuses);
+  return statuses;
+}
+
+}  // namespace
+
+TEST(StatusHistory, recordsTransitionsOnly)
+{
+  StatusHistory h(10, 1 << 20);
+  h.record(makeStatus("a", 0, "ok"), at(1));
+  h.record(makeStatus("a", 0, "ok"), at(2));
+  h.record(makeStatus("a", 1, "warm"), at(3));
+  h.record(makeStatus("a", 1, "warm"), at(4));
+  h.record(makeStatus("a", 0, "ok"), at(5));
+
+  std::vector<DiagnosticStatus> a = history(h, "a");
+  ASSERT_EQ(3u, a.size());
+  EXPECT_EQ("ok", a[0].message);
+  EXPECT_EQ("warm", a[1].message);
+  EXPECT_EQ(1, a[1].level);
+  EXPECT_EQ("ok", a[2].message);
+}
+
+TEST(StatusHistory, maxPerItem)
+{
+  StatusHistory h(3, 1 << 20);
+  for (int i = 0; i < 10; ++i) {
+    h.record(makeStatus("a", i % 2, "m" + std::to_string(i)), at(i + 1));
+  }
+  std::vector<DiagnosticStatus> a = history(h, "a");
+  ASSERT_EQ(3u, a.size());
+  EXPECT_EQ("m7", a[0].message);
+  EXPECT_EQ("m9", a[2].message);
+}
+
+TEST(StatusHistory, tracksCountInBudget)
+{
+  // Items that never change still cost memory, so a flood of names is bounded
+  StatusHistory h(10, 64 * 1024);
+  for (int i = 0; i < 100000; ++i) {
+    h.record(makeStatus("item" + std::to_string(i), 0, "ok"), at(i + 1));
+  }
+  EXPECT_LE(h.getMemoryUsage(), 64u * 1024);
+  std::vector<std::string> names;
+  h.getNames(names);
+  EXPECT_LT(names.size(), 1000u);
+  EXPECT_GT(names.size(), 0u);
+
+  // The most recent ones are kept
+  EXPECT_EQ(1u, history(h, "item99999").size());
+  EXPECT_EQ(0u, history(h, "item0").size());
+}
+
+TEST(StatusHistory, evictsOldestFirst)
+{
+  StatusHistory h(100, 1 << 20);
+  h.record(makeStatus("old", 0, "ok"), at(1));
+  h.record(makeStatus("old", 1, "warm"), at(2));
+  size_t before = h.getMemoryUsage();
+
+  // Just enough budget for the transitions of "old", then more transitions
+  // of "new". The oldest entries overall go first, which are those of "old",
+  // but its latest one only goes with the whole item.
+  StatusHistory small(100, before + 1024);
+  small.record(makeStatus("old", 0, "ok"), at(1));
+  small.record(makeStatus("old", 1, "warm"), at(2));
+  for (int i = 0; i < 50; ++i) {
+    small.record(makeStatus("new", i % 2, "m" + std::to_string(i)), at(i + 3));
+  }
+  EXPECT_LE(small.getMemoryUsage(), before + 1024);
+  std::vector<DiagnosticStatus> old = history(small, "old");
+  EXPECT_LE(old.size(), 1u);
+  if (!old.empty()) {
+    EXPECT_EQ("warm", old[0].message);
+  }
+  std::vector<DiagnosticStatus> recent = history(small, "new");
+  ASSERT_FALSE(recent.empty());
+  EXPECT_EQ("m49", recent.back().message);
+}
+
+TEST(StatusHistory, forget)
+{
+  StatusHistory h(10, 1 << 20);
+  EXPECT_EQ(0u, h.getMemoryUsage());
+  h.record(makeStatus("a", 0, "ok"), at(1));
+  h.record(makeStatus("a", 2, "broken"), at(2));
+  h.record(makeStatus("b", 0, "ok"), at(1));
+  size_t both = h.getMemoryUsage();
+
+  h.forget("a");
+  EXPECT_LT(h.getMemoryUsage(), both);
+  EXPECT_TRUE(history(h, "a").empty());
+  EXPECT_EQ(1u, history(h, "b").size());
+  std::vector<std::string> names;
+  h.getNames(names);
+  EXPECT_EQ(std::vector<std::string>({"b"}), names);
+
+  h.forget("b");
+  EXPECT_EQ(0u, h.getMemoryUsage());
+
+  // A forgotten item starts over
+  h.record(makeStatus("a", 2, "broken"), at(3));
+  ASSERT_EQ(1u, history(h, "a").size());
+  EXPECT_EQ("broken", history(h, "a")[0].message);
+}
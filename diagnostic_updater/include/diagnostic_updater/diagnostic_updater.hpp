@@ -15,10 +15,19 @@
 #ifndef DIAGNOSTIC_UPDATER__DIAGNOSTIC_UPDATER_HPP_
 #define DIAGNOSTIC_UPDATER__DIAGNOSTIC_UPDATER_HPP_
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>  // for bind()
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <set>
 #include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include "rclcpp/node.hpp"
@@ -41,6 +50,8 @@ namespace diagnostic_updater
 typedef std::function<void (DiagnosticStatusWrapper &)> TaskFunction;
 typedef std::function<void (diagnostic_msgs::msg::DiagnosticStatus &)>
   UnwrappedTaskFunction;
+typedef std::function<void (std::vector<DiagnosticStatusWrapper> &)>
+  MultiTaskFunction;
 
 /**
  * \brief DiagnosticTask is an abstract base class for collecting diagnostic
@@ -121,6 +132,71 @@ typedef GenericFunctionDiagnosticTask<diagnostic_msgs::msg::DiagnosticStatus>
 typedef GenericFunctionDiagnosticTask<DiagnosticStatusWrapper>
   FunctionDiagnosticTask;
 
+/**
+ * \brief Internal use only.
+ *
+ * Merges the summaries that the children of a composite task put in stat,
+ * like DiagnosticStatusWrapper::mergeSummary(). Messages are swapped in and
+ * out of stat rather than copied, so that their buffers get reused, and the
+ * message that was passed in is only copied back when a child changed it.
+ */
+class SummaryMerger
+{
+public:
+  explicit SummaryMerger(DiagnosticStatusWrapper & stat)
+  : stat_(stat), original_level_(stat.level), original_message_(stat.message), level_(0),
+    changed_(false) {}
+
+  /**
+   * \brief Puts the summary that was passed in back in stat.
+   */
+  void restore()
+  {
+    stat_.level = original_level_;
+    if (changed_) {
+      stat_.message.assign(original_message_);
+      changed_ = false;
+    }
+  }
+
+  /**
+   * \brief Merges the summary in stat into the combined summary.
+   */
+  void merge()
+  {
+    if (stat_.level > 0 && level_ > 0) {
+      if (!message_.empty()) {
+        message_ += "; ";
+        message_ += stat_.message;
+      }
+    } else if (stat_.level > level_) {
+      message_.swap(stat_.message);
+      changed_ = true;
+    }
+    if (stat_.level > level_) {
+      level_ = stat_.level;
+    }
+    changed_ = changed_ || stat_.message != original_message_;
+  }
+
+  /**
+   * \brief Puts the combined summary in stat.
+   */
+  void finish()
+  {
+    stat_.level = level_;
+    stat_.message.swap(message_);
+  }
+
+private:
+  DiagnosticStatusWrapper & stat_;
+  const unsigned char original_level_;
+  const std::string original_message_;
+  unsigned char level_;
+  std::string message_;
+  bool changed_;
+};
+
 /**
  * \brief Merges CompositeDiagnosticTask into a single DiagnosticTask.
  *
@@ -147,24 +223,21 @@ public:
    */
   virtual void run(DiagnosticStatusWrapper & stat)
   {
-    DiagnosticStatusWrapper combined_summary;
-    DiagnosticStatusWrapper original_summary;
-
-    original_summary.summary(stat);
+    SummaryMerger merger(stat);
 
     for (std::vector<DiagnosticTask *>::iterator i = tasks_.begin();
       i != tasks_.end(); i++)
     {
       // Put the summary that was passed in.
-      stat.summary(original_summary);
+      merger.restore();
       // Let the next task add entries and put its summary.
       (*i)->run(stat);
       // Merge the new summary into the combined summary.
-      combined_summary.mergeSummary(stat);
+      merger.merge();
     }
 
-    // Copy the combined summary into the output.
-    stat.summary(combined_summary);
+    // Put the combined summary into the output.
+    merger.finish();
   }
 
   /**
@@ -179,6 +252,230 @@ private:
   std::vector<DiagnosticTask *> tasks_;
 };
 
+/**
+ * \brief A CompositeDiagnosticTask whose children are fixed at compile time.
+ *
+ * The children are members of the task, constructed from the arguments
+ * that follow the name, and their run() methods are called directly rather
+ * than through a virtual call, so they can be inlined. Use it instead of a
+ * CompositeDiagnosticTask when the set of children is known, for instance
+ * when it is repeated for hundreds of topics.
+ *
+ * \code
+ * StaticCompositeDiagnosticTask<FrequencyStatus, TimeStampStatus> topic(
+ *   "Topic status", freq_param, stamp_param);
+ * topic.get<0>().tick();
+ * \endcode
+ */
+template<class ... Tasks>
+class StaticCompositeDiagnosticTask : public DiagnosticTask
+{
+public:
+  /**
+   * \brief Constructs the task and its children, from one argument each.
+   */
+  template<class ... Args>
+  explicit StaticCompositeDiagnosticTask(const std::string name, Args && ... args)
+  : DiagnosticTask(name), tasks_(std::forward<Args>(args) ...) {}
+
+  /**
+   * \brief Runs each child and merges their outputs.
+   */
+  virtual void run(DiagnosticStatusWrapper & stat)
+  {
+    SummaryMerger merger(stat);
+    runTasks(merger, stat, std::index_sequence_for<Tasks...>());
+    merger.finish();
+  }
+
+  /**
+   * \brief Returns the child at index I.
+   */
+  template<size_t I>
+  typename std::tuple_element<I, std::tuple<Tasks...>>::type & get()
+  {
+    return std::get<I>(tasks_);
+  }
+
+private:
+  template<size_t ... I>
+  void runTasks(SummaryMerger & merger, DiagnosticStatusWrapper & stat, std::index_sequence<I...>)
+  {
+    int expand[] = {0, (runTask(std::get<I>(tasks_), merger, stat), 0) ...};
+    (void)expand;
+  }
+
+  template<class Task>
+  static void runTask(Task & task, SummaryMerger & merger, DiagnosticStatusWrapper & stat)
+  {
+    merger.restore();
+    task.Task::run(stat);
+    merger.merge();
+  }
+
+  std::tuple<Tasks...> tasks_;
+};
+
+/**
+ * \brief Internal use only.
+ *
+ * Lets AsyncDiagnosticTasks wake the thread that resumes them. Each
+ * notification bumps a generation, so a waiter that was resuming tasks when
+ * it came doesn't miss it.
+ */
+class Wakeup
+{
+public:
+  Wakeup()
+  : generation_(0) {}
+
+  void notify()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++generation_;
+    cond_.notify_all();
+  }
+
+  uint64_t getGeneration()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return generation_;
+  }
+
+  /**
+   * Waits until time, or until a notification after generation was read.
+   */
+  void waitUntil(uint64_t generation, std::chrono::steady_clock::time_point time)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait_until(lock, time, [this, generation]() {return generation_ != generation;});
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  uint64_t generation_;
+};
+
+/**
+ * \brief A DiagnosticTask that waits for I/O without blocking the Updater.
+ *
+ * Instead of a run() call that blocks until a device answers, the task is
+ * started and then resumed until it returns true, like a coroutine that
+ * yields while its I/O is pending. The Updater starts all its
+ * AsyncDiagnosticTasks at once and resumes them in turn on its own thread,
+ * so their waits overlap. A task that isn't done by its deadline is cancelled
+ * and reported as an error.
+ *
+ * resume() must not block: it checks whether the answer arrived, for
+ * instance with a non-blocking read, and returns false if not. The task
+ * calls notify() when the answer arrives, for instance from an I/O callback,
+ * so that it is resumed at once. Otherwise it is only resumed again at its
+ * deadline, or at the poll period of the Updater if one is set.
+ */
+class AsyncDiagnosticTask
+{
+public:
+  /**
+   * \brief Constructs an AsyncDiagnosticTask.
+   *
+   * \param deadline Seconds after start() before the task is cancelled.
+   */
+  explicit AsyncDiagnosticTask(const std::string name, double deadline = 1.0)
+  : name_(name), deadline_(deadline), wakeup_(std::make_shared<Wakeup>()) {}
+
+  /**
+   * \brief Returns the name of the AsyncDiagnosticTask.
+   */
+  const std::string & getName() {return name_;}
+
+  double getDeadline() const {return deadline_;}
+
+  /**
+   * \brief Begins an update, for instance by sending a request to a device.
+   */
+  virtual void start() {}
+
+  /**
+   * \brief Makes progress without blocking. Returns true once stat is filled.
+   */
+  virtual bool resume(diagnostic_updater::DiagnosticStatusWrapper & stat) = 0;
+
+  /**
+   * \brief Called instead of resume() once the deadline has passed.
+   */
+  virtual void cancel() {}
+
+  /**
+   * \brief Wakes the thread waiting for the task, so that it resumes it.
+   * May be called from any thread.
+   */
+  void notify() {getWakeup()->notify();}
+
+  /**
+   * \brief Runs the task to completion on the calling thread. For callers
+   * that expect a blocking run().
+   *
+   * \param poll_period Seconds between resumes when the task doesn't
+   * notify(), 0 to resume it only when notified or late.
+   */
+  void runBlocking(
+    diagnostic_updater::DiagnosticStatusWrapper & stat,
+    double poll_period = 0.0)
+  {
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+      std::chrono::duration<double>(deadline_));
+    std::shared_ptr<Wakeup> wakeup = getWakeup();
+    start();
+    while (true) {
+      uint64_t generation = wakeup->getGeneration();
+      if (resume(stat)) {
+        return;
+      }
+      std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      if (now >= deadline) {
+        timeOut(stat);
+        return;
+      }
+      std::chrono::steady_clock::time_point next = deadline;
+      if (poll_period > 0) {
+        next = std::min(next, now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(poll_period)));
+      }
+      wakeup->waitUntil(generation, next);
+    }
+  }
+
+  /**
+   * \brief Cancels the task and reports that it timed out in stat.
+   */
+  void timeOut(diagnostic_updater::DiagnosticStatusWrapper & stat)
+  {
+    cancel();
+    stat.summaryf(diagnostic_msgs::msg::DiagnosticStatus::ERROR,
+      "Timed out after %g seconds", deadline_);
+  }
+
+  /**
+   * Virtual destructor as this is a base class.
+   */
+  virtual ~AsyncDiagnosticTask() {}
+
+  /**
+   * \brief Internal use only. Makes notify() wake the Updater the task is
+   * added to.
+   */
+  void setWakeup(std::shared_ptr<Wakeup> wakeup) {std::atomic_store(&wakeup_, wakeup);}
+
+  std::shared_ptr<Wakeup> getWakeup() const {return std::atomic_load(&wakeup_);}
+
+private:
+  const std::string name_;
+  const double deadline_;
+  std::shared_ptr<Wakeup> wakeup_;
+};
+
 /**
  * \brief Internal use only.
  *
@@ -198,23 +495,162 @@ protected:
   {
 public:
     DiagnosticTaskInternal(const std::string name, TaskFunction f)
-    : name_(name), fn_(f) {}
+    : name_(name), fn_(f), async_(nullptr) {}
+
+    DiagnosticTaskInternal(const std::string name, AsyncDiagnosticTask * task)
+    : name_(name), async_(task) {}
 
+    DiagnosticTaskInternal(const std::string name, MultiTaskFunction f)
+    : name_(name), async_(nullptr), multi_fn_(f) {}
+
+    /**
+     * A task producing several statuses is run into stat as if it was a
+     * CompositeDiagnosticTask.
+     */
     void run(diagnostic_updater::DiagnosticStatusWrapper & stat) const
     {
       stat.name = name_;
-      fn_(stat);
+      if (async_) {
+        async_->runBlocking(stat);
+      } else if (multi_fn_) {
+        std::vector<diagnostic_updater::DiagnosticStatusWrapper> statuses;
+        multi_fn_(statuses);
+        stat.clearSummary();
+        for (const diagnostic_updater::DiagnosticStatusWrapper & status : statuses) {
+          stat.mergeSummary(status);
+          stat.values.insert(stat.values.end(), status.values.begin(), status.values.end());
+        }
+      } else {
+        fn_(stat);
+      }
+    }
+
+    /**
+     * A synchronous task does all its work in its first resume(), so both
+     * kinds can be driven the same way.
+     */
+    void start() const
+    {
+      if (async_) {
+        async_->start();
+      }
+    }
+
+    bool resume(diagnostic_updater::DiagnosticStatusWrapper & stat) const
+    {
+      stat.name = name_;
+      if (async_) {
+        return async_->resume(stat);
+      }
+      if (!multi_fn_) {
+        fn_(stat);
+      }
+      return true;
+    }
+
+    /**
+     * Whether the task produces its own statuses with runMulti() instead of
+     * filling one in resume().
+     */
+    bool isMulti() const {return static_cast<bool>(multi_fn_);}
+
+    void runMulti(std::vector<diagnostic_updater::DiagnosticStatusWrapper> & statuses) const
+    {
+      multi_fn_(statuses);
+    }
+
+    /**
+     * Seconds after start() before the task is timed out, negative for none.
+     */
+    double getDeadline() const {return async_ ? async_->getDeadline() : -1.0;}
+
+    void timeOut(diagnostic_updater::DiagnosticStatusWrapper & stat) const
+    {
+      if (async_) {
+        async_->timeOut(stat);
+      }
     }
 
     const std::string & getName() const {return name_;}
 
+    /**
+     * Tells apart tasks with the same name, set when the task is added.
+     */
+    uint64_t getId() const {return id_;}
+
+    void setId(uint64_t id) {id_ = id;}
+
 private:
     std::string name_;
     TaskFunction fn_;
+    AsyncDiagnosticTask * async_;
+    MultiTaskFunction multi_fn_;
+    uint64_t id_ = 0;
+  };
+
+  /**
+   * \brief Copies the tasks for an update that runs them without holding
+   * lock_, and keeps removeByName() from returning while the update may
+   * still run a task it removed.
+   */
+  class TaskUse
+  {
+public:
+    explicit TaskUse(DiagnosticTaskVector & vector)
+    : vector_(vector)
+    {
+      std::unique_lock<std::mutex> lock(vector_.lock_);
+      tasks_ = vector_.tasks_;
+      held_.assign(tasks_.size(), true);
+      for (const DiagnosticTaskInternal & task : tasks_) {
+        vector_.in_use_.insert(task.getId());
+      }
+      vector_.user_ = std::this_thread::get_id();
+    }
+
+    const std::vector<DiagnosticTaskInternal> & getTasks() const {return tasks_;}
+
+    /**
+     * \brief Signals that the update is done with task i.
+     */
+    void release(size_t i)
+    {
+      std::unique_lock<std::mutex> lock(vector_.lock_);
+      releaseLocked(i);
+      vector_.released_.notify_all();
+    }
+
+    ~TaskUse()
+    {
+      std::unique_lock<std::mutex> lock(vector_.lock_);
+      for (size_t i = 0; i < tasks_.size(); ++i) {
+        releaseLocked(i);
+      }
+      vector_.user_ = std::thread::id();
+      vector_.released_.notify_all();
+    }
+
+private:
+    void releaseLocked(size_t i)
+    {
+      if (held_[i]) {
+        held_[i] = false;
+        vector_.in_use_.erase(vector_.in_use_.find(tasks_[i].getId()));
+      }
+    }
+
+    DiagnosticTaskVector & vector_;
+    std::vector<DiagnosticTaskInternal> tasks_;
+    std::vector<bool> held_;
   };
 
   std::mutex lock_;
 
+  /**
+   * Notified by the AsyncDiagnosticTasks added to this vector.
+   */
+  std::shared_ptr<Wakeup> wakeup_ = std::make_shared<Wakeup>();
+
   /**
    * \brief Returns the vector of tasks.
    */
@@ -253,6 +689,35 @@ public:
     add(task.getName(), f);
   }
 
+  /**
+   * \brief Add an AsyncDiagnosticTask to the DiagnosticTaskVector
+   *
+   * \param task The AsyncDiagnosticTask to be added. It must remain live
+   * until it is removed with removeByName(), which waits for a running
+   * update to be done with it. Its notify() wakes this DiagnosticTaskVector
+   * from then on.
+   */
+  void add(AsyncDiagnosticTask & task)
+  {
+    task.setWakeup(wakeup_);
+    DiagnosticTaskInternal int_task(task.getName(), &task);
+    addInternal(int_task);
+  }
+
+  /**
+   * \brief Add a task that produces any number of statuses
+   *
+   * \param name Name of the task, used when it is run by name or broadcast.
+   *
+   * \param f Function that appends the statuses, with their names, to its
+   * argument. The Updater publishes each of them.
+   */
+  void addMulti(const std::string & name, MultiTaskFunction f)
+  {
+    DiagnosticTaskInternal int_task(name, f);
+    addInternal(int_task);
+  }
+
   /**
    * \brief Add a DiagnosticTask embodied by a name and method to the
    * DiagnosticTaskVector
@@ -279,7 +744,8 @@ public:
    * \brief Remove a task based on its name.
    *
    * Removes the first task that matches the specified name. (New in
-   * version 1.1.2)
+   * version 1.1.2) If an update is running the task on another thread,
+   * waits until it is done with it, so that the task may then be destroyed.
    *
    * \param name Name of the task to remove.
    *
@@ -293,7 +759,12 @@ public:
       iter != tasks_.end(); iter++)
     {
       if (iter->getName() == name) {
+        uint64_t id = iter->getId();
         tasks_.erase(iter);
+        // A task that removes itself from the update running it needn't wait
+        released_.wait(lock, [this, id]() {
+            return in_use_.count(id) == 0 || user_ == std::this_thread::get_id();
+          });
         return true;
       }
 
@@ -310,6 +781,15 @@ private:
    */
   virtual void addedTaskCallback(DiagnosticTaskInternal &) {}
   std::vector<DiagnosticTaskInternal> tasks_;
+  uint64_t next_id_ = 0;
+
+  /**
+   * Ids of the tasks that TaskUses hold, and the thread running the update,
+   * guarded by lock_.
+   */
+  std::multiset<uint64_t> in_use_;
+  std::thread::id user_;
+  std::condition_variable released_;
 
 protected:
   /**
@@ -318,6 +798,7 @@ protected:
   void addInternal(DiagnosticTaskInternal & task)
   {
     std::unique_lock<std::mutex> lock(lock_);
+    task.setId(next_id_++);
     tasks_.push_back(task);
     addedTaskCallback(task);
   }
@@ -390,35 +871,97 @@ public:
     if (rclcpp::ok()) {
       bool warn_nohwid = hwid_.empty();
 
-      std::vector<diagnostic_msgs::msg::DiagnosticStatus> status_vec;
-
-      std::unique_lock<std::mutex> lock(
-        lock_);    // Make sure no adds happen while we are processing here.
-      const std::vector<DiagnosticTaskInternal> & tasks = getTasks();
-      for (std::vector<DiagnosticTaskInternal>::const_iterator iter =
-        tasks.begin();
-        iter != tasks.end(); iter++)
-      {
-        diagnostic_updater::DiagnosticStatusWrapper status;
-
-        status.name = iter->getName();
+      // Only one update drives the tasks at a time, but adds needn't wait for
+      // the asynchronous tasks, so they go to the next update. Removes wait
+      // until the update is done with the task.
+      std::unique_lock<std::mutex> update_lock(update_lock_);
+      TaskUse use(*this);
+      const std::vector<DiagnosticTaskInternal> & tasks = use.getTasks();
+
+      // Start every task, so the asynchronous ones wait for their I/O while
+      // the others run
+      std::vector<diagnostic_updater::DiagnosticStatusWrapper> status_vec(tasks.size());
+      std::vector<std::chrono::steady_clock::time_point> deadlines(tasks.size());
+      std::vector<size_t> pending;
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < tasks.size(); ++i) {
+        diagnostic_updater::DiagnosticStatusWrapper & status = status_vec[i];
+        status.name = tasks[i].getName();
         status.level = 2;
         status.message = "No message was set";
         status.hardware_id = hwid_;
 
-        iter->run(status);
+        double deadline = tasks[i].getDeadline();
+        deadlines[i] = deadline < 0 ? std::chrono::steady_clock::time_point::max() :
+          start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(deadline));
+        tasks[i].start();
+        pending.push_back(i);
+      }
 
-        status_vec.push_back(status);
+      // Resume the unfinished tasks in turn until they are done or late. When
+      // no task notified during a pass, sleep until one does or until the
+      // earliest deadline.
+      while (!pending.empty()) {
+        uint64_t generation = wakeup_->getGeneration();
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::time_point::max();
+        size_t still_pending = 0;
+        for (size_t i : pending) {
+          if (tasks[i].resume(status_vec[i])) {
+            if (!tasks[i].isMulti()) {
+              use.release(i);
+            }
+            continue;
+          }
+          if (now >= deadlines[i]) {
+            tasks[i].timeOut(status_vec[i]);
+            use.release(i);
+          } else {
+            pending[still_pending++] = i;
+            next = std::min(next, deadlines[i]);
+          }
+        }
+        pending.resize(still_pending);
+        if (!pending.empty()) {
+          if (poll_period_ > 0) {
+            std::chrono::steady_clock::duration poll_period =
+              std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(poll_period_));
+            next = std::min(next, now + poll_period);
+          }
+          wakeup_->waitUntil(generation, next);
+        }
+      }
 
-        if (status.level) {
-          warn_nohwid = false;
+      // Tasks with several statuses add them in their place
+      std::vector<diagnostic_msgs::msg::DiagnosticStatus> msgs;
+      msgs.reserve(status_vec.size());
+      std::vector<diagnostic_updater::DiagnosticStatusWrapper> multi_statuses;
+      for (size_t i = 0; i < status_vec.size(); ++i) {
+        multi_statuses.clear();
+        if (tasks[i].isMulti()) {
+          tasks[i].runMulti(multi_statuses);
+          use.release(i);
+        } else {
+          multi_statuses.push_back(std::move(status_vec[i]));
         }
 
-        if (verbose_ && status.level) {
-          //  ROS_WARN("Non-zero diagnostic status. Name: '%s', status %i:
+        for (diagnostic_updater::DiagnosticStatusWrapper & status : multi_statuses) {
+          if (status.hardware_id.empty()) {
+            status.hardware_id = hwid_;
+          }
+          if (status.level) {
+            warn_nohwid = false;
+          }
+
+          if (verbose_ && status.level) {
+            //  ROS_WARN("Non-zero diagnostic status. Name: '%s', status %i:
+            //  '%s'", status.name.c_str(), status.level,
+            //  status.message.c_str());
+          }
+          msgs.push_back(std::move(status));
         }
-        //  '%s'", status.name.c_str(), status.level,
-        //  status.message.c_str());
       }
 
       if (warn_nohwid && !warn_nohwid_done_) {
@@ -430,10 +973,17 @@ public:
         warn_nohwid_done_ = true;
       }
 
-      publish(status_vec);
+      publish(msgs);
     }
   }
 
+  /**
+   * \brief Sets how often pending AsyncDiagnosticTasks are resumed, in
+   * seconds, for tasks that don't notify(). 0, the default, resumes them
+   * only when one notifies or at their deadline.
+   */
+  void setPollPeriod(double poll_period) {poll_period_ = poll_period;}
+
   /**
    * \brief Returns the interval between updates.
    */
@@ -554,6 +1104,7 @@ private:
       "/diagnostics", 1);
 
     period_ = 1.0;
+    poll_period_ = 0.0;
 
     next_time_ = rclcpp::Clock().now() + rclcpp::Duration(period_);
     update_diagnostic_period();
@@ -581,7 +1132,9 @@ private:
 
   rclcpp::Time next_time_;
 
+  std::mutex update_lock_;
   double period_;
+  double poll_period_;
   std::string hwid_;
   std::string node_name_;
   bool warn_nohwid_done_;
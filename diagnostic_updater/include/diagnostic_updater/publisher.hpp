@@ -19,6 +19,7 @@
 #include <rclcpp/publisher.hpp>
 #include <rclcpp/subscription.hpp>
 
+#include <cstdint>
 #include <string>
 #include <memory>
 
@@ -138,6 +139,64 @@ private:
   TimeStampStatus stamp_;
 };
 
+/**
+ * \brief A class to facilitate making diagnostics for a topic using a
+ * FrequencyStatus and SequenceStatus.
+ *
+ * For messages with a sequence number or counter, to report how many are
+ * lost, reordered or duplicated.
+ */
+
+class SequencedTopicDiagnostic : public HeaderlessTopicDiagnostic
+{
+public:
+  /**
+   * \brief Constructs a SequencedTopicDiagnostic.
+   *
+   * \param name The name of the topic that is being diagnosed.
+   *
+   * \param diag The diagnostic_updater that the CompositeDiagnosticTask
+   * should add itself to.
+   *
+   * \param freq The parameters for the FrequencyStatus class that will be
+   * computing statistics.
+   *
+   * \param seq The parameters for the SequenceStatus class that will be
+   * computing statistics.
+   */
+
+  SequencedTopicDiagnostic(
+    std::string name, diagnostic_updater::Updater & diag,
+    const diagnostic_updater::FrequencyStatusParam & freq,
+    const diagnostic_updater::SequenceStatusParam & seq = SequenceStatusParam())
+  : HeaderlessTopicDiagnostic(name, diag, freq), seq_(seq)
+  {
+    addTask(&seq_);
+  }
+
+  virtual ~SequencedTopicDiagnostic() {}
+
+  /**
+   * This method should never be called on a SequencedTopicDiagnostic as a
+   * sequence number is needed to detect lost messages. It is defined here to
+   * prevent the inherited tick method from being used accidentally.
+   */
+  virtual void tick() {}
+
+  /**
+   * \brief Signals that the message with the given sequence number was
+   * published or received.
+   */
+  virtual void tick(uint64_t seq)
+  {
+    seq_.tick(seq);
+    HeaderlessTopicDiagnostic::tick();
+  }
+
+private:
+  SequenceStatus seq_;
+};
+
 /**
  * \brief A TopicDiagnostic combined with a ros::Publisher.
  *
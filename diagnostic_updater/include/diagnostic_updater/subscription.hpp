@@ -0,0 +1,288 @@
+// Copyright 2017 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DIAGNOSTIC_UPDATER__SUBSCRIPTION_HPP_
+#define DIAGNOSTIC_UPDATER__SUBSCRIPTION_HPP_
+
+#include <diagnostic_updater/update_functions.hpp>
+#include <rclcpp/subscription.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace diagnostic_updater
+{
+
+/**
+ * \brief Diagnostic task that monitors the messages received on a topic.
+ *
+ * Checks the frequency of the messages like a FrequencyStatus, their
+ * latency, the delay between their timestamp and their reception, like a
+ * TimeStampStatus, and, for messages with a sequence number, how many were
+ * lost like a SequenceStatus. All this in a single status.
+ *
+ * tick() only does relaxed atomic operations, so it can be called from
+ * several threads without locking.
+ */
+class SubscriptionStatus : public DiagnosticTask
+{
+public:
+  /**
+   * \brief Constructs a SubscriptionStatus.
+   *
+   * \param freq Acceptable frequencies of the messages.
+   *
+   * \param stamp Acceptable latencies of the messages, in seconds.
+   *
+   * \param seq Acceptable message losses, for messages with a sequence number.
+   */
+  SubscriptionStatus(
+    const std::string & name, const FrequencyStatusParam & freq,
+    const TimeStampStatusParam & stamp, const SequenceStatusParam & seq = SequenceStatusParam())
+  : DiagnosticTask(name), freq_(freq), stamp_(stamp), count_(0), zero_count_(0),
+    latency_sum_(0), min_latency_(kNoLatency), max_latency_(-kNoLatency),
+    sequence_(seq), sequenced_(false), times_(freq.window_size_), counts_(freq.window_size_),
+    hist_indx_(0), last_count_(0)
+  {
+    rclcpp::Time now = clock_.now();
+    for (int i = 0; i < freq_.window_size_; i++) {
+      times_[i] = now;
+    }
+  }
+
+  /**
+   * \brief Signals that a message with the given timestamp was received.
+   */
+  void tick(const rclcpp::Time & stamp)
+  {
+    count_.fetch_add(1, std::memory_order_relaxed);
+    int64_t stamp_ns = stamp.nanoseconds();
+    if (stamp_ns == 0) {
+      zero_count_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    int64_t latency = clock_.now().nanoseconds() - stamp_ns;
+    latency_sum_.fetch_add(latency, std::memory_order_relaxed);
+    int64_t min = min_latency_.load(std::memory_order_relaxed);
+    while (latency < min &&
+      !min_latency_.compare_exchange_weak(min, latency, std::memory_order_relaxed))
+    {
+    }
+    int64_t max = max_latency_.load(std::memory_order_relaxed);
+    while (latency > max &&
+      !max_latency_.compare_exchange_weak(max, latency, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  /**
+   * \brief Signals that a message with the given timestamp and sequence
+   * number was received.
+   *
+   * Sequence numbers should increase by one from a message to the next.
+   * Skipped numbers are counted as lost.
+   */
+  void tick(const rclcpp::Time & stamp, uint64_t seq)
+  {
+    if (!sequenced_.load(std::memory_order_relaxed)) {
+      sequenced_.store(true, std::memory_order_relaxed);
+    }
+    sequence_.tick(seq);
+    tick(stamp);
+  }
+
+  virtual void run(diagnostic_updater::DiagnosticStatusWrapper & stat)
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    rclcpp::Time now = clock_.now();
+
+    uint64_t zero_count = zero_count_.exchange(0, std::memory_order_relaxed);
+    uint64_t count = count_.load(std::memory_order_relaxed);
+    int64_t latency_sum = latency_sum_.exchange(0, std::memory_order_relaxed);
+    int64_t min_latency = min_latency_.exchange(kNoLatency, std::memory_order_relaxed);
+    int64_t max_latency = max_latency_.exchange(-kNoLatency, std::memory_order_relaxed);
+
+    // Messages with a zero timestamp have no latency. A tick() running
+    // concurrently may be counted in count_ but not yet in zero_count_.
+    uint64_t latency_count = count - last_count_ > zero_count ?
+      count - last_count_ - zero_count : 0;
+    last_count_ = count;
+
+    uint64_t events = count - counts_[hist_indx_];
+    double window = (now - times_[hist_indx_]).seconds();
+    double freq = events / window;
+    counts_[hist_indx_] = count;
+    times_[hist_indx_] = now;
+    hist_indx_ = (hist_indx_ + 1) % freq_.window_size_;
+
+    stat.clearSummary();
+    if (events == 0) {
+      stat.mergeSummary(2, "No messages received.");
+    } else if (freq < *freq_.min_freq_ * (1 - freq_.tolerance_)) {
+      stat.mergeSummary(1, "Frequency too low.");
+    } else if (freq > *freq_.max_freq_ * (1 + freq_.tolerance_)) {
+      stat.mergeSummary(1, "Frequency too high.");
+    }
+    if (latency_count && min_latency * 1e-9 < stamp_.min_acceptable_) {
+      stat.mergeSummary(2, "Timestamps too far in future seen.");
+    }
+    if (latency_count && max_latency * 1e-9 > stamp_.max_acceptable_) {
+      stat.mergeSummary(2, "Timestamps too far in past seen.");
+    }
+    if (zero_count) {
+      stat.mergeSummary(2, "Zero timestamp seen.");
+    }
+    DiagnosticStatusWrapper sequence;
+    if (sequenced_.load(std::memory_order_relaxed)) {
+      sequence_.run(sequence);
+      stat.mergeSummary(sequence);
+    }
+
+    stat.addf("Messages in window", "%llu", static_cast<unsigned long long>(events));
+    stat.addf("Messages since startup", "%llu", static_cast<unsigned long long>(count));
+    stat.addf("Duration of window (s)", "%f", window);
+    stat.addf("Actual frequency (Hz)", "%f", freq);
+    if (*freq_.min_freq_ > 0) {
+      stat.addf("Minimum acceptable frequency (Hz)", "%f",
+        *freq_.min_freq_ * (1 - freq_.tolerance_));
+    }
+    if (std::isfinite(*freq_.max_freq_)) {
+      stat.addf("Maximum acceptable frequency (Hz)", "%f",
+        *freq_.max_freq_ * (1 + freq_.tolerance_));
+    }
+    if (latency_count) {
+      stat.addf("Minimum latency (s)", "%f", min_latency * 1e-9);
+      stat.addf("Mean latency (s)", "%f", latency_sum * 1e-9 / latency_count);
+      stat.addf("Maximum latency (s)", "%f", max_latency * 1e-9);
+    }
+    stat.addf("Zero timestamps since last update", "%llu",
+      static_cast<unsigned long long>(zero_count));
+    stat.values.insert(stat.values.end(), sequence.values.begin(), sequence.values.end());
+  }
+
+private:
+  static constexpr int64_t kNoLatency = std::numeric_limits<int64_t>::max();
+
+  const FrequencyStatusParam freq_;
+  const TimeStampStatusParam stamp_;
+  rclcpp::Clock clock_;
+
+  // Written by tick()
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> zero_count_;
+  std::atomic<int64_t> latency_sum_;    /**< Nanoseconds */
+  std::atomic<int64_t> min_latency_;
+  std::atomic<int64_t> max_latency_;
+  SequenceStatus sequence_;
+  std::atomic<bool> sequenced_;
+
+  // Used by run()
+  std::mutex lock_;
+  std::vector<rclcpp::Time> times_;
+  std::vector<uint64_t> counts_;
+  int hist_indx_;
+  uint64_t last_count_;
+};
+
+/**
+ * \brief A subscription whose messages are monitored by a
+ * SubscriptionStatus.
+ *
+ * Subscribes to a topic of messages with a header, and checks every message
+ * before passing it to the callback. The SubscriptionStatus is added to the
+ * Updater as a single task.
+ */
+template<class T>
+class DiagnosedSubscription : public SubscriptionStatus
+{
+public:
+  typedef std::function<void (const std::shared_ptr<T>)> CallbackType;
+
+  /**
+   * \brief Constructs a DiagnosedSubscription.
+   *
+   * \param node The node that subscribes to the topic.
+   *
+   * \param topic The topic to subscribe to.
+   *
+   * \param callback The function to call with each message.
+   *
+   * \param diag The diagnostic_updater that the task should add itself to.
+   *
+   * \param freq The acceptable frequencies of the messages.
+   *
+   * \param stamp The acceptable latencies of the messages.
+   *
+   * \param seq The acceptable message losses, when setSequence() is used.
+   */
+  DiagnosedSubscription(
+    rclcpp::Node::SharedPtr node, const std::string & topic, CallbackType callback,
+    diagnostic_updater::Updater & diag,
+    const diagnostic_updater::FrequencyStatusParam & freq,
+    const diagnostic_updater::TimeStampStatusParam & stamp,
+    const rmw_qos_profile_t & qos = rmw_qos_profile_default,
+    const diagnostic_updater::SequenceStatusParam & seq = SequenceStatusParam())
+  : SubscriptionStatus(topic + " subscription status", freq, stamp, seq), callback_(callback)
+  {
+    subscription_ = node->template create_subscription<T>(topic,
+        [this](const std::shared_ptr<T> message) {receive(message);}, qos);
+    diag.add(*this);
+  }
+
+  virtual ~DiagnosedSubscription() {}
+
+  /**
+   * \brief Sets the function that returns the sequence number of a
+   * message, to count lost messages. Must be set before messages arrive.
+   */
+  void setSequence(std::function<uint64_t(const T &)> sequence) {sequence_ = sequence;}
+
+  /**
+   * \brief Collects statistics and calls the callback.
+   *
+   * The subscription calls this with every message.
+   */
+  void receive(const std::shared_ptr<T> & message)
+  {
+    if (sequence_) {
+      tick(rclcpp::Time(message->header.stamp), sequence_(*message));
+    } else {
+      tick(rclcpp::Time(message->header.stamp));
+    }
+    callback_(message);
+  }
+
+  /**
+   * \brief Returns the subscription.
+   */
+  typename rclcpp::Subscription<T>::SharedPtr getSubscription() const
+  {
+    return subscription_;
+  }
+
+private:
+  CallbackType callback_;
+  std::function<uint64_t(const T &)> sequence_;
+  typename rclcpp::Subscription<T>::SharedPtr subscription_;
+};
+}   // namespace diagnostic_updater
+
+#endif  // DIAGNOSTIC_UPDATER__SUBSCRIPTION_HPP_
@@ -0,0 +1,358 @@
+// Copyright 2017 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef DIAGNOSTIC_UPDATER__TOPIC_MONITOR_HUB_HPP_
+#define DIAGNOSTIC_UPDATER__TOPIC_MONITOR_HUB_HPP_
+
+#include <diagnostic_updater/update_functions.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace diagnostic_updater
+{
+
+/**
+ * \brief Monitors many topics with a single diagnostic task.
+ *
+ * Does the work of one HeaderlessTopicDiagnostic or TopicDiagnostic per
+ * topic, with the same statuses, but keeps the counters of all topics in
+ * one table with a column per counter. tick() is a lock-free update of the
+ * topic's row, and each update evaluates all the topics in one pass over the
+ * columns.
+ *
+ * Each update publishes either one status per topic, or a summary followed
+ * by the statuses of the failing topics only.
+ *
+ * The table has a fixed capacity so that ticks never race with its growth.
+ * The frequency window, a number of updates like
+ * FrequencyStatusParam::window_size_, is the same for all topics.
+ */
+class TopicMonitorHub
+{
+public:
+  enum Mode
+  {
+    PerTopic,            /**< One status per topic */
+    SummaryAndFailing    /**< A summary, and a status per failing topic */
+  };
+
+  /**
+   * \brief Constructs a TopicMonitorHub and adds it to the Updater.
+   *
+   * \param name Name of the summary status.
+   *
+   * \param capacity Maximum number of topics.
+   *
+   * \param window_size Number of updates over which frequencies are computed.
+   */
+  TopicMonitorHub(
+    const std::string & name, diagnostic_updater::Updater & diag,
+    size_t capacity, Mode mode = PerTopic, int window_size = 5)
+  : name_(name), capacity_(capacity), mode_(mode), size_(0),
+    ticks_(new std::atomic<uint64_t>[capacity]),
+    min_delay_(new std::atomic<double>[capacity]),
+    max_delay_(new std::atomic<double>[capacity]),
+    zero_seen_(new std::atomic<bool>[capacity]),
+    names_(capacity), freq_params_(capacity, FrequencyStatusParam(nullptr, nullptr)),
+    added_(capacity), has_stamp_(capacity), min_acceptable_(capacity),
+    max_acceptable_(capacity),
+    window_times_(window_size, rclcpp::Clock().now().seconds()),
+    window_counts_(window_size * capacity), hist_indx_(0),
+    count_(capacity), min_delay_seen_(capacity), max_delay_seen_(capacity),
+    zero_seen_now_(capacity), min_freq_(capacity), max_freq_(capacity), events_(capacity),
+    window_(capacity), freq_(capacity), freq_level_(capacity), stamp_level_(capacity),
+    level_(capacity),
+    late_count_(capacity), early_count_(capacity), zero_count_(capacity)
+  {
+    diag.addMulti(name, [this](std::vector<DiagnosticStatusWrapper> & statuses) {
+        run(statuses);
+      });
+  }
+
+  /**
+   * \brief Adds a topic checked like a HeaderlessTopicDiagnostic.
+   *
+   * \return Index of the topic, to pass to tick().
+   */
+  size_t addTopic(const std::string & name, const FrequencyStatusParam & freq)
+  {
+    return addTopic(name, freq, TimeStampStatusParam(), false);
+  }
+
+  /**
+   * \brief Adds a topic checked like a TopicDiagnostic.
+   *
+   * \return Index of the topic, to pass to tick().
+   */
+  size_t addTopic(
+    const std::string & name, const FrequencyStatusParam & freq,
+    const TimeStampStatusParam & stamp)
+  {
+    return addTopic(name, freq, stamp, true);
+  }
+
+  /**
+   * \brief Signals that a message was published on a topic.
+   */
+  void tick(size_t topic)
+  {
+    ticks_[topic].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  /**
+   * \brief Signals that a message with the given timestamp was published.
+   */
+  void tick(size_t topic, double stamp)
+  {
+    if (stamp == 0) {
+      zero_seen_[topic].store(true, std::memory_order_relaxed);
+    } else {
+      double delay = rclcpp::Clock().now().seconds() - stamp;
+      double min = min_delay_[topic].load(std::memory_order_relaxed);
+      while (delay < min &&
+        !min_delay_[topic].compare_exchange_weak(min, delay, std::memory_order_relaxed))
+      {
+      }
+      double max = max_delay_[topic].load(std::memory_order_relaxed);
+      while (delay > max &&
+        !max_delay_[topic].compare_exchange_weak(max, delay, std::memory_order_relaxed))
+      {
+      }
+    }
+    tick(topic);
+  }
+
+  void tick(size_t topic, const rclcpp::Time & stamp) {tick(topic, stamp.seconds());}
+
+  /**
+   * \brief Number of topics.
+   */
+  size_t size() const {return size_.load(std::memory_order_acquire);}
+
+  /**
+   * \brief Evaluates every topic and appends their statuses.
+   */
+  void run(std::vector<DiagnosticStatusWrapper> & statuses)
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    const size_t n = size_.load(std::memory_order_acquire);
+    const double now = rclcpp::Clock().now().seconds();
+    const size_t slot = hist_indx_;
+    const double window_start = window_times_[slot];
+    window_times_[slot] = now;
+    hist_indx_ = (hist_indx_ + 1) % window_times_.size();
+
+    // Take the atomic counters first, so that the passes below run over
+    // plain columns
+    for (size_t i = 0; i < n; ++i) {
+      count_[i] = ticks_[i].load(std::memory_order_relaxed);
+      min_delay_seen_[i] = min_delay_[i].exchange(kNoDelay, std::memory_order_relaxed);
+      max_delay_seen_[i] = max_delay_[i].exchange(-kNoDelay, std::memory_order_relaxed);
+      zero_seen_now_[i] = zero_seen_[i].exchange(false, std::memory_order_relaxed);
+    }
+    for (size_t i = 0; i < n; ++i) {
+      min_freq_[i] = *freq_params_[i].min_freq_ * (1 - freq_params_[i].tolerance_);
+      max_freq_[i] = *freq_params_[i].max_freq_ * (1 + freq_params_[i].tolerance_);
+    }
+
+    // Frequencies, over the windows of the topics
+    uint64_t * window_count = &window_counts_[slot * capacity_];
+    for (size_t i = 0; i < n; ++i) {
+      events_[i] = count_[i] - window_count[i];
+      window_count[i] = count_[i];
+      window_[i] = now - std::max(window_start, added_[i]);
+      freq_[i] = events_[i] / window_[i];
+      freq_level_[i] = events_[i] == 0 ? 2 :
+        (freq_[i] < min_freq_[i] || freq_[i] > max_freq_[i]) ? 1 : 0;
+    }
+
+    // Timestamps, for the topics that have them
+    size_t failing = 0;
+    unsigned char worst = 0;
+    for (size_t i = 0; i < n; ++i) {
+      bool valid = min_delay_seen_[i] <= max_delay_seen_[i];
+      bool bad = min_delay_seen_[i] < min_acceptable_[i] ||
+        max_delay_seen_[i] > max_acceptable_[i] || zero_seen_now_[i];
+      stamp_level_[i] = has_stamp_[i] ? (!valid ? 1 : bad ? 2 : 0) : 0;
+      level_[i] = std::max(freq_level_[i], stamp_level_[i]);
+      failing += level_[i] != 0;
+      worst = std::max(worst, level_[i]);
+    }
+
+    if (mode_ == SummaryAndFailing) {
+      statuses.emplace_back();
+      DiagnosticStatusWrapper & summary = statuses.back();
+      summary.name = name_;
+      if (failing) {
+        summary.summaryf(worst, "%zu of %zu topics failing", failing, n);
+      } else {
+        summary.summaryf(0, "All %zu topics OK", n);
+      }
+      summary.add("Topics", n);
+      summary.add("Failing topics", failing);
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+      if (mode_ == PerTopic || level_[i]) {
+        statuses.emplace_back();
+        report(i, statuses.back());
+      }
+    }
+  }
+
+private:
+  static constexpr double kNoDelay = std::numeric_limits<double>::infinity();
+
+  size_t addTopic(
+    const std::string & name, const FrequencyStatusParam & freq,
+    const TimeStampStatusParam & stamp, bool has_stamp)
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    size_t i = size_.load(std::memory_order_relaxed);
+    if (i == capacity_) {
+      throw std::runtime_error("TopicMonitorHub is full");
+    }
+    names_[i] = name + " topic status";
+    freq_params_[i] = freq;
+    added_[i] = rclcpp::Clock().now().seconds();
+    has_stamp_[i] = has_stamp;
+    min_acceptable_[i] = stamp.min_acceptable_;
+    max_acceptable_[i] = stamp.max_acceptable_;
+    ticks_[i].store(0, std::memory_order_relaxed);
+    min_delay_[i].store(kNoDelay, std::memory_order_relaxed);
+    max_delay_[i].store(-kNoDelay, std::memory_order_relaxed);
+    zero_seen_[i].store(false, std::memory_order_relaxed);
+    size_.store(i + 1, std::memory_order_release);
+    return i;
+  }
+
+  /**
+   * \brief Fills the status of topic i like a TopicDiagnostic would.
+   */
+  void report(size_t i, DiagnosticStatusWrapper & stat)
+  {
+    const FrequencyStatusParam & params = freq_params_[i];
+    stat.name = names_[i];
+
+    if (freq_level_[i] == 2) {
+      stat.mergeSummary(2, "No events recorded.");
+    } else if (freq_[i] < min_freq_[i]) {
+      stat.mergeSummary(1, "Frequency too low.");
+    } else if (freq_[i] > max_freq_[i]) {
+      stat.mergeSummary(1, "Frequency too high.");
+    }
+    stat.addf("Events in window", "%d", static_cast<int>(events_[i]));
+    stat.addf("Events since startup", "%d", static_cast<int>(count_[i]));
+    stat.addf("Duration of window (s)", "%f", window_[i]);
+    stat.addf("Actual frequency (Hz)", "%f", freq_[i]);
+    if (*params.min_freq_ == *params.max_freq_) {
+      stat.addf("Target frequency (Hz)", "%f", *params.min_freq_);
+    }
+    if (*params.min_freq_ > 0) {
+      stat.addf("Minimum acceptable frequency (Hz)", "%f", min_freq_[i]);
+    }
+    if (std::isfinite(*params.max_freq_)) {
+      stat.addf("Maximum acceptable frequency (Hz)", "%f", max_freq_[i]);
+    }
+
+    if (!has_stamp_[i]) {
+      return;
+    }
+    double min_delay = 0;
+    double max_delay = 0;
+    const char * message = "Timestamps are reasonable.";
+    if (min_delay_seen_[i] > max_delay_seen_[i]) {
+      message = "No data since last update.";
+    } else {
+      min_delay = min_delay_seen_[i];
+      max_delay = max_delay_seen_[i];
+      if (min_delay < min_acceptable_[i]) {
+        message = "Timestamps too far in future seen.";
+        early_count_[i]++;
+      }
+      if (max_delay > max_acceptable_[i]) {
+        message = "Timestamps too far in past seen.";
+        late_count_[i]++;
+      }
+      if (zero_seen_now_[i]) {
+        message = "Zero timestamp seen.";
+        zero_count_[i]++;
+      }
+    }
+    stat.mergeSummary(stamp_level_[i], message);
+    stat.addf("Earliest timestamp delay:", "%f", min_delay);
+    stat.addf("Latest timestamp delay:", "%f", max_delay);
+    stat.addf("Earliest acceptable timestamp delay:", "%f", min_acceptable_[i]);
+    stat.addf("Latest acceptable timestamp delay:", "%f", max_acceptable_[i]);
+    stat.add("Late diagnostic update count:", late_count_[i]);
+    stat.add("Early diagnostic update count:", early_count_[i]);
+    stat.add("Zero seen diagnostic update count:", zero_count_[i]);
+  }
+
+  const std::string name_;
+  const size_t capacity_;
+  const Mode mode_;
+  std::atomic<size_t> size_;
+  std::mutex lock_;   /**< Guards everything but the tick columns */
+
+  // Tick columns, written by tick() without locking
+  std::unique_ptr<std::atomic<uint64_t>[]> ticks_;
+  std::unique_ptr<std::atomic<double>[]> min_delay_;
+  std::unique_ptr<std::atomic<double>[]> max_delay_;
+  std::unique_ptr<std::atomic<bool>[]> zero_seen_;
+
+  // Configuration columns
+  std::vector<std::string> names_;
+  std::vector<FrequencyStatusParam> freq_params_;
+  std::vector<double> added_;
+  std::vector<unsigned char> has_stamp_;
+  std::vector<double> min_acceptable_;
+  std::vector<double> max_acceptable_;
+
+  // Frequency windows, shared by all topics. window_counts_ holds the
+  // counts of every topic at the update of window_times_ with the same slot.
+  std::vector<double> window_times_;
+  std::vector<uint64_t> window_counts_;
+  size_t hist_indx_;
+
+  // Columns of the latest update
+  std::vector<uint64_t> count_;
+  std::vector<double> min_delay_seen_;
+  std::vector<double> max_delay_seen_;
+  std::vector<unsigned char> zero_seen_now_;
+  std::vector<double> min_freq_;
+  std::vector<double> max_freq_;
+  std::vector<uint64_t> events_;
+  std::vector<double> window_;
+  std::vector<double> freq_;
+  std::vector<unsigned char> freq_level_;
+  std::vector<unsigned char> stamp_level_;
+  std::vector<unsigned char> level_;
+  std::vector<int> late_count_;
+  std::vector<int> early_count_;
+  std::vector<int> zero_count_;
+};
+
+}  // namespace diagnostic_updater
+
+#endif  // DIAGNOSTIC_UPDATER__TOPIC_MONITOR_HUB_HPP_
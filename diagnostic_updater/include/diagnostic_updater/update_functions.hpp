@@ -18,8 +18,16 @@
 #include <diagnostic_updater/diagnostic_updater.hpp>
 #include <math.h>
 
-#include <vector>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 namespace diagnostic_updater
 {
@@ -368,6 +376,277 @@ private:
   std::mutex lock_;
 };
 
+/**
+ * \brief A structure that holds the constructor parameters for the
+ * SequenceStatus class.
+ */
+struct SequenceStatusParam
+{
+  /**
+   * \brief Creates a filled-out SequenceStatusParam.
+   */
+  SequenceStatusParam(
+    double warn_loss = 1.0, double error_loss = 10.0,
+    uint64_t warn_burst = 5, uint64_t error_burst = 50,
+    uint32_t resync_late = 5, uint32_t resync_jump = 65536)
+  : warn_loss_(warn_loss), error_loss_(error_loss), warn_burst_(warn_burst),
+    error_burst_(error_burst), resync_late_(resync_late), resync_jump_(resync_jump) {}
+
+  /**
+   * \brief Percentages of messages lost since the last update above which
+   * a warning, or an error, is reported.
+   */
+  double warn_loss_;
+  double error_loss_;
+
+  /**
+   * \brief Numbers of consecutive messages lost above which a warning, or
+   * an error, is reported.
+   */
+  uint64_t warn_burst_;
+  uint64_t error_burst_;
+
+  /**
+   * \brief Number of consecutive late messages, or distance behind the
+   * latest number, at which the sequence is assumed to have restarted, for
+   * instance because the publisher did.
+   */
+  uint32_t resync_late_;
+  uint32_t resync_jump_;
+};
+
+/**
+ * \brief Diagnostic task to monitor the sequence numbers of messages.
+ *
+ * Detects lost, reordered and duplicate messages from the sequence number
+ * or counter of each message. Reports the percentage of messages lost since
+ * the last update and the longest run of consecutive lost messages, with
+ * thresholds for both.
+ *
+ * Sequence numbers are compared modulo 2^32, so counters may wrap around at
+ * 2^32. A message missing when a later one arrives is counted as lost. If it
+ * arrives within 31 numbers of the latest one, it is counted as reordered
+ * instead. Older messages can't be told from duplicates and are counted as
+ * late. After resync_late consecutive late messages, or one at least
+ * resync_jump numbers behind, the sequence restarts from that message.
+ *
+ * tick() is a constant-time update of atomic counters without locks.
+ */
+class SequenceStatus : public DiagnosticTask
+{
+public:
+  /**
+   * \brief Constructs a SequenceStatus with the given parameters.
+   */
+  SequenceStatus(const SequenceStatusParam & params, std::string name)
+  : DiagnosticTask(name), params_(params)
+  {
+    init();
+  }
+
+  /**
+   * \brief Constructs a SequenceStatus with the given parameters.
+   *        Uses a default diagnostic task name of "Sequence Status".
+   */
+  explicit SequenceStatus(const SequenceStatusParam & params)
+  : DiagnosticTask("Sequence Status"), params_(params)
+  {
+    init();
+  }
+
+  /**
+   * \brief Signals that the message with the given sequence number was
+   * received.
+   */
+  void tick(uint64_t seq)
+  {
+    uint32_t seq32 = static_cast<uint32_t>(seq);
+    uint64_t start = (static_cast<uint64_t>(seq32) << 32) | kInitialized;
+    bool restart = false;
+    uint64_t state = state_.load(std::memory_order_relaxed);
+    while (true) {
+      if (state == kNoState) {
+        if (state_.compare_exchange_weak(state, start, std::memory_order_relaxed)) {
+          received_.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        continue;
+      }
+
+      uint32_t latest = static_cast<uint32_t>(state >> 32);
+      uint32_t ahead = seq32 - latest;
+      uint32_t behind = latest - seq32;
+      if (static_cast<int32_t>(ahead) < 0 && behind > kWindowSize) {
+        if (!restart) {
+          restart = behind >= params_.resync_jump_ ||
+            late_run_.fetch_add(1, std::memory_order_relaxed) + 1 >= params_.resync_late_;
+        }
+        if (!restart) {
+          late_.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        // The sequence restarted, for instance with its publisher
+        if (!state_.compare_exchange_weak(state, start, std::memory_order_relaxed)) {
+          continue;
+        }
+        late_run_.store(0, std::memory_order_relaxed);
+        received_.fetch_add(1, std::memory_order_relaxed);
+        resyncs_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      if (late_run_.load(std::memory_order_relaxed)) {
+        late_run_.store(0, std::memory_order_relaxed);
+      }
+
+      if (static_cast<int32_t>(ahead) > 0) {
+        // Bit i of the window is set when message latest - 1 - i was received
+        uint64_t shifted = ahead > kWindowSize ? 0 :
+          (((state & kWindow) << ahead) | (1ull << (ahead - 1)));
+        uint64_t next = start | (shifted & kWindow);
+        if (!state_.compare_exchange_weak(state, next, std::memory_order_relaxed)) {
+          continue;
+        }
+        received_.fetch_add(1, std::memory_order_relaxed);
+        uint64_t burst = ahead - 1;
+        if (burst) {
+          lost_.fetch_add(burst, std::memory_order_relaxed);
+          gaps_.fetch_add(1, std::memory_order_relaxed);
+          uint64_t max = max_burst_.load(std::memory_order_relaxed);
+          while (burst > max &&
+            !max_burst_.compare_exchange_weak(max, burst, std::memory_order_relaxed))
+          {
+          }
+        }
+        return;
+      }
+      if (ahead == 0) {
+        duplicates_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+
+      uint64_t bit = 1ull << (behind - 1);
+      if (state & bit) {
+        duplicates_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      if (state_.compare_exchange_weak(state, state | bit, std::memory_order_relaxed)) {
+        // A message counted as lost arrived after all
+        received_.fetch_add(1, std::memory_order_relaxed);
+        reordered_.fetch_add(1, std::memory_order_relaxed);
+        lost_.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+
+  virtual void run(diagnostic_updater::DiagnosticStatusWrapper & stat)
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    uint64_t received = received_.load(std::memory_order_relaxed);
+    int64_t lost = lost_.load(std::memory_order_relaxed);
+    uint64_t burst = max_burst_.exchange(0, std::memory_order_relaxed);
+
+    // Reordered messages may make fewer messages lost than at the last update
+    uint64_t new_received = received - last_received_;
+    uint64_t new_lost = lost > last_lost_ ? lost - last_lost_ : 0;
+    double loss = new_received + new_lost ?
+      100.0 * new_lost / (new_received + new_lost) : 0.0;
+    last_received_ = received;
+    last_lost_ = lost;
+    if (burst > longest_burst_) {
+      longest_burst_ = burst;
+    }
+
+    stat.summary(0, "No messages lost.");
+    if (received == 0) {
+      stat.summary(1, "No sequence numbers received.");
+    }
+    if (loss > params_.error_loss_) {
+      stat.summary(2, "Message loss too high.");
+    } else if (burst > params_.error_burst_) {
+      stat.summary(2, "Message loss burst too long.");
+    } else if (loss > params_.warn_loss_) {
+      stat.summary(1, "Message loss too high.");
+    } else if (burst > params_.warn_burst_) {
+      stat.summary(1, "Message loss burst too long.");
+    } else if (new_lost) {
+      stat.summary(0, "Some messages lost.");
+    }
+
+    stat.addf("Message loss since last update (%)", "%f", loss);
+    stat.addf("Longest loss burst since last update", "%llu",
+      static_cast<unsigned long long>(burst));
+    stat.addf("Messages lost since last update", "%llu",
+      static_cast<unsigned long long>(new_lost));
+    stat.addf("Messages received since startup", "%llu",
+      static_cast<unsigned long long>(received));
+    stat.addf("Messages lost since startup", "%lld", static_cast<long long>(lost));
+    stat.addf("Loss bursts since startup", "%llu",
+      static_cast<unsigned long long>(gaps_.load(std::memory_order_relaxed)));
+    stat.addf("Longest loss burst since startup", "%llu",
+      static_cast<unsigned long long>(longest_burst_));
+    stat.addf("Reordered messages since startup", "%llu",
+      static_cast<unsigned long long>(reordered_.load(std::memory_order_relaxed)));
+    stat.addf("Duplicate messages since startup", "%llu",
+      static_cast<unsigned long long>(duplicates_.load(std::memory_order_relaxed)));
+    stat.addf("Late messages since startup", "%llu",
+      static_cast<unsigned long long>(late_.load(std::memory_order_relaxed)));
+    stat.addf("Sequence restarts since startup", "%llu",
+      static_cast<unsigned long long>(resyncs_.load(std::memory_order_relaxed)));
+    stat.addf("Maximum acceptable message loss (%)", "%f", params_.error_loss_);
+    stat.addf("Maximum acceptable loss burst", "%llu",
+      static_cast<unsigned long long>(params_.error_burst_));
+  }
+
+private:
+  /**
+   * No message received yet. Any other value holds the latest sequence
+   * number in its high half, kInitialized, and the window of the 31 previous
+   * ones in its low bits.
+   */
+  static constexpr uint64_t kNoState = 0;
+  static constexpr uint64_t kInitialized = 1ull << 31;
+  static constexpr uint64_t kWindow = kInitialized - 1;
+  static constexpr uint32_t kWindowSize = 31;
+
+  void init()
+  {
+    state_ = kNoState;
+    received_ = 0;
+    lost_ = 0;
+    gaps_ = 0;
+    max_burst_ = 0;
+    reordered_ = 0;
+    duplicates_ = 0;
+    late_ = 0;
+    late_run_ = 0;
+    resyncs_ = 0;
+    last_received_ = 0;
+    last_lost_ = 0;
+    longest_burst_ = 0;
+  }
+
+  const SequenceStatusParam params_;
+
+  // Written by tick()
+  std::atomic<uint64_t> state_;
+  std::atomic<uint64_t> received_;
+  std::atomic<int64_t> lost_;
+  std::atomic<uint64_t> gaps_;
+  std::atomic<uint64_t> max_burst_;
+  std::atomic<uint64_t> reordered_;
+  std::atomic<uint64_t> duplicates_;
+  std::atomic<uint64_t> late_;
+  std::atomic<uint32_t> late_run_;
+  std::atomic<uint64_t> resyncs_;
+
+  // Used by run()
+  std::mutex lock_;
+  uint64_t last_received_;
+  int64_t last_lost_;
+  uint64_t longest_burst_;
+};
+
 /**
 * \brief Diagnostic task to monitor whether a node is alive
 *
@@ -389,6 +668,101 @@ public:
     stat.summary(0, "Alive");
   }
 };
+
+/**
+ * \brief Diagnostic task that computes its status on a background thread
+ *
+ * For metrics too expensive to compute while the Updater holds its lock,
+ * like walking a queue or summing a large map. The sampler function is
+ * called every period seconds on a thread of this task, into a back buffer
+ * that is then swapped with the front one. run() only copies the front
+ * buffer, so its cost does not depend on the metric. The age of the copied
+ * sample is added to the status, and a warning is merged in when the
+ * sampler has not finished within three periods.
+ */
+class SampledDiagnosticTask : public DiagnosticTask
+{
+public:
+  /**
+   * \brief Constructs a SampledDiagnosticTask and starts its thread
+   *
+   * \param sampler Fills a status like the function of a
+   * FunctionDiagnosticTask. It is never called concurrently with itself. An
+   * exception it throws is reported as an error in the sample.
+   *
+   * \param period Seconds between the starts of two samples.
+   */
+  SampledDiagnosticTask(const std::string & name, TaskFunction sampler, double period)
+  : DiagnosticTask(name), sampler_(sampler), period_(period), sampled_(false), stop_(false)
+  {
+    thread_ = std::thread([this]() {sample();});
+  }
+
+  ~SampledDiagnosticTask()
+  {
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    thread_.join();
+  }
+
+  virtual void run(diagnostic_updater::DiagnosticStatusWrapper & stat)
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    if (!sampled_) {
+      stat.summary(1, "No sample yet");
+      return;
+    }
+    double age = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - front_time_).count();
+    stat.summary(front_.level, front_.message);
+    stat.values = front_.values;
+    stat.addf("Sample age (s)", "%.3f", age);
+    if (age > 3 * period_) {
+      stat.mergeSummary(1, "Sampler is late");
+    }
+  }
+
+private:
+  void sample()
+  {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!stop_) {
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      lock.unlock();
+      back_.clearSummary();
+      back_.values.clear();
+      try {
+        sampler_(back_);
+      } catch (std::exception & e) {
+        back_.summary(2, std::string("Uncaught exception: ") + e.what());
+      } catch (...) {
+        back_.summary(2, "Uncaught exception");
+      }
+      lock.lock();
+
+      std::swap(front_, back_);
+      front_time_ = start;
+      sampled_ = true;
+      wake_.wait_until(lock, start +
+        std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(period_)), [this]() {return stop_;});
+    }
+  }
+
+  const TaskFunction sampler_;
+  const double period_;
+  DiagnosticStatusWrapper front_;   /**< Latest sample, guarded by lock_ */
+  DiagnosticStatusWrapper back_;    /**< Being sampled, only used by thread_ */
+  std::chrono::steady_clock::time_point front_time_;
+  bool sampled_;
+  bool stop_;
+  std::mutex lock_;
+  std::condition_variable wake_;
+  std::thread thread_;
+};
 }   // namespace diagnostic_updater
 
 #endif  // DIAGNOSTIC_UPDATER__UPDATE_FUNCTIONS_HPP_
@@ -15,9 +15,22 @@
 #include <diagnostic_updater/DiagnosticStatusWrapper.hpp>
 #include <diagnostic_updater/diagnostic_updater.hpp>
 #include <diagnostic_updater/update_functions.hpp>
+#include <diagnostic_updater/publisher.hpp>
+#include <diagnostic_updater/subscription.hpp>
+#include <diagnostic_updater/topic_monitor_hub.hpp>
 #include <gtest/gtest.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
 class TestClass
 {
 public:
@@ -193,6 +206,516 @@ TEST(DiagnosticUpdater, testTimeStampStatus) {
     "Name should be \"Timestamp Status\"";
 }
 
+TEST(DiagnosticUpdater, testAsyncDiagnosticTask) {
+  // Answers once delay seconds have passed since it was started, and notifies
+  // then unless it polls
+  class DelayedTask : public diagnostic_updater::AsyncDiagnosticTask
+  {
+public:
+    DelayedTask(const std::string & name, double delay, double deadline, bool polls = false)
+    : AsyncDiagnosticTask(name, deadline), delay_(delay), polls_(polls), cancelled_(false),
+      resumes_(0) {}
+
+    ~DelayedTask()
+    {
+      if (answer_.joinable()) {
+        answer_.join();
+      }
+    }
+
+    void start()
+    {
+      start_ = std::chrono::steady_clock::now();
+      if (!polls_ && delay_ < 1.0) {
+        if (answer_.joinable()) {
+          answer_.join();
+        }
+        answer_ = std::thread([this]() {
+              std::this_thread::sleep_for(std::chrono::duration<double>(delay_));
+              notify();
+            });
+      }
+    }
+
+    bool resume(diagnostic_updater::DiagnosticStatusWrapper & s)
+    {
+      ++resumes_;
+      if (std::chrono::steady_clock::now() - start_ < std::chrono::duration<double>(delay_)) {
+        return false;
+      }
+      s.summary(0, "Answered");
+      answered_ = std::chrono::steady_clock::now();
+      return true;
+    }
+
+    void cancel() {cancelled_ = true;}
+
+    double delay_;
+    bool polls_;
+    bool cancelled_;
+    int resumes_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point answered_;
+    std::thread answer_;
+  };
+
+  // Deadlines far beyond the delays, so that only a task that is never
+  // resumed after its answer times out, however loaded the machine
+  DelayedTask fast("fast", 0.05, 10.0);
+  diagnostic_updater::DiagnosticStatusWrapper stat;
+  fast.runBlocking(stat);
+  EXPECT_EQ(0, stat.level) << "runBlocking not woken by notify";
+  EXPECT_FALSE(fast.cancelled_) << "task cancelled before its deadline";
+  EXPECT_LE(fast.resumes_, 3) << "runBlocking polled a task that notifies";
+
+  DelayedTask hung("hung", 10.0, 0.05);
+  hung.runBlocking(stat);
+  EXPECT_EQ(2, stat.level) << "late task not reported as an error";
+  EXPECT_STREQ("Timed out after 0.05 seconds", stat.message.c_str());
+  EXPECT_TRUE(hung.cancelled_) << "late task not cancelled";
+
+  // The updater waits for all its tasks at once, without polling them
+  diagnostic_updater::Updater updater;
+  std::vector<std::unique_ptr<DelayedTask>> tasks;
+  for (int i = 0; i < 4; ++i) {
+    tasks.emplace_back(new DelayedTask("task" + std::to_string(i), 0.1, 10.0));
+    updater.add(*tasks.back());
+  }
+  DelayedTask late("late", 10.0, 0.1);
+  updater.add(late);
+  updater.force_update();
+  EXPECT_TRUE(late.cancelled_) << "late task not cancelled by the updater";
+  EXPECT_LE(late.resumes_, 10) << "updater polled a task that doesn't notify";
+  for (const std::unique_ptr<DelayedTask> & task : tasks) {
+    EXPECT_FALSE(task->cancelled_);
+    for (const std::unique_ptr<DelayedTask> & other : tasks) {
+      EXPECT_LT(task->start_, other->answered_) << "tasks were not waited for concurrently";
+    }
+  }
+
+  // A task that doesn't notify is resumed at the poll period
+  diagnostic_updater::Updater polling;
+  DelayedTask polled("polled", 0.05, 10.0, true);
+  polling.add(polled);
+  polling.setPollPeriod(0.01);
+  polling.force_update();
+  EXPECT_FALSE(polled.cancelled_) << "task not resumed at the poll period";
+  EXPECT_GT(polled.resumes_, 1);
+}
+
+TEST(DiagnosticUpdater, testRemoveRunningTask) {
+  diagnostic_updater::Updater updater;
+  std::atomic<bool> entered(false), release(false), left(false);
+  updater.add("blocking", [&](diagnostic_updater::DiagnosticStatusWrapper & s) {
+      entered = true;
+      while (!release) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      s.summary(0, "Done");
+      left = true;
+    });
+
+  // removeByName() returns only once the update is done with the task
+  std::thread update([&updater]() {updater.force_update();});
+  while (!entered) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  std::atomic<bool> removed(false);
+  std::thread remove([&]() {
+      EXPECT_TRUE(updater.removeByName("blocking"));
+      EXPECT_TRUE(left) << "removeByName returned while the task ran";
+      removed = true;
+    });
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  EXPECT_FALSE(removed) << "removeByName did not wait for the running task";
+  release = true;
+  remove.join();
+  update.join();
+
+  // The same for an asynchronous task waiting for its answer
+  class PendingTask : public diagnostic_updater::AsyncDiagnosticTask
+  {
+public:
+    PendingTask()
+    : AsyncDiagnosticTask("pending", 0.2), started_(false), cancelled_(false) {}
+
+    void start() {started_ = true;}
+
+    bool resume(diagnostic_updater::DiagnosticStatusWrapper &) {return false;}
+
+    void cancel() {cancelled_ = true;}
+
+    std::atomic<bool> started_;
+    std::atomic<bool> cancelled_;
+  };
+  std::unique_ptr<PendingTask> pending(new PendingTask);
+  updater.add(*pending);
+  update = std::thread([&updater]() {updater.force_update();});
+  while (!pending->started_) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  EXPECT_TRUE(updater.removeByName("pending"));
+  EXPECT_TRUE(pending->cancelled_) << "removeByName returned while the task was pending";
+  pending.reset();
+  update.join();
+
+  // A task may remove itself without waiting for its own update
+  updater.add("self", [&updater](diagnostic_updater::DiagnosticStatusWrapper & s) {
+      EXPECT_TRUE(updater.removeByName("self"));
+      s.summary(0, "Removed");
+    });
+  updater.force_update();
+  EXPECT_FALSE(updater.removeByName("self"));
+}
+
+TEST(DiagnosticUpdater, testSampledDiagnosticTask) {
+  std::atomic<int> samples(0);
+  diagnostic_updater::SampledDiagnosticTask task("sampled",
+    [&samples](diagnostic_updater::DiagnosticStatusWrapper & s) {
+      ++samples;
+      s.summary(0, "Sampled");
+      s.add("Samples", samples.load());
+    }, 0.01);
+
+  // Wait for a few samples, with room for a loaded machine
+  for (int i = 0; i < 500 && samples < 3; ++i) {
+    usleep(10000);
+  }
+  diagnostic_updater::DiagnosticStatusWrapper stat;
+  task.run(stat);
+  EXPECT_STREQ("Sampled", stat.message.c_str());
+  ASSERT_EQ(2u, stat.values.size());
+  EXPECT_STREQ("Samples", stat.values[0].key.c_str());
+  EXPECT_GT(atoi(stat.values[0].value.c_str()), 1) << "sampler not called periodically";
+  EXPECT_STREQ("Sample age (s)", stat.values[1].key.c_str());
+  EXPECT_LT(atof(stat.values[1].value.c_str()), 1.0);
+
+  // A sampler that throws is reported as an error and keeps being called
+  std::atomic<int> throws(0);
+  diagnostic_updater::SampledDiagnosticTask throwing("throwing",
+    [&throws](diagnostic_updater::DiagnosticStatusWrapper &) {
+      ++throws;
+      throw std::runtime_error("Sensor unplugged");
+    }, 0.01);
+  for (int i = 0; i < 500 && throws < 2; ++i) {
+    usleep(10000);
+  }
+  EXPECT_GE(throws, 2);
+  diagnostic_updater::DiagnosticStatusWrapper thrown;
+  throwing.run(thrown);
+  EXPECT_EQ(2, thrown.level);
+  EXPECT_STREQ("Uncaught exception: Sensor unplugged", thrown.message.c_str());
+}
+
+TEST(DiagnosticUpdater, testStaticCompositeDiagnosticTask) {
+  class LevelTask : public diagnostic_updater::DiagnosticTask
+  {
+public:
+    explicit LevelTask(int level)
+    : DiagnosticTask("level"), level_(level) {}
+
+    void run(diagnostic_updater::DiagnosticStatusWrapper & s)
+    {
+      s.summaryf(level_, "Level %d", level_);
+      s.add("Level", level_);
+    }
+
+    int level_;
+  };
+
+  // Every combination of levels gives the same result as the runtime composite
+  for (int a = 0; a < 3; ++a) {
+    for (int b = 0; b < 3; ++b) {
+      for (int c = 0; c < 3; ++c) {
+        diagnostic_updater::StaticCompositeDiagnosticTask<LevelTask, LevelTask, LevelTask>
+        fixed("fixed", a, b, c);
+        LevelTask ta(a), tb(b), tc(c);
+        diagnostic_updater::CompositeDiagnosticTask dynamic("dynamic");
+        dynamic.addTask(&ta);
+        dynamic.addTask(&tb);
+        dynamic.addTask(&tc);
+
+        diagnostic_updater::DiagnosticStatusWrapper fixed_stat, dynamic_stat;
+        fixed_stat.summary(2, "No message was set");
+        dynamic_stat.summary(2, "No message was set");
+        fixed.run(fixed_stat);
+        dynamic.run(dynamic_stat);
+        EXPECT_EQ(dynamic_stat.level, fixed_stat.level);
+        EXPECT_EQ(dynamic_stat.message, fixed_stat.message);
+        EXPECT_EQ(3u, fixed_stat.values.size());
+      }
+    }
+  }
+
+  diagnostic_updater::StaticCompositeDiagnosticTask<LevelTask, LevelTask> pair("pair", 1, 2);
+  diagnostic_updater::DiagnosticStatusWrapper stat;
+  pair.run(stat);
+  EXPECT_EQ(2, stat.level);
+  EXPECT_STREQ("Level 1; Level 2", stat.message.c_str());
+  pair.get<1>().level_ = 0;
+  pair.run(stat);
+  EXPECT_EQ(1, stat.level);
+  EXPECT_STREQ("Level 1", stat.message.c_str());
+
+  // Each child sees the summary that was passed in, whether or not the child
+  // before it changed the message
+  class SeeingTask : public diagnostic_updater::DiagnosticTask
+  {
+public:
+    SeeingTask()
+    : DiagnosticTask("seeing") {}
+
+    void run(diagnostic_updater::DiagnosticStatusWrapper & s) {seen_.push_back(s.message);}
+
+    std::vector<std::string> seen_;
+  };
+  diagnostic_updater::StaticCompositeDiagnosticTask<SeeingTask, LevelTask, SeeingTask, SeeingTask>
+  seeing("seeing", SeeingTask(), 1, SeeingTask(), SeeingTask());
+  stat.summary(2, "Passed in");
+  seeing.run(stat);
+  EXPECT_EQ(std::vector<std::string>({"Passed in"}), seeing.get<0>().seen_);
+  EXPECT_EQ(std::vector<std::string>({"Passed in"}), seeing.get<2>().seen_);
+  EXPECT_EQ(std::vector<std::string>({"Passed in"}), seeing.get<3>().seen_);
+  EXPECT_EQ(2, stat.level);
+  EXPECT_STREQ("Passed in; Level 1; Passed in; Passed in", stat.message.c_str());
+}
+
+TEST(DiagnosticUpdater, testTopicMonitorHub) {
+  double min_freq = 0;
+  double max_freq = std::numeric_limits<double>::infinity();
+  diagnostic_updater::FrequencyStatusParam freq(&min_freq, &max_freq);
+  diagnostic_updater::Updater updater;
+
+  diagnostic_updater::TopicMonitorHub hub("hub", updater, 4);
+  size_t ticked = hub.addTopic("ticked", freq);
+  size_t silent = hub.addTopic("silent", freq);
+  size_t stamped = hub.addTopic("stamped", freq, diagnostic_updater::TimeStampStatusParam());
+  size_t zero = hub.addTopic("zero", freq, diagnostic_updater::TimeStampStatusParam());
+  EXPECT_THROW(hub.addTopic("one too many", freq), std::runtime_error);
+  EXPECT_EQ(1u, silent);
+  EXPECT_EQ(4u, hub.size());
+
+  // The same checks with one TopicDiagnostic per topic
+  diagnostic_updater::HeaderlessTopicDiagnostic ticked_diag("ticked", updater, freq);
+  diagnostic_updater::HeaderlessTopicDiagnostic silent_diag("silent", updater, freq);
+  diagnostic_updater::TopicDiagnostic stamped_diag("stamped", updater, freq,
+    diagnostic_updater::TimeStampStatusParam());
+  diagnostic_updater::TopicDiagnostic zero_diag("zero", updater, freq,
+    diagnostic_updater::TimeStampStatusParam());
+
+  usleep(10000);
+  rclcpp::Time now = rclcpp::Clock().now();
+  for (int i = 0; i < 3; ++i) {
+    hub.tick(ticked);
+    ticked_diag.tick();
+    hub.tick(stamped, now);
+    stamped_diag.tick(now);
+    hub.tick(zero, 0.0);
+    zero_diag.tick(rclcpp::Time(0, 0u));
+  }
+
+  std::vector<diagnostic_updater::DiagnosticStatusWrapper> statuses;
+  hub.run(statuses);
+  ASSERT_EQ(4u, statuses.size());
+  diagnostic_updater::CompositeDiagnosticTask * diags[] =
+  {&ticked_diag, &silent_diag, &stamped_diag, &zero_diag};
+  for (size_t i = 0; i < statuses.size(); ++i) {
+    diagnostic_updater::DiagnosticStatusWrapper expected;
+    diags[i]->run(expected);
+    EXPECT_EQ(diags[i]->getName(), statuses[i].name);
+    EXPECT_EQ(expected.level, statuses[i].level) << statuses[i].name;
+    EXPECT_EQ(expected.message, statuses[i].message) << statuses[i].name;
+    ASSERT_EQ(expected.values.size(), statuses[i].values.size()) << statuses[i].name;
+    for (size_t j = 0; j < expected.values.size(); ++j) {
+      EXPECT_EQ(expected.values[j].key, statuses[i].values[j].key);
+    }
+  }
+  EXPECT_EQ(0, statuses[0].level);
+  EXPECT_EQ(2, statuses[1].level);
+  EXPECT_EQ(0, statuses[2].level);
+  EXPECT_EQ(1, statuses[3].level) << "only zero stamps are no data";
+
+  // Only the summary and the failing topics
+  diagnostic_updater::TopicMonitorHub failing("failing", updater, 2,
+    diagnostic_updater::TopicMonitorHub::SummaryAndFailing);
+  failing.addTopic("ticked", freq);
+  failing.addTopic("silent", freq);
+  failing.tick(0);
+  statuses.clear();
+  failing.run(statuses);
+  ASSERT_EQ(2u, statuses.size());
+  EXPECT_STREQ("failing", statuses[0].name.c_str());
+  EXPECT_EQ(2, statuses[0].level);
+  EXPECT_STREQ("1 of 2 topics failing", statuses[0].message.c_str());
+  EXPECT_STREQ("silent topic status", statuses[1].name.c_str());
+
+  updater.force_update();
+}
+
+TEST(DiagnosticUpdater, testDiagnosedSubscription) {
+  double min_freq = 0;
+  double max_freq = std::numeric_limits<double>::infinity();
+  diagnostic_updater::Updater updater;
+  int received = 0;
+  diagnostic_updater::DiagnosedSubscription<diagnostic_msgs::msg::DiagnosticArray> sub(
+    rclcpp::Node::make_shared("test_subscription"), "/topic",
+    [&received](const std::shared_ptr<diagnostic_msgs::msg::DiagnosticArray>) {++received;},
+    updater, diagnostic_updater::FrequencyStatusParam(&min_freq, &max_freq),
+    diagnostic_updater::TimeStampStatusParam());
+  // The number of statuses stands for a sequence number
+  sub.setSequence([](const diagnostic_msgs::msg::DiagnosticArray & msg) {
+      return msg.status.size();
+    });
+
+  diagnostic_updater::DiagnosticStatusWrapper stat;
+  usleep(10000);
+  auto msg = std::make_shared<diagnostic_msgs::msg::DiagnosticArray>();
+  msg->header.stamp = rclcpp::Clock().now();
+  for (size_t seq : {1, 2, 3, 6, 7}) {
+    msg->status.resize(seq);
+    sub.receive(msg);
+  }
+  sub.run(stat);
+  EXPECT_EQ(5, received) << "callback not called";
+  EXPECT_EQ(2, stat.level);
+  EXPECT_STREQ("Message loss too high.", stat.message.c_str());
+  std::map<std::string, std::string> values;
+  for (const auto & value : stat.values) {
+    values[value.key] = value.value;
+  }
+  EXPECT_EQ("5", values["Messages in window"]);
+  EXPECT_EQ("2", values["Messages lost since last update"]);
+  EXPECT_EQ(1u, values.count("Mean latency (s)"));
+
+  msg->status.resize(8);
+  sub.receive(msg);
+  sub.run(stat);
+  EXPECT_EQ(0, stat.level) << stat.message;
+
+  msg->header.stamp = rclcpp::Time(0, 0u);
+  sub.receive(msg);
+  sub.run(stat);
+  EXPECT_EQ(2, stat.level);
+  EXPECT_STREQ("Zero timestamp seen.", stat.message.c_str());
+
+}
+
+TEST(DiagnosticUpdater, testSequenceStatus) {
+  diagnostic_updater::SequenceStatus seq(diagnostic_updater::SequenceStatusParam(1.0, 10.0, 5, 50));
+  diagnostic_updater::DiagnosticStatusWrapper stat;
+
+  seq.run(stat);
+  EXPECT_EQ(1, stat.level) << "no data should return a warning";
+
+  // 4 and 5 lost, 5 then arrives late, 6 is duplicated, 8 to 19 lost
+  for (uint64_t n : {1, 2, 3, 6, 5, 6, 7, 20}) {
+    seq.tick(n);
+  }
+  seq.run(stat);
+  std::map<std::string, std::string> values;
+  for (const auto & value : stat.values) {
+    values[value.key] = value.value;
+  }
+  EXPECT_EQ(2, stat.level);
+  EXPECT_STREQ("Message loss too high.", stat.message.c_str());
+  EXPECT_EQ("13", values["Messages lost since last update"]);
+  EXPECT_EQ("7", values["Messages received since startup"]);
+  EXPECT_EQ("12", values["Longest loss burst since last update"]);
+  EXPECT_EQ("2", values["Loss bursts since startup"]);
+  EXPECT_EQ("1", values["Reordered messages since startup"]);
+  EXPECT_EQ("1", values["Duplicate messages since startup"]);
+  EXPECT_EQ(65.0, atof(values["Message loss since last update (%)"].c_str()));
+
+  // Counters wrap around at 2^32
+  diagnostic_updater::SequenceStatusParam defaults;
+  diagnostic_updater::SequenceStatus wrapping(defaults);
+  for (uint64_t n = 0xfffffff0ull; n < 0x100000010ull; ++n) {
+    wrapping.tick(n & 0xffffffffull);
+  }
+  wrapping.run(stat);
+  EXPECT_EQ(0, stat.level) << stat.message;
+  EXPECT_STREQ("No messages lost.", stat.message.c_str());
+
+  // Bursts are checked even when the loss is acceptable
+  for (uint64_t n = 0x10; n < 1000; ++n) {
+    wrapping.tick(n);
+  }
+  wrapping.tick(1007);
+  wrapping.run(stat);
+  EXPECT_EQ(1, stat.level);
+  EXPECT_STREQ("Message loss burst too long.", stat.message.c_str());
+
+  // Small losses are reported without a warning
+  for (uint64_t n = 1008; n < 2000; ++n) {
+    wrapping.tick(n == 1500 ? 0 : n);
+  }
+  wrapping.run(stat);
+  EXPECT_EQ(0, stat.level);
+  EXPECT_STREQ("Some messages lost.", stat.message.c_str());
+
+  // The latest number 0xffffffff with a full window is still a started sequence
+  diagnostic_updater::SequenceStatus full(defaults);
+  for (uint64_t n = 0xffffffc0ull; n <= 0xffffffffull; ++n) {
+    full.tick(n);
+  }
+  full.tick(0xfffffff0ull);
+  full.run(stat);
+  values.clear();
+  for (const auto & value : stat.values) {
+    values[value.key] = value.value;
+  }
+  EXPECT_EQ("1", values["Duplicate messages since startup"]);
+  EXPECT_EQ("64", values["Messages received since startup"]);
+
+  // A publisher that restarts from 0 is followed after a few late messages
+  diagnostic_updater::SequenceStatus restarted(defaults);
+  for (uint64_t n = 100; n < 200; ++n) {
+    restarted.tick(n);
+  }
+  for (uint64_t n = 0; n < 100; ++n) {
+    restarted.tick(n);
+  }
+  restarted.run(stat);
+  values.clear();
+  for (const auto & value : stat.values) {
+    values[value.key] = value.value;
+  }
+  EXPECT_EQ(0, stat.level) << stat.message;
+  EXPECT_EQ("4", values["Late messages since startup"]);
+  EXPECT_EQ("1", values["Sequence restarts since startup"]);
+  EXPECT_EQ("0", values["Messages lost since startup"]);
+
+  // and at once when it jumps far back
+  diagnostic_updater::SequenceStatus jumped(
+    diagnostic_updater::SequenceStatusParam(1.0, 10.0, 5, 50, 5, 1000));
+  jumped.tick(5000);
+  jumped.tick(3);
+  jumped.tick(4);
+  jumped.run(stat);
+  values.clear();
+  for (const auto & value : stat.values) {
+    values[value.key] = value.value;
+  }
+  EXPECT_EQ("0", values["Late messages since startup"]);
+  EXPECT_EQ("1", values["Sequence restarts since startup"]);
+  EXPECT_EQ("0", values["Messages lost since startup"]);
+
+  diagnostic_updater::Updater updater;
+  double min_freq = 0;
+  double max_freq = std::numeric_limits<double>::infinity();
+  diagnostic_updater::SequencedTopicDiagnostic topic("topic", updater,
+    diagnostic_updater::FrequencyStatusParam(&min_freq, &max_freq));
+  usleep(10000);
+  topic.tick(1);
+  topic.tick(2);
+  topic.run(stat);
+  EXPECT_EQ(0, stat.level) << stat.message;
+  topic.tick(10);
+  topic.run(stat);
+  EXPECT_EQ(2, stat.level);
+  EXPECT_STREQ("Message loss too high.", stat.message.c_str());
+}
+
 int main(int argc, char ** argv)
 {
   rclcpp::init(argc, argv);
@@ -0,0 +1,96 @@
+// Copyright 2017 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+//  Measures the overhead DiagnosedSubscription adds to each message. It has
+//  not been measured against rclcpp on a multi-core host yet, so there are
+//  no reference numbers for it.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "diagnostic_updater/subscription.hpp"
+
+typedef diagnostic_msgs::msg::DiagnosticArray Message;
+
+const int kMessages = 2000000;
+
+//  Delivers kMessages messages from each of threads threads, like a
+//  multi-threaded executor would. Returns nanoseconds per message of a
+//  thread.
+template<class Receive>
+double run(int threads, Receive receive)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&receive]() {
+        auto message = std::make_shared<Message>();
+        message->header.stamp = rclcpp::Clock().now();
+        for (int i = 0; i < kMessages; ++i) {
+          receive(message);
+        }
+      });
+  }
+  for (std::thread & worker : workers) {
+    worker.join();
+  }
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return elapsed * 1e9 / kMessages;
+}
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+  rclcpp::Node::SharedPtr node = rclcpp::Node::make_shared("subscription_benchmark");
+  diagnostic_updater::Updater updater(node);
+  double min_freq = 0;
+  double max_freq = std::numeric_limits<double>::infinity();
+  diagnostic_updater::FrequencyStatusParam freq(&min_freq, &max_freq);
+
+  std::atomic<uint64_t> received(0);
+  auto callback = [&received](const std::shared_ptr<Message>) {
+      received.fetch_add(1, std::memory_order_relaxed);
+    };
+  diagnostic_updater::DiagnosedSubscription<Message> plain(node, "plain", callback, updater,
+    freq, diagnostic_updater::TimeStampStatusParam());
+  diagnostic_updater::DiagnosedSubscription<Message> sequenced(node, "sequenced", callback,
+    updater, freq, diagnostic_updater::TimeStampStatusParam());
+  std::atomic<uint64_t> seq(0);
+  sequenced.setSequence([&seq](const Message &) {
+      return seq.fetch_add(1, std::memory_order_relaxed);
+    });
+
+  printf("%8s %14s %14s %14s\n", "threads", "callback (ns)", "diagnosed (ns)", "with seq (ns)");
+  for (int threads : {1, 4}) {
+    double base = run(threads, [&](const std::shared_ptr<Message> & message) {
+          callback(message);
+        });
+    double diagnosed = run(threads, [&](const std::shared_ptr<Message> & message) {
+          plain.receive(message);
+        });
+    double with_seq = run(threads, [&](const std::shared_ptr<Message> & message) {
+          sequenced.receive(message);
+        });
+    printf("%8d %14.1f %14.1f %14.1f\n", threads, base, diagnosed, with_seq);
+  }
+
+  updater.force_update();
+  rclcpp::shutdown();
+  return 0;
+}
@@ -0,0 +1,304 @@
+// Copyright 2017 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef SELF_TEST__FLEET_ORCHESTRATOR_HPP_
+#define SELF_TEST__FLEET_ORCHESTRATOR_HPP_
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "diagnostic_msgs/srv/self_test.hpp"
+
+namespace self_test
+{
+
+/**
+ * \brief Runs the self-tests of many nodes at once, and reports them together
+ *
+ * discover() lists the SelfTest services in the graph. run() calls up to
+ * parallelism of them at a time, and gives each one timeout seconds to
+ * become available and respond. Nothing blocks: requests are sent from a
+ * timer of the given node, so the node must be spinning, on an executor
+ * thread other than the one calling wait().
+ */
+class FleetOrchestrator
+{
+public:
+  enum Outcome
+  {
+    Pending,
+    Passed,
+    Failed,
+    Timeout,
+    Unavailable
+  };
+
+  /**
+   * \brief Result of the self-test of one node
+   */
+  struct Result
+  {
+    std::string service;
+    Outcome outcome;
+    std::string id;
+    double duration;   /**< Seconds from the first attempt to the response */
+    std::vector<diagnostic_msgs::msg::DiagnosticStatus> status;
+  };
+
+  FleetOrchestrator(
+    rclcpp::Node::SharedPtr node, size_t parallelism = 8,
+    double timeout = 60.0)
+  : node_(node), parallelism_(std::max<size_t>(parallelism, 1)), timeout_(timeout),
+    started_(0), finished_(0)
+  {
+    group_ = node_->create_callback_group(
+      rclcpp::callback_group::CallbackGroupType::MutuallyExclusive);
+  }
+
+  /**
+   * \brief SelfTest services in the graph under the namespace prefix
+   *
+   * prefix matches whole name components, so /robot1 doesn't match
+   * /robot10/self_test.
+   */
+  std::vector<std::string> discover(const std::string & prefix = "")
+  {
+    std::string ns = prefix;
+    while (!ns.empty() && ns.back() == '/') {
+      ns.pop_back();
+    }
+
+    std::vector<std::string> services;
+    std::map<std::string, std::vector<std::string>> names_and_types =
+      node_->get_service_names_and_types();
+    for (const auto & name_and_types : names_and_types) {
+      const std::string & name = name_and_types.first;
+      if (name.compare(0, ns.size(), ns) != 0 ||
+        (name.size() > ns.size() && name[ns.size()] != '/'))
+      {
+        continue;
+      }
+      for (const std::string & type : name_and_types.second) {
+        if (type == "diagnostic_msgs/SelfTest" || type == "diagnostic_msgs/srv/SelfTest") {
+          services.push_back(name_and_types.first);
+          break;
+        }
+      }
+    }
+    return services;
+  }
+
+  /**
+   * \brief Starts the self-tests of services
+   */
+  void run(const std::vector<std::string> & services)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    calls_.clear();
+    calls_.resize(services.size());
+    for (size_t i = 0; i < services.size(); ++i) {
+      calls_[i].result.service = services[i];
+      calls_[i].result.outcome = Pending;
+      calls_[i].result.duration = 0.0;
+    }
+    started_ = 0;
+    finished_ = 0;
+
+    using namespace std::chrono_literals;
+    timer_ = node_->create_wall_timer(50ms, [this]() {tick();}, group_);
+  }
+
+  /**
+   * \brief Blocks until every self-test responded, failed or timed out
+   */
+  void wait()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this]() {return finished_ == calls_.size();});
+    if (timer_) {
+      timer_->cancel();
+    }
+  }
+
+  std::vector<Result> getResults()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::vector<Result> results;
+    for (const Call & call : calls_) {
+      results.push_back(call.result);
+    }
+    return results;
+  }
+
+  static const char * getOutcomeName(Outcome outcome)
+  {
+    switch (outcome) {
+      case Pending: return "pending";
+      case Passed: return "passed";
+      case Failed: return "failed";
+      case Timeout: return "timeout";
+      case Unavailable: return "unavailable";
+    }
+    return "unknown";
+  }
+
+  /**
+   * \brief Report of results as JSON, with a summary and every status
+   */
+  static std::string toJson(const std::vector<Result> & results)
+  {
+    std::map<Outcome, size_t> counts;
+    std::ostringstream services;
+    for (size_t i = 0; i < results.size(); ++i) {
+      const Result & result = results[i];
+      ++counts[result.outcome];
+      services << (i ? ",\n" : "\n") << "    {\"service\": " << quote(result.service) <<
+        ", \"outcome\": \"" << getOutcomeName(result.outcome) << "\", \"id\": " <<
+        quote(result.id) << ", \"duration\": " << result.duration << ", \"status\": [";
+      for (size_t j = 0; j < result.status.size(); ++j) {
+        const diagnostic_msgs::msg::DiagnosticStatus & status = result.status[j];
+        services << (j ? ", " : "") << "{\"name\": " << quote(status.name) <<
+          ", \"level\": " << static_cast<int>(status.level) << ", \"message\": " <<
+          quote(status.message) << ", \"values\": {";
+        for (size_t k = 0; k < status.values.size(); ++k) {
+          services << (k ? ", " : "") << quote(status.values[k].key) << ": " <<
+            quote(status.values[k].value);
+        }
+        services << "}}";
+      }
+      services << "]}";
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"summary\": {\"total\": " << results.size() <<
+      ", \"passed\": " << counts[Passed] << ", \"failed\": " << counts[Failed] <<
+      ", \"timeout\": " << counts[Timeout] << ", \"unavailable\": " << counts[Unavailable] <<
+      "},\n  \"services\": [" << services.str() << (results.empty() ? "]\n}\n" : "\n  ]\n}\n");
+    return json.str();
+  }
+
+private:
+  struct Call
+  {
+    Result result;
+    rclcpp::Client<diagnostic_msgs::srv::SelfTest>::SharedPtr client;
+    std::chrono::steady_clock::time_point start;
+    bool sent;
+  };
+
+  static std::string quote(const std::string & text)
+  {
+    std::string quoted = "\"";
+    for (char c : text) {
+      if (c == '"' || c == '\\') {
+        quoted += '\\';
+        quoted += c;
+      } else if (static_cast<unsigned char>(c) < 0x20) {
+        char escape[8];
+        snprintf(escape, sizeof(escape), "\\u%04x", c);
+        quoted += escape;
+      } else {
+        quoted += c;
+      }
+    }
+    return quoted + "\"";
+  }
+
+  /**
+   * \brief Starts calls up to the parallelism, sends the requests of the
+   * services that became available, and times out the late ones
+   */
+  void tick()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    size_t active = started_ - finished_;
+    for (; started_ < calls_.size() && active < parallelism_; ++started_, ++active) {
+      Call & call = calls_[started_];
+      call.client = node_->create_client<diagnostic_msgs::srv::SelfTest>(
+        call.result.service, rmw_qos_profile_services_default, group_);
+      call.start = now;
+      call.sent = false;
+    }
+
+    for (size_t i = 0; i < started_; ++i) {
+      Call & call = calls_[i];
+      if (call.result.outcome != Pending) {
+        continue;
+      }
+      double elapsed = std::chrono::duration<double>(now - call.start).count();
+      if (elapsed > timeout_) {
+        finish(i, call.sent ? Timeout : Unavailable, elapsed);
+        continue;
+      }
+      if (!call.sent && call.client->service_is_ready()) {
+        call.sent = true;
+        auto request = std::make_shared<diagnostic_msgs::srv::SelfTest::Request>();
+        call.client->async_send_request(request,
+          [this, i](rclcpp::Client<diagnostic_msgs::srv::SelfTest>::SharedFuture future) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            Call & call = calls_[i];
+            if (call.result.outcome != Pending) {
+              return;  // Timed out already
+            }
+            auto response = future.get();
+            call.result.id = response->id;
+            call.result.status = response->status;
+            finish(i, response->passed ? Passed : Failed,
+              std::chrono::duration<double>(std::chrono::steady_clock::now() - call.start).count());
+          });
+      }
+    }
+  }
+
+  /**
+   * \brief Records the outcome of call i and releases its client, so that at
+   * most parallelism clients exist at a time. mutex_ must be held.
+   */
+  void finish(size_t i, Outcome outcome, double duration)
+  {
+    calls_[i].result.outcome = outcome;
+    calls_[i].result.duration = duration;
+    calls_[i].client.reset();
+    ++finished_;
+    if (finished_ == calls_.size()) {
+      done_.notify_all();
+    }
+  }
+
+  rclcpp::Node::SharedPtr node_;
+  rclcpp::callback_group::CallbackGroup::SharedPtr group_;
+  rclcpp::TimerBase::SharedPtr timer_;
+  size_t parallelism_;
+  double timeout_;
+
+  std::mutex mutex_;
+  std::condition_variable done_;
+  std::vector<Call> calls_;
+  size_t started_;    /**< calls_ before started_ have a client */
+  size_t finished_;
+};
+
+}  //  namespace self_test
+#endif  //  SELF_TEST__FLEET_ORCHESTRATOR_HPP_
@@ -15,8 +15,15 @@
 #ifndef SELF_TEST__SELF_TEST_HPP_
 #define SELF_TEST__SELF_TEST_HPP_
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <stdexcept>
 #include <vector>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <string>
 #include <functional>
 #include <thread>
@@ -24,27 +31,279 @@
 #include <iostream>
 #include "rclcpp/rclcpp.hpp"
 #include "rcutils/cmdline_parser.h"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
 #include "diagnostic_msgs/msg/diagnostic_status.hpp"
 #include "diagnostic_msgs/srv/self_test.hpp"
 #include "diagnostic_updater/diagnostic_updater.hpp"
+#include "self_test/srv/run_tests.hpp"
 
 namespace self_test
 {
 //  using namespace diagnostic_updater;
 
+/**
+ * \brief Runs a set of tests when the self_test service is called.
+ *
+ * By default the tests run one at a time, in the order in which they were
+ * added. setConcurrency() lets independent tests run at the same time on up
+ * to that many threads. Tests that must run after others declare it with
+ * addDependency(), and are skipped if one of their dependencies fails.
+ *
+ * Concurrent tests, and tests with a timeout, run on a pool of at most
+ * "concurrency" threads owned by the TestRunner. With a timeout, a test that
+ * doesn't finish in time is reported as failed. It can't be stopped, so it
+ * keeps its thread until it returns, and the destructor waits for it. Tests
+ * that can't start because every thread is held by such a test are reported
+ * as skipped.
+ *
+ * While the tests run, the state of every test is published on the
+ * self_test/progress topic each time a test starts or finishes. Tests that
+ * haven't finished are STALE with the message "Pending" or "Running", so
+ * each message is complete on its own, and the results of finished tests
+ * are out of the node even if a later test crashes it.
+ *
+ * Tests whose result stays valid for a while, like reading a serial number,
+ * can be cached with setCacheDuration() or setCacheKey(). A cached result
+ * that passed is returned instead of running the test again, and is reported
+ * as cached by the self_test/run service. That service also runs only some
+ * tests, or only the ones that failed, along with the tests they depend on.
+ *
+ * The services are served on their own callback group. The rclcpp in use sends
+ * the response when the callback returns, so the callback waits for the
+ * tests; spin the node with a MultiThreadedExecutor to keep its other
+ * callbacks running during a self-test.
+ */
 class TestRunner : public diagnostic_updater::DiagnosticTaskVector
 {
 private:
   rclcpp::Service<diagnostic_msgs::srv::SelfTest>::SharedPtr service_server_;
+  rclcpp::Service<self_test::srv::RunTests>::SharedPtr run_server_;
+  rclcpp::callback_group::CallbackGroup::SharedPtr service_group_;
+  rclcpp::Publisher<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr progress_publisher_;
   rclcpp::Node::SharedPtr node_handle_;
   rclcpp::Node::SharedPtr private_node_handle_;
   std::string id_;
+  std::mutex id_lock_;
   bool verbose;
 
+  size_t concurrency_;
+  double timeout_;
+  std::map<std::string, double> timeouts_;
+  std::map<std::string, std::vector<std::string>> dependencies_;
+  std::map<std::string, double> cache_durations_;
+  std::map<std::string, std::function<std::string()>> cache_keys_;
+
+  /**
+   * \brief Last result of a test, and what it was cached under
+   */
+  struct CachedResult
+  {
+    diagnostic_updater::DiagnosticStatusWrapper status;
+    std::chrono::steady_clock::time_point time;
+    std::string key;
+  };
+
+  /**
+   * \brief Threads that run the tests, started on demand and joined by the
+   * destructor
+   */
+  std::mutex pool_lock_;
+  std::condition_variable pool_cond_;
+  std::vector<std::thread> workers_;
+  std::deque<std::function<void()>> jobs_;
+  size_t busy_workers_;   /**< Jobs queued or running, including timed out tests */
+  bool stopping_;
+
+  std::mutex run_lock_;   /**< One self-test at a time, guards results_ */
+  std::map<std::string, CachedResult> results_;
+
+  /**
+   * \brief State of one self-test, shared with the threads of its tests
+   */
+  struct Run
+  {
+    enum TestState
+    {
+      Pending,
+      Running,
+      Finished
+    };
+
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<diagnostic_updater::DiagnosticStatusWrapper> statuses;
+    std::vector<TestState> states;
+    std::vector<std::chrono::steady_clock::time_point> deadlines;
+    std::vector<double> timeouts;
+    bool exception_thrown;
+  };
+
+  void workerLoop()
+  {
+    std::unique_lock<std::mutex> lock(pool_lock_);
+    while (true) {
+      pool_cond_.wait(lock, [this]() {return stopping_ || !jobs_.empty();});
+      if (stopping_) {
+        return;
+      }
+      std::function<void()> job = jobs_.front();
+      jobs_.pop_front();
+      lock.unlock();
+      job();
+      lock.lock();
+    }
+  }
+
+  /**
+   * \brief Number of jobs that can start on the pool without waiting
+   */
+  size_t getFreeWorkers()
+  {
+    std::unique_lock<std::mutex> lock(pool_lock_);
+    return busy_workers_ < concurrency_ ? concurrency_ - busy_workers_ : 0;
+  }
+
+  /**
+   * \brief Queues a job, starting a thread for it if all are busy. The job
+   * must call releaseWorker() once done.
+   */
+  void submit(const std::function<void()> & job)
+  {
+    std::unique_lock<std::mutex> lock(pool_lock_);
+    jobs_.push_back(job);
+    if (++busy_workers_ > workers_.size()) {
+      workers_.emplace_back(&TestRunner::workerLoop, this);
+    }
+    pool_cond_.notify_one();
+  }
+
+  void releaseWorker()
+  {
+    std::unique_lock<std::mutex> lock(pool_lock_);
+    --busy_workers_;
+  }
+
+  /**
+   * \brief Runs one test and stores its status, unless it timed out meanwhile
+   *
+   * \param pooled : True on a worker thread, whose slot is freed before the
+   * status is stored, so that the next test can start once this one is seen
+   * finished.
+   */
+  void runTest(
+    std::shared_ptr<Run> run, size_t index,
+    const DiagnosticTaskInternal & task, bool pooled)
+  {
+    diagnostic_updater::DiagnosticStatusWrapper status;
+    status.level = 2;
+    status.message = "No message was set";
+    bool exception_thrown = false;
+
+    try {
+      task.run(status);
+    } catch (std::exception & e) {
+      status.level = 2;
+      status.message = std::string("Uncaught exception: ") + e.what();
+      exception_thrown = true;
+    } catch (...) {
+      status.level = 2;
+      status.message = "Uncaught exception";
+      exception_thrown = true;
+    }
+
+    if (pooled) {
+      releaseWorker();
+    }
+    std::unique_lock<std::mutex> lock(run->mutex);
+    if (run->states[index] == Run::Running) {
+      run->statuses[index] = status;
+      run->states[index] = Run::Finished;
+      run->exception_thrown = run->exception_thrown || exception_thrown;
+    }
+    run->finished.notify_all();
+  }
+
+  /**
+   * \brief Publishes the state of every test. lock must hold run.mutex, and
+   * is released while publishing so the tests aren't held up by it.
+   */
+  void publishProgress(const Run & run, std::unique_lock<std::mutex> & lock)
+  {
+    diagnostic_msgs::msg::DiagnosticArray msg;
+    msg.header.stamp = rclcpp::Clock().now();
+    msg.status.resize(run.statuses.size());
+    for (size_t i = 0; i < run.statuses.size(); ++i) {
+      if (run.states[i] == Run::Finished) {
+        msg.status[i] = run.statuses[i];
+      } else {
+        msg.status[i].name = run.statuses[i].name;
+        msg.status[i].level = diagnostic_msgs::msg::DiagnosticStatus::STALE;
+        msg.status[i].message = run.states[i] == Run::Running ? "Running" : "Pending";
+      }
+    }
+    lock.unlock();
+    progress_publisher_->publish(msg);
+    lock.lock();
+  }
+
+  /**
+   * \brief Key of the test named name, empty if it has none or it threw
+   */
+  std::string getCacheKey(const std::string & name)
+  {
+    std::map<std::string, std::function<std::string()>>::const_iterator key =
+      cache_keys_.find(name);
+    if (key == cache_keys_.end()) {
+      return "";
+    }
+    try {
+      return key->second();
+    } catch (std::exception & e) {
+      std::cout << "Cache key of " << name << " threw: " << e.what() << std::endl;
+      return "";
+    }
+  }
+
+  /**
+   * \brief Cached result of the test named name, if it passed and is still valid
+   */
+  const CachedResult * getCachedResult(const std::string & name, const std::string & key)
+  {
+    std::map<std::string, double>::const_iterator duration = cache_durations_.find(name);
+    bool has_key = cache_keys_.count(name) > 0;
+    if (duration == cache_durations_.end() && !has_key) {
+      return nullptr;
+    }
+
+    std::map<std::string, CachedResult>::const_iterator result = results_.find(name);
+    if (result == results_.end() || result->second.status.level >= 2) {
+      return nullptr;
+    }
+    if (duration != cache_durations_.end() &&
+      std::chrono::steady_clock::now() - result->second.time >
+      std::chrono::duration<double>(duration->second))
+    {
+      return nullptr;
+    }
+    if (has_key && (key.empty() || key != result->second.key)) {
+      return nullptr;
+    }
+    return &result->second;
+  }
+
+  static void fail(
+    diagnostic_updater::DiagnosticStatusWrapper & status,
+    const std::string & message)
+  {
+    status.level = 2;
+    status.message = message;
+  }
+
 public:
   using diagnostic_updater::DiagnosticTaskVector::add;
 
   explicit TestRunner(rclcpp::Node::SharedPtr ph)
+  : concurrency_(1), timeout_(0.0), busy_workers_(0), stopping_(false)
   {
     //  ROS_DEBUG("Advertising self_test");
     private_node_handle_ = ph;
@@ -53,86 +312,457 @@ public:
       [this](std::shared_ptr<diagnostic_msgs::srv::SelfTest::Request> request,
         std::shared_ptr<diagnostic_msgs::srv::SelfTest::Response> response) -> bool
       {
-        bool retval = false;
-        bool ignore_set_id_warn = false;
+        (void)request;
         std::cout << "I am in service callback" << std::endl;
+        return runTests(*response);
+      };
+
+    auto runCB =
+      [this](std::shared_ptr<self_test::srv::RunTests::Request> request,
+        std::shared_ptr<self_test::srv::RunTests::Response> response) -> bool
+      {
+        Selection selection;
+        selection.tests = request->tests;
+        selection.only_failed = request->only_failed;
+        selection.ignore_cache = request->ignore_cache;
+
+        diagnostic_msgs::srv::SelfTest::Response result;
+        if (!runTests(selection, result, response->cached)) {
+          return false;
+        }
+        response->id = result.id;
+        response->passed = result.passed;
+        response->status = result.status;
+        return true;
+      };
+
+    service_group_ = private_node_handle_->create_callback_group(
+      rclcpp::callback_group::CallbackGroupType::MutuallyExclusive);
+    service_server_ = private_node_handle_->create_service<diagnostic_msgs::srv::SelfTest>(
+      "self_test", serviceCB, rmw_qos_profile_services_default, service_group_);
+    run_server_ = private_node_handle_->create_service<self_test::srv::RunTests>(
+      "self_test/run", runCB, rmw_qos_profile_services_default, service_group_);
+
+    // Deep enough for a whole self-test, so a slow reader doesn't lose results
+    rmw_qos_profile_t progress_qos = rmw_qos_profile_default;
+    progress_qos.depth = 100;
+    progress_publisher_ =
+      private_node_handle_->create_publisher<diagnostic_msgs::msg::DiagnosticArray>(
+      "self_test/progress", progress_qos);
+    verbose = true;
+  }
+
+  /**
+   * \brief Waits for the tests still running, like those that timed out
+   */
+  ~TestRunner()
+  {
+    {
+      std::unique_lock<std::mutex> lock(pool_lock_);
+      stopping_ = true;
+      jobs_.clear();
+    }
+    pool_cond_.notify_all();
+    for (std::thread & worker : workers_) {
+      worker.join();
+    }
+  }
+
+  void setID(std::string id)
+  {
+    std::unique_lock<std::mutex> lock(id_lock_);
+    id_ = id;
+  }
+
+  /**
+   * \brief Most tests run at the same time, and most threads the tests run on.
+   * 1, the default, runs them in order.
+   */
+  void setConcurrency(size_t concurrency)
+  {
+    concurrency_ = std::max<size_t>(concurrency, 1);
+  }
 
-        if (rclcpp::ok()) {
-          const std::string unspecified_id("unspecified");
+  /**
+   * \brief Time after which a test is reported as failed, 0 for none
+   */
+  void setTimeout(double timeout) {timeout_ = timeout;}
 
-          //  ROS_INFO("Entering self-test.");
-          std::cout << "Entering self-test." << std::endl;
+  /**
+   * \brief Timeout of the test named name, instead of the default one
+   */
+  void setTimeout(const std::string & name, double timeout)
+  {
+    timeouts_[name] = timeout;
+  }
+
+  /**
+   * \brief The test named name starts only after depends_on passed
+   *
+   * If depends_on fails, times out or is skipped, name is skipped and
+   * reported as failed.
+   */
+  void addDependency(const std::string & name, const std::string & depends_on)
+  {
+    dependencies_[name].push_back(depends_on);
+  }
+
+  /**
+   * \brief Reuses a passing result of the test named name for duration seconds
+   */
+  void setCacheDuration(const std::string & name, double duration)
+  {
+    cache_durations_[name] = duration;
+  }
+
+  /**
+   * \brief Reuses a passing result of the test named name while key returns
+   * the same value, like a firmware version
+   *
+   * key is called at each self-test, before the tests run. With a cache
+   * duration as well, the result must satisfy both.
+   */
+  void setCacheKey(const std::string & name, std::function<std::string()> key)
+  {
+    cache_keys_[name] = key;
+  }
+
+  /**
+   * \brief Tests to run, as requested from the self_test/run service
+   */
+  struct Selection
+  {
+    Selection()
+    : only_failed(false), ignore_cache(false) {}
+
+    std::vector<std::string> tests;   /**< All of them if empty */
+    bool only_failed;   /**< Only the tests that failed or never ran */
+    bool ignore_cache;
+  };
+
+  /**
+   * \brief Runs all the tests and fills response, like the service does
+   *
+   * \return False if the tests could not be run
+   */
+  bool runTests(diagnostic_msgs::srv::SelfTest::Response & response)
+  {
+    std::vector<bool> cached;
+    return runTests(Selection(), response, cached);
+  }
+
+  /**
+   * \brief Runs the selected tests and the tests they depend on
+   *
+   * \param cached : For each status of response, true if it was cached
+   * \return False if the tests could not be run
+   */
+  bool runTests(
+    const Selection & selection,
+    diagnostic_msgs::srv::SelfTest::Response & response,
+    std::vector<bool> & cached)
+  {
+    if (!rclcpp::ok()) {
+      return false;
+    }
 
-          std::vector<diagnostic_msgs::msg::DiagnosticStatus> status_vec;
+    const std::string unspecified_id("unspecified");
 
-          const std::vector<DiagnosticTaskInternal> & tasks = getTasks();
-          for (std::vector<DiagnosticTaskInternal>::const_iterator iter = tasks.begin();
-            iter != tasks.end(); iter++)
+    //  ROS_INFO("Entering self-test.");
+    std::cout << "Entering self-test." << std::endl;
+
+    std::unique_lock<std::mutex> run_lock(run_lock_);
+
+    std::vector<DiagnosticTaskInternal> all_tasks;
+    {
+      std::unique_lock<std::mutex> lock(lock_);
+      all_tasks = getTasks();
+    }
+
+    // Selected tests, then the tests they depend on
+    std::vector<bool> selected(all_tasks.size(), selection.tests.empty());
+    std::vector<std::string> unknown_tests;
+    for (const std::string & name : selection.tests) {
+      bool found = false;
+      for (size_t i = 0; i < all_tasks.size(); ++i) {
+        if (all_tasks[i].getName() == name) {
+          selected[i] = true;
+          found = true;
+        }
+      }
+      if (!found) {
+        unknown_tests.push_back(name);
+      }
+    }
+    if (selection.only_failed) {
+      for (size_t i = 0; i < all_tasks.size(); ++i) {
+        std::map<std::string, CachedResult>::const_iterator result =
+          results_.find(all_tasks[i].getName());
+        if (result != results_.end() && result->second.status.level < 2) {
+          selected[i] = false;
+        }
+      }
+    }
+    bool added = true;
+    while (added) {
+      added = false;
+      for (size_t i = 0; i < all_tasks.size(); ++i) {
+        std::map<std::string, std::vector<std::string>>::const_iterator deps =
+          dependencies_.find(all_tasks[i].getName());
+        if (!selected[i] || deps == dependencies_.end()) {
+          continue;
+        }
+        for (size_t j = 0; j < all_tasks.size(); ++j) {
+          if (!selected[j] && std::find(deps->second.begin(), deps->second.end(),
+            all_tasks[j].getName()) != deps->second.end())
           {
-            diagnostic_updater::DiagnosticStatusWrapper status;
-
-            status.level = 2;
-            status.message = "No message was set";
-
-            try {
-              //  ROS_INFO("Starting test: %s", iter->getName().c_str());
-              std::cout << "Starting test: %s" << iter->getName().c_str() << std::endl;
-              iter->run(status);
-            } catch (std::exception & e) {
-              status.level = 2;
-              status.message = std::string("Uncaught exception: ") + e.what();
-              ignore_set_id_warn = true;
-            }
+            selected[j] = true;
+            added = true;
+          }
+        }
+      }
+    }
+
+    std::vector<DiagnosticTaskInternal> tasks;
+    for (size_t i = 0; i < all_tasks.size(); ++i) {
+      if (selected[i]) {
+        tasks.push_back(all_tasks[i]);
+      }
+    }
+
+    std::shared_ptr<Run> run = std::make_shared<Run>();
+    run->statuses.resize(tasks.size());
+    run->states.assign(tasks.size(), Run::Pending);
+    run->deadlines.resize(tasks.size());
+    run->timeouts.resize(tasks.size());
+    run->exception_thrown = false;
 
-            if (status.level >= 1) {
-              if (verbose) {
-                std::cout << "Non-zero self-test test status. Name:" << status.name.c_str() <<
-                  "status %i: '%s" << status.level << "msg is" << status.message << std::endl;
-              }
+    // Dependencies by index, and tests that depend on unknown ones
+    std::vector<std::vector<size_t>> dependencies(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      run->statuses[i].name = tasks[i].getName();
+      std::map<std::string, std::vector<std::string>>::const_iterator deps =
+        dependencies_.find(tasks[i].getName());
+      if (deps == dependencies_.end()) {
+        continue;
+      }
+      for (const std::string & dependency : deps->second) {
+        size_t j = 0;
+        while (j < tasks.size() && tasks[j].getName() != dependency) {
+          ++j;
+        }
+        if (j == tasks.size() || j == i) {
+          fail(run->statuses[i], "Depends on unknown test " + dependency);
+          run->states[i] = Run::Finished;
+          break;
+        }
+        dependencies[i].push_back(j);
+      }
+    }
+
+    // Valid cached results are finished already
+    cached.assign(tasks.size(), false);
+    std::vector<std::string> keys(tasks.size());
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      keys[i] = getCacheKey(tasks[i].getName());
+      const CachedResult * result = getCachedResult(tasks[i].getName(), keys[i]);
+      if (run->states[i] == Run::Pending && result && !selection.ignore_cache) {
+        run->statuses[i] = result->status;
+        run->states[i] = Run::Finished;
+        cached[i] = true;
+      }
+    }
+
+    std::unique_lock<std::mutex> lock(run->mutex);
+    publishProgress(*run, lock);
+    size_t running = 0;
+    size_t finished = 0;
+    bool starved = false;   // A ready test found no free thread in the last pass
+    while (true) {
+      // Skip the tests whose dependencies failed, start the ready ones in order
+      bool changed = true;
+      while (changed) {
+        changed = false;
+        starved = false;
+        for (size_t i = 0; i < tasks.size() && running < concurrency_; ++i) {
+          if (run->states[i] != Run::Pending) {
+            continue;
+          }
+          bool ready = true;
+          for (size_t j : dependencies[i]) {
+            if (run->states[j] != Run::Finished) {
+              ready = false;
+            } else if (run->statuses[j].level >= 2) {
+              fail(run->statuses[i], "Skipped, " + tasks[j].getName() + " failed");
+              run->states[i] = Run::Finished;
+              changed = true;
+              ready = false;
+              break;
             }
-            status_vec.push_back(status);
           }
-          if (!ignore_set_id_warn && id_.empty()) {
-            std::cout << "setID was not called by any self-test" << std::endl;
+          if (!ready) {
+            continue;
           }
-          //  One of the test calls should use setID
-          response->id = id_;
-
-          response->passed = true;
-          for (std::vector<diagnostic_msgs::msg::DiagnosticStatus>::iterator status_iter =
-            status_vec.begin();
-            status_iter != status_vec.end();
-            status_iter++)
-          {
-            if (status_iter->level >= 2) {
-              response->passed = false;
-            }
+
+          std::map<std::string, double>::const_iterator timeout =
+            timeouts_.find(tasks[i].getName());
+          double seconds = timeout == timeouts_.end() ? timeout_ : timeout->second;
+          bool pooled = concurrency_ > 1 || seconds > 0;
+          if (pooled && getFreeWorkers() == 0) {
+            starved = true;
+            continue;
           }
 
+          //  ROS_INFO("Starting test: %s", tasks[i].getName().c_str());
+          std::cout << "Starting test: " << tasks[i].getName() << std::endl;
+          run->states[i] = Run::Running;
+          ++running;
+          changed = true;
 
-          if (response->passed && id_ == unspecified_id) {
-            std::cout <<
-              "Self-test passed, but setID was not called. This is a bug in the driver."
-                      <<
-              std::endl;
+          run->timeouts[i] = seconds;
+          if (seconds > 0) {
+            run->deadlines[i] = std::chrono::steady_clock::now() +
+              std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+              std::chrono::duration<double>(seconds));
+          } else {
+            run->deadlines[i] = std::chrono::steady_clock::time_point::max();
           }
-          response->status = status_vec;
 
-          retval = true;
+          if (!pooled) {
+            // Nothing to wait for, so the test runs on this thread once it is
+            // seen running
+            publishProgress(*run, lock);
+            lock.unlock();
+            runTest(run, i, tasks[i], false);
+            lock.lock();
+          } else {
+            DiagnosticTaskInternal task = tasks[i];
+            submit([this, run, i, task]() {runTest(run, i, task, true);});
+          }
+        }
 
-          std::cout << "Self-test complete." << std::endl;
+        // Collect the finished tests, fail the ones past their deadline
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        size_t was_finished = finished;
+        running = 0;
+        finished = 0;
+        for (size_t i = 0; i < tasks.size(); ++i) {
+          if (run->states[i] != Run::Running) {
+            finished += run->states[i] == Run::Finished;
+            continue;
+          }
+          if (run->deadlines[i] <= now) {
+            std::ostringstream message;
+            message << "Timed out after " << run->timeouts[i] << " seconds";
+            fail(run->statuses[i], message.str());
+            run->states[i] = Run::Finished;
+            ++finished;
+            changed = true;
+          } else {
+            ++running;
+          }
         }
+        if (changed || finished != was_finished) {
+          // Tests can finish while it is published, so look again before waiting
+          publishProgress(*run, lock);
+          changed = true;
+        }
+      }
 
-        return retval;
-      };
+      if (running == 0) {
+        break;
+      }
 
-    service_server_ = private_node_handle_->create_service<diagnostic_msgs::srv::SelfTest>(
-      "self_test", serviceCB);
-    verbose = true;
-  }
-  void setID(std::string id)
-  {
-    id_ = id;
+      std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+      for (size_t i = 0; i < tasks.size(); ++i) {
+        if (run->states[i] == Run::Running) {
+          deadline = std::min(deadline, run->deadlines[i]);
+        }
+      }
+      if (deadline == std::chrono::steady_clock::time_point::max()) {
+        run->finished.wait(lock);
+      } else {
+        run->finished.wait_until(lock, deadline);
+      }
+    }
+
+    // Whatever is left waits on itself, or on a thread held by a test that
+    // timed out
+    if (finished < tasks.size()) {
+      for (size_t i = 0; i < tasks.size(); ++i) {
+        if (run->states[i] == Run::Pending) {
+          fail(run->statuses[i], starved ?
+            "Skipped, every thread is held by a test that timed out" :
+            "Skipped, dependency cycle");
+          run->states[i] = Run::Finished;
+        }
+      }
+      publishProgress(*run, lock);
+    }
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    std::vector<diagnostic_msgs::msg::DiagnosticStatus> status_vec;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      const diagnostic_updater::DiagnosticStatusWrapper & status = run->statuses[i];
+      if (!cached[i]) {
+        CachedResult & result = results_[tasks[i].getName()];
+        result.status = status;
+        result.time = now;
+        result.key = keys[i];
+      }
+      if (status.level >= 1) {
+        if (verbose) {
+          std::cout << "Non-zero self-test test status. Name: " << status.name <<
+            " status: " << static_cast<int>(status.level) << " msg: " << status.message <<
+            std::endl;
+        }
+      }
+      status_vec.push_back(status);
+    }
+    bool ignore_set_id_warn = run->exception_thrown;
+    lock.unlock();
+
+    for (const std::string & name : unknown_tests) {
+      diagnostic_updater::DiagnosticStatusWrapper status;
+      status.name = name;
+      fail(status, "No such test");
+      status_vec.push_back(status);
+      cached.push_back(false);
+    }
+
+    std::string id;
+    {
+      std::unique_lock<std::mutex> id_lock(id_lock_);
+      id = id_;
+    }
+    if (!ignore_set_id_warn && id.empty()) {
+      std::cout << "setID was not called by any self-test" << std::endl;
+    }
+    //  One of the test calls should use setID
+    response.id = id;
+
+    response.passed = true;
+    for (std::vector<diagnostic_msgs::msg::DiagnosticStatus>::iterator status_iter =
+      status_vec.begin();
+      status_iter != status_vec.end();
+      status_iter++)
+    {
+      if (status_iter->level >= 2) {
+        response.passed = false;
+      }
+    }
+
+    if (response.passed && id == unspecified_id) {
+      std::cout <<
+        "Self-test passed, but setID was not called. This is a bug in the driver."
+                <<
+        std::endl;
+    }
+    response.status = status_vec;
+
+    std::cout << "Self-test complete." << std::endl;
+    return true;
   }
 };
 }  //  namespace self_test
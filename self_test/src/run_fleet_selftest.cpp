@@ -0,0 +1,101 @@
+// Copyright 2017 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rclcpp/rclcpp.hpp"
+#include "self_test/fleet_orchestrator.hpp"
+
+//  Runs the self-test of every node that has one, and writes a JSON report.
+//
+//  run_fleet_selftest [--parallel N] [--timeout SECONDS] [--discovery SECONDS]
+//                     [--prefix PREFIX] [--output FILE]
+//
+//  Exits with 0 if every self-test passed.
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+
+  size_t parallelism = 8;
+  double timeout = 60.0;
+  double discovery = 2.0;
+  std::string prefix;
+  std::string output;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.find(":=") != std::string::npos || arg.find("__") == 0) {
+      continue;  //  ROS arguments
+    }
+    bool known = arg == "--parallel" || arg == "--timeout" || arg == "--discovery" ||
+      arg == "--prefix" || arg == "--output";
+    if (!known || i + 1 == argc) {
+      fprintf(stderr, known ? "%s needs a value\n" : "Unknown option %s\n", arg.c_str());
+      rclcpp::shutdown();
+      return 2;
+    }
+    const char * value = argv[++i];
+    if (arg == "--parallel") {
+      parallelism = std::strtoul(value, nullptr, 10);
+    } else if (arg == "--timeout") {
+      timeout = std::atof(value);
+    } else if (arg == "--discovery") {
+      discovery = std::atof(value);
+    } else if (arg == "--prefix") {
+      prefix = value;
+    } else {
+      output = value;
+    }
+  }
+
+  auto node = std::make_shared<rclcpp::Node>("fleet_self_test");
+  self_test::FleetOrchestrator orchestrator(node, parallelism, timeout);
+
+  rclcpp::executors::SingleThreadedExecutor executor;
+  executor.add_node(node);
+  std::thread spinner([&executor]() {executor.spin();});
+
+  //  The graph fills in as other participants are discovered
+  std::this_thread::sleep_for(std::chrono::duration<double>(discovery));
+  std::vector<std::string> services = orchestrator.discover(prefix);
+  fprintf(stderr, "Running %zd self-tests, %zd at a time\n", services.size(), parallelism);
+
+  orchestrator.run(services);
+  orchestrator.wait();
+  executor.cancel();
+  spinner.join();
+
+  std::vector<self_test::FleetOrchestrator::Result> results = orchestrator.getResults();
+  std::string report = self_test::FleetOrchestrator::toJson(results);
+  if (output.empty()) {
+    printf("%s", report.c_str());
+  } else {
+    std::ofstream file(output.c_str());
+    file << report;
+  }
+
+  bool passed = true;
+  for (const self_test::FleetOrchestrator::Result & result : results) {
+    fprintf(stderr, "%-40s %s\n", result.service.c_str(),
+      self_test::FleetOrchestrator::getOutcomeName(result.outcome));
+    passed = passed && result.outcome == self_test::FleetOrchestrator::Passed;
+  }
+
+  rclcpp::shutdown();
+  return passed ? 0 : 1;
+}
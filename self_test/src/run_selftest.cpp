@@ -11,22 +11,92 @@
 // WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 // See the License for the specific language governing permissions and
 // limitations under the License.
+#include <cstdio>
 #include <memory>
 #include <string>
+#include <vector>
 #include <chrono>
 #include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
 #include "diagnostic_msgs/srv/self_test.hpp"
+#include "self_test/srv/run_tests.hpp"
+
+//  Prints a test result, in the order in which it finished
+void printStatus(size_t index, const diagnostic_msgs::msg::DiagnosticStatus & status)
+{
+  printf("%2zd) %s\n", index, status.name.c_str());
+  if (status.level == 0) {
+    printf("     [OK]: ");
+  } else if (status.level == 1) {
+    printf("     [WARNING]: ");
+  } else {
+    printf("     [ERROR]: ");
+  }
+  printf("%s\n", status.message.c_str());
+
+  for (size_t j = 0; j < status.values.size(); j++) {
+    printf("      [%s] %s\n", status.values[j].key.c_str(), status.values[j].value.c_str());
+  }
+  printf("\n");
+  fflush(stdout);
+}
 
 class ClientNode : public rclcpp::Node
 {
 public:
-  ClientNode()
-  : Node("self_test_client")
+  //  Without a selection, every test is run through the plain self_test service
+  explicit ClientNode(std::shared_ptr<self_test::srv::RunTests::Request> selection)
+  : Node("self_test_client"), request_sent_(false), printed_count_(0), test_count_(0)
   {
-    client_ = create_client<diagnostic_msgs::srv::SelfTest>("self_test");
+    if (selection) {
+      run_client_ = create_client<self_test::srv::RunTests>("self_test/run");
+    } else {
+      client_ = create_client<diagnostic_msgs::srv::SelfTest>("self_test");
+    }
+
+    //  Results are printed as the tests finish
+    rmw_qos_profile_t progress_qos = rmw_qos_profile_default;
+    progress_qos.depth = 100;
+    progress_sub_ = create_subscription<diagnostic_msgs::msg::DiagnosticArray>(
+      "self_test/progress",
+      [this](const diagnostic_msgs::msg::DiagnosticArray::SharedPtr msg) {
+        progressCallback(msg);
+      }, progress_qos);
+
+    //  Notices when the node under test dies before responding
+    using namespace std::chrono_literals;
+    watchdog_ = create_wall_timer(1s, [this]() {
+          bool ready = client_ ? client_->service_is_ready() : run_client_->service_is_ready();
+          if (request_sent_ && !ready) {
+            printf("Self test service went away after %zd of %zd tests. "
+              "Results above are all that completed.\n", printed_count_, test_count_);
+            rclcpp::shutdown();
+          }
+        });
 
     //  Queue an asynchronous service request that will be sent once `spin` is called on the node.
-    queue_async_request();
+    if (selection) {
+      queue_run_request(selection);
+    } else {
+      queue_async_request();
+    }
+  }
+
+  void progressCallback(const diagnostic_msgs::msg::DiagnosticArray::SharedPtr msg)
+  {
+    if (test_count_ == 0 && !msg->status.empty()) {
+      printf("Running %zd tests\n\n", msg->status.size());
+    }
+    test_count_ = msg->status.size();
+    printed_.resize(test_count_, false);
+    for (size_t i = 0; i < msg->status.size(); i++) {
+      const diagnostic_msgs::msg::DiagnosticStatus & status = msg->status[i];
+      if (status.level == diagnostic_msgs::msg::DiagnosticStatus::STALE || printed_[i]) {
+        continue;
+      }
+      printed_[i] = true;
+      printStatus(++printed_count_, status);
+    }
   }
 
   void queue_async_request()
@@ -49,50 +119,95 @@ public:
       rclcpp::Client<diagnostic_msgs::srv::SelfTest>::SharedFuture;
     auto response_received_callback = [this](ServiceResponseFuture future) {
         auto result_out = future.get();
-        std::string passfail;
-
-        if (result_out->passed) {
-          passfail = "PASSED";
-        } else {
-          passfail = "FAILED";
-        }
+        printResult(result_out->passed, result_out->id, result_out->status);
+        rclcpp::shutdown();
+      };
+    auto future_result = client_->async_send_request(request, response_received_callback);
+    request_sent_ = true;
+  }
 
-        printf("Self test %s for device with id: [%s]\n", passfail.c_str(), result_out->id.c_str());
+  void queue_run_request(std::shared_ptr<self_test::srv::RunTests::Request> request)
+  {
+    using namespace std::chrono_literals;
+    while (!run_client_->wait_for_service(1s)) {
+      if (!rclcpp::ok()) {
+        RCLCPP_ERROR(this->get_logger(), "Interrupted while waiting for the service. Exiting.");
+        return;
+      }
+      RCLCPP_INFO(this->get_logger(), "service not available, waiting again...");
+    }
 
-        for (size_t i = 0; i < result_out->status.size(); i++) {
-          printf("%2zd) %s\n", i + 1, result_out->status[i].name.c_str());
-          if (result_out->status[i].level == 0) {
-            printf("     [OK]: ");
-          } else if (result_out->status[i].level == 1) {
-            printf("     [WARNING]: ");
-          } else {
-            printf("     [ERROR]: ");
-          }
-          printf("%s\n", result_out->status[i].message.c_str());
+    using ServiceResponseFuture =
+      rclcpp::Client<self_test::srv::RunTests>::SharedFuture;
+    auto response_received_callback = [this](ServiceResponseFuture future) {
+        auto result_out = future.get();
+        printResult(result_out->passed, result_out->id, result_out->status);
 
-          for (size_t j = 0; j < result_out->status[i].values.size(); j++) {
-            printf("      [%s] %s\n",
-              result_out->status[i].values[j].key.c_str(),
-              result_out->status[i].values[j].value.c_str());
-          }
-          printf("\n");
+        size_t cached = 0;
+        for (size_t i = 0; i < result_out->cached.size(); i++) {
+          cached += result_out->cached[i];
+        }
+        if (cached > 0) {
+          printf("%zd of %zd results were cached\n", cached, result_out->status.size());
         }
-
-
         rclcpp::shutdown();
       };
-    auto future_result = client_->async_send_request(request, response_received_callback);
+    auto future_result = run_client_->async_send_request(request, response_received_callback);
+    request_sent_ = true;
+  }
+
+  void printResult(
+    bool passed, const std::string & id,
+    const std::vector<diagnostic_msgs::msg::DiagnosticStatus> & status)
+  {
+    //  Results whose progress message was missed
+    printed_.resize(status.size(), false);
+    for (size_t i = 0; i < status.size(); i++) {
+      if (!printed_[i]) {
+        printed_[i] = true;
+        printStatus(++printed_count_, status[i]);
+      }
+    }
+
+    printf("Self test %s for device with id: [%s]\n", passed ? "PASSED" : "FAILED", id.c_str());
   }
 
 private:
   rclcpp::Client<diagnostic_msgs::srv::SelfTest>::SharedPtr client_;
+  rclcpp::Client<self_test::srv::RunTests>::SharedPtr run_client_;
+  rclcpp::Subscription<diagnostic_msgs::msg::DiagnosticArray>::SharedPtr progress_sub_;
+  rclcpp::TimerBase::SharedPtr watchdog_;
+  bool request_sent_;
+  std::vector<bool> printed_;   /**< By index, the order of the response */
+  size_t printed_count_;
+  size_t test_count_;
 };
 
 
+//  run_selftest [--failed] [--no-cache] [test name...]
 int main(int argc, char ** argv)
 {
   rclcpp::init(argc, argv);
-  auto node = std::make_shared<ClientNode>();
+
+  std::shared_ptr<self_test::srv::RunTests::Request> selection;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg.find(":=") != std::string::npos || arg.find("__") == 0) {
+      continue;  //  ROS arguments
+    }
+    if (!selection) {
+      selection = std::make_shared<self_test::srv::RunTests::Request>();
+    }
+    if (arg == "--failed") {
+      selection->only_failed = true;
+    } else if (arg == "--no-cache") {
+      selection->ignore_cache = true;
+    } else {
+      selection->tests.push_back(arg);
+    }
+  }
+
+  auto node = std::make_shared<ClientNode>(selection);
   rclcpp::spin(node);
 
   rclcpp::shutdown();
@@ -46,6 +46,11 @@ public:
     //  diagnostic_updater::DiagnosticTaskVector. You will have to refer to
     //  the diagnostic_updater doxygen documentation to find them:
     self_test_.add("ID Lookup", this, &MyNode::test1);
+
+    //  Results that don't change often can be reused for a while instead of
+    //  running the test at every request. Only results that passed are
+    //  reused, and the self_test/run service can bypass the cache.
+    self_test_.setCacheDuration("ID Lookup", 60.0);
     self_test_.add("Exception generating test", this, &MyNode::test2);
     self_test_.add("Value generating test", this, &MyNode::test3);
     self_test_.add("Value testing test", this, &MyNode::test4);
@@ -0,0 +1,214 @@
+// Copyright 2017 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "self_test/fleet_orchestrator.hpp"
+#include "self_test/self_test.hpp"
+
+using self_test::FleetOrchestrator;
+
+namespace
+{
+
+std::atomic<bool> release_hung(false);
+
+/*
+ *\brief Spins an executor on its own thread until destroyed. Spinning until a
+ *future completes, unlike cancel(), can't miss a stop that comes before spin.
+ */
+class Spinner
+{
+public:
+  explicit Spinner(rclcpp::Node::SharedPtr node)
+  : stopped_(stop_.get_future().share())
+  {
+    executor_.add_node(node);
+    thread_ = std::thread([this]() {executor_.spin_until_future_complete(stopped_);});
+  }
+
+  ~Spinner()
+  {
+    stop_.set_value();
+    thread_.join();
+  }
+
+private:
+  rclcpp::executors::SingleThreadedExecutor executor_;
+  std::promise<void> stop_;
+  std::shared_future<void> stopped_;
+  std::thread thread_;
+};
+
+/*
+ *\brief A node with a self-test, spun on its own thread
+ */
+class Device
+{
+public:
+  enum Behavior
+  {
+    Pass,
+    Fail,
+    Hang
+  };
+
+  Device(const std::string & ns, Behavior behavior)
+  : node_(std::make_shared<rclcpp::Node>("device", ns)), self_test_(node_)
+  {
+    self_test_.add("Check", [this, ns, behavior](
+        diagnostic_updater::DiagnosticStatusWrapper & status) {
+        self_test_.setID(ns);
+        while (behavior == Hang && !release_hung) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        if (behavior == Fail) {
+          status.summary(diagnostic_msgs::msg::DiagnosticStatus::ERROR, "Broken");
+        } else {
+          status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Fine");
+        }
+      });
+    spinner_.reset(new Spinner(node_));
+  }
+
+private:
+  rclcpp::Node::SharedPtr node_;
+  self_test::TestRunner self_test_;
+  std::unique_ptr<Spinner> spinner_;
+};
+
+}  // namespace
+
+class FleetOrchestratorTest : public ::testing::Test
+{
+protected:
+  static void SetUpTestCase() {rclcpp::init(0, nullptr);}
+
+  static void TearDownTestCase() {rclcpp::shutdown();}
+
+  void SetUp()
+  {
+    node_ = std::make_shared<rclcpp::Node>("fleet_orchestrator_test");
+    spinner_.reset(new Spinner(node_));
+  }
+
+  void TearDown()
+  {
+    release_hung = true;
+    spinner_.reset();
+    devices_.clear();
+  }
+
+  void addDevice(const std::string & ns, Device::Behavior behavior)
+  {
+    devices_.emplace_back(new Device(ns, behavior));
+  }
+
+  rclcpp::Node::SharedPtr node_;
+  std::unique_ptr<Spinner> spinner_;
+  std::vector<std::unique_ptr<Device>> devices_;
+};
+
+TEST_F(FleetOrchestratorTest, outcomes)
+{
+  release_hung = false;
+  addDevice("/pass", Device::Pass);
+  addDevice("/fail", Device::Fail);
+  addDevice("/hang", Device::Hang);
+
+  FleetOrchestrator orchestrator(node_, 2, 1.0);
+  orchestrator.run({"/pass/self_test", "/fail/self_test", "/hang/self_test", "/none/self_test"});
+  orchestrator.wait();
+
+  std::vector<FleetOrchestrator::Result> results = orchestrator.getResults();
+  ASSERT_EQ(4u, results.size());
+  EXPECT_EQ("/pass/self_test", results[0].service);
+  EXPECT_EQ(FleetOrchestrator::Passed, results[0].outcome);
+  EXPECT_EQ("/pass", results[0].id);
+  ASSERT_EQ(1u, results[0].status.size());
+  EXPECT_EQ("Fine", results[0].status[0].message);
+  EXPECT_EQ(FleetOrchestrator::Failed, results[1].outcome);
+  EXPECT_EQ(FleetOrchestrator::Timeout, results[2].outcome);
+  EXPECT_GE(results[2].duration, 1.0);
+  EXPECT_EQ(FleetOrchestrator::Unavailable, results[3].outcome);
+
+  std::string json = FleetOrchestrator::toJson(results);
+  EXPECT_NE(std::string::npos, json.find(
+      "\"summary\": {\"total\": 4, \"passed\": 1, \"failed\": 1, \"timeout\": 1, "
+      "\"unavailable\": 1}")) << json;
+}
+
+TEST_F(FleetOrchestratorTest, limitsParallelism)
+{
+  // With one call at a time, the hung device holds up the others until it
+  // times out
+  release_hung = false;
+  addDevice("/hang", Device::Hang);
+  addDevice("/pass", Device::Pass);
+
+  FleetOrchestrator orchestrator(node_, 1, 0.5);
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  orchestrator.run({"/hang/self_test", "/pass/self_test"});
+  orchestrator.wait();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<FleetOrchestrator::Result> results = orchestrator.getResults();
+  ASSERT_EQ(2u, results.size());
+  EXPECT_EQ(FleetOrchestrator::Timeout, results[0].outcome);
+  EXPECT_EQ(FleetOrchestrator::Passed, results[1].outcome);
+  EXPECT_GE(elapsed, 0.5);
+  EXPECT_LT(results[1].duration, 0.5);
+}
+
+TEST_F(FleetOrchestratorTest, discoverByNamespace)
+{
+  addDevice("/robot1", Device::Pass);
+  addDevice("/robot10", Device::Pass);
+
+  // The services take a moment to show up in the graph
+  FleetOrchestrator orchestrator(node_);
+  std::chrono::steady_clock::time_point give_up =
+    std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while (orchestrator.discover().size() < 2 && std::chrono::steady_clock::now() < give_up) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  EXPECT_EQ(std::vector<std::string>({"/robot1/self_test"}), orchestrator.discover("/robot1"));
+  EXPECT_EQ(std::vector<std::string>({"/robot1/self_test"}), orchestrator.discover("/robot1/"));
+  EXPECT_EQ(std::vector<std::string>({"/robot10/self_test"}), orchestrator.discover("/robot10"));
+  EXPECT_TRUE(orchestrator.discover("/robot").empty());
+
+  std::vector<std::string> all = orchestrator.discover();
+  std::sort(all.begin(), all.end());
+  EXPECT_EQ(std::vector<std::string>({"/robot1/self_test", "/robot10/self_test"}), all);
+  EXPECT_EQ(all, orchestrator.discover("/"));
+}
+
+TEST_F(FleetOrchestratorTest, noServices)
+{
+  FleetOrchestrator orchestrator(node_);
+  orchestrator.run({});
+  orchestrator.wait();
+  EXPECT_TRUE(orchestrator.getResults().empty());
+  EXPECT_NE(std::string::npos, FleetOrchestrator::toJson({}).find("\"total\": 0"));
+}
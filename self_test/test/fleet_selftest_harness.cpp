@@ -0,0 +1,151 @@
+// Copyright 2017 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "self_test/fleet_orchestrator.hpp"
+#include "self_test/self_test.hpp"
+
+//  Runs FleetOrchestrator against N in-process TestRunner nodes, each in its
+//  own namespace and on its own executor thread, and checks the report.
+//  Every 7th device fails a test and every 11th hangs past the timeout.
+//
+//  fleet_selftest_harness [N] [parallelism]
+
+std::atomic<bool> stop(false);
+
+class Device
+{
+public:
+  explicit Device(size_t index)
+  : index_(index),
+    node_(std::make_shared<rclcpp::Node>("device", "/fleet_sim_" + std::to_string(index))),
+    self_test_(node_)
+  {
+    self_test_.add("ID Lookup", this, &Device::idLookup);
+    self_test_.add("Motor check", this, &Device::motorCheck);
+    self_test_.add("Sensor check", this, &Device::sensorCheck);
+    executor_.add_node(node_);
+    thread_ = std::thread([this]() {executor_.spin();});
+  }
+
+  ~Device()
+  {
+    executor_.cancel();
+    thread_.join();
+  }
+
+  void idLookup(diagnostic_updater::DiagnosticStatusWrapper & status)
+  {
+    self_test_.setID("device_" + std::to_string(index_));
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "ID Lookup successful");
+  }
+
+  void motorCheck(diagnostic_updater::DiagnosticStatusWrapper & status)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100 + 37 * (index_ % 10)));
+    if (index_ % 7 == 3) {
+      status.summary(diagnostic_msgs::msg::DiagnosticStatus::ERROR, "Motor stalled");
+    } else {
+      status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Motor OK");
+    }
+  }
+
+  void sensorCheck(diagnostic_updater::DiagnosticStatusWrapper & status)
+  {
+    while (index_ % 11 == 5 && !stop) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Sensor OK");
+  }
+
+private:
+  size_t index_;
+  rclcpp::Node::SharedPtr node_;
+  self_test::TestRunner self_test_;
+  rclcpp::executors::SingleThreadedExecutor executor_;
+  std::thread thread_;
+};
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+  size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 20;
+  size_t parallelism = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 8;
+  const double timeout = 3.0;
+
+  std::vector<std::unique_ptr<Device>> devices;
+  size_t expected_passed = 0, expected_failed = 0, expected_timeout = 0;
+  for (size_t i = 0; i < count; ++i) {
+    devices.emplace_back(new Device(i));
+    if (i % 11 == 5) {
+      ++expected_timeout;
+    } else if (i % 7 == 3) {
+      ++expected_failed;
+    } else {
+      ++expected_passed;
+    }
+  }
+
+  auto node = std::make_shared<rclcpp::Node>("fleet_self_test_harness");
+  self_test::FleetOrchestrator orchestrator(node, parallelism, timeout);
+  rclcpp::executors::SingleThreadedExecutor executor;
+  executor.add_node(node);
+  std::thread spinner([&executor]() {executor.spin();});
+
+  std::vector<std::string> services;
+  for (int attempt = 0; attempt < 100 && services.size() < count; ++attempt) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    services = orchestrator.discover("/fleet_sim_");
+  }
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  orchestrator.run(services);
+  orchestrator.wait();
+  double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::vector<self_test::FleetOrchestrator::Result> results = orchestrator.getResults();
+  printf("%s", self_test::FleetOrchestrator::toJson(results).c_str());
+
+  size_t passed = 0, failed = 0, timed_out = 0;
+  for (const self_test::FleetOrchestrator::Result & result : results) {
+    passed += result.outcome == self_test::FleetOrchestrator::Passed;
+    failed += result.outcome == self_test::FleetOrchestrator::Failed;
+    timed_out += result.outcome == self_test::FleetOrchestrator::Timeout;
+  }
+  fprintf(stderr, "%zd devices, %zd at a time: %zd passed, %zd failed, %zd timed out in %.1f s\n",
+    results.size(), parallelism, passed, failed, timed_out, elapsed);
+
+  stop = true;
+  executor.cancel();
+  spinner.join();
+  devices.clear();
+  rclcpp::shutdown();
+
+  bool ok = services.size() == count && passed == expected_passed &&
+    failed == expected_failed && timed_out == expected_timeout;
+  if (!ok) {
+    fprintf(stderr, "Expected %zd devices: %zd passed, %zd failed, %zd timed out\n",
+      count, expected_passed, expected_failed, expected_timeout);
+  }
+  return ok ? 0 : 1;
+}
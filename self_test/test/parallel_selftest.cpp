@@ -0,0 +1,89 @@
+// Copyright 2017 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/msg/diagnostic_status.hpp"
+#include "diagnostic_msgs/srv/self_test.hpp"
+#include "self_test/self_test.hpp"
+
+//  Slow checks run concurrently, "Read serial" waits for "Open device", and a
+//  hanging check is reported as failed after its timeout.
+class MyNode
+{
+private:
+  self_test::TestRunner self_test_;
+  std::atomic<bool> device_open_;
+
+public:
+  explicit MyNode(rclcpp::Node::SharedPtr nh_)
+  : self_test_(nh_), device_open_(false)
+  {
+    self_test_.add("Open device", this, &MyNode::openDevice);
+    self_test_.add("Read serial", this, &MyNode::readSerial);
+    self_test_.add("Motor check", this, &MyNode::slowCheck);
+    self_test_.add("Sensor check", this, &MyNode::slowCheck);
+    self_test_.add("Hanging check", this, &MyNode::hangingCheck);
+
+    self_test_.addDependency("Read serial", "Open device");
+    self_test_.setConcurrency(4);
+    self_test_.setTimeout(5.0);
+    self_test_.setTimeout("Hanging check", 1.0);
+  }
+
+  void openDevice(diagnostic_updater::DiagnosticStatusWrapper & status)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    device_open_ = true;
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Device opened.");
+  }
+
+  void readSerial(diagnostic_updater::DiagnosticStatusWrapper & status)
+  {
+    if (device_open_) {
+      self_test_.setID("12345");
+      status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Serial read.");
+    } else {
+      status.summary(diagnostic_msgs::msg::DiagnosticStatus::ERROR,
+        "Serial read before the device was open.");
+    }
+  }
+
+  void slowCheck(diagnostic_updater::DiagnosticStatusWrapper & status)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Check passed.");
+  }
+
+  void hangingCheck(diagnostic_updater::DiagnosticStatusWrapper & status)
+  {
+    std::this_thread::sleep_for(std::chrono::seconds(30));
+    status.summary(diagnostic_msgs::msg::DiagnosticStatus::OK, "Check passed.");
+  }
+};
+
+int main(int argc, char ** argv)
+{
+  rclcpp::init(argc, argv);
+  rclcpp::Node::SharedPtr nh_;
+  nh_ = std::make_shared<rclcpp::Node>("my_node");
+  MyNode n(nh_);
+  rclcpp::executors::MultiThreadedExecutor executor;
+  executor.add_node(nh_);
+  executor.spin();
+  return 0;
+}
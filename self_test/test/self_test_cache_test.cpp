@@ -0,0 +1,248 @@
+// Copyright 2026 Open Source Robotics Foundation, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "rclcpp/rclcpp.hpp"
+#include "diagnostic_msgs/msg/diagnostic_array.hpp"
+#include "self_test/self_test.hpp"
+
+using self_test::TestRunner;
+
+class SelfTestCacheTest : public ::testing::Test
+{
+protected:
+  static void SetUpTestCase() {rclcpp::init(0, nullptr);}
+
+  static void TearDownTestCase() {rclcpp::shutdown();}
+
+  void SetUp()
+  {
+    node_ = std::make_shared<rclcpp::Node>("self_test_cache_test");
+    runner_.reset(new TestRunner(node_));
+    runs_.clear();
+    failing_.clear();
+  }
+
+  void TearDown()
+  {
+    runner_.reset();
+  }
+
+  /*
+   *\brief Adds a test that counts its runs, and fails while it is in failing_
+   */
+  void addTest(const std::string & name)
+  {
+    runner_->add(name, [this, name](diagnostic_updater::DiagnosticStatusWrapper & status) {
+        runner_->setID("cache_test");
+        ++runs_[name];
+        if (failing_.count(name)) {
+          status.summary(2, "Failed");
+        } else {
+          status.summary(0, "OK");
+        }
+      });
+  }
+
+  diagnostic_msgs::srv::SelfTest::Response run(
+    const TestRunner::Selection & selection = TestRunner::Selection())
+  {
+    diagnostic_msgs::srv::SelfTest::Response response;
+    EXPECT_TRUE(runner_->runTests(selection, response, cached_));
+    EXPECT_EQ(response.status.size(), cached_.size());
+    return response;
+  }
+
+  rclcpp::Node::SharedPtr node_;
+  std::unique_ptr<TestRunner> runner_;
+  std::map<std::string, int> runs_;
+  std::map<std::string, bool> failing_;
+  std::vector<bool> cached_;
+};
+
+TEST_F(SelfTestCacheTest, cacheDuration)
+{
+  addTest("Serial");
+  addTest("Motor");
+  runner_->setCacheDuration("Serial", 0.5);
+
+  run();
+  EXPECT_EQ(runs_["Serial"], 1);
+  EXPECT_FALSE(cached_[0]);
+
+  // Within the duration the result is reused, the uncached test runs again
+  diagnostic_msgs::srv::SelfTest::Response response = run();
+  EXPECT_EQ(runs_["Serial"], 1);
+  EXPECT_EQ(runs_["Motor"], 2);
+  ASSERT_EQ(cached_.size(), 2u);
+  EXPECT_TRUE(cached_[0]);
+  EXPECT_FALSE(cached_[1]);
+  EXPECT_EQ(response.status[0].name, "Serial");
+  EXPECT_EQ(response.status[0].message, "OK");
+  EXPECT_TRUE(response.passed);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(600));
+  run();
+  EXPECT_EQ(runs_["Serial"], 2);
+  EXPECT_FALSE(cached_[0]);
+
+  // The cache is ignored on request, and failures aren't cached
+  TestRunner::Selection selection;
+  selection.ignore_cache = true;
+  failing_["Serial"] = true;
+  run(selection);
+  EXPECT_EQ(runs_["Serial"], 3);
+  EXPECT_FALSE(cached_[0]);
+  run();
+  EXPECT_EQ(runs_["Serial"], 4);
+  EXPECT_FALSE(cached_[0]);
+
+  failing_.clear();
+  run();
+  run();
+  EXPECT_EQ(runs_["Serial"], 5);
+  EXPECT_TRUE(cached_[0]);
+}
+
+TEST_F(SelfTestCacheTest, cacheKey)
+{
+  std::string firmware = "1.0";
+  addTest("Serial");
+  addTest("Motor");
+  runner_->setCacheKey("Serial", [&firmware]() {return firmware;});
+
+  run();
+  run();
+  EXPECT_EQ(runs_["Serial"], 1);
+  EXPECT_TRUE(cached_[0]);
+
+  firmware = "1.1";
+  run();
+  EXPECT_EQ(runs_["Serial"], 2);
+  EXPECT_FALSE(cached_[0]);
+
+  // Selecting other tests leaves the cached result alone, and the cached
+  // flags follow the selected tests
+  TestRunner::Selection selection;
+  selection.tests = {"Motor"};
+  diagnostic_msgs::srv::SelfTest::Response response = run(selection);
+  ASSERT_EQ(response.status.size(), 1u);
+  EXPECT_EQ(response.status[0].name, "Motor");
+  EXPECT_FALSE(cached_[0]);
+
+  selection.tests = {"Serial"};
+  response = run(selection);
+  ASSERT_EQ(response.status.size(), 1u);
+  EXPECT_EQ(response.status[0].name, "Serial");
+  EXPECT_TRUE(cached_[0]);
+  EXPECT_EQ(runs_["Serial"], 2);
+
+  // A key that throws has no valid cache
+  runner_->setCacheKey("Serial", []() -> std::string {throw std::runtime_error("no device");});
+  run();
+  run();
+  EXPECT_EQ(runs_["Serial"], 4);
+  EXPECT_FALSE(cached_[0]);
+}
+
+TEST_F(SelfTestCacheTest, onlyFailed)
+{
+  addTest("Pass");
+  addTest("Fail");
+  addTest("Later");
+  failing_["Fail"] = true;
+
+  TestRunner::Selection selection;
+  selection.tests = {"Pass", "Fail"};
+  diagnostic_msgs::srv::SelfTest::Response response = run(selection);
+  EXPECT_FALSE(response.passed);
+
+  // Failed tests and those that never ran, not the ones that passed
+  selection.tests.clear();
+  selection.only_failed = true;
+  response = run(selection);
+  ASSERT_EQ(response.status.size(), 2u);
+  EXPECT_EQ(response.status[0].name, "Fail");
+  EXPECT_EQ(response.status[1].name, "Later");
+  EXPECT_EQ(runs_["Pass"], 1);
+  EXPECT_EQ(runs_["Fail"], 2);
+  EXPECT_EQ(runs_["Later"], 1);
+
+  failing_.clear();
+  response = run(selection);
+  ASSERT_EQ(response.status.size(), 1u);
+  EXPECT_EQ(response.status[0].name, "Fail");
+  EXPECT_TRUE(response.passed);
+
+  response = run(selection);
+  EXPECT_TRUE(response.status.empty());
+  EXPECT_TRUE(response.passed);
+  EXPECT_EQ(runs_["Fail"], 3);
+}
+
+TEST_F(SelfTestCacheTest, unknownTest)
+{
+  addTest("Serial");
+
+  TestRunner::Selection selection;
+  selection.tests = {"Serial", "Nonexistent"};
+  diagnostic_msgs::srv::SelfTest::Response response = run(selection);
+  EXPECT_EQ(runs_["Serial"], 1);
+  EXPECT_FALSE(response.passed);
+  ASSERT_EQ(response.status.size(), 2u);
+  EXPECT_EQ(response.status[0].name, "Serial");
+  EXPECT_EQ(response.status[0].level, 0);
+  EXPECT_EQ(response.status[1].name, "Nonexistent");
+  EXPECT_EQ(response.status[1].level, 2);
+  EXPECT_EQ(response.status[1].message, "No such test");
+  EXPECT_FALSE(cached_[1]);
+}
+
+TEST_F(SelfTestCacheTest, sequentialProgress)
+{
+  addTest("First");
+  addTest("Second");
+
+  std::vector<diagnostic_msgs::msg::DiagnosticArray> progress;
+  auto subscription = node_->create_subscription<diagnostic_msgs::msg::DiagnosticArray>(
+    "self_test/progress",
+    [&progress](const diagnostic_msgs::msg::DiagnosticArray::SharedPtr msg) {
+      progress.push_back(*msg);
+    });
+  run();
+
+  // Every test is seen running before it finishes, then the last one is done
+  std::chrono::steady_clock::time_point give_up =
+    std::chrono::steady_clock::now() + std::chrono::seconds(5);
+  while ((progress.empty() || progress.back().status[1].level != 0) &&
+    std::chrono::steady_clock::now() < give_up)
+  {
+    rclcpp::spin_some(node_);
+  }
+  std::vector<std::string> messages;
+  for (const diagnostic_msgs::msg::DiagnosticArray & msg : progress) {
+    ASSERT_EQ(msg.status.size(), 2u);
+    messages.push_back(msg.status[0].message + ", " + msg.status[1].message);
+  }
+  std::vector<std::string> expected = {
+    "Pending, Pending", "Running, Pending", "OK, Pending", "OK, Running", "OK, OK"};
+  EXPECT_EQ(messages, expected);
+}